@@ -72,10 +72,14 @@ void FileWatcher::Tick()
   TimeStamp now = TimeStamp::Now();
   if (!_lastTickTime.IsValid() || (now - _lastTickTime) > TimeDuration::Seconds(1))
   {
-    int num = min((int)_watchedFiles.size(), MAX_FILES_PER_TICK);
+    _lastTickTime = now;
+
+    // round robin over all the files, MAX_FILES_PER_TICK at a time
+    int size = (int)_watchedFiles.size();
+    int num = min(size, MAX_FILES_PER_TICK);
     for (int i = 0; i < num; ++i)
     {
-      shared_ptr<WatchedFile>& f = _watchedFiles[(i+_watchFileOfs) % num];
+      shared_ptr<WatchedFile>& f = _watchedFiles[(i + _watchFileOfs) % size];
       const string& filename = f->filename;
       time_t lastModification = LastModification(filename.c_str());
       if (lastModification > f->lastModification)
@@ -89,6 +93,7 @@ void FileWatcher::Tick()
         f->lastModification = lastModification;
       }
     }
-    _watchFileOfs += num;
+    if (size > 0)
+      _watchFileOfs = (_watchFileOfs + num) % size;
   }
 }
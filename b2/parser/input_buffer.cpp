@@ -1,11 +1,38 @@
 #include "input_buffer.hpp"
 
-#define SET_SUCCESS(s)                                                                             \
-
 using namespace std;
 
 namespace parser
 {
+  //-----------------------------------------------------------------------------
+  static const uint8_t DIGIT = CharDigit | CharIdentifier;
+  static const uint8_t ALPHA = CharAlpha | CharIdentifier;
+  static const uint8_t WS = CharWhitespace;
+
+  const uint8_t CHAR_CLASS[256] = {
+    // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, WS, WS, 0, 0, WS, 0, 0,
+    // 0x10
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x20 (space)
+    WS, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x30 (0-9)
+    DIGIT, DIGIT, DIGIT, DIGIT, DIGIT, DIGIT, DIGIT, DIGIT, DIGIT, DIGIT, 0, 0, 0, 0, 0, 0,
+    // 0x40 (A-O)
+    0, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA,
+    ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA,
+    // 0x50 (P-Z, _)
+    ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA,
+    ALPHA, ALPHA, ALPHA, 0, 0, 0, 0, CharIdentifier,
+    // 0x60 (a-o)
+    0, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA,
+    ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA,
+    // 0x70 (p-z)
+    ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA, ALPHA,
+    ALPHA, ALPHA, ALPHA, 0, 0, 0, 0, 0,
+    // 0x80 - 0xff are all 0
+  };
+
   //-----------------------------------------------------------------------------
   InputBuffer::InputBuffer() : _buf(nullptr), _idx(0), _len(0) {}
 
@@ -18,7 +45,7 @@ namespace parser
   //-----------------------------------------------------------------------------
   char InputBuffer::Peek(bool* success)
   {
-    SET_PARSER_SUCCESS(!Eof());
+    SET_PARSER_SUCCESS(*this, !Eof());
     if (Eof())
       return 0;
 
@@ -31,7 +58,7 @@ namespace parser
   //-----------------------------------------------------------------------------
   char InputBuffer::Get(bool* success)
   {
-    SET_PARSER_SUCCESS(!Eof());
+    SET_PARSER_SUCCESS(*this, !Eof());
     if (Eof())
       return 0;
 
@@ -41,7 +68,7 @@ namespace parser
   //-----------------------------------------------------------------------------
   void InputBuffer::Consume(bool* success)
   {
-    SET_PARSER_SUCCESS(!Eof());
+    SET_PARSER_SUCCESS(*this, !Eof());
     if (Eof())
       return;
 
@@ -60,9 +87,6 @@ namespace parser
     return consume;
   }
 
-  //-----------------------------------------------------------------------------
-  bool InputBuffer::Eof() { return _idx == _len; }
-
   //-----------------------------------------------------------------------------
   bool InputBuffer::IsOneOf(const char* str, size_t len, char* res)
   {
@@ -99,57 +123,26 @@ namespace parser
     return false;
   }
 
-  //-----------------------------------------------------------------------------
-  bool InputBuffer::Satifies(const function<bool(char)>& fn, char* out)
-  {
-    if (Eof())
-      return false;
-
-    char ch = Peek();
-    bool satisfies = fn(ch);
-    if (satisfies)
-    {
-      *out = ch;
-      Consume();
-    }
-    return satisfies;
-  }
-
   //-----------------------------------------------------------------------------
   void InputBuffer::SkipWhitespace()
   {
-    while (true)
-    {
-      char ch = _buf[_idx];
-      if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
-      {
-        _idx++;
-        if (_idx == _len)
-          return;
-      }
-      else
-      {
-        return;
-      }
-    }
+    SkipClass(CharWhitespace);
   }
 
   //-----------------------------------------------------------------------------
   bool InputBuffer::Expect(char ch, bool* success)
   {
-    return Get(success) == ch;
+    bool found = !Eof() && _buf[_idx] == ch;
+    SET_PARSER_SUCCESS(*this, found);
+    if (found)
+      ++_idx;
+    return found;
   }
 
-  //-----------------------------------------------------------------------------
-  bool InputBuffer::IsDigit(char ch) { return !!isdigit(ch); }
-
-  //-----------------------------------------------------------------------------
-  bool InputBuffer::IsAlphaNum(char ch) { return !!isalnum(ch) || ch == '_'; }
-
   //-----------------------------------------------------------------------------
   void InputBuffer::SkipUntil(char ch, bool consume, bool* success)
   {
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(*this, true);
     while (!Eof())
     {
       char tmp = Get();
@@ -161,13 +154,13 @@ namespace parser
       }
     }
 
-    SET_PARSER_SUCCESS(false);
+    SET_PARSER_SUCCESS(*this, false);
   }
 
   //-----------------------------------------------------------------------------
   void InputBuffer::SkipUntilOneOf(const char* str, size_t len, char* res, bool consume, bool* success)
   {
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(*this, true);
     while (!Eof())
     {
       char tmp = Get();
@@ -183,28 +176,14 @@ namespace parser
         }
       }
     }
-    SET_PARSER_SUCCESS(false);
-  }
-
-  //-----------------------------------------------------------------------------
-  void InputBuffer::SkipWhile(const function<bool(char)>& fn)
-  {
-    while (!Eof())
-    {
-      char ch = Get();
-      if (!fn(ch))
-      {
-        Rewind(1);
-        return;
-      }
-    }
+    SET_PARSER_SUCCESS(*this, false);
   }
 
   //-----------------------------------------------------------------------------
   string InputBuffer::SubStr(size_t start, size_t len, bool* success)
   {
     bool valid = start + len <= _len;
-    SET_PARSER_SUCCESS(valid);
+    SET_PARSER_SUCCESS(*this, valid);
     string res;
     if (valid)
     {
@@ -222,7 +201,7 @@ namespace parser
     char close = delim[1];
 
     const char* start = &_buf[_idx];
-    const char* end = &_buf[_idx + _len];
+    const char* end = &_buf[_len];
     const char* cur = start;
 
     // find opening delimiter
@@ -268,16 +247,30 @@ namespace parser
   //-----------------------------------------------------------------------------
   void InputBuffer::SaveState()
   {
-    _saveStack.push_back(_idx);
+    assert(_saveDepth < MAX_SAVE_DEPTH);
+    if (_saveDepth < MAX_SAVE_DEPTH)
+      _saveStack[_saveDepth] = _idx;
+    // keep counting on overflow, so the saves and restores stay balanced
+    _saveDepth++;
   }
 
   //-----------------------------------------------------------------------------
   void InputBuffer::RestoreState(bool fullRestore)
   {
-    if (fullRestore)
-    {
-      _idx = _saveStack.back();
-    }
-    _saveStack.pop_back();
+    assert(_saveDepth > 0);
+    --_saveDepth;
+    if (fullRestore && _saveDepth < MAX_SAVE_DEPTH)
+      _idx = _saveStack[_saveDepth];
+  }
+
+  //-----------------------------------------------------------------------------
+  void InputBuffer::SetError(const char* function)
+  {
+    if (_error != ParseError::None)
+      return;
+
+    _error = Eof() ? ParseError::UnexpectedEof : ParseError::Syntax;
+    _errorFunction = function;
+    _errorOfs = _idx;
   }
 }
@@ -1,15 +1,20 @@
 #pragma once
 #include <vector>
-#include <deque>
+#include <string>
+#include <stdint.h>
+#include <assert.h>
 namespace parser
 {
-
-  struct ParseExpcetion : std::exception
+  // Parse failures are recorded in the InputBuffer rather than thrown. The first failure
+  // sticks, so a whole config can be parsed, and the buffer checked once at the end.
+  enum class ParseError : uint8_t
   {
-    ParseExpcetion(const char* e) : std::exception(e) {}
+    None,
+    UnexpectedEof,
+    Syntax,
   };
 
-#define SET_PARSER_SUCCESS(s)                                                                      \
+#define SET_PARSER_SUCCESS(buf, s)                                                                 \
   do                                                                                               \
   {                                                                                                \
     if (s)                                                                                         \
@@ -22,7 +27,7 @@ namespace parser
       if (success)                                                                                 \
         *success = false;                                                                          \
       else                                                                                         \
-        throw ParseExpcetion(__FUNCTION__);                                                        \
+        (buf).SetError(__FUNCTION__);                                                              \
     }                                                                                              \
   } while (false);
 
@@ -33,15 +38,26 @@ namespace parser
       return false;                                                                                \
   } while (false);
 
+  enum CharClass : uint8_t
+  {
+    CharDigit = 1 << 0,
+    CharAlpha = 1 << 1,
+    CharWhitespace = 1 << 2,
+    // letters, digits and '_'
+    CharIdentifier = 1 << 3,
+  };
+
+  extern const uint8_t CHAR_CLASS[256];
+
   struct InputBuffer
   {
     InputBuffer();
     InputBuffer(const char* buf, size_t len);
     InputBuffer(const std::vector<char>& buf);
 
-    // The idea behind the functions is that everything where you expect to find something will return
-    // an error, either in the success ptr, or by throwing an exception. Functions that are purely for
-    // testing will return false on errors (EOF).
+    // The idea behind the functions is that everything where you expect to find something will
+    // return an error, either in the success ptr, or by setting the buffer's error. Functions that
+    // are purely for testing will return false on errors (EOF).
     char Peek(bool* success = nullptr);
     char Get(bool* success = nullptr);
     void Consume(bool* success = nullptr);
@@ -55,25 +71,65 @@ namespace parser
 
     bool IsOneOf(const char* str, size_t len, char* res);
     bool IsOneOfIdx(const char* str, size_t len, int* res);
-    void SkipWhile(const std::function<bool(char)>& fn);
-    bool Satifies(const std::function<bool(char)>& fn, char* out);
     void SkipWhitespace();
 
-    static bool IsDigit(char ch);
-    static bool IsAlphaNum(char ch);
+    // The predicates are templates, so they are inlined rather than called through a
+    // std::function for every character
+    template <typename Fn>
+    void SkipWhile(Fn fn)
+    {
+      while (_idx < _len && fn(_buf[_idx]))
+        ++_idx;
+    }
+
+    template <typename Fn>
+    bool Satifies(Fn fn, char* out)
+    {
+      if (_idx == _len || !fn(_buf[_idx]))
+        return false;
+      *out = _buf[_idx++];
+      return true;
+    }
+
+    // Skips characters that have any of the CharClass bits in 'mask'
+    void SkipClass(uint8_t mask)
+    {
+      while (_idx < _len && (CHAR_CLASS[(uint8_t)_buf[_idx]] & mask))
+        ++_idx;
+    }
+
+    static bool IsDigit(char ch) { return !!(CHAR_CLASS[(uint8_t)ch] & CharDigit); }
+    static bool IsAlphaNum(char ch) { return !!(CHAR_CLASS[(uint8_t)ch] & CharIdentifier); }
+    static bool IsWhitespace(char ch) { return !!(CHAR_CLASS[(uint8_t)ch] & CharWhitespace); }
 
     bool ConsumeIf(char ch);
-    bool Eof();
+    // A failed parse reports Eof, so loops that run until the end of the input stop at
+    // the first error, instead of spinning on a character that's never consumed
+    bool Eof() const { return _idx == _len || _error != ParseError::None; }
 
     bool InnerScope(const char* delim, InputBuffer* scope);
 
     void SaveState();
     void RestoreState(bool fullRestore=true);
 
-    std::deque<size_t> _saveStack;
+    // Records the first error, and where it happened
+    void SetError(const char* function);
+    bool Ok() const { return _error == ParseError::None; }
+    ParseError Error() const { return _error; }
+    const char* ErrorFunction() const { return _errorFunction; }
+    size_t ErrorOffset() const { return _errorOfs; }
+
+    // The parse functions nest a couple of levels deep at most
+    enum { MAX_SAVE_DEPTH = 32 };
+    size_t _saveStack[MAX_SAVE_DEPTH];
+    int _saveDepth = 0;
 
     const char* _buf;
     size_t _idx;
     size_t _len;
+
+    ParseError _error = ParseError::None;
+    const char* _errorFunction = nullptr;
+    size_t _errorOfs = 0;
   };
 }
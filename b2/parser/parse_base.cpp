@@ -1,5 +1,8 @@
 #include <ctype.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include "parse_base.hpp"
 #include "input_buffer.hpp"
 #include "output_buffer.hpp"
@@ -14,9 +17,8 @@ namespace parser
     ScopedRestore(InputBuffer* buf, bool* success) : buf(buf), success(success) { buf->SaveState(); }
     ~ScopedRestore()
     {
-      // this relies on the fact the SET_PARSER_SUCCESS has been called, which will throw an
-      // exception in the case of an error, so if success doesn't exist, then the parse must
-      // have been successful.
+      // only probing parses (with a success ptr) are rewound. Without one, the error is
+      // recorded in the buffer, and parsing carries on from where it failed.
       buf->RestoreState(success && !(*success));
     }
     InputBuffer* buf;
@@ -27,7 +29,7 @@ namespace parser
   bool ParseBool(InputBuffer& buf, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(buf, true);
 
     size_t start = buf._idx;
     buf.SkipWhile(InputBuffer::IsAlphaNum);
@@ -40,7 +42,7 @@ namespace parser
     if (str == "false")
       return false;
 
-    SET_PARSER_SUCCESS(false);
+    SET_PARSER_SUCCESS(buf, false);
     return false;
   }
 
@@ -48,54 +50,123 @@ namespace parser
   float ParseFloat(InputBuffer& buf, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
 
-    char ch;
-    buf.IsOneOf("-+", 2, &ch);
-    bool neg = ch == '-';
-
-    int numLeadingDigits = 0;
-    int numTrailingDigits = 0;
+    // Accumulates up to MAX_DIGITS significant digits into an integer mantissa, and keeps
+    // track of the decimal exponent. When both are small enough to be exact as floats,
+    // the result is a single correctly rounded multiply or divide (Clinger's fast path),
+    // otherwise strtof does the work.
+    const int MAX_DIGITS = 19;
+    const char* start = buf._buf + buf._idx;
+    const char* end = buf._buf + buf._len;
+    const char* cur = start;
+
+    bool neg = false;
+    if (cur < end && (*cur == '-' || *cur == '+'))
+      neg = *cur++ == '-';
+
+    uint64_t mantissa = 0;
+    int numDigits = 0;
+    int exponent = 0;
+    bool truncated = false;
+    bool hasDigits = false;
+
+    for (; cur < end && InputBuffer::IsDigit(*cur); ++cur)
+    {
+      hasDigits = true;
+      if (numDigits < MAX_DIGITS)
+      {
+        mantissa = mantissa * 10 + (*cur - '0');
+        numDigits += mantissa != 0;
+      }
+      else
+      {
+        ++exponent;
+        truncated = true;
+      }
+    }
 
-    int whole = 0;
-    // find whole part if one exists
-    while (buf.Satifies(InputBuffer::IsDigit, &ch))
+    if (cur < end && *cur == '.')
     {
-      numLeadingDigits++;
-      whole = whole * 10 + (ch - '0');
+      ++cur;
+      for (; cur < end && InputBuffer::IsDigit(*cur); ++cur)
+      {
+        hasDigits = true;
+        if (numDigits < MAX_DIGITS)
+        {
+          mantissa = mantissa * 10 + (*cur - '0');
+          numDigits += mantissa != 0;
+          --exponent;
+        }
+        else
+        {
+          truncated = true;
+        }
+      }
     }
 
-    float res = (neg ? -1.f : 1.f) * whole;
+    SET_PARSER_SUCCESS(buf, hasDigits);
+    if (!hasDigits)
+      return 0;
 
-    // look for a '.'
-    if (buf.ConsumeIf('.'))
+    // optional exponent, only consumed if it's followed by digits
+    if (cur < end && (*cur == 'e' || *cur == 'E'))
     {
-      // fractional
-      int frac = 0;
-      int len = 0;
-      while (buf.Satifies(InputBuffer::IsDigit, &ch))
+      const char* expStart = cur++;
+      bool expNeg = false;
+      if (cur < end && (*cur == '-' || *cur == '+'))
+        expNeg = *cur++ == '-';
+
+      if (cur < end && InputBuffer::IsDigit(*cur))
       {
-        ++len;
-        frac = frac * 10 + (ch - '0');
-        numTrailingDigits++;
+        int e = 0;
+        for (; cur < end && InputBuffer::IsDigit(*cur); ++cur)
+          e = min(e * 10 + (*cur - '0'), 100000);
+        exponent += expNeg ? -e : e;
       }
-
-      if (len)
+      else
       {
-        res += frac / powf(10.f, (float)len);
+        cur = expStart;
       }
     }
 
-    bool validParse = numLeadingDigits > 0 || numTrailingDigits > 0;
-    SET_PARSER_SUCCESS(validParse);
-    return res;
+    buf._idx = cur - buf._buf;
+
+    // trailing zeros (as written by Serialize) don't need to be in the mantissa
+    while (mantissa != 0 && mantissa % 10 == 0 && exponent < 0)
+    {
+      mantissa /= 10;
+      ++exponent;
+    }
+
+    static const float POW10[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    float res;
+    if (mantissa == 0)
+    {
+      res = 0;
+    }
+    else if (!truncated && mantissa <= (1 << 24) && exponent >= -10 && exponent <= 10)
+    {
+      res = exponent < 0 ? (float)mantissa / POW10[-exponent] : (float)mantissa * POW10[exponent];
+    }
+    else
+    {
+      // strtof needs a terminated string
+      char tmp[128];
+      size_t len = min((size_t)(cur - start), sizeof(tmp) - 1);
+      memcpy(tmp, start, len);
+      tmp[len] = 0;
+      return strtof(tmp, nullptr);
+    }
+
+    return neg ? -res : res;
   }
 
   //-----------------------------------------------------------------------------
   int ParseInt(InputBuffer& buf, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(buf, true);
 
     char ch;
     buf.IsOneOf("-+", 2, &ch);
@@ -104,7 +175,7 @@ namespace parser
     // read the first char, and make sure it's a digit
     if (!buf.Satifies(InputBuffer::IsDigit, &ch))
     {
-      SET_PARSER_SUCCESS(false);
+      SET_PARSER_SUCCESS(buf, false);
       return 0;
     }
 
@@ -122,7 +193,7 @@ namespace parser
   void ParseVec(InputBuffer& buf, float* res, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(buf, true);
 
     // { x, y, z, w }
     buf.Expect('{', success);
@@ -156,7 +227,7 @@ namespace parser
   color ParseColor(InputBuffer& buf, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(buf, true);
 
     float tmp[4];
     ParseVec<4>(buf, tmp, success);
@@ -167,7 +238,7 @@ namespace parser
   vec2 ParseVec2(InputBuffer& buf, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(buf, true);
 
     float tmp[2];
     ParseVec<2>(buf, tmp, success);
@@ -178,7 +249,7 @@ namespace parser
   vec3 ParseVec3(InputBuffer& buf, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(buf, true);
 
     float tmp[3];
     ParseVec<3>(buf, tmp, success);
@@ -189,7 +260,7 @@ namespace parser
   vec4 ParseVec4(InputBuffer& buf, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(buf, true);
 
     float tmp[4];
     ParseVec<4>(buf, tmp, success);
@@ -201,7 +272,7 @@ namespace parser
   std::string ParseString(InputBuffer& buf, bool* success)
   {
     ScopedRestore r(&buf, success);
-    SET_PARSER_SUCCESS(true);
+    SET_PARSER_SUCCESS(buf, true);
 
     char ch;
     buf.SkipUntilOneOf("'\"", 2, &ch, true, success);
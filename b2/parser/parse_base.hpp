@@ -13,8 +13,8 @@ namespace parser
   struct InputBuffer;
 
   // If a success pointer is passed in, then it's used to indicate the result, so the
-  // functions can be used for probing. Otherwise an exception (ugh!!) is thrown if the
-  // parse fails.
+  // functions can be used for probing. Otherwise a failed parse sets the buffer's error
+  // (see InputBuffer::Ok).
   bool ParseBool(InputBuffer& buf, bool* success = nullptr);
   float ParseFloat(InputBuffer& buf, bool* success = nullptr);
   int ParseInt(InputBuffer& buf, bool* success = nullptr);
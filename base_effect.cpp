@@ -29,6 +29,12 @@ void FindFileVersions(const char* base, vector<int>* versions, unordered_map<int
     do
     {
       int len = (int)strlen(findData.cFileName) - 1;
+
+      // skip the compiled version of the config
+      int extLen = (int)strlen(COMPILED_SETTINGS_EXT);
+      if (len + 1 >= extLen && strcmp(findData.cFileName + len + 1 - extLen, COMPILED_SETTINGS_EXT) == 0)
+        continue;
+
       int idx = len;
       while (idx >= 0 && isdigit(findData.cFileName[idx]))
         idx--;
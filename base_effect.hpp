@@ -3,6 +3,10 @@
 #include "object_handle.hpp"
 #include "update_state.hpp"
 #include "camera.hpp"
+#include "compiled_settings.hpp"
+#if WITH_UNPACKED_RESOUCES
+#include "resource_manager.hpp"
+#endif
 
 namespace tano
 {
@@ -24,6 +28,13 @@ namespace tano
     virtual bool Render();
     virtual bool Close();
     virtual bool InitAnimatedParameters();
+    // Effects whose Update and FixedUpdate don't touch the graphics context, or any
+    // state shared with other effects, can return true here to be updated on the
+    // scheduler (when the demo's parallel_update setting is on)
+    virtual bool ThreadSafeUpdate() const { return false; }
+    // Called on the main thread before Update and FixedUpdate, so input polling, ImGui,
+    // and reads of other shared state go here when the effect is thread safe
+    virtual void PreUpdate() {}
 
     virtual const char* GetName() = 0;
     const string& InstanceName() const { return _instanceName; }
@@ -83,6 +94,50 @@ namespace tano
 
   protected:
 
+    // Parses the effect's config, which is either text, or compiled by a development build
+    // (see compiled_settings.hpp). Keeps the previous settings if the config is broken.
+    template <typename T, typename Fn>
+    bool ParseSettings(const vector<char>& buf, T* settings, Fn fnParse)
+    {
+      if (IsCompiledSettings(buf))
+      {
+        if (LoadCompiledSettings(buf, settings))
+          return true;
+
+        // a packed build with a compiled file from an older settings layout
+        LOG_WARN("Compiled settings for ",
+            _configName,
+            " don't match the current layout (schema hash ",
+            ((const CompiledSettingsHeader*)buf.data())->schemaHash,
+            ", expected ",
+            SettingsSchemaHash<T>(),
+            "), keeping the previous settings");
+        return false;
+      }
+
+      InputBuffer inputBuffer(buf);
+      T tmp = fnParse(inputBuffer);
+      if (!inputBuffer.Ok())
+      {
+        LOG_WARN("Error parsing ",
+            _configName,
+            " in ",
+            inputBuffer.ErrorFunction(),
+            ", at offset ",
+            inputBuffer.ErrorOffset());
+        return false;
+      }
+      *settings = tmp;
+
+#if WITH_UNPACKED_RESOUCES
+      // only the canonical config is packed, so don't compile a version being previewed
+      vector<char> compiled;
+      if (_currentConfigVersion == -1 && CompileSettings(*settings, &compiled))
+        RESOURCE_MANAGER.WriteCompiledFile(_configName.c_str(), COMPILED_SETTINGS_EXT, compiled);
+#endif
+      return true;
+    }
+
     string _instanceName;
     u32 _id;
 
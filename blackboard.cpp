@@ -52,6 +52,15 @@ bool Blackboard::Init(const char* filename, const char* datafile)
           InputBuffer inputBuffer(buf);
           deque<string> namespaceStack;
           res = ParseBlackboard(inputBuffer, namespaceStack);
+          if (!inputBuffer.Ok())
+          {
+            LOG_WARN("Error parsing ",
+                filename,
+                " in ",
+                inputBuffer.ErrorFunction(),
+                ", at offset ",
+                inputBuffer.ErrorOffset());
+          }
           if (res)
           {
             LoadData();
@@ -309,7 +318,14 @@ bool Blackboard::ParseBlackboard(InputBuffer& buf, deque<string>& namespaceStack
       tmp._buf++;
       tmp._len -= 2;
       char cc = tmp._buf[tmp._len];
-      CHECKED_OP(ParseBlackboard(tmp, namespaceStack));
+      if (!ParseBlackboard(tmp, namespaceStack))
+      {
+        // pass the error on, relative to the outer buffer
+        buf._error = tmp._error;
+        buf._errorFunction = tmp._errorFunction;
+        buf._errorOfs = (tmp._buf - buf._buf) + tmp._errorOfs;
+        return false;
+      }
 
       // update the current buffer to skip the inner one
       buf._idx += inner._len;
@@ -406,6 +422,8 @@ bool Blackboard::ParseBlackboard(InputBuffer& buf, deque<string>& namespaceStack
       return false;
     }
 
+    // a value that failed to parse leaves the error in the buffer
+    CHECKED_OP(buf.Ok());
     buf.SkipWhitespace();
   }
 
@@ -0,0 +1,109 @@
+#pragma once
+#include <type_traits>
+
+// Settings structs that are plain data (no strings or arrays) are also written in a
+// compiled form when a development build parses their text config. The resource list
+// then maps the config's name to the compiled file, so the packed build loads it with a
+// single memcpy instead of running the parser. Settings with strings stay as text.
+
+namespace tano
+{
+  struct CompiledSettingsHeader
+  {
+    char id[4];
+    // catches compiled files written by a build with a different settings layout
+    u32 schemaHash;
+    u32 dataSize;
+    u32 padding;
+  };
+
+  // compiled configs are written next to the text version, with this appended
+  static const char* COMPILED_SETTINGS_EXT = ".bin";
+
+  //------------------------------------------------------------------------------
+  inline bool IsCompiledSettings(const vector<char>& buf)
+  {
+    return buf.size() >= sizeof(CompiledSettingsHeader) && memcmp(buf.data(), "tgbc", 4) == 0;
+  }
+
+  //------------------------------------------------------------------------------
+  // Hashes the serialized default settings, so a renamed, reordered or retyped field, or a
+  // changed default, gives a new hash
+  template <typename T>
+  u32 SettingsSchemaHash()
+  {
+    static u32 hash = []
+    {
+      OutputBuffer buf;
+      Serialize(buf, T());
+
+      // FNV-1a
+      u32 h = 0x811c9dc5;
+      for (size_t i = 0; i < buf._ofs; ++i)
+        h = (h ^ (u8)buf._buf[i]) * 0x01000193;
+      return (h ^ (u32)sizeof(T)) * 0x01000193;
+    }();
+    return hash;
+  }
+
+  //------------------------------------------------------------------------------
+  template <typename T>
+  bool CompileSettings(const T& settings, vector<char>* buf, std::true_type)
+  {
+    buf->resize(sizeof(CompiledSettingsHeader) + sizeof(T));
+    CompiledSettingsHeader* header = (CompiledSettingsHeader*)buf->data();
+    memcpy(header->id, "tgbc", 4);
+    header->schemaHash = SettingsSchemaHash<T>();
+    header->dataSize = sizeof(T);
+    header->padding = 0;
+    memcpy(buf->data() + sizeof(CompiledSettingsHeader), &settings, sizeof(T));
+    return true;
+  }
+
+  //------------------------------------------------------------------------------
+  template <typename T>
+  bool CompileSettings(const T& settings, vector<char>* buf, std::false_type)
+  {
+    return false;
+  }
+
+  //------------------------------------------------------------------------------
+  // Returns false if the settings aren't plain data, and have to stay as text
+  template <typename T>
+  bool CompileSettings(const T& settings, vector<char>* buf)
+  {
+    return CompileSettings(settings, buf, std::is_trivially_copyable<T>());
+  }
+
+  //------------------------------------------------------------------------------
+  // Fails without logging when the file is stale, so the caller can say which config it was
+  template <typename T>
+  bool LoadCompiledSettings(const vector<char>& buf, T* settings, std::true_type)
+  {
+    const CompiledSettingsHeader* header = (const CompiledSettingsHeader*)buf.data();
+    if (header->schemaHash != SettingsSchemaHash<T>() || header->dataSize != sizeof(T)
+        || buf.size() < sizeof(CompiledSettingsHeader) + sizeof(T))
+    {
+      return false;
+    }
+
+    memcpy(settings, buf.data() + sizeof(CompiledSettingsHeader), sizeof(T));
+    return true;
+  }
+
+  //------------------------------------------------------------------------------
+  template <typename T>
+  bool LoadCompiledSettings(const vector<char>& buf, T* settings, std::false_type)
+  {
+    LOG_ERROR("Compiled settings found for a type that isn't plain data");
+    return false;
+  }
+
+  //------------------------------------------------------------------------------
+  // Expects IsCompiledSettings(buf) to be true
+  template <typename T>
+  bool LoadCompiledSettings(const vector<char>& buf, T* settings)
+  {
+    return LoadCompiledSettings(buf, settings, std::is_trivially_copyable<T>());
+  }
+}
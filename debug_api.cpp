@@ -125,8 +125,12 @@ void DebugApi::CreateDebugGeometry()
 //------------------------------------------------------------------------------
 void DebugApi::BeginFrame()
 {
-  _lineChunks.clear();
+  // the thread buffers reset themselves on first use in a new frame
+  ++_frame;
   _numVerts = 0;
+  _droppedVerts = 0;
+  _hasDefaultTransform = false;
+  _mainThreadBuffer = GetThreadBuffer();
 }
 
 //------------------------------------------------------------------------------
@@ -139,26 +143,137 @@ void DebugApi::EndFrame()
   _ctx->SetGpuObjects(_gpuObjects);
   _ctx->SetGpuState(_gpuStateDepthTestDisabled);
 
-  for (const LineChunk& chunk : _lineChunks)
+  int numThreadBuffers = min((int)_numThreadBuffers, MAX_THREADS);
+  for (int i = 0; i < numThreadBuffers; ++i)
   {
-    if (!chunk.numVertices)
+    const ThreadBuffer& buffer = _threadBuffers[i];
+    if (buffer.frame != _frame)
       continue;
 
-    _cbPerFrame.world = chunk.mtxWorld.Transpose();
-    _cbPerFrame.viewProj = chunk.mtxViewProj.Transpose();
-    _ctx->SetConstantBuffer(_cbPerFrame, ShaderType::VertexShader, 0);
-    _ctx->Draw(chunk.numVertices, chunk.startOfs);
+    for (const LineChunk& chunk : buffer.chunks)
+    {
+      if (!chunk.numVertices)
+        continue;
+
+      _cbPerFrame.world = chunk.mtxWorld.Transpose();
+      _cbPerFrame.viewProj = chunk.mtxViewProj.Transpose();
+      _ctx->SetConstantBuffer(_cbPerFrame, ShaderType::VertexShader, 0);
+      _ctx->Draw(chunk.numVertices, chunk.startOfs);
+    }
+  }
+
+  if (_droppedVerts)
+  {
+    static bool warned = false;
+    if (!warned)
+      LOG_WARN("Debug line buffer full, dropped vertices: ", (int)_droppedVerts);
+    warned = true;
+  }
+}
+
+//------------------------------------------------------------------------------
+DebugApi::ThreadBuffer* DebugApi::GetThreadBuffer()
+{
+  // each thread grabs a buffer the first time it records anything
+  static thread_local DebugApi* owner = nullptr;
+  static thread_local ThreadBuffer* threadBuffer = nullptr;
+  if (owner != this)
+  {
+    int idx = InterlockedIncrement(&_numThreadBuffers) - 1;
+    threadBuffer = idx < MAX_THREADS ? &_threadBuffers[idx] : nullptr;
+    owner = this;
+  }
+
+  if (threadBuffer && threadBuffer->frame != _frame)
+  {
+    threadBuffer->frame = _frame;
+    threadBuffer->chunks.clear();
+    threadBuffer->hasTransform = false;
+    threadBuffer->transformChanged = false;
+    threadBuffer->blockEnd = 0;
+  }
+
+  return threadBuffer;
+}
+
+//------------------------------------------------------------------------------
+DebugApi::PosCol* DebugApi::ReserveVertices(int count)
+{
+  ThreadBuffer* buffer = GetThreadBuffer();
+  if (!buffer)
+    return nullptr;
+
+  if (!buffer->hasTransform)
+  {
+    // if no transform is set, there's nothing to draw the lines with, so we can bail
+    if (!_hasDefaultTransform)
+      return nullptr;
+    buffer->world = _defaultWorld;
+    buffer->viewProj = _defaultViewProj;
+    buffer->hasTransform = true;
+    buffer->transformChanged = true;
   }
 
+  LineChunk* chunk = buffer->chunks.empty() ? nullptr : &buffer->chunks.back();
+  int ofs = chunk ? chunk->startOfs + chunk->numVertices : 0;
+  if (!chunk || ofs + count > buffer->blockEnd || buffer->transformChanged)
+  {
+    if (!chunk || ofs + count > buffer->blockEnd)
+    {
+      // reserve a new block, or whatever is left if that's enough for this primitive.
+      // Primitives are never split across blocks
+      LONG cur = InterlockedCompareExchange(&_numVerts, 0, 0);
+      while (true)
+      {
+        int avail = MAX_VERTS - cur;
+        if (avail < count)
+        {
+          InterlockedExchangeAdd(&_droppedVerts, count);
+          return nullptr;
+        }
+
+        int blockSize = min(max((int)BLOCK_VERTS, count), avail);
+        LONG prev = InterlockedCompareExchange(&_numVerts, cur + blockSize, cur);
+        if (prev == cur)
+        {
+          ofs = cur;
+          buffer->blockEnd = cur + blockSize;
+          break;
+        }
+        cur = prev;
+      }
+    }
+
+    buffer->chunks.push_back({buffer->world, buffer->viewProj, ofs, 0});
+    buffer->transformChanged = false;
+    chunk = &buffer->chunks.back();
+  }
+
+  chunk->numVertices += count;
+  return &_vertices[ofs];
 }
 
 //------------------------------------------------------------------------------
 void DebugApi::SetTransform(const Matrix& world, const Matrix& viewProj)
 {
-  // if the transform is the same as the previous one, just append to it
-  if (_lineChunks.empty() || _lineChunks.back().mtxWorld != world || _lineChunks.back().mtxViewProj != viewProj)
+  ThreadBuffer* buffer = GetThreadBuffer();
+  if (!buffer)
+    return;
+
+  // if the transform is the same as the previous one, just append to the current chunk
+  if (!buffer->hasTransform || buffer->world != world || buffer->viewProj != viewProj)
   {
-    _lineChunks.push_back({ world, viewProj, _numVerts, 0 });
+    buffer->world = world;
+    buffer->viewProj = viewProj;
+    buffer->hasTransform = true;
+    buffer->transformChanged = true;
+  }
+
+  if (buffer == _mainThreadBuffer)
+  {
+    _defaultWorld = world;
+    _defaultViewProj = viewProj;
+    _hasDefaultTransform = true;
   }
 }
 
@@ -171,44 +286,60 @@ void DebugApi::AddDebugLine(const vec3& start, const vec3& end, const Color& col
 //------------------------------------------------------------------------------
 void DebugApi::AddDebugLine(const vec3& start, const vec3& end, const Color& startColor, const Color& endColor)
 {
-  // if no line chunk is present, then there was no call to SetTransform, and we can bail
-  if (_lineChunks.empty())
+  PosCol* vtx = ReserveVertices(2);
+  if (!vtx)
     return;
-  assert(!_lineChunks.empty());
-
-  LineChunk& chunk = _lineChunks.back();
-  chunk.numVertices += 2;
 
-  _vertices[_numVerts + 0].pos = start;
-  _vertices[_numVerts + 0].col = startColor;
+  vtx[0].pos = start;
+  vtx[0].col = startColor;
 
-  _vertices[_numVerts + 1].pos = end;
-  _vertices[_numVerts + 1].col = endColor;
-
-  _numVerts += 2;
+  vtx[1].pos = end;
+  vtx[1].col = endColor;
 }
 
 //------------------------------------------------------------------------------
 void DebugApi::AddDebugSphere(const vec3& center, float radius, const Color& color)
 {
-  assert(!_lineChunks.empty());
-  LineChunk& chunk = _lineChunks.back();
+  PosCol* vtx = ReserveVertices((int)_unitSphere.size());
+  if (!vtx)
+    return;
 
-  int i = _numVerts;
   for (const vec3& p : _unitSphere)
   {
-    _vertices[i].pos = center + radius * p;
-    _vertices[i].col = color;
-    i++;
+    vtx->pos = center + radius * p;
+    vtx->col = color;
+    vtx++;
   }
-
-  chunk.numVertices += (int)_unitSphere.size();
-  _numVerts += (int)_unitSphere.size();
 }
 
 //------------------------------------------------------------------------------
 void DebugApi::AddDebugCube(const vec3& center, const vec3& extents, const Color& color)
 {
-  assert(!_lineChunks.empty());
-  LineChunk& chunk = _lineChunks.back();
+  PosCol* vtx = ReserveVertices(24);
+  if (!vtx)
+    return;
+
+  vec3 corners[8];
+  for (int i = 0; i < 8; ++i)
+  {
+    corners[i] = center + vec3(
+      i & 1 ? extents.x : -extents.x,
+      i & 2 ? extents.y : -extents.y,
+      i & 4 ? extents.z : -extents.z);
+  }
+
+  // the 12 edges connect corners that differ in a single bit
+  for (int i = 0; i < 8; ++i)
+  {
+    for (int bit = 1; bit < 8; bit <<= 1)
+    {
+      if (i & bit)
+        continue;
+
+      vtx[0].pos = corners[i];
+      vtx[1].pos = corners[i | bit];
+      vtx[0].col = vtx[1].col = color;
+      vtx += 2;
+    }
+  }
 }
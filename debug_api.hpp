@@ -5,6 +5,15 @@ namespace tano
 {
   class GraphicsContext;
 
+  // Lines can be added from any thread. Each thread records into its own list of
+  // chunks, and reserves blocks of vertices from the shared buffer with an atomic add,
+  // so recording doesn't take any locks. EndFrame draws the chunks from all the threads,
+  // so any tasks adding lines must be done by then.
+  //
+  // Threads that haven't called SetTransform use the transform last set on the thread
+  // that called BeginFrame, so set it before kicking the tasks.
+  //
+  // When the buffer is full, new primitives are dropped whole, and counted.
   struct DebugApi
   {
     static DebugApi& Instance();
@@ -27,6 +36,9 @@ namespace tano
 
     bool Init(GraphicsContext* ctx);
 
+    // vertices dropped this frame because the buffer was full
+    int DroppedVertices() const { return _droppedVerts; }
+
     struct LineChunk
     {
       Matrix mtxWorld;
@@ -35,19 +47,51 @@ namespace tano
       int numVertices;
     };
 
-    vector<LineChunk> _lineChunks;
-    vector<vec3> _unitSphere;
-
-    static const int MAX_VERTS = 128 * 1024;
-
     struct PosCol
     {
       vec3 pos;
       Color col;
     };
 
+    struct ThreadBuffer
+    {
+      // the buffer is stale if this doesn't match the current frame
+      u32 frame = 0;
+      vector<LineChunk> chunks;
+      Matrix world;
+      Matrix viewProj;
+      bool hasTransform = false;
+      // set when the next primitive needs a new chunk
+      bool transformChanged = false;
+      // end of the block of vertices reserved by the current chunk
+      int blockEnd = 0;
+    };
+
+    ThreadBuffer* GetThreadBuffer();
+    // Returns space for 'count' vertices in the current chunk, or nullptr if there is no
+    // transform, or the buffer is full
+    PosCol* ReserveVertices(int count);
+
+    vector<vec3> _unitSphere;
+
+    static const int MAX_VERTS = 128 * 1024;
+    // vertices reserved per thread at a time
+    static const int BLOCK_VERTS = 1024;
+    static const int MAX_THREADS = 64;
+
     PosCol _vertices[MAX_VERTS];
-    int _numVerts = 0;
+    volatile LONG _numVerts = 0;
+    volatile LONG _droppedVerts = 0;
+
+    ThreadBuffer _threadBuffers[MAX_THREADS];
+    volatile LONG _numThreadBuffers = 0;
+    ThreadBuffer* _mainThreadBuffer = nullptr;
+    u32 _frame = 0;
+
+    // transform for threads that haven't set their own
+    Matrix _defaultWorld;
+    Matrix _defaultViewProj;
+    bool _hasDefaultTransform = false;
 
     struct CBufferPerFrame
     {
@@ -4,10 +4,13 @@
 #include "resource_manager.hpp"
 #include "tano.hpp"
 #include "init_sequence.hpp"
+#include "scheduler.hpp"
+#include "stop_watch.hpp"
 #include "generated/demo.parse.hpp"
 #include "generated/demo.types.hpp"
 
 using namespace tano;
+using namespace tano::scheduler;
 using namespace bristol;
 
 DemoEngine* tano::g_DemoEngine;
@@ -24,6 +27,9 @@ namespace
   // const float bpm = 180.0f;
   // const float rpb = 8.0f;
   float ROWS_PER_SECOND = 24.0f; // bpm / 60.0f * rpb;
+
+  const int MAX_PARALLEL_EFFECTS = 16;
+  const int UPDATE_TIME_SAMPLES = 100;
 }
 
 //------------------------------------------------------------------------------
@@ -291,6 +297,7 @@ void DemoEngine::UpdateEffects()
     curState.localTime = current - _forceEffect->StartTime();
 
     fixedState.localTime = current - _forceEffect->StartTime();
+    _forceEffect->PreUpdate();
     if (_initForceEffect)
     {
       _initForceEffect = false;
@@ -319,19 +326,46 @@ void DemoEngine::UpdateEffects()
     e->SetRunning(false);
   }
 
-  // Update all active effects
+  // Update all active effects. The ones that are thread safe are kicked off on the
+  // scheduler first, and the rest are updated here while they run. Every effect gets its
+  // PreUpdate before any tasks are kicked, so input is sampled on the main thread.
+  StopWatch stopWatch;
+  stopWatch.Start();
+
+  _effectUpdates.clear();
   for (BaseEffect* effect : _activeEffects)
   {
+    effect->PreUpdate();
     fixedState.localTime = current - effect->StartTime();
-    for (int i = 0; i < numTicks; ++i)
-    {
-      effect->FixedUpdate(fixedState);
-    }
-
     curState.localTime = current - effect->StartTime();
-    effect->Update(curState);
+    _effectUpdates.push_back(EffectUpdate{effect, curState, fixedState, numTicks, false, 0, 0});
   }
 
+  SimpleAppendBuffer<TaskId, MAX_PARALLEL_EFFECTS> tasks;
+  for (EffectUpdate& update : _effectUpdates)
+  {
+    update.parallel = _settings.parallel_update && update.effect->ThreadSafeUpdate()
+                      && tasks.Size() < tasks.Capacity();
+    if (!update.parallel)
+      continue;
+
+    KernelData kd;
+    kd.data = &update;
+    kd.size = sizeof(EffectUpdate);
+    tasks.Append(g_Scheduler->AddTask(kd, EffectUpdateKernel));
+  }
+
+  for (EffectUpdate& update : _effectUpdates)
+  {
+    if (!update.parallel)
+      RunEffectUpdate(&update);
+  }
+
+  for (const TaskId& taskId : tasks)
+    g_Scheduler->Wait(taskId);
+
+  ReportEffectUpdateTimes(stopWatch.Stop());
+
   _initialState.globalTime = current;
   _initialState.paused = paused;
 
@@ -343,6 +377,7 @@ void DemoEngine::UpdateEffects()
     e->InitAnimatedParameters();
     _initialState.localTime = current - e->StartTime();
     _initialFixedState.localTime = current - e->StartTime();
+    e->PreUpdate();
     e->Update(_initialState);
     e->FixedUpdate(_initialFixedState);
   }
@@ -353,6 +388,80 @@ void DemoEngine::UpdateEffects()
   }
 }
 
+//------------------------------------------------------------------------------
+void DemoEngine::RunEffectUpdate(EffectUpdate* update)
+{
+  StopWatch stopWatch;
+  stopWatch.Start();
+  for (int i = 0; i < update->numTicks; ++i)
+  {
+    update->effect->FixedUpdate(update->fixedState);
+  }
+  update->fixedUpdateTime = stopWatch.Stop();
+
+  stopWatch.Start();
+  update->effect->Update(update->state);
+  update->updateTime = stopWatch.Stop();
+}
+
+//------------------------------------------------------------------------------
+void DemoEngine::EffectUpdateKernel(const TaskData& data)
+{
+  rmt_ScopedCPUSample(DemoEngine_EffectUpdate);
+  RunEffectUpdate((EffectUpdate*)data.kernelData.data);
+}
+
+//------------------------------------------------------------------------------
+void DemoEngine::ReportEffectUpdateTimes(double wallTime)
+{
+  struct EffectTiming
+  {
+    const char* name;
+    double fixedUpdate;
+    double update;
+    double avg;
+    bool parallel;
+  };
+
+  vector<EffectTiming> timings;
+  double total = 0;
+  for (const EffectUpdate& update : _effectUpdates)
+  {
+    double elapsed = update.fixedUpdateTime + update.updateTime;
+    auto it = _effectUpdateTimes.find(update.effect->GetId());
+    if (it == _effectUpdateTimes.end())
+    {
+      it = _effectUpdateTimes.insert(
+          make_pair(update.effect->GetId(), RollingAverage<double>(UPDATE_TIME_SAMPLES))).first;
+    }
+    it->second.AddSample(elapsed);
+    total += elapsed;
+
+    timings.push_back(EffectTiming{update.effect->InstanceName().c_str(),
+        update.fixedUpdateTime,
+        update.updateTime,
+        it->second.GetAverage(),
+        update.parallel});
+  }
+
+#if WITH_IMGUI
+  TANO.AddPerfCallback([=]()
+      {
+        // with parallel updates, the wall time should be less than the sum
+        ImGui::Text("Effect update: %.3fms (sum: %.3fms)", 1000 * wallTime, 1000 * total);
+        for (const EffectTiming& t : timings)
+        {
+          ImGui::Text("  %s%s: fixed %.3fms, update %.3fms, avg %.3fms",
+              t.name,
+              t.parallel ? " (parallel)" : "",
+              1000 * t.fixedUpdate,
+              1000 * t.update,
+              1000 * t.avg);
+        }
+      });
+#endif
+}
+
 //------------------------------------------------------------------------------
 void DemoEngine::Destroy()
 {
@@ -417,7 +526,7 @@ bool DemoEngine::ApplySettings(const DemoSettings& settings)
       return effect->OnConfigChanged(buf);
     };
 
-    FileWatcherWin32::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(configFile, true, fnOnFileChanged);
+    NativeFileWatcher::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(configFile, true, fnOnFileChanged);
 
     // if using a force effect, only init that one
     if (!hasForceEffect || (hasForceEffect && e.force))
@@ -461,7 +570,15 @@ bool DemoEngine::Init(const char* config, HINSTANCE instance)
   vector<char> buf;
   INIT_FATAL(RESOURCE_MANAGER.LoadFile(config, &buf));
 
-  DemoSettings settings = ParseDemoSettings(InputBuffer(buf));
+  InputBuffer inputBuffer(buf);
+  DemoSettings settings = ParseDemoSettings(inputBuffer);
+  INIT_FATAL_LOG(inputBuffer.Ok(),
+      "Error parsing ",
+      config,
+      " in ",
+      inputBuffer.ErrorFunction(),
+      ", at offset ",
+      inputBuffer.ErrorOffset());
   INIT_FATAL(ApplySettings(settings));
 
 #if WITH_MUSIC
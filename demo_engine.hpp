@@ -8,6 +8,10 @@
 
 namespace tano
 {
+  namespace scheduler
+  {
+    struct TaskData;
+  }
 
   class BaseEffect;
   typedef function<BaseEffect*(const char*, const char*, u32)> EffectFactory;
@@ -51,7 +55,22 @@ namespace tano
     void ReclassifyEffects();
     void KillEffects();
 
+    struct EffectUpdate
+    {
+      BaseEffect* effect;
+      UpdateState state;
+      FixedUpdateState fixedState;
+      int numTicks;
+      bool parallel;
+      // seconds spent in FixedUpdate and Update
+      double fixedUpdateTime;
+      double updateTime;
+    };
+
     void UpdateEffects();
+    static void RunEffectUpdate(EffectUpdate* update);
+    static void EffectUpdateKernel(const scheduler::TaskData& data);
+    void ReportEffectUpdateTimes(double wallTime);
     BaseEffect* FindEffectByName(const string &name);
     bool ApplySettings(const DemoSettings& settings);
 
@@ -85,6 +104,9 @@ namespace tano
     FixedUpdateState _initialFixedState;
     BaseEffect* _forceEffect = nullptr;
 
+    vector<EffectUpdate> _effectUpdates;
+    unordered_map<u32, RollingAverage<double>> _effectUpdateTimes;
+
     double _updatedAcc = 0;
     bool _initForceEffect = false;
   };
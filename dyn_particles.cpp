@@ -24,8 +24,6 @@ using namespace DirectX;
 static const int NUM_BUCKETS = 16;
 static const int TOTAL_NUM_BUCKETS = NUM_BUCKETS * NUM_BUCKETS;
 
-static RandomUniform RANDOM_FLOAT;
-
 //------------------------------------------------------------------------------
 DynParticles::~DynParticles()
 {
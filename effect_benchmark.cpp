@@ -0,0 +1,583 @@
+#include "effect_benchmark.hpp"
+
+#if WITH_BENCHMARKS
+#include "arena_allocator.hpp"
+#include "dyn_particles.hpp"
+#include "mesh_utils.hpp"
+#include "particle_emitters.hpp"
+#include "scheduler.hpp"
+#include "spatial_grid.hpp"
+#include "stop_watch.hpp"
+#include "verlet.hpp"
+#include "effects/landscape.hpp"
+#include "effects/tubes.hpp"
+#include "resource_manager.hpp"
+#include "generated/demo.parse.hpp"
+
+using namespace tano;
+using namespace tano::scheduler;
+using namespace bristol;
+
+namespace
+{
+  const int NUM_FLOCKS = 4;
+  const int BOIDS_PER_FLOCK = 2000;
+  const float BOID_SPLINE_RADIUS = 500;
+
+  const int CHUNKS_PER_TICK = 8;
+
+  const int NUM_PLEXUS_POINTS = 4096;
+  const int MAX_PLEXUS_NEIGHBOURS = 16;
+
+  const int CLOTH_DIM_X = 100;
+  const int CLOTH_DIM_Y = 100;
+  const int CLOTH_ITERATIONS = 5;
+
+  const int NUM_EMITTERS = 20;
+  const int PARTICLES_PER_EMITTER = 5000;
+
+  const int PARSE_ITERATIONS = 200;
+
+  //------------------------------------------------------------------------------
+  // Stands in for a mapped dynamic buffer. The phases write their output here instead
+  // of to the graphics context, and it's hashed so runs can be compared.
+  struct MemoryBuffer
+  {
+    template <typename T>
+    T* Map(int count)
+    {
+      mem.resize(count * sizeof(T));
+      return (T*)mem.data();
+    }
+
+    void Unmap(int bytesWritten)
+    {
+      // FNV-1a
+      for (int i = 0; i < bytesWritten; ++i)
+        hash = (hash ^ mem[i]) * 0x100000001b3ull;
+      totalBytes += bytesWritten;
+    }
+
+    vector<u8> mem;
+    u64 hash = 0xcbf29ce484222325ull;
+    u64 totalBytes = 0;
+  };
+
+  //------------------------------------------------------------------------------
+  struct Phase
+  {
+    const char* name;
+    function<void(int tick)> update;
+    vector<double> times;
+    MemoryBuffer buffer;
+  };
+
+  //------------------------------------------------------------------------------
+  double Percentile(const vector<double>& sorted, float p)
+  {
+    int idx = (int)(p * (sorted.size() - 1) + 0.5f);
+    return sorted[min((int)sorted.size() - 1, max(0, idx))];
+  }
+
+  //------------------------------------------------------------------------------
+  struct BoidsBenchmark
+  {
+    BoidsBenchmark(u64 seed)
+    {
+      vector<vec3> controlPoints;
+      int numPts = 100;
+      for (int i = 0; i < numPts; ++i)
+      {
+        float angle = i * XM_2PI / numPts;
+        controlPoints.push_back(
+            vec3(BOID_SPLINE_RADIUS * sinf(angle), 0, BOID_SPLINE_RADIUS * cosf(angle)));
+      }
+      spline.Create(controlPoints.data(), numPts);
+
+      RandomUniform random(seed, 0);
+      for (int i = 0; i < NUM_FLOCKS; ++i)
+      {
+        DynParticles& boids = flocks[i].boids;
+        boids.Init(BOIDS_PER_FLOCK, 10, 10);
+        flocks[i].follow = new BehaviorPathFollow(spline);
+        boids.AddKinematics(&landscapeFollow, 0.3f);
+        boids.AddKinematics(flocks[i].follow, 0.6f);
+        // the spacing draws random pairs, so each flock gets its own stream of the seed
+        flocks[i].spacing = new BehaviorSpacing(seed, 16 + i);
+        boids.AddKinematics(flocks[i].spacing, 0.1f);
+
+        vec3 center = controlPoints[(i * numPts) / NUM_FLOCKS];
+        for (int j = 0; j < BOIDS_PER_FLOCK; ++j)
+          boids._bodies.pos[j] = center + vec3(random.Next(-20, 20), 0, random.Next(-20, 20));
+      }
+    }
+
+    ~BoidsBenchmark()
+    {
+      for (Flock& flock : flocks)
+      {
+        delete flock.follow;
+        delete flock.spacing;
+      }
+    }
+
+    static void UpdateKernel(const TaskData& data)
+    {
+      FlockKernelData* k = (FlockKernelData*)data.kernelData.data;
+      k->flock->boids.Update(k->dt, false);
+    }
+
+    void Update(float dt, MemoryBuffer* buffer)
+    {
+      SimpleAppendBuffer<TaskId, NUM_FLOCKS> tasks;
+      for (Flock& flock : flocks)
+      {
+        FlockKernelData* data = g_ScratchMemory.Alloc<FlockKernelData>(1);
+        *data = FlockKernelData{&flock, dt};
+        KernelData kd;
+        kd.data = data;
+        kd.size = sizeof(FlockKernelData);
+        tasks.Append(g_Scheduler->AddTask(kd, UpdateKernel));
+      }
+
+      for (const TaskId& taskId : tasks)
+        g_Scheduler->Wait(taskId);
+
+      vec3* vtx = buffer->Map<vec3>(NUM_FLOCKS * BOIDS_PER_FLOCK);
+      for (const Flock& flock : flocks)
+      {
+        memcpy(vtx, flock.boids._bodies.pos, BOIDS_PER_FLOCK * sizeof(vec3));
+        vtx += BOIDS_PER_FLOCK;
+      }
+      buffer->Unmap(NUM_FLOCKS * BOIDS_PER_FLOCK * sizeof(vec3));
+    }
+
+    struct Flock
+    {
+      DynParticles boids;
+      BehaviorPathFollow* follow = nullptr;
+      BehaviorSpacing* spacing = nullptr;
+    };
+
+    struct FlockKernelData
+    {
+      Flock* flock;
+      float dt;
+    };
+
+    CardinalSpline spline;
+    BehaviorLandscapeFollow landscapeFollow;
+    Flock flocks[NUM_FLOCKS];
+  };
+
+  //------------------------------------------------------------------------------
+  struct LandscapeBenchmark
+  {
+    LandscapeBenchmark() : chunks(CHUNKS_PER_TICK) {}
+
+    // Fills a new strip of chunks each tick, as if the camera was flying along x
+    void Update(int tick, MemoryBuffer* buffer)
+    {
+      float chunkSize = Landscape::GRID_SIZE * Landscape::NUM_CHUNK_QUADS;
+      SimpleAppendBuffer<TaskId, CHUNKS_PER_TICK> tasks;
+      for (int i = 0; i < CHUNKS_PER_TICK; ++i)
+      {
+        Landscape::Chunk* chunk = &chunks[i];
+        chunk->cx = tick;
+        chunk->cz = i - CHUNKS_PER_TICK / 2;
+        chunk->x = chunk->cx * chunkSize;
+        chunk->y = chunk->cz * chunkSize;
+        tasks.Append(Landscape::QueueFillChunk(chunk, TaskPriority::Normal));
+      }
+
+      for (const TaskId& taskId : tasks)
+        g_Scheduler->Wait(taskId);
+
+      // lower, upper and particle verts, as in Landscape::CopyOutTask
+      const int vertsPerChunk =
+          Landscape::Chunk::LOWER_VERTS + 2 * Landscape::Chunk::UPPER_VERTS;
+      tasks.Clear();
+      vec3* vtx = buffer->Map<vec3>(CHUNKS_PER_TICK * vertsPerChunk);
+      for (int i = 0; i < CHUNKS_PER_TICK; ++i)
+      {
+        Landscape::CopyKernelData* data = g_ScratchMemory.Alloc<Landscape::CopyKernelData>(1);
+        vec3* lower = vtx + i * vertsPerChunk;
+        vec3* upper = lower + Landscape::Chunk::LOWER_VERTS;
+        *data = Landscape::CopyKernelData{
+            &chunks[i], lower, upper, upper + Landscape::Chunk::UPPER_VERTS};
+
+        KernelData kd;
+        kd.data = data;
+        kd.size = sizeof(Landscape::CopyKernelData);
+        tasks.Append(g_Scheduler->AddTask(kd, Landscape::CopyOutTask));
+      }
+
+      for (const TaskId& taskId : tasks)
+        g_Scheduler->Wait(taskId);
+
+      buffer->Unmap(CHUNKS_PER_TICK * vertsPerChunk * sizeof(vec3));
+    }
+
+    vector<Landscape::Chunk> chunks;
+  };
+
+  //------------------------------------------------------------------------------
+  struct PlexusBenchmark
+  {
+    PlexusBenchmark(u64 seed) : points(NUM_PLEXUS_POINTS), velocity(NUM_PLEXUS_POINTS)
+    {
+      RandomUniform random(seed, 1);
+      for (int i = 0; i < NUM_PLEXUS_POINTS; ++i)
+      {
+        points[i] = vec3(random.Next(-200, 200), random.Next(-200, 200), random.Next(-200, 200));
+        velocity[i] = vec3(random.Next(-20, 20), random.Next(-20, 20), random.Next(-20, 20));
+      }
+
+      config.min_dist = 1;
+      config.max_dist = 40;
+      config.num_neighbours = MAX_PLEXUS_NEIGHBOURS;
+      config.num_nearest = 2;
+    }
+
+    void Update(float dt, MemoryBuffer* buffer)
+    {
+      for (int i = 0; i < NUM_PLEXUS_POINTS; ++i)
+        points[i] += dt * velocity[i];
+
+      int* neighbours = g_ScratchMemory.Alloc<int>(NUM_PLEXUS_POINTS * MAX_PLEXUS_NEIGHBOURS);
+      grid.Update(points.data(), NUM_PLEXUS_POINTS, config.max_dist);
+      grid.CalcNeighbours(config.num_neighbours,
+          config.min_dist,
+          config.max_dist,
+          neighbours,
+          MAX_PLEXUS_NEIGHBOURS);
+
+      vec3* vtx = buffer->Map<vec3>(2 * NUM_PLEXUS_POINTS * config.num_nearest);
+      int numVerts = CalcPlexusGrouping(
+          vtx, points.data(), NUM_PLEXUS_POINTS, neighbours, MAX_PLEXUS_NEIGHBOURS, config);
+      buffer->Unmap(numVerts * sizeof(vec3));
+    }
+
+    vector<vec3> points;
+    vector<vec3> velocity;
+    SpatialGrid grid;
+    PlexusGrouping config;
+  };
+
+  //------------------------------------------------------------------------------
+  struct ClothBenchmark
+  {
+    ClothBenchmark()
+    {
+      cloth.Create(CLOTH_DIM_X * CLOTH_DIM_Y);
+      VerletSystem::Particle* p = cloth._particles.data();
+      for (int i = 0; i < CLOTH_DIM_Y; ++i)
+      {
+        for (int j = 0; j < CLOTH_DIM_X; ++j)
+        {
+          vec3 pos((float)j, (float)i, 0);
+          *p++ = VerletSystem::Particle{pos, pos, vec3(0, 0, 0)};
+        }
+      }
+
+      // same connectivity as the Credits cloth: horiz, vert and diag, 1 and 2 steps away
+      vector<VerletSystem::Constraint> constraints;
+      for (int i = 0; i < CLOTH_DIM_Y; ++i)
+      {
+        for (int j = 0; j < CLOTH_DIM_X; ++j)
+        {
+          for (int dy = -2; dy <= 2; ++dy)
+          {
+            for (int dx = -2; dx <= 2; ++dx)
+            {
+              int xx = j + dx;
+              int yy = i + dy;
+              bool straight = dx == 0 || dy == 0 || abs(dx) == abs(dy);
+              if ((dx == 0 && dy == 0) || !straight || xx < 0 || xx >= CLOTH_DIM_X || yy < 0
+                  || yy >= CLOTH_DIM_Y)
+                continue;
+
+              u32 idx0 = i * CLOTH_DIM_X + j;
+              u32 idx1 = yy * CLOTH_DIM_X + xx;
+              float restLength = Distance(cloth._particles[idx0].pos, cloth._particles[idx1].pos);
+              constraints.push_back({idx0, idx1, restLength});
+            }
+          }
+        }
+      }
+
+      cloth.SetConstraints(constraints.data(), (int)constraints.size());
+    }
+
+    void Update(int tick, float dt, MemoryBuffer* buffer)
+    {
+      // pin the top row, and push the middle around
+      int mid = (CLOTH_DIM_Y / 2) * CLOTH_DIM_X + CLOTH_DIM_X / 2;
+      cloth._particles[mid].acc = vec3(0, 0, 50 * sinf(tick * dt));
+      cloth.Integrate(dt, 0.01f, vec3(0, -10, 0));
+      cloth.Relax(CLOTH_ITERATIONS, 0);
+      for (int i = 0; i < CLOTH_DIM_X; ++i)
+      {
+        VerletSystem::Particle& p = cloth._particles[(CLOTH_DIM_Y - 1) * CLOTH_DIM_X + i];
+        p.pos = p.lastPos = vec3((float)i, (float)(CLOTH_DIM_Y - 1), 0);
+      }
+
+      int num = (int)cloth._particles.size();
+      VerletSystem::Particle* vtx = buffer->Map<VerletSystem::Particle>(num);
+      memcpy(vtx, cloth._particles.data(), num * sizeof(VerletSystem::Particle));
+      buffer->Unmap(num * sizeof(VerletSystem::Particle));
+    }
+
+    VerletSystem cloth;
+  };
+
+  //------------------------------------------------------------------------------
+  struct EmitterBenchmark
+  {
+    EmitterBenchmark(u64 seed)
+    {
+      // the emitters only take a stream, so the seed picks the block of streams used
+      for (int i = 0; i < NUM_EMITTERS; ++i)
+      {
+        emitters[i].Create(
+            vec3(0, 0, 0), 25.f * (i + 1), PARTICLES_PER_EMITTER, (seed << 16) + i);
+      }
+    }
+
+    ~EmitterBenchmark()
+    {
+      for (RadialParticleEmitter& emitter : emitters)
+        emitter.Destroy();
+    }
+
+    void Update(float dt, MemoryBuffer* buffer)
+    {
+      typedef RadialParticleEmitter::EmitterKernelData EmitterKernelData;
+      SimpleAppendBuffer<TaskId, NUM_EMITTERS> tasks;
+      for (RadialParticleEmitter& emitter : emitters)
+      {
+        EmitterKernelData* data = g_ScratchMemory.Alloc<EmitterKernelData>(1);
+        *data = EmitterKernelData{&emitter, dt, nullptr};
+        KernelData kd;
+        kd.data = data;
+        kd.size = sizeof(EmitterKernelData);
+        tasks.Append(g_Scheduler->AddTask(kd, RadialParticleEmitter::UpdateEmitter));
+      }
+
+      for (const TaskId& taskId : tasks)
+        g_Scheduler->Wait(taskId);
+      tasks.Clear();
+
+      int numParticles = 0;
+      for (const RadialParticleEmitter& emitter : emitters)
+        numParticles += emitter._spawnedParticles;
+
+      vec4* vtx = buffer->Map<vec4>(numParticles);
+      for (RadialParticleEmitter& emitter : emitters)
+      {
+        EmitterKernelData* data = g_ScratchMemory.Alloc<EmitterKernelData>(1);
+        *data = EmitterKernelData{&emitter, dt, vtx};
+        vtx += emitter._spawnedParticles;
+        KernelData kd;
+        kd.data = data;
+        kd.size = sizeof(EmitterKernelData);
+        tasks.Append(g_Scheduler->AddTask(kd, RadialParticleEmitter::CopyOutEmitter));
+      }
+
+      for (const TaskId& taskId : tasks)
+        g_Scheduler->Wait(taskId);
+
+      buffer->Unmap(numParticles * sizeof(vec4));
+    }
+
+    RadialParticleEmitter emitters[NUM_EMITTERS];
+  };
+
+  //------------------------------------------------------------------------------
+  struct TubesBenchmark
+  {
+    TubesBenchmark(u64 seed) : pathy(seed) { pathy.Create(); }
+    ~TubesBenchmark() { SeqDelete(&pathy.segments); }
+
+    void Update(int tick, float dt, MemoryBuffer* buffer)
+    {
+      pathy.CreateTubesIncremental(tick * dt);
+
+      int numVerts = 0;
+      for (const Pathy::Segment* s : pathy.segments)
+        numVerts += s->NumVerts();
+
+      PN* vtx = buffer->Map<PN>(numVerts);
+      for (const Pathy::Segment* s : pathy.segments)
+      {
+        memcpy(vtx, s->rings.data(), s->NumVerts() * sizeof(PN));
+        vtx += s->NumVerts();
+      }
+      buffer->Unmap(numVerts * sizeof(PN));
+    }
+
+    Pathy pathy;
+  };
+
+  //------------------------------------------------------------------------------
+  // Parses the shipped configs over and over, to keep an eye on the parser's throughput,
+  // which is what gates the hot reload when tweaking settings
+  string ParserBenchmark()
+  {
+    struct Config
+    {
+      const char* filename;
+      function<void(InputBuffer&)> parse;
+    };
+
+    Config configs[] = {
+      {"config/demo.gb", [](InputBuffer& buf) { ParseDemoSettings(buf); }},
+      {"config/intro.gb", [](InputBuffer& buf) { ParseIntroSettings(buf); }},
+      {"config/landscape.gb", [](InputBuffer& buf) { ParseLandscapeSettings(buf); }},
+      {"config/split.gb", [](InputBuffer& buf) { ParseSplitSettings(buf); }},
+      {"config/plexus.gb", [](InputBuffer& buf) { ParsePlexusSettings(buf); }},
+      {"config/tunnel.gb", [](InputBuffer& buf) { ParseTunnelSettings(buf); }},
+      {"config/credits.gb", [](InputBuffer& buf) { ParseCreditsSettings(buf); }},
+    };
+
+    string report = ToString("\nparser benchmark: %d iterations\n", PARSE_ITERATIONS);
+    report += ToString("%-20s %10s %10s %10s %6s\n", "config", "bytes", "mean us", "MB/s", "ok");
+
+    StopWatch stopWatch;
+    for (const Config& config : configs)
+    {
+      vector<char> buf;
+      if (!RESOURCE_MANAGER.LoadFile(config.filename, &buf))
+      {
+        report += ToString("%-20s unable to load\n", config.filename);
+        continue;
+      }
+
+      bool ok = true;
+      stopWatch.Start();
+      for (int i = 0; i < PARSE_ITERATIONS; ++i)
+      {
+        // the parsers record any errors in the buffer
+        InputBuffer inputBuffer(buf);
+        config.parse(inputBuffer);
+        ok &= inputBuffer.Ok();
+      }
+      double elapsed = stopWatch.Stop();
+
+      report += ToString("%-20s %10d %10.2f %10.1f %6s\n",
+          config.filename,
+          (int)buf.size(),
+          1e6 * elapsed / PARSE_ITERATIONS,
+          PARSE_ITERATIONS * buf.size() / (1024.0 * 1024.0 * elapsed),
+          ok ? "yes" : "no");
+    }
+
+    return report;
+  }
+}
+
+//------------------------------------------------------------------------------
+EffectBenchmarkOptions tano::ParseEffectBenchmarkOptions(const char* cmdLine)
+{
+  EffectBenchmarkOptions options;
+  if (const char* ticks = strstr(cmdLine, "--benchmark-ticks="))
+    options.numTicks = max(1, atoi(ticks + strlen("--benchmark-ticks=")));
+
+  if (const char* seed = strstr(cmdLine, "--benchmark-seed="))
+    options.seed = strtoull(seed + strlen("--benchmark-seed="), nullptr, 0);
+
+  if (const char* out = strstr(cmdLine, "--benchmark-out="))
+  {
+    out += strlen("--benchmark-out=");
+    const char* end = out;
+    while (*end && *end != ' ')
+      ++end;
+    options.outputFile = string(out, end);
+  }
+
+  return options;
+}
+
+//------------------------------------------------------------------------------
+bool tano::RunEffectBenchmark(const EffectBenchmarkOptions& options)
+{
+  float dt = options.tickDelta;
+
+  BoidsBenchmark boids(options.seed);
+  LandscapeBenchmark landscape;
+  PlexusBenchmark plexus(options.seed);
+  ClothBenchmark cloth;
+  EmitterBenchmark emitters(options.seed);
+  TubesBenchmark tubes(options.seed);
+
+  Phase phases[] = {
+    {"boids"},
+    {"landscape chunks"},
+    {"plexus grouping"},
+    {"cloth"},
+    {"particle emitters"},
+    {"tubes"},
+  };
+
+  phases[0].update = [&](int tick) { boids.Update(dt, &phases[0].buffer); };
+  phases[1].update = [&](int tick) { landscape.Update(tick, &phases[1].buffer); };
+  phases[2].update = [&](int tick) { plexus.Update(dt, &phases[2].buffer); };
+  phases[3].update = [&](int tick) { cloth.Update(tick, dt, &phases[3].buffer); };
+  phases[4].update = [&](int tick) { emitters.Update(dt, &phases[4].buffer); };
+  phases[5].update = [&](int tick) { tubes.Update(tick, dt, &phases[5].buffer); };
+
+  StopWatch stopWatch;
+  for (int tick = 0; tick < options.numTicks; ++tick)
+  {
+    g_ScratchMemory.NewFrame();
+    for (Phase& phase : phases)
+    {
+      stopWatch.Start();
+      phase.update(tick);
+      phase.times.push_back(stopWatch.Stop());
+    }
+  }
+
+  string report =
+      ToString("effect benchmark: %d ticks, seed 0x%llx\n", options.numTicks, options.seed);
+  report += ToString("%-20s %10s %10s %10s %10s %10s %12s %18s\n",
+      "phase", "mean ms", "p50", "p90", "p99", "max", "MB written", "checksum");
+
+  for (Phase& phase : phases)
+  {
+    vector<double>& times = phase.times;
+    double sum = 0;
+    for (double t : times)
+      sum += t;
+    sort(times.begin(), times.end());
+
+    report += ToString("%-20s %10.3f %10.3f %10.3f %10.3f %10.3f %12.1f %18llx\n",
+        phase.name,
+        1e3 * sum / times.size(),
+        1e3 * Percentile(times, 0.5f),
+        1e3 * Percentile(times, 0.9f),
+        1e3 * Percentile(times, 0.99f),
+        1e3 * times.back(),
+        phase.buffer.totalBytes / (1024.0 * 1024.0),
+        phase.buffer.hash);
+  }
+
+  report += ParserBenchmark();
+
+  LOG_INFO(report);
+
+  if (!options.outputFile.empty())
+  {
+    FILE* f = fopen(options.outputFile.c_str(), "wt");
+    if (!f)
+    {
+      LOG_WARN("Unable to write benchmark results: ", options.outputFile);
+      return false;
+    }
+    fputs(report.c_str(), f);
+    fclose(f);
+  }
+
+  return true;
+}
+#endif
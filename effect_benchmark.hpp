@@ -0,0 +1,28 @@
+#pragma once
+
+#if WITH_BENCHMARKS
+#include "random.hpp"
+
+namespace tano
+{
+  struct EffectBenchmarkOptions
+  {
+    int numTicks = 1000;
+    u64 seed = Philox::DEFAULT_SEED;
+    // matches the demo engine's fixed update rate
+    float tickDelta = 1.0f / 100;
+    // if set, the report is written here as well as to the log
+    string outputFile;
+  };
+
+  // Reads "--benchmark-ticks=N", "--benchmark-seed=S" and "--benchmark-out=file"
+  EffectBenchmarkOptions ParseEffectBenchmarkOptions(const char* cmdLine);
+
+  // Runs the CPU side of the effects (boids, landscape chunks, plexus grouping, cloth,
+  // particle emitters and tubes) for a fixed number of ticks, without a graphics
+  // device. Buffers that would be mapped are written to system memory instead. Logs
+  // per phase timings, and a checksum of the output so runs with the same seed can be
+  // compared. Needs the blackboard, scheduler and scratch memory to be set up.
+  bool RunEffectBenchmark(const EffectBenchmarkOptions& options);
+}
+#endif
@@ -11,6 +11,7 @@
 #include "../stop_watch.hpp"
 #include "../blackboard.hpp"
 #include "../random.hpp"
+#include "../upload_buffer.hpp"
 
 /*
   update timing:
@@ -33,12 +34,10 @@ namespace
 {
   int GRID_SIZE = 20;
   float CLOTH_SIZE = 10;
-
-  int MAX_PARTICLES = 16 * 1024;
+  int CLOTH_ITERATIONS = 5;
 }
 
 StopWatch g_stopWatch;
-static RandomGauss150 RANDOM_150;
 
 //------------------------------------------------------------------------------
 Credits::Credits(const string &name, const string& config, u32 id)
@@ -55,8 +54,7 @@ Credits::~Credits()
 //------------------------------------------------------------------------------
 bool Credits::OnConfigChanged(const vector<char>& buf)
 {
-  _settings = ParseCreditsSettings(InputBuffer(buf));
-  return true;
+  return ParseSettings(buf, &_settings, ParseCreditsSettings);
 }
 
 //------------------------------------------------------------------------------
@@ -92,7 +90,6 @@ bool Credits::Init()
     .PixelShader("shaders/out/credits.particle", "PsParticle")
     .InputElement(CD3D11_INPUT_ELEMENT_DESC("POSITION", DXGI_FORMAT_R32G32B32A32_FLOAT))
     .Topology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST)
-    .DynamicVb(MAX_PARTICLES, sizeof(vec4))
     .DepthStencilDesc(depthDescDepthDisabled)
     .BlendDesc(blendDescPreMultipliedAlpha)
     .RasterizerDesc(rasterizeDescCullNone)));
@@ -140,17 +137,15 @@ void Credits::ResetParticleSpline()
 //------------------------------------------------------------------------------
 void Credits::UpdateParticles(const FixedUpdateState& state)
 {
-  if (_clothParticles.empty())
+  if (_cloth._particles.empty())
     return;
 
   g_stopWatch.Start();
 
-  size_t numParticles = _clothParticles.size();
+  vector<VerletSystem::Particle>& particles = _cloth._particles;
   float dt = state.delta;
-  float dt2 = dt * dt;
 
-  const IoState& ioState = TANO.GetIoState();
-  if (ioState.keysPressed['1'])
+  if (_pushCloth)
   {
     int s = 20;
     for (int i = 0; i <= s; ++i)
@@ -162,66 +157,14 @@ void Credits::UpdateParticles(const FixedUpdateState& state)
         float dx = (float)xOfs;
         float dy = (float)yOfs;
         float r = Clamp(0.f, 1.f, s/2 - sqrtf(dx*dx+dy*dy));
-        _clothParticles[(_clothDimY/2+yOfs) * _clothDimX + _clothDimX/2+xOfs].acc = r * vec3(0, 0, 50);
+        particles[(_clothDimY/2+yOfs) * _clothDimX + _clothDimX/2+xOfs].acc = r * vec3(0, 0, 50);
       }
     }
   }
 
 
-  ClothParticle* p = &_clothParticles[0];
-  for (size_t i = 0; i < numParticles; ++i)
-  {
-    // verlet integration
-    vec3 tmp = p->pos;
-    p->pos += (1.0f - _settings.damping) * (p->pos - p->lastPos) + dt2 * p->acc;
-    p->lastPos = tmp;
-    p->acc = vec3(0, 0, 0);
-    ++p;
-  }
-
-  // apply the constraints
-  p = &_clothParticles[0];
-  Constraint* c = &_constraints[0];
-  for (int i = 0; i < 5; ++i)
-  {
-    int num = (int)(_constraints.size() / 4);
-    for (int j = 0; j < num; ++j)
-    {
-      const Constraint& c0 = c[j * 4 + 0];
-      const Constraint& c1 = c[j * 4 + 1];
-      const Constraint& c2 = c[j * 4 + 2];
-      const Constraint& c3 = c[j * 4 + 3];
-
-      vec3 v0 = (c0.p1->pos - c0.p0->pos);
-      vec3 v1 = (c1.p1->pos - c1.p0->pos);
-      vec3 v2 = (c2.p1->pos - c2.p0->pos);
-      vec3 v3 = (c3.p1->pos - c3.p0->pos);
-
-      float dist0 = max(0.001f, Length(v0));
-      float dist1 = max(0.001f, Length(v1));
-      float dist2 = max(0.001f, Length(v2));
-      float dist3 = max(0.001f, Length(v3));
-
-      float s0 = 1 - c0.restLength / dist0;
-      float s1 = 1 - c1.restLength / dist1;
-      float s2 = 1 - c2.restLength / dist2;
-      float s3 = 1 - c3.restLength / dist3;
-
-      vec3 dir0 = 0.5f * s0 * v0;
-      vec3 dir1 = 0.5f * s1 * v1;
-      vec3 dir2 = 0.5f * s2 * v2;
-      vec3 dir3 = 0.5f * s3 * v3;
-
-      c0.p0->pos += dir0;
-      c0.p1->pos -= dir0;
-      c1.p0->pos += dir1;
-      c1.p1->pos -= dir1;
-      c2.p0->pos += dir2;
-      c2.p1->pos -= dir2;
-      c3.p0->pos += dir3;
-      c3.p1->pos -= dir3;
-    }
-  }
+  _cloth.Integrate(dt, _settings.damping, vec3(0, 0, 0));
+  _cloth.Relax(CLOTH_ITERATIONS, 0);
 
   // top row is fixed
   float incX = CLOTH_SIZE / (_clothDimX - 1);
@@ -229,17 +172,16 @@ void Credits::UpdateParticles(const FixedUpdateState& state)
   vec3 bottom(-CLOTH_SIZE / 2.f, -CLOTH_SIZE / 2.f, 0);
   for (int i = 0; i < _clothDimX; ++i)
   {
-    _clothParticles[i].pos = top;
-    _clothParticles[(_clothDimY-1)*_clothDimX+i].pos = bottom;
+    particles[i].pos = top;
+    particles[(_clothDimY-1)*_clothDimX+i].pos = bottom;
     top.x += incX;
     bottom.x += incX;
   }
 
   _avgUpdate.AddSample(g_stopWatch.Stop());
 
-  vec3* vtx = _ctx->MapWriteDiscard<vec3>(_clothGpuObjects._vb);
-  memcpy(vtx, _clothParticles.data(), _numClothParticles * sizeof(ClothParticle));
-  _ctx->Unmap(_clothGpuObjects._vb);
+  // The cloth isn't drawn, so it isn't uploaded. This runs in the update, which can be on
+  // a worker, so when it is drawn, copy it through g_DynamicVertices in Render instead.
 }
 
 //------------------------------------------------------------------------------
@@ -252,7 +194,6 @@ bool Credits::InitParticles()
   int dimY = h / GRID_SIZE + 1;
   
   int numParticles = dimX * dimY;
-  _clothGpuObjects.CreateDynamicVb(numParticles * sizeof(ClothParticle), sizeof(ClothParticle));
 
   _clothDimX = dimX;
   _clothDimY = dimY;
@@ -287,65 +228,21 @@ bool Credits::InitParticles()
   }
   _clothGpuObjects.CreateIndexBuffer((u32)indices.size() * sizeof(u32), DXGI_FORMAT_R32_UINT, indices.data());
 
-  _clothParticles.resize(numParticles);
+  _cloth.Create(numParticles);
 
   ResetParticles();
 
-  // Check if we've saved the grouped constraints
-  vector<char> buf;
-  char filename[MAX_PATH];
-  sprintf(filename, "data/cloth_constraints_%d.dat", GRID_SIZE);
-  if (RESOURCE_MANAGER.LoadFile(filename, &buf))
-  {
-    int num = *(int*)&buf[0];
-    _constraints.resize(num);
-    vector<u16> data(num*2);
-
-    memcpy(data.data(), (u16*)&buf[4], num * 2 * sizeof(u16));
-
-    for (int i = 0; i < num; ++i)
-    {
-      _constraints[i].p0 = &_clothParticles[data[i * 2 + 0]];
-      _constraints[i].p1 = &_clothParticles[data[i * 2 + 1]];
-      _constraints[i].restLength = Distance(_constraints[i].p0->pos, _constraints[i].p1->pos);
-    }
-  }
-  else
-  {
-#if WITH_UNPACKED_RESOUCES
-    GroupConstraints();
-    FILE* f = RESOURCE_MANAGER.OpenWriteFile(filename);
-
-    // note, for the constraints, just save a u16 particle index
-    vector<u16> data;
-    data.reserve(_constraints.size() * 2);
-    for (const Constraint& c : _constraints)
-    {
-      data.push_back((u16)c.idx0);
-      data.push_back((u16)c.idx1);
-    }
-    RESOURCE_MANAGER.WriteFile(f, (int)_constraints.size());
-    RESOURCE_MANAGER.WriteFile(f, (const char*)&data[0], (int)(data.size() * sizeof(u16)));
-    RESOURCE_MANAGER.CloseFile(f);
-
-    // apply the constaint fixup
-    for (Constraint& c : _constraints)
-    {
-      c.p0 = &_clothParticles[c.idx0];
-      c.p1 = &_clothParticles[c.idx1];
-    }
-#endif
-  }
-
+  CreateConstraints();
 
   return true;
 }
 
 //------------------------------------------------------------------------------
-void Credits::GroupConstraints()
+void Credits::CreateConstraints()
 {
   int dimX = _clothDimX;
   int dimY = _clothDimY;
+  vector<VerletSystem::Constraint> constraints;
 
   // create cloth constraints
   // each particle is connected horiz, vert and diag (both 1 and 2 steps away)
@@ -354,7 +251,7 @@ void Credits::GroupConstraints()
     for (int j = 0; j < dimX; ++j)
     {
       u32 idx0 = i*dimX + j;
-      vec3* p0 = &_clothParticles[idx0].pos;
+      vec3* p0 = &_cloth._particles[idx0].pos;
 
       static int ofs[] = {
         -1, +0,
@@ -377,100 +274,15 @@ void Credits::GroupConstraints()
             continue;
 
           u32 idx1 = yy*dimX + xx;
-          vec3* p1 = &_clothParticles[idx1].pos;
+          vec3* p1 = &_cloth._particles[idx1].pos;
 
-          _constraints.push_back(Constraint(idx0, idx1, Distance(*p0, *p1)));
+          constraints.push_back({idx0, idx1, Distance(*p0, *p1)});
         }
       }
     }
   }
 
-#if 1
-  // make num constraints a multiple of 4
-  for (int i = 0; i < (_constraints.size() & 3); ++i)
-  {
-    _constraints.push_back(Constraint(0, 0, 0));
-  }
-
-  // reorder the constaints so no group of 4 refers to the same particles
-  // this allows us to process the whole block at once
-  int numConstraints = (int)_constraints.size();
-  int numChunks = (numConstraints / 4);
-  vector<u32> used(numConstraints);
-  vector<int> order(numConstraints);
-  memset(used.data(), 0xff, numConstraints * sizeof(u32));
-
-  vector<int> unmatched;
-  for (int i = 0; i < numChunks; ++i)
-  {
-    u32 curChunk[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
-    for (int j = 0; j < 4; ++j)
-    {
-      // find first unused constraint whose particles aren't used in the chunk
-      int constraintIdx = -1;
-      int ofs = 0;
-      for (int k = 0; k < numConstraints; ++k)
-      {
-        int idx = (k + ofs) % numConstraints;
-        if (used[idx] != 0xffffffff)
-          continue;
-
-        bool found = true;
-        for (int cc = 0; cc < j * 2; ++cc)
-        {
-          if (_constraints[idx].idx0 == curChunk[cc] || _constraints[idx].idx1 == curChunk[cc])
-          {
-            found = false;
-            break;
-          }
-        }
-
-        if (found)
-        {
-          constraintIdx = idx;
-          break;
-        }
-      }
-
-      if (constraintIdx == -1)
-      {
-        // we've found constraints that can't be done in parallell, so store them
-        for (int k = 0; k < numConstraints; ++k)
-        {
-          if (used[k] == 0xffffffff || used[k] == i)
-          {
-            // unassigned constraint
-            unmatched.push_back(k);
-            used[k] = ~0xffffffff;
-          }
-        }
-        goto DONE;
-      }
-
-      // store which chunk the constraint was used in
-      used[constraintIdx] = i;
-      curChunk[j * 2 + 0] = _constraints[constraintIdx].idx0;
-      curChunk[j * 2 + 1] = _constraints[constraintIdx].idx1;
-
-      // found a constraint to use
-      order[i * 4 + j] = constraintIdx;
-    }
-  }
-DONE:
-
-  // reorder the constraints
-  vector<Constraint> reorderedConstraints;
-  reorderedConstraints.reserve(numConstraints);
-
-  for (int i = 0; i < numConstraints; ++i)
-  {
-    if (order[i] == 0xffffffff)
-      continue;
-    reorderedConstraints.push_back(_constraints[order[i]]);
-  }
-
-  _constraints.swap(reorderedConstraints);
-#endif
+  _cloth.SetConstraints(constraints.data(), (int)constraints.size());
 }
 
 //------------------------------------------------------------------------------
@@ -482,7 +294,7 @@ void Credits::ResetParticles()
 
   vec3 org(-CLOTH_SIZE / 2.f, CLOTH_SIZE / 2.f, 0);
   vec3 cur = org;
-  ClothParticle* p = &_clothParticles[0];
+  VerletSystem::Particle* p = _cloth._particles.data();
 
   for (int i = 0; i < _clothDimY; ++i)
   {
@@ -529,29 +341,24 @@ void Credits::InitParticleSpline(const vector<int>& indices)
 
   for (int i : indices)
   {
-    float s = RANDOM_150.Next(angleSpeed, angleSpeedVar);
+    float s = _random150.Next(angleSpeed, angleSpeedVar);
     if (s == 0.f)
       s += 0.001f;
 
     _particleState[i] = ParticleState{
-      RANDOM_150.Next(speed, speedVar),
+      _random150.Next(speed, speedVar),
       -width,
-      RANDOM_150.Next(height, heightVar),
-      RANDOM_150.Next(DirectX::XM_2PI, angleVar),
+      _random150.Next(height, heightVar),
+      _random150.Next(DirectX::XM_2PI, angleVar),
       XM_2PI / s,
       0,
-      RANDOM_150.Next(fadeSpeed, fadeSpeedVar)};
+      _random150.Next(fadeSpeed, fadeSpeedVar)};
   }
 }
 
 //------------------------------------------------------------------------------
 void Credits::UpdateParticleSpline(float dt)
 {
-  if (g_Blackboard->IsDirtyTrigger(this))
-  {
-    ResetParticleSpline();
-  }
-
   float width = SCRATCH_GET_FLOAT(credits, waveWidth);
 
   vector<int> deadParticles;
@@ -575,6 +382,18 @@ void Credits::UpdateParticleSpline(float dt)
   }
 }
 
+//------------------------------------------------------------------------------
+void Credits::PreUpdate()
+{
+  // the blackboard's dirty set is shared between effects, so check it before the update
+  if (g_Blackboard->IsDirtyTrigger(this))
+  {
+    ResetParticleSpline();
+  }
+
+  _pushCloth = TANO.GetIoState().keysPressed['1'];
+}
+
 //------------------------------------------------------------------------------
 bool Credits::Update(const UpdateState& state)
 {
@@ -621,16 +440,19 @@ bool Credits::Render()
 
   {
     // particles
-    ObjectHandle h = _particleBundle.objects._vb;
-    vec4* vtx = _ctx->MapWriteDiscard<vec4>(h);
-    memcpy(vtx, _particles.data(), (int)_particles.size() * sizeof(vec4));
-    _ctx->Unmap(h);
-
-    // Render particles
-    _cbParticle.Set(_ctx, 0);
-    _ctx->SetBundleWithSamplers(_particleBundle, PixelShader);
-    _ctx->SetShaderResource(_particleTexture);
-    _ctx->Draw((int)_particles.size(), 0);
+    UploadRange range;
+    if (vec4* vtx = g_DynamicVertices.Map<vec4>(_ctx, (u32)_particles.size(), &range))
+    {
+      memcpy(vtx, _particles.data(), (int)_particles.size() * sizeof(vec4));
+      g_DynamicVertices.Unmap(_ctx, range);
+
+      // Render particles
+      _cbParticle.Set(_ctx, 0);
+      _ctx->SetBundleWithSamplers(_particleBundle, PixelShader);
+      _ctx->SetVertexBuffer(range.handle);
+      _ctx->SetShaderResource(_particleTexture);
+      _ctx->Draw((int)_particles.size(), range.firstElement);
+    }
   }
 
   ScopedRenderTarget rtText(DXGI_FORMAT_R11G11B10_FLOAT);
@@ -8,6 +8,8 @@
 #include "../camera.hpp"
 #include "../scene.hpp"
 #include "../tano_math.hpp"
+#include "../verlet.hpp"
+#include "../random.hpp"
 #include "../shaders/out/credits.particle_gsparticle.cbuffers.hpp"
 #include "../shaders/out/credits.composite_pscomposite.cbuffers.hpp"
 #include "../shaders/out/credits.background_psbackground.cbuffers.hpp"
@@ -25,6 +27,8 @@ namespace tano
     virtual bool Init() override;
     virtual bool Update(const UpdateState& state) override;
     virtual bool FixedUpdate(const FixedUpdateState& state) override;
+    virtual bool ThreadSafeUpdate() const override { return true; }
+    virtual void PreUpdate() override;
     virtual bool Render() override;
     virtual bool Close() override;
     virtual const char* GetName() { return Name(); }
@@ -47,35 +51,12 @@ namespace tano
     void UpdateParticles(const FixedUpdateState& state);
     bool InitParticles();
     void ResetParticles();
-    void GroupConstraints();
+    void CreateConstraints();
 
     void ResetParticleSpline();
     void UpdateParticleSpline(float dt);
     void InitParticleSpline(const vector<int>& indices);
 
-    struct ClothParticle
-    {
-      vec3 pos;
-      vec3 lastPos;
-      vec3 acc;
-    };
-
-    struct Constraint
-    {
-      Constraint() {}
-      Constraint(u32 idx0, u32 idx1, float length) : idx0(idx0), idx1(idx1), restLength(length) {}
-      union {
-        ClothParticle* p0;
-        u32 idx0;
-      };
-      union {
-        ClothParticle* p1;
-        u32 idx1;
-      };
-
-      float restLength;
-    };
-
     struct ParticleState
     {
       float speed;
@@ -88,11 +69,14 @@ namespace tano
     };
 
     vector<ParticleState> _particleState;
+    // per instance, as InitParticleSpline runs from the (possibly threaded) update
+    RandomGauss150 _random150;
 
     vector<vec4> _particles;
 
-    vector<ClothParticle> _clothParticles;
-    vector<Constraint> _constraints;
+    // The cloth is disabled, as FixedUpdate doesn't call UpdateParticles
+    VerletSystem _cloth;
+    bool _pushCloth = false;
 
     ConstantBufferBundle<void, void, cb::CreditsParticleF> _cbParticle;
 
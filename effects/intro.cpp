@@ -29,10 +29,6 @@ namespace
   float height = 0;
   float distance = 1300;
   bool extended = true;
-
-  static int MAX_NUM_PARTICLES = 10000;
-  static int VB_FRAMES = 3;
-  static int VB_INDEX = 0;
 }
 
 //------------------------------------------------------------------------------
@@ -52,8 +48,7 @@ Intro::~Intro()
 //------------------------------------------------------------------------------
 bool Intro::OnConfigChanged(const vector<char>& buf)
 {
-  _settings = ParseIntroSettings(InputBuffer(buf));
-  return true;
+  return ParseSettings(buf, &_settings, ParseIntroSettings);
 }
 
 //------------------------------------------------------------------------------
@@ -80,7 +75,6 @@ bool Intro::Init()
     .PixelShader("shaders/out/intro.particle", "PsParticle")
     .InputElement(CD3D11_INPUT_ELEMENT_DESC("POSITION", DXGI_FORMAT_R32G32B32A32_FLOAT))
     .Topology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST)
-    .DynamicVb(VB_FRAMES * MAX_NUM_PARTICLES, sizeof(vec4))
     .DepthStencilDesc(depthDescDepthDisabled)
     .BlendDesc(blendDescPreMultipliedAlpha)
     .RasterizerDesc(rasterizeDescCullNone)));
@@ -101,7 +95,7 @@ bool Intro::Init()
   for (int i = 0; i < 20; ++i)
   {
     _particleEmitters.Append(RadialParticleEmitter())
-        .Create(vec3(0, 0, 0), 25.f * (i + 1), _settings.num_particles);
+        .Create(vec3(0, 0, 0), 25.f * (i + 1), _settings.num_particles, i);
   }
 
   // Generic setup
@@ -212,42 +206,36 @@ void Intro::CopyOutParticleEmitters()
 
   typedef RadialParticleEmitter::EmitterKernelData EmitterKernelData;
 
-  ObjectHandle vb = _particleBundle.objects._vb;
+  _numSpawnedParticles = 0;
+  for (int i = 0; i < _particleEmitters.Size(); ++i)
+    _numSpawnedParticles += _particleEmitters[i]._spawnedParticles;
 
-  D3D11_MAPPED_SUBRESOURCE res;
-  D3D11_MAP m = D3D11_MAP_WRITE_NO_OVERWRITE;
-  if (VB_INDEX == VB_FRAMES)
+  // reserve space for all the emitters, and let each task write its own part
+  vec4* vtx = g_DynamicVertices.Map<vec4>(_ctx, _numSpawnedParticles, &_particleRange);
+  if (!vtx)
   {
-    VB_INDEX = 0;
-    m = D3D11_MAP_WRITE_DISCARD;
+    _numSpawnedParticles = 0;
+    return;
   }
 
-  HRESULT hr = _ctx->Map(_particleBundle.objects._vb, 0, m, 0, &res);
-  // vec4* vtx = _ctx->MapWriteDiscard<vec4>(_particleBundle.objects._vb);
-  vec4* vtx = (vec4*)res.pData; //  _ctx->MapWriteDiscard<vec4>(_particleBundle.objects._vb);
-
   SimpleAppendBuffer<TaskId, 32> tasks;
 
-  _numSpawnedParticles = 0;
   for (int i = 0; i < _particleEmitters.Size(); ++i)
   {
     EmitterKernelData* data = g_ScratchMemory.Alloc<EmitterKernelData>(1);
-    *data = EmitterKernelData{&_particleEmitters[i],
-        0,
-        vtx + VB_INDEX * MAX_NUM_PARTICLES + i * _particleEmitters[i]._spawnedParticles};
+    *data = EmitterKernelData{&_particleEmitters[i], 0, vtx};
+    vtx += _particleEmitters[i]._spawnedParticles;
     KernelData kd;
     kd.data = data;
     kd.size = sizeof(RadialParticleEmitter::EmitterKernelData);
 
     tasks.Append(g_Scheduler->AddTask(kd, RadialParticleEmitter::CopyOutEmitter));
-
-    _numSpawnedParticles += _particleEmitters[i]._spawnedParticles;
   }
 
   for (const TaskId& taskId : tasks)
     g_Scheduler->Wait(taskId);
 
-  _ctx->Unmap(vb);
+  g_DynamicVertices.Unmap(_ctx, _particleRange);
 }
 
 //------------------------------------------------------------------------------
@@ -319,7 +307,11 @@ bool Intro::Render()
     _cbParticle.Set(_ctx, 0);
     _ctx->SetBundleWithSamplers(_particleBundle, PixelShader);
     _ctx->SetShaderResource(_particleTexture);
-    _ctx->Draw(_numSpawnedParticles, VB_INDEX * MAX_NUM_PARTICLES);
+    if (_particleRange.IsValid())
+    {
+      _ctx->SetVertexBuffer(_particleRange.handle);
+      _ctx->Draw(_numSpawnedParticles, _particleRange.firstElement);
+    }
   }
 
   ScopedRenderTarget rtText(DXGI_FORMAT_R11G11B10_FLOAT);
@@ -416,7 +408,6 @@ bool Intro::Render()
         &black);
   }
 
-  VB_INDEX += 1;
   return true;
 }
 
@@ -6,6 +6,7 @@
 #include "../text_writer.hpp"
 #include "../animation_helpers.hpp"
 #include "../append_buffer.hpp"
+#include "../upload_buffer.hpp"
 #include "../tano_math.hpp"
 #include "../camera.hpp"
 #include "../shaders/out/intro.background_psbackground.cbuffers.hpp"
@@ -77,6 +78,8 @@ namespace tano
     float _particlesStart, _particlesEnd;
 
     int _numSpawnedParticles = 0;
+    // this frame's particles, in the shared vertex upload buffer
+    UploadRange _particleRange;
 
     float _curTime = 0;
 
@@ -7,6 +7,7 @@
 #include "../init_sequence.hpp"
 #include "../generated/demo.parse.hpp"
 #include "../mesh_utils.hpp"
+#include "../mesh_optimizer.hpp"
 #include "../fullscreen_effect.hpp"
 #include "../debug_api.hpp"
 #include "../tano_math.hpp"
@@ -24,7 +25,6 @@ using namespace bristol;
 using namespace DirectX;
 
 static const vec3 ZERO3(0, 0, 0);
-static const float GRID_SIZE = 5;
 static const int MAX_CHUNKS = 750;
 static const float NOISE_HEIGHT = 50;
 static const float NOISE_SCALE_X = 0.01f;
@@ -32,6 +32,15 @@ static const float NOISE_SCALE_Z = 0.01f;
 
 static const float SPLINE_RADIUS = 500;
 
+// chunk prefetching looks PREFETCH_STEPS * PREFETCH_STEP_TIME seconds ahead
+static const int PREFETCH_STEPS = 2;
+static const float PREFETCH_STEP_TIME = 1.0f;
+static const int PREFETCH_RINGS = 2;
+static const int MAX_PREFETCH_PER_FRAME = 16;
+
+// Spline samples evaluated at a time by BehaviorPathFollow
+static const int PATH_FOLLOW_BLOCK = 256;
+
 struct FlockTiming
 {
   float time;
@@ -53,8 +62,7 @@ vector<FlockTiming> FLOCK_TIMING = {
 #define PROFILE_UPDATES 0
 
 int Landscape::Chunk::nextId = 1;
-
-static RandomInt RANDOM_INT;
+const float Landscape::GRID_SIZE = 5;
 
 //------------------------------------------------------------------------------
 void BehaviorSpacing::Update(const ParticleKinematics::UpdateParams& params)
@@ -71,8 +79,8 @@ void BehaviorSpacing::Update(const ParticleKinematics::UpdateParams& params)
   // pick a random number of points, and try to adjust their spacing
   for (int i = 0; i < numBodies; ++i)
   {
-    int a = RANDOM_INT.Next() % numBodies;
-    int b = RANDOM_INT.Next() % numBodies;
+    int a = random.Next() % numBodies;
+    int b = random.Next() % numBodies;
 
     float dist = Distance(pos[a], pos[b]);
     if (dist > 0.f)
@@ -94,25 +102,29 @@ void BehaviorPathFollow::Update(const UpdateParams& params)
 {
   if (_splineOffset.empty())
   {
+    // sample the spline once, and find the closest sample for each body
+    float dt = 1 / 10.f;
+    float end = (float)_spline._controlPoints.size();
+    int numSamples = (int)(end / dt) + 1;
+    vector<float> sampleT(numSamples);
+    vector<vec3> samplePos(numSamples);
+    for (int j = 0; j < numSamples; ++j)
+      sampleT[j] = j * dt;
+    _spline.InterpolateArcLength(sampleT.data(), numSamples, samplePos.data());
+
     _splineOffset.resize(params.bodies->numBodies);
     for (int i = 0; i < params.bodies->numBodies; ++i)
     {
-      float t = 0;
-      float dt = 1 / 10.f;
-      float end = (float)_spline._controlPoints.size();
-
       float closestDist = FLT_MAX;
       float closestT = 0;
-      while (t < end)
+      for (int j = 0; j < numSamples; ++j)
       {
-        float cand = Distance(params.bodies->pos[i], _spline.Interpolate(t));
+        float cand = DistanceSquared(params.bodies->pos[i], samplePos[j]);
         if (cand < closestDist)
         {
           closestDist = cand;
-          closestT = t;
+          closestT = sampleT[j];
         }
-
-        t += dt;
       }
 
       _splineOffset[i] = closestT;
@@ -125,14 +137,21 @@ void BehaviorPathFollow::Update(const UpdateParams& params)
   int numBodies = params.bodies->numBodies;
   float maxSpeed = params.p->_maxSpeed;
 
-  for (int i = params.start; i < params.end; ++i)
+  vec3 targets[PATH_FOLLOW_BLOCK];
+  for (int start = params.start; start < params.end; start += PATH_FOLLOW_BLOCK)
   {
-    float t = _splineOffset[i];
-    vec3 desiredVel = maxSpeed * Normalize(_spline.Interpolate(t) - pos[i]);
-    //force[i] += params.weight * ClampVector(desiredVel - vel[i], maxForce);
-    force[i] += params.weight * (desiredVel - vel[i]);
+    int num = min(PATH_FOLLOW_BLOCK, params.end - start);
+    _spline.InterpolateArcLength(&_splineOffset[start], num, targets);
 
-    _splineOffset[i] += 0.005f;
+    for (int j = 0; j < num; ++j)
+    {
+      int i = start + j;
+      vec3 desiredVel = maxSpeed * Normalize(targets[j] - pos[i]);
+      //force[i] += params.weight * ClampVector(desiredVel - vel[i], maxForce);
+      force[i] += params.weight * (desiredVel - vel[i]);
+
+      _splineOffset[i] += 0.005f;
+    }
   }
 }
 
@@ -154,6 +173,7 @@ Landscape::Flock::Flock(const BoidSettings& settings, const CardinalSpline& spli
 Landscape::Flock::~Flock()
 {
   SAFE_DELETE(seek);
+  SAFE_DELETE(spacing);
 }
 
 //------------------------------------------------------------------------------
@@ -170,8 +190,7 @@ Landscape::~Landscape()
 //------------------------------------------------------------------------------
 bool Landscape::OnConfigChanged(const vector<char>& buf)
 {
-  _settings = ParseLandscapeSettings(InputBuffer(buf));
-  return true;
+  return ParseSettings(buf, &_settings, ParseLandscapeSettings);
 }
 
 //------------------------------------------------------------------------------
@@ -200,15 +219,21 @@ bool Landscape::Init()
 
   // clang-format off
 
-  vector<u32> lowerIndices, upperIndices;
-  for (int i = 0; i < MAX_CHUNKS; ++i)
-  {
-    GeneratePlaneIndices(
-      NUM_CHUNK_VERTS, NUM_CHUNK_VERTS, i * NUM_CHUNK_VERTS * NUM_CHUNK_VERTS, &lowerIndices);
+  // All the chunks share the same topology, so cache optimize a single chunk, and
+  // replicate it. The vertex order is fixed by FillChunk, so only the triangles move
+  vector<u32> lowerChunkIndices, upperChunkIndices;
+  GeneratePlaneIndices(NUM_CHUNK_VERTS, NUM_CHUNK_VERTS, 0, &lowerChunkIndices);
+  GeneratePlaneIndices(UPPER_NUM_CHUNK_VERTS, UPPER_NUM_CHUNK_VERTS, 0, &upperChunkIndices);
 
-    GeneratePlaneIndices(
-      UPPER_NUM_CHUNK_VERTS, UPPER_NUM_CHUNK_VERTS, i * UPPER_NUM_CHUNK_VERTS * UPPER_NUM_CHUNK_VERTS, &upperIndices);
-  }
+  float acmrBefore = CalcAcmr(lowerChunkIndices.data(), (u32)lowerChunkIndices.size());
+  OptimizeVertexCache(lowerChunkIndices.data(), (u32)lowerChunkIndices.size(), Chunk::LOWER_VERTS);
+  OptimizeVertexCache(upperChunkIndices.data(), (u32)upperChunkIndices.size(), Chunk::UPPER_VERTS);
+  float acmrAfter = CalcAcmr(lowerChunkIndices.data(), (u32)lowerChunkIndices.size());
+  LOG_INFO("Landscape chunk ACMR before: ", acmrBefore, ", after: ", acmrAfter);
+
+  vector<u32> lowerIndices, upperIndices;
+  ReplicateIndices(lowerChunkIndices, MAX_CHUNKS, Chunk::LOWER_VERTS, &lowerIndices);
+  ReplicateIndices(upperChunkIndices, MAX_CHUNKS, Chunk::UPPER_VERTS, &upperIndices);
 
   // Blend desc that doesn't write to the emissive channel
   CD3D11_BLEND_DESC blendDescAlphaNoEmissive = blendDescBlendSrcAlpha;
@@ -220,7 +245,6 @@ bool Landscape::Init()
   blendDescNoEmissive.RenderTarget[1].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALPHA;
 
   INIT(_landscapeLowerBundle.Create(BundleOptions()
-    .DynamicVb(MAX_CHUNKS * Chunk::LOWER_VERTS, sizeof(vec3))
     .StaticIb(lowerIndices)
     .VertexShader("shaders/out/landscape.lower", "VsLandscape")
     .GeometryShader("shaders/out/landscape.lower", "GsLandscape")
@@ -229,7 +253,6 @@ bool Landscape::Init()
     .BlendDesc(blendDescNoEmissive)));
 
   INIT(_landscapeUpperBundle.Create(BundleOptions()
-    .DynamicVb(MAX_CHUNKS * Chunk::UPPER_VERTS, sizeof(vec3))
     .StaticIb(upperIndices)
     .VertexShader("shaders/out/landscape.landscape", "VsLandscape")
     .GeometryShader("shaders/out/landscape.landscape", "GsLandscape")
@@ -251,7 +274,6 @@ bool Landscape::Init()
     .PixelShader("shaders/out/landscape.lensflare", "PsLensFlare")));
 
   INIT(_particleBundle.Create(BundleOptions()
-    .DynamicVb(1024 * 1024, sizeof(vec3))
     .VertexShader("shaders/out/landscape.particle", "VsParticle")
     .GeometryShader("shaders/out/landscape.particle", "GsParticle")
     .PixelShader("shaders/out/landscape.particle", "PsParticle")
@@ -261,7 +283,6 @@ bool Landscape::Init()
     .BlendDesc(blendDescBlendOneOne)));
 
   INIT(_boidsBundle.Create(BundleOptions()
-    .DynamicVb(1024 * 1024, sizeof(vec3))
     .VertexShader("shaders/out/landscape.boids", "VsParticle")
     .GeometryShader("shaders/out/landscape.boids", "GsParticle")
     .PixelShader("shaders/out/landscape.boids", "PsParticle")
@@ -286,6 +307,7 @@ bool Landscape::Init()
   const BoidSettings& b = _settings.boids;
 
   _flockCamera.flock = _flocks[0];
+  _prevCameraPos = _curCamera->_pos;
 
   {
     FixedUpdateState state;
@@ -313,7 +335,6 @@ void Landscape::InitBoids()
   _behaviorSeparataion = new BehaviorSeparataion(b.separation_distance);
   _behaviorCohesion = new BehaviorCohesion(b.cohesion_distance);
   _behaviorLandscapeFollow = new BehaviorLandscapeFollow();
-  _behaviorSpacing = new BehaviorSpacing();
 
   float clearance = g_Blackboard->GetFloatVar("landscape.clearance");
 
@@ -348,7 +369,8 @@ void Landscape::InitBoids()
 
     flock->boids.AddKinematics(_behaviorLandscapeFollow, _settings.boids.follow_scale / sum);
     flock->boids.AddKinematics(flock->follow, b.wander_scale / sum);
-    flock->boids.AddKinematics(_behaviorSpacing, b.cohesion_scale / sum);
+    flock->spacing = new BehaviorSpacing(Philox::DEFAULT_SEED, i);
+    flock->boids.AddKinematics(flock->spacing, b.cohesion_scale / sum);
 
     int pointIdx = _randomInt.Next() % _spline._controlPoints.size();
 
@@ -427,7 +449,7 @@ void Landscape::UpdateBoids(const FixedUpdateState& state)
   SimpleAppendBuffer<TaskId, 2048> chunkTasks;
 
   vec3 splineTarget =
-      _spline.Interpolate(state.localTime.TotalSecondsAsFloat() * _settings.spline_speed);
+      _spline.InterpolateArcLength(state.localTime.TotalSecondsAsFloat() * _settings.spline_speed);
   for (Flock* flock : _flocks)
   {
     FlockKernelData* data = (FlockKernelData*)g_ScratchMemory.Alloc(sizeof(FlockKernelData));
@@ -446,7 +468,7 @@ void Landscape::UpdateBoids(const FixedUpdateState& state)
 bool Landscape::Update(const UpdateState& state)
 {
   float t = state.localTime.TotalSecondsAsFloat();
-  vec3 pp = _spline.Interpolate(t * _settings.spline_speed);
+  vec3 pp = _spline.InterpolateArcLength(t * _settings.spline_speed);
 
   vec3 sunDir = Normalize(g_Blackboard->GetVec3Var("landscape.sunDir"));
   _cbLandscape.ps0.sunDir = sunDir;
@@ -499,6 +521,10 @@ bool Landscape::FixedUpdate(const FixedUpdateState& state)
         _flockCamera._pos.x += _random.Next(-20, 20);
         _flockCamera._pos.y += _random.Next(5, 10);
         _flockCamera._pos.z += _random.Next(5, 20);
+
+        // the camera jumps to the new flock, so restart the velocity estimate
+        _prevCameraPos = _flockCamera._pos;
+        _cameraVel = vec3(0, 0, 0);
       }
       else
       {
@@ -521,20 +547,24 @@ bool Landscape::FixedUpdate(const FixedUpdateState& state)
   }
 
   _curCamera->Update(state.delta);
+
+  // track a smoothed camera velocity for the chunk prefetching
+  _localTime = state.localTime.TotalSecondsAsFloat();
+  vec3 pos = _curCamera->_pos;
+  if (state.delta > 0)
+    _cameraVel = lerp(_cameraVel, (1 / state.delta) * (pos - _prevCameraPos), 0.1f);
+  _prevCameraPos = pos;
   return true;
 }
 
 //------------------------------------------------------------------------------
-void Landscape::UpdateCameraMatrix(const UpdateState& state)
+void Landscape::PreUpdate()
 {
-  const IoState& ioState = TANO.GetIoState();
-
 #if WITH_IMGUI
-  static bool drawForces = false;
   if (g_KeyUpTrigger.IsTriggered('6'))
-    drawForces = !drawForces;
+    _drawForces = !_drawForces;
 
-  if (drawForces)
+  if (_drawForces)
     _flocks[0]->boids.DrawForcePlot();
 #endif
 
@@ -546,6 +576,12 @@ void Landscape::UpdateCameraMatrix(const UpdateState& state)
 
   if (g_KeyUpTrigger.IsTriggered('9'))
     _drawFlags ^= DrawParticles;
+}
+
+//------------------------------------------------------------------------------
+void Landscape::UpdateCameraMatrix(const UpdateState& state)
+{
+  const IoState& ioState = TANO.GetIoState();
 
   Matrix view = _curCamera->_view;
   Matrix proj = _curCamera->_proj;
@@ -580,7 +616,8 @@ void Landscape::UpdateCameraMatrix(const UpdateState& state)
 #if DEBUG_DRAW_PATH
   DEBUG_API.SetTransform(Matrix::Identity(), viewProj);
   float t = state.localTime.TotalSecondsAsFloat();
-  DEBUG_API.AddDebugSphere(_spline.Interpolate(t * _settings.spline_speed), 10, Color(1, 1, 1));
+  DEBUG_API.AddDebugSphere(
+      _spline.InterpolateArcLength(t * _settings.spline_speed), 10, Color(1, 1, 1));
 #endif
 }
 
@@ -604,39 +641,120 @@ inline void CopyPosNormal(float* buf, const vec3& v, const vec3& n)
 }
 
 //------------------------------------------------------------------------------
-inline float SnapUp(float v, float snapSize)
+Landscape::ChunkCache::ChunkCache()
 {
-  return snapSize * ceilf(v / snapSize);
-};
+  for (int i = 0; i < HASH_SIZE; ++i)
+    _lookup[i] = -1;
+}
 
 //------------------------------------------------------------------------------
-inline float SnapDown(float v, float snapSize)
+u32 Landscape::ChunkCache::HashKey(int cx, int cz)
 {
-  return snapSize * floorf(v / snapSize);
-};
+  u32 h = (u32)cx * 0x9e3779b1 ^ (u32)cz * 0x85ebca77;
+  return h ^ (h >> 16);
+}
 
 //------------------------------------------------------------------------------
-Landscape::Chunk* Landscape::ChunkCache::FindChunk(float x, float y, int timestamp)
+int Landscape::ChunkCache::FindSlot(int cx, int cz) const
 {
-  auto it = _chunkLookup.find(make_pair(x, y));
-  if (it == _chunkLookup.end())
-    return nullptr;
+  // Returns the slot holding the chunk, or the empty slot where it should go
+  int slot = HashKey(cx, cz) & (HASH_SIZE - 1);
+  while (_lookup[slot] != -1)
+  {
+    const Chunk& chunk = _cache[_lookup[slot]];
+    if (chunk.cx == cx && chunk.cz == cz)
+      break;
+    slot = (slot + 1) & (HASH_SIZE - 1);
+  }
+  return slot;
+}
+
+//------------------------------------------------------------------------------
+void Landscape::ChunkCache::RemoveFromLookup(const Chunk* chunk)
+{
+  int i = FindSlot(chunk->cx, chunk->cz);
+  assert(_lookup[i] == chunk - _cache);
+  _lookup[i] = -1;
+
+  // Backward shift deletion, so the following entries in the probe sequence can still
+  // be found without needing tombstones
+  int j = i;
+  while (true)
+  {
+    j = (j + 1) & (HASH_SIZE - 1);
+    if (_lookup[j] == -1)
+      break;
+
+    const Chunk& cur = _cache[_lookup[j]];
+    int k = HashKey(cur.cx, cur.cz) & (HASH_SIZE - 1);
+
+    // leave the entry if its home slot lies cyclically in (i, j]
+    bool inRange = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+    if (inRange)
+      continue;
+
+    _lookup[i] = _lookup[j];
+    _lookup[j] = -1;
+    i = j;
+  }
+}
+
+//------------------------------------------------------------------------------
+void Landscape::ChunkCache::Unlink(Chunk* chunk)
+{
+  if (chunk->prev)
+    chunk->prev->next = chunk->next;
+  else
+    _head = chunk->next;
+
+  if (chunk->next)
+    chunk->next->prev = chunk->prev;
+  else
+    _tail = chunk->prev;
+
+  chunk->prev = chunk->next = nullptr;
+}
+
+//------------------------------------------------------------------------------
+void Landscape::ChunkCache::PushFront(Chunk* chunk)
+{
+  chunk->prev = nullptr;
+  chunk->next = _head;
+  if (_head)
+    _head->prev = chunk;
+  else
+    _tail = chunk;
+  _head = chunk;
+}
 
-  // because we don't delete chunks when they're overwritten, this might not be
-  // the chunk we're looking for!
-  Chunk* chunk = it->second;
-  if (chunk->x != x || chunk->y != y)
+//------------------------------------------------------------------------------
+Landscape::Chunk* Landscape::ChunkCache::FindChunk(int cx, int cz)
+{
+  int slot = FindSlot(cx, cz);
+  if (_lookup[slot] == -1)
   {
-    _chunkLookup.erase(it);
+    _stats.misses++;
     return nullptr;
   }
 
-  chunk->lastAccessed = timestamp;
+  _stats.hits++;
+  Chunk* chunk = &_cache[_lookup[slot]];
+  if (chunk != _head)
+  {
+    Unlink(chunk);
+    PushFront(chunk);
+  }
   return chunk;
 }
 
 //------------------------------------------------------------------------------
-Landscape::Chunk* Landscape::ChunkCache::GetFreeChunk(float x, float y, int timestamp)
+bool Landscape::ChunkCache::HasChunk(int cx, int cz) const
+{
+  return _lookup[FindSlot(cx, cz)] != -1;
+}
+
+//------------------------------------------------------------------------------
+Landscape::Chunk* Landscape::ChunkCache::GetFreeChunk(int cx, int cz, float chunkSize)
 {
   Chunk* chunk;
   if (_used < CACHE_SIZE)
@@ -645,27 +763,44 @@ Landscape::Chunk* Landscape::ChunkCache::GetFreeChunk(float x, float y, int time
   }
   else
   {
-    // cache is full, so replace the oldest element
-    int oldestValue = _cache[0].lastAccessed;
-    chunk = &_cache[0];
-    for (int i = 1; i < CACHE_SIZE; ++i)
-    {
-      if (_cache[i].lastAccessed < oldestValue)
-      {
-        oldestValue = _cache[i].lastAccessed;
-        chunk = &_cache[i];
-      }
-    }
+    // cache is full, so recycle the least recently used chunk
+    _stats.evictions++;
+    chunk = _tail;
+    RemoveFromLookup(chunk);
+    Unlink(chunk);
+
+    // make sure a prefetch task isn't still writing to it
+    if (chunk->pending)
+      g_Scheduler->Wait(chunk->fillTask);
   }
 
-  chunk->x = x;
-  chunk->y = y;
+  chunk->pending = false;
+  chunk->cx = cx;
+  chunk->cz = cz;
+  chunk->x = cx * chunkSize;
+  chunk->y = cz * chunkSize;
   float ofs = HALF_CHUNK_SIZE * GRID_SIZE;
-  chunk->center = vec3(x + ofs, 0, y - ofs);
-  chunk->lastAccessed = timestamp;
-  _chunkLookup[make_pair(x, y)] = chunk;
+  chunk->center = vec3(chunk->x + ofs, 0, chunk->y - ofs);
+
+  _lookup[FindSlot(cx, cz)] = (int)(chunk - _cache);
+  PushFront(chunk);
   return chunk;
 }
+
+
+//------------------------------------------------------------------------------
+void Landscape::ChunkCache::FlushPending()
+{
+  for (Chunk* chunk = _head; chunk; chunk = chunk->next)
+  {
+    if (chunk->pending)
+    {
+      g_Scheduler->Wait(chunk->fillTask);
+      chunk->pending = false;
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 void Landscape::CopyOutTask(const scheduler::TaskData& data)
 {
@@ -677,19 +812,40 @@ void Landscape::CopyOutTask(const scheduler::TaskData& data)
   memcpy(kernelData->particleBuf, chunk->upperData, Chunk::UPPER_VERTS * sizeof(vec3));
 }
 
+//------------------------------------------------------------------------------
+TaskId Landscape::QueueFillChunk(Chunk* chunk, TaskPriority priority)
+{
+  // The chunk itself is the kernel data, as prefetch tasks can outlive the frame's
+  // scratch memory
+  KernelData kd;
+  kd.data = chunk;
+  kd.size = sizeof(Chunk);
+  return g_Scheduler->AddTask(kd, FillChunk, priority);
+}
+
 //------------------------------------------------------------------------------
 void Landscape::FillChunk(const TaskData& data)
 {
-  ChunkKernelData* chunkData = (ChunkKernelData*)data.kernelData.data;
-  Chunk* chunk = chunkData->chunk;
-  float x = chunkData->x;
-  float z = chunkData->z;
+  Chunk* chunk = (Chunk*)data.kernelData.data;
+  float x = chunk->x;
+  float z = chunk->y;
 
   vec3 v0, v1, v2, v3;
   vec3 n0, n1;
 
-  // first compute the noise values
+  // first compute the noise values. The grid is evaluated in one batch, which
+  // matches NoiseAtPoint up to the rounding of the sample coordinates
+  float heights[NUM_CHUNK_VERTS * NUM_CHUNK_VERTS];
+  Perlin2D::ValueGrid(NOISE_SCALE_X * x,
+      NOISE_SCALE_Z * (z - GRID_SIZE),
+      NOISE_SCALE_X * GRID_SIZE,
+      NOISE_SCALE_Z * GRID_SIZE,
+      NUM_CHUNK_VERTS,
+      NUM_CHUNK_VERTS,
+      heights);
+
   vec3* noise = chunk->noiseValues;
+  const float* height = heights;
   for (int i = 0; i < NUM_CHUNK_VERTS; ++i)
   {
     for (int j = 0; j < NUM_CHUNK_VERTS; ++j)
@@ -697,7 +853,7 @@ void Landscape::FillChunk(const TaskData& data)
       float xx0 = x + (j + 0) * GRID_SIZE;
       float zz0 = z + (i - 1) * GRID_SIZE;
       noise->x = xx0;
-      noise->y = NoiseAtPoint(vec3{xx0, 0, zz0});
+      noise->y = NOISE_HEIGHT * *height++;
       noise->z = zz0;
       ++noise;
     }
@@ -727,7 +883,6 @@ void Landscape::FillChunk(const TaskData& data)
 //------------------------------------------------------------------------------
 void Landscape::RasterizeLandscape()
 {
-  _curTick++;
   rmt_ScopedCPUSample(Landscape_Rasterize);
 
   // Create a large rect around the camera, and clip it using the camera planes
@@ -761,46 +916,37 @@ void Landscape::RasterizeLandscape()
     maxPos = Max(maxPos, buf0[i]);
   }
 
-  // create a AABB for the clipped polygon
+  // create a AABB for the clipped polygon, in chunk coordinates
   float s = GRID_SIZE * NUM_CHUNK_QUADS;
-  vec3 topLeft(SnapDown(minPos.x, s), 0, SnapUp(maxPos.z, s));
-  vec3 topRight(SnapUp(maxPos.x, s), 0, SnapUp(maxPos.z, s));
-  vec3 bottomLeft(SnapDown(minPos.x, s), 0, SnapDown(minPos.z, s));
-  vec3 bottomRight(SnapUp(maxPos.x, s), 0, SnapDown(minPos.z, s));
-
-  float x = topLeft.x;
-  float z = topLeft.z;
-  int chunkHits = 0;
-  int chunkMisses = 0;
-
-  vec3 v0, v1, v2, v3;
-  vec3 n0, n1;
+  int x0 = (int)floorf(minPos.x / s);
+  int x1 = (int)ceilf(maxPos.x / s);
+  int z0 = (int)floorf(minPos.z / s);
+  int z1 = (int)ceilf(maxPos.z / s);
 
   SimpleAppendBuffer<TaskId, 2048> chunkTasks;
 
   SimpleAppendBuffer<Chunk*, 2048> chunks;
 
-  for (float z = bottomLeft.z; z <= topLeft.z; z += s)
+  for (int cz = z0; cz <= z1; ++cz)
   {
-    for (float x = bottomLeft.x; x <= bottomRight.x; x += s)
+    for (int cx = x0; cx <= x1; ++cx)
     {
       // check if the current chunk exists in the cache
-      Chunk* chunk = _chunkCache.FindChunk(x, z, _curTick);
-      if (chunk)
+      Chunk* chunk = _chunkCache.FindChunk(cx, cz);
+      if (!chunk)
       {
-        ++chunkHits;
+        chunk = _chunkCache.GetFreeChunk(cx, cz, s);
+        chunkTasks.Append(QueueFillChunk(chunk, TaskPriority::Normal));
       }
-      else
+      else if (chunk->pending)
       {
-        ++chunkMisses;
-        chunk = _chunkCache.GetFreeChunk(x, z, _curTick);
-
-        ChunkKernelData* data = (ChunkKernelData*)g_ScratchMemory.Alloc(sizeof(ChunkKernelData));
-        *data = ChunkKernelData{chunk, x, z};
-        KernelData kd;
-        kd.data = data;
-        kd.size = sizeof(ChunkKernelData);
-        chunkTasks.Append(g_Scheduler->AddTask(kd, FillChunk));
+        // prefetched, but the task might not have been run yet
+        if (!g_Scheduler->IsTaskFinished(chunk->fillTask))
+        {
+          _chunkCache._stats.prefetchWaits++;
+          chunkTasks.Append(chunk->fillTask);
+        }
+        chunk->pending = false;
       }
 
       chunks.Append(chunk);
@@ -822,10 +968,17 @@ void Landscape::RasterizeLandscape()
         return a->dist > b->dist;
       });
 
-  // copy all the chunk data into the vertex buffer
-  vec3* lowerBuf = _ctx->MapWriteDiscard<vec3>(_landscapeLowerBundle.objects._vb);
-  vec3* upperBuf = _ctx->MapWriteDiscard<vec3>(_landscapeUpperBundle.objects._vb);
-  vec3* particleBuf = _ctx->MapWriteDiscard<vec3>(_particleBundle.objects._vb);
+  // copy all the chunk data into the shared vertex buffer. Only one range can be mapped
+  // at a time, so the lower, upper and particle verts are allocated together, in that
+  // order, and drawn from their offsets in the range
+  u32 numChunks = (u32)chunks.Size();
+  assert(numChunks < MAX_CHUNKS);
+  vec3* lowerBuf = g_DynamicVertices.Map<vec3>(
+      _ctx, numChunks * (Chunk::LOWER_VERTS + 2 * Chunk::UPPER_VERTS), &_chunkVerts);
+  if (!lowerBuf)
+    return;
+  vec3* upperBuf = lowerBuf + numChunks * Chunk::LOWER_VERTS;
+  vec3* particleBuf = upperBuf + numChunks * Chunk::UPPER_VERTS;
 
   // upper chunks, and particles
   SimpleAppendBuffer<TaskId, 2048> copyTasks;
@@ -836,8 +989,8 @@ void Landscape::RasterizeLandscape()
     *data = CopyKernelData{ chunk, lowerBuf, upperBuf, particleBuf };
     KernelData kd;
     kd.data = data;
-    kd.size = sizeof(ChunkKernelData);
-    chunkTasks.Append(g_Scheduler->AddTask(kd, CopyOutTask));
+    kd.size = sizeof(CopyKernelData);
+    copyTasks.Append(g_Scheduler->AddTask(kd, CopyOutTask));
 
     lowerBuf += Chunk::LOWER_VERTS;
     upperBuf += Chunk::UPPER_VERTS;
@@ -847,50 +1000,107 @@ void Landscape::RasterizeLandscape()
   for (const TaskId& taskId : copyTasks)
     g_Scheduler->Wait(taskId);
 
-  _ctx->Unmap(_particleBundle.objects._vb);
-  _ctx->Unmap(_landscapeLowerBundle.objects._vb);
-  _ctx->Unmap(_landscapeUpperBundle.objects._vb);
+  g_DynamicVertices.Unmap(_ctx, _chunkVerts);
 
-  u32 numChunks = (u32)chunks.Size();
-  assert(numChunks < MAX_CHUNKS);
   _numChunks = numChunks;
   _numLowerIndices = numChunks * Chunk::LOWER_INDICES;
   _numUpperIndices = numChunks * Chunk::UPPER_INDICES;
   _numParticles = numChunks * Chunk::UPPER_VERTS;
 
+  PrefetchChunks();
+
 #if WITH_IMGUI
   TANO.AddPerfCallback([=]()
       {
         ImGui::Text("# particles: %d", _numParticles);
         ImGui::Text("# chunks: %d", _numChunks);
+        const ChunkCache::Stats& stats = _chunkCache._stats;
+        ImGui::Text(
+            "chunk cache hit/miss/evict: %u/%u/%u", stats.hits, stats.misses, stats.evictions);
+        ImGui::Text("chunk prefetch/wait: %u/%u", stats.prefetches, stats.prefetchWaits);
       });
 #endif
 }
 
 //------------------------------------------------------------------------------
-void Landscape::RenderBoids(const ObjectHandle* renderTargets, ObjectHandle dsHandle)
+void Landscape::PrefetchChunks()
 {
-  vec3* boidPos = _ctx->MapWriteDiscard<vec3>(_boidsBundle.objects._vb);
+  rmt_ScopedCPUSample(Landscape_Prefetch);
+
+  // Extrapolate where the camera is heading, both from its current velocity and from
+  // the spline the flocks are following, and generate the chunks around those points
+  // as low priority tasks so they're (hopefully) ready once they become visible
+  SimpleAppendBuffer<vec3, 2 * PREFETCH_STEPS> targets;
+  for (int i = 1; i <= PREFETCH_STEPS; ++i)
+  {
+    float t = i * PREFETCH_STEP_TIME;
+    targets.Append(_curCamera->_pos + t * _cameraVel);
+    if (_curCamera == &_flockCamera)
+      targets.Append(_spline.InterpolateArcLength((_localTime + t) * _settings.spline_speed));
+  }
+
+  float s = GRID_SIZE * NUM_CHUNK_QUADS;
+  int budget = MAX_PREFETCH_PER_FRAME;
+
+  // nearest rings first, so a limited budget goes to the most urgent chunks
+  for (int r = 0; r <= PREFETCH_RINGS; ++r)
+  {
+    for (const vec3& target : targets)
+    {
+      int tx = (int)floorf(target.x / s);
+      int tz = (int)floorf(target.z / s);
+
+      for (int cz = tz - r; cz <= tz + r; ++cz)
+      {
+        for (int cx = tx - r; cx <= tx + r; ++cx)
+        {
+          bool onRing = abs(cx - tx) == r || abs(cz - tz) == r;
+          if (!onRing || _chunkCache.HasChunk(cx, cz))
+            continue;
+
+          Chunk* chunk = _chunkCache.GetFreeChunk(cx, cz, s);
+          chunk->fillTask = QueueFillChunk(chunk, TaskPriority::Low);
+          chunk->pending = true;
+          _chunkCache._stats.prefetches++;
+
+          if (--budget == 0)
+            return;
+        }
+      }
+    }
+  }
+}
 
+//------------------------------------------------------------------------------
+void Landscape::RenderBoids(const ObjectHandle* renderTargets, ObjectHandle dsHandle)
+{
   int numBoids = 0;
+  for (const Flock* flock : _flocks)
+    numBoids += flock->boids._bodies.numBodies;
+
+  UploadRange range;
+  vec3* boidPos = g_DynamicVertices.Map<vec3>(_ctx, numBoids, &range);
+  if (!boidPos)
+    return;
+
   for (const Flock* flock : _flocks)
   {
     vec3* pos = flock->boids._bodies.pos;
     memcpy(boidPos, pos, flock->boids._bodies.numBodies * sizeof(vec3));
     boidPos += flock->boids._bodies.numBodies;
-    numBoids += flock->boids._bodies.numBodies;
   }
 
-  _ctx->Unmap(_boidsBundle.objects._vb);
+  g_DynamicVertices.Unmap(_ctx, range);
 
   _cbParticle.Set(_ctx, 0);
   _ctx->SetBundleWithSamplers(_boidsBundle, ShaderType::PixelShader);
+  _ctx->SetVertexBuffer(range.handle);
 
   // Unset the DSV, as we want to use it as a texture resource
   _ctx->SetRenderTargets(renderTargets, 1, ObjectHandle(), nullptr);
   ObjectHandle srv[] = {_boidsTexture, dsHandle};
   _ctx->SetShaderResources(srv, 2, ShaderType::PixelShader);
-  _ctx->Draw(numBoids, 0);
+  _ctx->Draw(numBoids, range.firstElement);
   _ctx->UnsetShaderResources(0, 2, ShaderType::PixelShader);
 }
 
@@ -920,35 +1130,45 @@ bool Landscape::Render()
     _ctx->Draw(3, 0);
   }
 
+  // last frame's range might already be reused, so only draw from this frame's
+  _chunkVerts = UploadRange();
   if (_renderLandscape)
-  {
     RasterizeLandscape();
 
+  // the lower, upper and particle verts follow each other in the range
+  u32 upperStart = _chunkVerts.firstElement + _numChunks * Chunk::LOWER_VERTS;
+  u32 particleStart = upperStart + _numChunks * Chunk::UPPER_VERTS;
+
+  if (_chunkVerts.IsValid())
+  {
     _cbLandscape.Set(_ctx, 0);
 
     if (_drawFlags & DrawLower)
     {
       _ctx->SetBundle(_landscapeLowerBundle);
-      _ctx->DrawIndexed(_numLowerIndices, 0, 0);
+      _ctx->SetVertexBuffer(_chunkVerts.handle);
+      _ctx->DrawIndexed(_numLowerIndices, 0, _chunkVerts.firstElement);
     }
 
     if (_drawFlags & DrawUpper)
     {
       _ctx->SetBundle(_landscapeUpperBundle);
-      _ctx->DrawIndexed(_numUpperIndices, 0, 0);
+      _ctx->SetVertexBuffer(_chunkVerts.handle);
+      _ctx->DrawIndexed(_numUpperIndices, 0, upperStart);
     }
   }
 
-  if (_drawFlags & DrawParticles)
+  if ((_drawFlags & DrawParticles) && _chunkVerts.IsValid())
   {
     _cbParticle.Set(_ctx, 0);
     _ctx->SetBundleWithSamplers(_particleBundle, ShaderType::PixelShader);
+    _ctx->SetVertexBuffer(_chunkVerts.handle);
 
     // Unset the DSV, as we want to use it as a texture resource
     _ctx->SetRenderTargets(renderTargets, 2, ObjectHandle(), nullptr);
     ObjectHandle srv[] = {_particleTexture, rtColor._dsHandle};
     _ctx->SetShaderResources(srv, 2, ShaderType::PixelShader);
-    _ctx->Draw(_numParticles, 0);
+    _ctx->Draw(_numParticles, particleStart);
     _ctx->UnsetShaderResources(0, 2, ShaderType::PixelShader);
   }
 
@@ -1132,6 +1352,7 @@ void Landscape::Reset()
 //------------------------------------------------------------------------------
 bool Landscape::Close()
 {
+  _chunkCache.FlushPending();
   return true;
 }
 
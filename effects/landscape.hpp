@@ -9,6 +9,8 @@
 #include "../dyn_particles.hpp"
 #include "../tano_math.hpp"
 #include "../random.hpp"
+#include "../scheduler.hpp"
+#include "../upload_buffer.hpp"
 #include "../shaders/out/landscape.lensflare_pslensflare.cbuffers.hpp"
 #include "../shaders/out/landscape.sky_pssky.cbuffers.hpp"
 #include "../shaders/out/landscape.composite_pscomposite.cbuffers.hpp"
@@ -21,11 +23,6 @@
 
 namespace tano
 {
-  namespace scheduler
-  {
-    struct TaskData;
-  }
-
   struct BehaviorPathFollow : public ParticleKinematics
   {
     BehaviorPathFollow(const CardinalSpline& spline);
@@ -42,8 +39,11 @@ namespace tano
 
   struct BehaviorSpacing : public ParticleKinematics
   {
+    // Each flock has its own, so the flocks can be updated in parallel, and the draws
+    // don't depend on which thread runs first
+    BehaviorSpacing(u64 seed = Philox::DEFAULT_SEED, u64 stream = 0) : random(seed, stream) {}
     virtual void Update(const ParticleKinematics::UpdateParams& params) override;
-
+    RandomInt random;
   };
 
   class Landscape : public BaseEffect
@@ -59,12 +59,17 @@ namespace tano
       UPPER_NUM_CHUNK_VERTS = UPPER_NUM_CHUNK_QUADS + 1,
     };
 
+    // world space size of a chunk quad
+    static const float GRID_SIZE;
+
     Landscape(const string& name, const string& config, u32 id);
     ~Landscape();
     virtual bool OnConfigChanged(const vector<char>& buf) override;
     virtual bool Init() override;
     virtual bool Update(const UpdateState& state) override;
     virtual bool FixedUpdate(const FixedUpdateState& state) override;
+    virtual bool ThreadSafeUpdate() const override { return true; }
+    virtual void PreUpdate() override;
     virtual bool Render() override;
     virtual bool Close() override;
     virtual bool InitAnimatedParameters() override;
@@ -84,6 +89,7 @@ namespace tano
 
     void UpdateCameraMatrix(const UpdateState& state);
     void RasterizeLandscape();
+    void PrefetchChunks();
 
     void InitBoids();
     void UpdateBoids(const FixedUpdateState& state);
@@ -94,10 +100,17 @@ namespace tano
     struct Chunk
     {
       Chunk() : id(nextId++) {}
+      // integer chunk coordinates, and the world space position of the corner
+      int cx, cz;
       float x, y;
       vec3 center;
       float dist = 0;
-      int lastAccessed = 0;
+      // intrusive LRU list, most recently used first
+      Chunk* prev = nullptr;
+      Chunk* next = nullptr;
+      // set for prefetched chunks until the fill task is known to be done
+      bool pending = false;
+      scheduler::TaskId fillTask;
       enum
       {
         UPPER_INDICES = UPPER_NUM_CHUNK_QUADS * UPPER_NUM_CHUNK_QUADS * 6,
@@ -112,12 +125,6 @@ namespace tano
       static int nextId;
     };
 
-    struct ChunkKernelData
-    {
-      Chunk* chunk;
-      float x, z;
-    };
-
     struct CopyKernelData
     {
       const Chunk* chunk;
@@ -127,6 +134,7 @@ namespace tano
     };
 
     static void FillChunk(const scheduler::TaskData& data);
+    static scheduler::TaskId QueueFillChunk(Chunk* chunk, scheduler::TaskPriority priority);
     static void CopyOutTask(const scheduler::TaskData& data);
     static void UpdateFlock(const scheduler::TaskData& data);
 
@@ -138,18 +146,49 @@ namespace tano
       float deltaTime;
     };
 
+    // LRU cache of generated chunks, keyed on the integer chunk coordinates. Lookups
+    // go through an open addressing hash table, and the least recently used chunk is
+    // recycled once the cache is full.
     struct ChunkCache
     {
-      Chunk* FindChunk(float x, float y, int timestamp);
-      Chunk* GetFreeChunk(float x, float y, int timestamp);
+      ChunkCache();
+      Chunk* FindChunk(int cx, int cz);
+      bool HasChunk(int cx, int cz) const;
+      Chunk* GetFreeChunk(int cx, int cz, float chunkSize);
+      // waits for any outstanding prefetch tasks
+      void FlushPending();
+
       static const int CACHE_SIZE = 2048;
+      // power of 2, and twice the cache size to keep the probe sequences short
+      static const int HASH_SIZE = 2 * CACHE_SIZE;
+
+      struct Stats
+      {
+        u32 hits = 0;
+        u32 misses = 0;
+        u32 evictions = 0;
+        u32 prefetches = 0;
+        // visible chunks whose prefetch task hadn't finished yet
+        u32 prefetchWaits = 0;
+      };
+      Stats _stats;
+
+    private:
+      static u32 HashKey(int cx, int cz);
+      int FindSlot(int cx, int cz) const;
+      void RemoveFromLookup(const Chunk* chunk);
+      void Unlink(Chunk* chunk);
+      void PushFront(Chunk* chunk);
+
       Chunk _cache[CACHE_SIZE];
       int _used = 0;
-      unordered_map<pair<float, float>, Chunk*> _chunkLookup;
+      // index into _cache, or -1 for empty slots
+      int _lookup[HASH_SIZE];
+      Chunk* _head = nullptr;
+      Chunk* _tail = nullptr;
     };
 
     ChunkCache _chunkCache;
-    int _curTick = 0;
 
     struct Flock
     {
@@ -158,6 +197,7 @@ namespace tano
       DynParticles boids;
       BehaviorSeek* seek = nullptr;
       BehaviorPathFollow* follow = nullptr;
+      BehaviorSpacing* spacing = nullptr;
     };
 
     struct FlockCamera : public Camera
@@ -197,11 +237,14 @@ namespace tano
       DrawParticles = 0x4,
     };
     u32 _drawFlags = 0x7;
+    bool _drawForces = false;
 
     u32 _numUpperIndices = 0;
     u32 _numLowerIndices = 0;
     u32 _numParticles = 0;
     u32 _numChunks = 0;
+    // this frame's lower, upper and particle verts, in the shared vertex upload buffer
+    UploadRange _chunkVerts;
 
     GpuBundle _boidsBundle;
     bool _renderLandscape = true;
@@ -210,7 +253,6 @@ namespace tano
     BehaviorSeparataion* _behaviorSeparataion = nullptr;
     BehaviorCohesion* _behaviorCohesion = nullptr;
     BehaviorLandscapeFollow* _behaviorLandscapeFollow = nullptr;
-    BehaviorSpacing* _behaviorSpacing = nullptr;
 
     FlockCamera _flockCamera;
     Camera* _curCamera = &_flockCamera;
@@ -218,6 +260,9 @@ namespace tano
     int _followFlock = 0;
 
     CardinalSpline _spline;
+    float _localTime = 0;
+    vec3 _prevCameraPos = vec3(0, 0, 0);
+    vec3 _cameraVel = vec3(0, 0, 0);
     int _curFlockIdx = -1;
     float _flockFade = 1;
 
@@ -12,8 +12,8 @@
 #include "../stop_watch.hpp"
 #include "../perlin2d.hpp"
 #include "../blackboard.hpp"
-#include "../fixed_deque.hpp"
 #include "../random.hpp"
+#include "../upload_buffer.hpp"
 
 using namespace tano;
 using namespace bristol;
@@ -197,8 +197,7 @@ void GenRandomPoints(float kernelSize, RandomUniform& r)
 //------------------------------------------------------------------------------
 bool Plexus::OnConfigChanged(const vector<char>& buf)
 {
-  _settings = ParsePlexusSettings(InputBuffer(buf));
-  return true;
+  return ParseSettings(buf, &_settings, ParsePlexusSettings);
 }
 
 //------------------------------------------------------------------------------
@@ -226,7 +225,6 @@ bool Plexus::Init()
     .RasterizerDesc(rasterizeDescCullNone)
     .BlendDesc(blendDescBlendOneOne)
     .DepthStencilDesc(depthDescDepthWriteDisabled)
-    .DynamicVb(128 * 1024, sizeof(vec3))
     .Topology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST)));
 
   INIT_FATAL(_greetsBundle.Create(BundleOptions()
@@ -234,7 +232,6 @@ bool Plexus::Init()
     .InputElement(CD3D11_INPUT_ELEMENT_DESC("NORMAL", DXGI_FORMAT_R32G32B32_FLOAT))
     .VertexShader("shaders/out/plexus.greets", "VsGreets")
     .PixelShader("shaders/out/plexus.greets", "PsGreets")
-    .DynamicVb(MAX_GREETS_HEIGHT*MAX_GREETS_WIDTH * 24 * 2, 2 * sizeof(vec3))
     .StaticIb(GenerateCubeIndicesFaceted(MAX_GREETS_HEIGHT*MAX_GREETS_WIDTH))));
 
   INIT_FATAL(_compositeBundle.Create(BundleOptions()
@@ -246,7 +243,8 @@ bool Plexus::Init()
   // clang-format on
 
   INIT_FATAL(_greetsBlock.Init());
-  CalcPoints(true);
+  CalcPoints();
+  CalcNeighbours();
 
   INIT_FATAL(_cbGreets.Create());
   INIT_FATAL(_cbComposite.Create());
@@ -314,14 +312,8 @@ void Plexus::PointsTest(const UpdateState& state)
 }
 
 //------------------------------------------------------------------------------
-void Plexus::CalcPoints(bool recalcEdges)
+void Plexus::CalcPoints()
 {
-  struct Edge
-  {
-    int e[6];
-  };
-  SimpleAppendBuffer<Edge, MAX_POINTS> edges;
-
   _points.Clear();
 
   float radiusInc = _settings.sphere.radius / _settings.sphere.layers;
@@ -334,109 +326,47 @@ void Plexus::CalcPoints(bool recalcEdges)
   int slices = _settings.sphere.slices;
   int stacks = _settings.sphere.stacks;
 
-  int num = layers * slices * stacks;
-
-  int nodeIdx = 0;
-
   for (int i = 0; i < layers; ++i)
   {
-    bool edgeOut = i > 0;
-    bool edgeIn = i < layers - 1;
-
     float phi = 0;
     for (int j = 0; j < slices; ++j)
     {
       float theta = 0;
       for (int k = 0; k < stacks; ++k)
       {
-        bool edgeUp = k > 0;
-        bool edgeDown = k < stacks - 1;
-
         vec3 pt = FromSpherical(r, phi, theta);
         float s = _settings.deform.noise_strength * stb_perlin_noise3(pt.x, pt.y, pt.z);
         pt = pt + s * pt;
 
         _points.Append(pt);
-
-        // Create the edges. Every point basically has left/right/up/down/out/in and
-        // then we need to take care of boundaries
-        if (recalcEdges)
-        {
-          int edgeIdx = 2;
-          int(&e)[6] = edges.Append(Edge()).e;
-          e[0] = IntMod(nodeIdx - stacks, num);
-          e[1] = IntMod(nodeIdx - stacks, num);
-
-          if (edgeUp)
-            e[edgeIdx++] = IntMod(nodeIdx - 1, num);
-          if (edgeDown)
-            e[edgeIdx++] = IntMod(nodeIdx + 1, num);
-
-          if (edgeOut)
-            e[edgeIdx++] = IntMod(nodeIdx - (slices * stacks), num);
-          if (edgeIn)
-            e[edgeIdx++] = IntMod(nodeIdx - (slices * stacks), num);
-
-          // set a sentinal if needed
-          if (edgeIdx != 6)
-            e[edgeIdx - 1] = -1;
-        }
-
-        nodeIdx++;
         theta += thetaInc;
       }
       phi += phiInc;
     }
     r -= radiusInc;
   }
+}
 
-  if (recalcEdges)
-  {
-    // order the neighbours in depth-first edge order
-    SAFE_ADELETE(_neighbours);
-    _neighbours = new int[num * num];
-
-    u8* visited = g_ScratchMemory.Alloc<u8>(num);
-
-    for (int i = 0; i < num; ++i)
-    {
-      memset(visited, 0, num);
-      FixedDequeue<int> frontier(g_ScratchMemory.Alloc<int>(num), num);
-      frontier.PushFront(i);
-      int idx = 0;
-      while (!frontier.IsEmpty())
-      {
-        int cur = frontier.Front();
-        _neighbours[i * num + idx] = cur;
-        idx++;
-        frontier.PopFront();
-        visited[cur] = 1;
-
-        for (int j = 0; j < 6; ++j)
-        {
-          int tmp = edges[cur].e[j];
-          if (tmp == -1)
-            break;
-          if (!visited[tmp])
-          {
-            visited[tmp] = 1;
-            frontier.PushBack(tmp);
-          }
-        }
-      }
-    }
-  }
+//------------------------------------------------------------------------------
+void Plexus::CalcNeighbours()
+{
+  // The points are deformed every frame, so the neighbours are found spatially rather
+  // than from the sphere lattice. Use the max distance as cell size, so a query only
+  // ever has to look at the adjacent cells.
+  int num = _points.Size();
+  _neighbours.resize(num * MAX_NEIGHBOURS);
+  _pointGrid.Update(_points.Data(), num, _settings.plexus.max_dist);
+  _pointGrid.CalcNeighbours(_settings.plexus.num_neighbours,
+      _settings.plexus.min_dist,
+      _settings.plexus.max_dist,
+      _neighbours.data(),
+      MAX_NEIGHBOURS);
 }
 
 //------------------------------------------------------------------------------
 void Plexus::UpdateGreets(const UpdateState& state)
 {
   _greetsBlock.Update(state);
-
-  ObjectHandle handle = _greetsBundle.objects._vb;
-  vec3* verts = _ctx->MapWriteDiscard<vec3>(handle);
-  _greetsBlock.CopyOut(verts);
-  _ctx->Unmap(handle);
 }
 
 //------------------------------------------------------------------------------
@@ -452,11 +382,12 @@ bool Plexus::Update(const UpdateState& state)
   float scale = g_Blackboard->GetFloatVar("plexus.scale");
 
   _settings.deform.noise_strength = base + scale * lo;
-  CalcPoints(false);
+  CalcPoints();
 
 
   UpdateCameraMatrix(state);
   PointsTest(state);
+  CalcNeighbours();
   UpdateGreets(state);
   return true;
 }
@@ -542,13 +473,22 @@ bool Plexus::Render()
     _cbPlexus.ps0.lineParams = vec4(params.x, params.y, params.z, 1);
     _cbPlexus.Set(_ctx, 0);
 
-    ObjectHandle vb = _plexusLineBundle.objects._vb;
-    vec3* vtx = _ctx->MapWriteDiscard<vec3>(vb);
-    int numLines = CalcPlexusGrouping(
-      vtx, _points.Data(), _points.Size(), _neighbours, _points.Size(), _settings.plexus);
-    _ctx->Unmap(vb);
-    _ctx->SetBundle(_plexusLineBundle);
-    _ctx->Draw(numLines, 0);
+    // each point adds at most 'num_nearest' edges
+    UploadRange range;
+    int maxVerts = _points.Size() * max(1, _settings.plexus.num_nearest) * 2;
+    if (vec3* vtx = g_DynamicVertices.Map<vec3>(_ctx, maxVerts, &range))
+    {
+      int numVerts = CalcPlexusGrouping(vtx,
+          _points.Data(),
+          _points.Size(),
+          _neighbours.data(),
+          MAX_NEIGHBOURS,
+          _settings.plexus);
+      g_DynamicVertices.Unmap(_ctx, range);
+      _ctx->SetBundle(_plexusLineBundle);
+      _ctx->SetVertexBuffer(range.handle);
+      _ctx->Draw(numVerts, range.firstElement);
+    }
   }
 
   ScopedRenderTarget rtGreets(DXGI_FORMAT_R16G16B16A16_FLOAT);
@@ -556,10 +496,20 @@ bool Plexus::Render()
     // greets
     _ctx->SetRenderTarget(rtGreets, g_Graphics->GetDepthStencil(), &black);
 
-    _cbGreets.Set(_ctx, 0);
-    _ctx->SetBundle(_greetsBundle);
-    //_ctx->DrawIndexed(_greetsBlock.numGreetsCubes * 36, 0, 0);
-    _ctx->DrawIndexed(_greetsBlock.numGreetsCubes * 6, 0, 0);
+    // only the front face of each cube is written, with a position and normal per vertex
+    UploadRange range = g_DynamicVertices.Map(
+        _ctx, _greetsBlock.width * _greetsBlock.height * 4, 2 * sizeof(vec3));
+    if (range.IsValid())
+    {
+      _greetsBlock.CopyOut((vec3*)range.ptr);
+      g_DynamicVertices.Unmap(_ctx, range);
+
+      _cbGreets.Set(_ctx, 0);
+      _ctx->SetBundle(_greetsBundle);
+      _ctx->SetVertexBuffer(range.handle);
+      //_ctx->DrawIndexed(_greetsBlock.numGreetsCubes * 36, 0, 0);
+      _ctx->DrawIndexed(_greetsBlock.numGreetsCubes * 6, 0, range.firstElement);
+    }
   }
 
   {
@@ -598,18 +548,8 @@ void Plexus::RenderParameterSet()
   if (showPlexusSettings)
   {
     bool recalc = false;
-    bool recalcEdges = true;
-    if (ImGui::SliderFloat("radius", &_settings.sphere.radius, 50, 2000))
-    {
-      recalc = true;
-      recalcEdges = false;
-    }
-
-    if (ImGui::SliderFloat("noise-strength", &_settings.deform.noise_strength, -2500, 2500))
-    {
-      recalc = true;
-      recalcEdges = false;
-    }
+    recalc |= ImGui::SliderFloat("radius", &_settings.sphere.radius, 50, 2000);
+    recalc |= ImGui::SliderFloat("noise-strength", &_settings.deform.noise_strength, -2500, 2500);
 
     ImGui::SliderFloat("perlin-scale", &_settings.deform.perlin_scale, 0, 1000);
 
@@ -620,14 +560,15 @@ void Plexus::RenderParameterSet()
     recalc |= ImGui::SliderInt("stacks", &_settings.sphere.stacks, 1, 50);
     recalc |= ImGui::SliderInt("layers", &_settings.sphere.layers, 1, 50);
     recalc |= ImGui::SliderInt("num-nearest", &_settings.plexus.num_nearest, 1, 20);
-    recalc |= ImGui::SliderInt("num-neighbours", &_settings.plexus.num_neighbours, 1, 100);
+    recalc |= ImGui::SliderInt("num-neighbours", &_settings.plexus.num_neighbours, 1, MAX_NEIGHBOURS);
 
     if (ImGui::SliderFloat("blur-kernel", &_settings.deform.blur_kernel, 1, 250))
       GenRandomPoints(_settings.deform.blur_kernel, _randomFloat);
 
     if (recalc)
     {
-      CalcPoints(recalcEdges);
+      CalcPoints();
+      CalcNeighbours();
     }
   }
 
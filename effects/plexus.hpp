@@ -11,6 +11,7 @@
 #include "../shaders/out/plexus.compose_pscomposite.cbuffers.hpp"
 #include "../shaders/out/plexus.sky_pssky.cbuffers.hpp"
 #include "../random.hpp"
+#include "../spatial_grid.hpp"
 
 namespace tano
 {
@@ -72,12 +73,15 @@ namespace tano
     void UpdateCameraMatrix(const UpdateState& state);
 
     void PointsTest(const UpdateState& state);
-    void CalcPoints(bool recalcEdges);
+    void CalcPoints();
+    void CalcNeighbours();
     enum { MAX_POINTS = 16 * 1024 };
+    enum { MAX_NEIGHBOURS = 32 };
 
     SimpleAppendBuffer<vec3, MAX_POINTS> _points;
     SimpleAppendBuffer<vec3, MAX_POINTS> _tris;
-    int* _neighbours = nullptr;
+    SpatialGrid _pointGrid;
+    vector<int> _neighbours;
 
     void UpdateGreets(const UpdateState& state);
 
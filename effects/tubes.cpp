@@ -15,58 +15,66 @@
 #include "../debug_api.hpp"
 #include "../tano_math_convert.hpp"
 #include "../random.hpp"
+#include "../scheduler.hpp"
+#include "../upload_buffer.hpp"
 
 using namespace tano;
+using namespace tano::scheduler;
 using namespace bristol;
 using namespace DirectX;
 
-static int SEGMENT_SPLITS = 20;
-static int ROTATION_SEGMENTS = 20;
+static const int SEGMENT_SPLITS = 20;
+static const int ROTATION_SEGMENTS = 20;
+static const int SEGMENTS_PER_TASK = 16;
+static const float SPLINE_SCALE = 1.0f / 4.0f;
 static int NUM_INITIAL_SEGMENTS = 20;
 static float INITIAL_SPREAD = 30;
 
+static float RING_COS[ROTATION_SEGMENTS];
+static float RING_SIN[ROTATION_SEGMENTS];
+
 #define DEBUG_DRAW_SPLINE 0
 
 static RandomGauss150 RANDOM_150;
-RandomUniform RANDOM_FLOAT;
+static RandomUniform RANDOM_FLOAT;
 
 //------------------------------------------------------------------------------
-void AddRing(float curT,
-    const vec3& prevT,
-    const CardinalSpline& spline,
-    float scale,
-    vec3* newD,
-    vec3* newN,
-    vec3* newT,
-    vector<PN>* out)
+static void InitRingTables()
 {
-  float delta = 1.f / SEGMENT_SPLITS;
+  float angleInc = XM_2PI / ROTATION_SEGMENTS;
+  for (int k = 0; k < ROTATION_SEGMENTS; ++k)
+  {
+    RING_COS[k] = cosf(k * angleInc);
+    RING_SIN[k] = sinf(k * angleInc);
+  }
+}
 
-  vec3 pos = spline.Interpolate(curT);
+//------------------------------------------------------------------------------
+// Writes ROTATION_SEGMENTS vertices around the spline at curT, and updates the
+// segment's reference frame
+static void AddRing(float curT, Pathy::Segment* segment, PN* out)
+{
+  vec3 pos, d;
+  segment->spline.Frame(curT, &pos, &d);
 
   // Propagate frame along spline, using method by Ken Sloan
-  vec3 d = Normalize(spline.Interpolate(curT + delta) - pos);
   // note, this uses t from the previous frame
-  vec3 n = Cross(d, prevT);
+  vec3 n = Cross(d, segment->frameT);
   vec3 t = Cross(n, d);
 
-  *newD = d;
-  *newN = n;
-  *newT = t;
+  segment->frameD = d;
+  segment->frameN = n;
+  segment->frameT = t;
 
-  float angle = 0;
-  float angleInc = XM_2PI / ROTATION_SEGMENTS;
+  // n is perpendicular to d, so rotating it around d is a blend between n and d x n
+  float radius = segment->scale * Length(n);
+  vec3 u = Normalize(n);
+  vec3 v = Cross(d, u);
   for (int k = 0; k < ROTATION_SEGMENTS; ++k)
   {
-    vec3 pp = pos;
-    vec3 dd = Normalize(d);
-    Matrix mtx = Matrix::CreateFromAxisAngle(ToVector3(dd), angle);
-    vec3 xx = scale * n;
-    vec3 rr = Normalize(xx);
-    rr = FromVector3(Vector3::Transform(ToVector3(rr), mtx));
-    vec3 vv = pp + FromVector3(Vector3::Transform(ToVector3(xx), mtx));
-    angle += angleInc;
-    out->push_back(PN{vec3(vv), vec3(rr)});
+    vec3 rr = RING_COS[k] * u + RING_SIN[k] * v;
+    vec3 vv = pos + radius * rr;
+    out[k] = PN{vv, rr};
 
 #if DEBUG_DRAW_SPLINE
     DEBUG_API.AddDebugLine(vv, vv + rr, Color(1, 1, 0), Color(1, 0, 1));
@@ -74,10 +82,18 @@ void AddRing(float curT,
   }
 }
 
+//------------------------------------------------------------------------------
+int Pathy::Segment::NumVerts() const
+{
+  // the in progress ring is only valid once the segment has started
+  return isStarted ? (numCompleteRings + 1) * ROTATION_SEGMENTS : 0;
+}
+
 //------------------------------------------------------------------------------
 void Pathy::Create()
 {
   SeqDelete(&segments);
+  InitRingTables();
 
   float speedMean = g_Blackboard->GetFloatVar("split.speedMean");
   float speedVar = g_Blackboard->GetFloatVar("split.speedVar");
@@ -88,9 +104,9 @@ void Pathy::Create()
   for (int i = 0; i < NUM_INITIAL_SEGMENTS; ++i)
   {
     float ss = INITIAL_SPREAD;
-    float x = RANDOM_FLOAT.Next(-ss, ss);
-    float z = RANDOM_FLOAT.Next(-ss, ss);
-    Segment* s = new Segment{vec3(x, 0, z), 1, RANDOM_150.Next(speedMean, speedMean), 0, 0, 0};
+    float x = randomFloat.Next(-ss, ss);
+    float z = randomFloat.Next(-ss, ss);
+    Segment* s = new Segment{vec3(x, 0, z), 1, random150.Next(speedMean, speedMean), 0, 0, 0};
     segments.push_back(s);
     segmentStart.push_back(SegmentStart{time, s});
   }
@@ -117,15 +133,15 @@ void Pathy::Create()
       if (numVerts >= TOTAL_POINTS)
         break;
 
-      float r = RANDOM_FLOAT.Next(0.f, 1.f);
+      float r = randomFloat.Next(0.f, 1.f);
       if (r >= childProb && (int)segments.size() < maxChildren)
       {
         Segment* s = new Segment{cur,
             scale * childScale,
-            scale * RANDOM_150.Next(speedMean, speedVar),
-            angleX + RANDOM_150.Next(angleXMean, angleXVariance),
-            angleY + RANDOM_150.Next(angleYMean, angleYVariance),
-            angleZ + RANDOM_150.Next(angleZMean, angleZVariance)};
+            scale * random150.Next(speedMean, speedVar),
+            angleX + random150.Next(angleXMean, angleXVariance),
+            angleY + random150.Next(angleYMean, angleYVariance),
+            angleZ + random150.Next(angleZMean, angleZVariance)};
 
         segments.push_back(s);
         segmentStart.push_back(SegmentStart{time, s});
@@ -134,9 +150,9 @@ void Pathy::Create()
       Matrix mtx = Matrix::CreateFromYawPitchRoll(angleX, angleY, angleZ);
       vec3 delta = curLen * FromVector3(Vector3::Transform(Vector3(0, -1, 0), mtx));
 
-      segment.angleX += RANDOM_150.Next(angleXMean, angleXVariance);
-      segment.angleY += RANDOM_150.Next(angleYMean, angleYVariance);
-      segment.angleZ += RANDOM_150.Next(angleZMean, angleZVariance);
+      segment.angleX += random150.Next(angleXMean, angleXVariance);
+      segment.angleY += random150.Next(angleYMean, angleYVariance);
+      segment.angleZ += random150.Next(angleZMean, angleZVariance);
       segment.cur += delta;
     }
     time++;
@@ -145,31 +161,71 @@ void Pathy::Create()
   for (int i = 0; i < (int)segments.size(); ++i)
   {
     Segment* segment = segments[i];
-    segment->spline.Create(segment->verts.data(), (int)segment->verts.size(), 1.0f / 4.0f);
+    segment->spline.Create(segment->verts.data(), (int)segment->verts.size(), SPLINE_SCALE);
+
+    // the spline is constant past the last control point, so keep the rings a tick
+    // away from it
+    float splineEnd = (segment->verts.size() - 1) * SPLINE_SCALE;
+    segment->maxTicks = max(0, (int)(splineEnd / delta) - 1);
 
     float tt = segmentStart[i].time;
 
     // Reference frame
-    segment->frameD =
-        Normalize(segment->spline.Interpolate(tt + delta) - segment->spline.Interpolate(tt));
+    vec3 pos;
+    segment->spline.Frame(tt, &pos, &segment->frameD);
     segment->frameT = Perp(segment->frameD);
     segment->frameN = Cross(segment->frameD, segment->frameT);
     segment->frameT = Cross(segment->frameN, segment->frameD);
 
-    AddRing(0,
-        segment->frameT,
-        segment->spline,
-        segment->scale,
-        &segment->frameD,
-        &segment->frameN,
-        &segment->frameT,
-        &segment->completeRings);
+    segment->rings.resize(2 * ROTATION_SEGMENTS);
+    AddRing(0, segment, segment->rings.data());
+    segment->numCompleteRings = 1;
+  }
+}
+
+//------------------------------------------------------------------------------
+void Pathy::UpdateRings(Segment* s, float elapsedTime)
+{
+  float delta = 1.f / SEGMENT_SPLITS;
+  int numTicks = (int)(elapsedTime / delta);
+
+  // add any new full rings
+  while (s->lastNumTicks < numTicks)
+  {
+    s->lastNumTicks++;
+    AddRing(s->lastNumTicks * delta, s, &s->rings[s->numCompleteRings * ROTATION_SEGMENTS]);
+    s->numCompleteRings++;
+  }
+
+#if DEBUG_DRAW_SPLINE
+  {
+    vec3 p0 = s->spline.Interpolate(elapsedTime);
+    DEBUG_API.AddDebugLine(p0, p0 + s->frameD, Color(1, 0, 0));
+    DEBUG_API.AddDebugLine(p0, p0 + s->frameN, Color(0, 1, 0));
+    DEBUG_API.AddDebugLine(p0, p0 + s->frameT, Color(0, 0, 1));
   }
+#endif
+
+  AddRing(elapsedTime, s, &s->rings[s->numCompleteRings * ROTATION_SEGMENTS]);
+}
+
+//------------------------------------------------------------------------------
+void Pathy::RingKernel(const TaskData& data)
+{
+  RingKernelData* k = (RingKernelData*)data.kernelData.data;
+  for (int i = 0; i < k->numSegments; ++i)
+    UpdateRings(k->segments[i].segment, k->segments[i].elapsedTime);
 }
 
 //------------------------------------------------------------------------------
 void Pathy::CreateTubesIncremental(float orgTime)
 {
+  float delta = 1.f / SEGMENT_SPLITS;
+
+  // find the started segments, and make room for their new rings, so the tasks
+  // don't have to allocate
+  ActiveSegment* active = g_ScratchMemory.Alloc<ActiveSegment>((u32)segmentStart.size());
+  int numActive = 0;
   for (SegmentStart start : segmentStart)
   {
     Segment* s = start.segment;
@@ -181,46 +237,29 @@ void Pathy::CreateTubesIncremental(float orgTime)
 
     s->isStarted = true;
 
-    float delta = 1.f / SEGMENT_SPLITS;
-    float elapsedTime = time - start.time;
+    float elapsedTime = min(time - start.time, s->maxTicks * delta);
     int numTicks = (int)(elapsedTime / delta);
+    int numRings = s->numCompleteRings + max(0, numTicks - s->lastNumTicks) + 1;
+    if ((int)s->rings.size() < numRings * ROTATION_SEGMENTS)
+      s->rings.resize(numRings * ROTATION_SEGMENTS);
 
-    if (numTicks > s->lastNumTicks)
-    {
-      s->lastNumTicks = numTicks;
-
-      // add a new full ring
-      AddRing(numTicks * delta,
-          s->frameT,
-          s->spline,
-          s->scale,
-          &s->frameD,
-          &s->frameN,
-          &s->frameT,
-          &s->completeRings);
-    }
+    active[numActive++] = ActiveSegment{s, elapsedTime};
+  }
 
-#if DEBUG_DRAW_SPLINE
-    {
-      vec3 p0 = s->spline.Interpolate(elapsedTime);
-      DEBUG_API.AddDebugLine(p0, p0 + s->frameD, Color(1, 0, 0));
-      DEBUG_API.AddDebugLine(p0, p0 + s->frameN, Color(0, 1, 0));
-      DEBUG_API.AddDebugLine(p0, p0 + s->frameT, Color(0, 0, 1));
-    }
-#endif
+  SimpleAppendBuffer<TaskId, 256> tasks;
+  for (int i = 0; i < numActive; i += SEGMENTS_PER_TASK)
+  {
+    RingKernelData* data = g_ScratchMemory.Alloc<RingKernelData>(1);
+    *data = RingKernelData{active + i, min(SEGMENTS_PER_TASK, numActive - i)};
 
-    s->inprogressRing.clear();
-    float ss = (elapsedTime - (int)(elapsedTime / delta) * delta) / delta;
-    ss = 1;
-    AddRing(elapsedTime,
-        s->frameT,
-        s->spline,
-        s->scale,
-        &s->frameD,
-        &s->frameN,
-        &s->frameT,
-        &s->inprogressRing);
+    KernelData kd;
+    kd.data = data;
+    kd.size = sizeof(RingKernelData);
+    tasks.Append(g_Scheduler->AddTask(kd, RingKernel));
   }
+
+  for (const TaskId& taskId : tasks)
+    g_Scheduler->Wait(taskId);
 }
 
 //------------------------------------------------------------------------------
@@ -236,7 +275,8 @@ Tubes::~Tubes()
 //------------------------------------------------------------------------------
 bool Tubes::OnConfigChanged(const vector<char>& buf)
 {
-  _settings = ParseSplitSettings(InputBuffer(buf));
+  if (!ParseSettings(buf, &_settings, ParseSplitSettings))
+    return false;
   _freeflyCamera.FromProtocol(_settings.camera);
   return true;
 }
@@ -262,13 +302,11 @@ bool Tubes::Init()
     .BlendDesc(blendDescWeightedBlend)
     .InputElement(CD3D11_INPUT_ELEMENT_DESC("POSITION", DXGI_FORMAT_R32G32B32_FLOAT))
     .InputElement(CD3D11_INPUT_ELEMENT_DESC("NORMAL", DXGI_FORMAT_R32G32B32_FLOAT))
-    .DynamicVb(10 * 1024 * 1024, 2 * sizeof(vec3))
     .StaticIb(CreateCylinderIndices(ROTATION_SEGMENTS, 100000, false))
     .VertexShader("shaders/out/split.mesh", "VsMesh")
     .PixelShader("shaders/out/split.mesh", "PsMeshTrans")));
 
   INIT(_particleBundle.Create(BundleOptions()
-    .DynamicVb(1024 * 1024 * 6, sizeof(vec4))
     .VertexShader("shaders/out/split.particle", "VsParticle")
     .GeometryShader("shaders/out/split.particle", "GsParticle")
     .PixelShader("shaders/out/split.particle", "PsParticle")
@@ -339,6 +377,15 @@ void Tubes::UpdateParticles(const UpdateState& state)
   }
 }
 
+//------------------------------------------------------------------------------
+void Tubes::PreUpdate()
+{
+  if (g_KeyUpTrigger.IsTriggered('1'))
+  {
+    _curCamera = _curCamera == &_freeflyCamera ? &_camera : &_freeflyCamera;
+  }
+}
+
 //------------------------------------------------------------------------------
 bool Tubes::Update(const UpdateState& state)
 {
@@ -362,11 +409,6 @@ void Tubes::UpdateCameraMatrix(const UpdateState& state)
   _cbComposite.ps0.time =
     vec2(state.localTime.TotalSecondsAsFloat(), state.globalTime.TotalSecondsAsFloat());
 
-  if (g_KeyUpTrigger.IsTriggered('1'))
-  {
-    _curCamera = _curCamera == &_freeflyCamera ? &_camera : &_freeflyCamera;
-  }
-
   float tt = state.localTime.TotalSecondsAsFloat();
 
   _camera._pos.y = g_Blackboard->GetFloatVar("split.camOffsetY")
@@ -420,15 +462,6 @@ void Tubes::UpdateCameraMatrix(const UpdateState& state)
 #endif
 }
 
-//------------------------------------------------------------------------------
-template <typename T>
-size_t CopyOut(T* dst, const vector<T>& src)
-{
-  size_t len = src.size() * sizeof(T);
-  memcpy(dst, src.data(), len);
-  return src.size();
-}
-
 //------------------------------------------------------------------------------
 template <typename T>
 size_t CopyOutN(T* dst, const vector<T>& src, size_t ofs, size_t n)
@@ -482,57 +515,64 @@ bool Tubes::Render()
   ScopedRenderTarget rtOpacity(DXGI_FORMAT_R16G16B16A16_FLOAT);
   ScopedRenderTarget rtRevealage(DXGI_FORMAT_R16_FLOAT);
 
-  ObjectHandle handle = _meshBundle.objects._vb;
-  PN* vtx = _ctx->MapWriteDiscard<PN>(handle);
-  int indexCount = 0;
+  int totalVerts = 0;
   for (const Pathy::Segment* s : _pathy.segments)
   {
     if (s->isStarted)
+      totalVerts += s->NumVerts();
+  }
+
+  UploadRange meshRange;
+  if (PN* vtx = g_DynamicVertices.Map<PN>(_ctx, totalVerts, &meshRange))
+  {
+    for (const Pathy::Segment* s : _pathy.segments)
     {
-      // calc # faces at the current segment
-      int numVerts = (int)(s->completeRings.size() + s->inprogressRing.size());
-      int n = ((numVerts / SEGMENT_SPLITS) - 1) * 6 * ROTATION_SEGMENTS;
-      indexCount += n;
-      vtx += CopyOut(vtx, s->completeRings);
-      vtx += CopyOut(vtx, s->inprogressRing);
+      if (s->isStarted)
+      {
+        int numVerts = s->NumVerts();
+        memcpy(vtx, s->rings.data(), numVerts * sizeof(PN));
+        vtx += numVerts;
+      }
     }
+    g_DynamicVertices.Unmap(_ctx, meshRange);
   }
-  _ctx->Unmap(handle);
 
   static const Color* clearColors[] = {&black, &white};
   ObjectHandle targets[] = {rtOpacity, rtRevealage};
   _ctx->SetRenderTargets(targets, 2, g_Graphics->GetDepthStencil(), clearColors);
+  if (meshRange.IsValid())
   {
     // tubes
     _cbMesh.Set(_ctx, 0);
     _cbMesh.Set(_ctx, 1);
     _ctx->SetBundle(_meshBundle);
+    _ctx->SetVertexBuffer(meshRange.handle);
     int startVtx;
     _ctx->SetRasterizerState(_meshFrontFace);
-    startVtx = 0;
+    startVtx = (int)meshRange.firstElement;
 
     for (const Pathy::Segment* s : _pathy.segments)
     {
       if (s->isStarted)
       {
         // calc # faces at the current segment
-        int numVerts = (int)(s->completeRings.size() + s->inprogressRing.size());
-        int n = ((numVerts / SEGMENT_SPLITS) - 1) * 6 * ROTATION_SEGMENTS;
+        int numVerts = s->NumVerts();
+        int n = ((numVerts / ROTATION_SEGMENTS) - 1) * 6 * ROTATION_SEGMENTS;
         _ctx->DrawIndexed(n, 0, startVtx);
         startVtx += numVerts;
       }
     }
 
     _ctx->SetRasterizerState(_meshBackFace);
-    startVtx = 0;
+    startVtx = (int)meshRange.firstElement;
 
     for (const Pathy::Segment* s : _pathy.segments)
     {
       if (s->isStarted)
       {
         // calc # faces at the current segment
-        int numVerts = (int)(s->completeRings.size() + s->inprogressRing.size());
-        int n = ((numVerts / SEGMENT_SPLITS) - 1) * 6 * ROTATION_SEGMENTS;
+        int numVerts = s->NumVerts();
+        int n = ((numVerts / ROTATION_SEGMENTS) - 1) * 6 * ROTATION_SEGMENTS;
         _ctx->DrawIndexed(n, 0, startVtx);
         startVtx += numVerts;
       }
@@ -541,33 +581,35 @@ bool Tubes::Render()
 
   {
     // particles
-    int numParticles = 0;
-    ObjectHandle handle = _particleBundle.objects._vb;
-    vec4* vtx = _ctx->MapWriteDiscard<vec4>(handle);
+    int numParticles = (int)_cloudParticles.size();
     for (const Pathy::Segment* s : _pathy.segments)
+      numParticles += (int)s->particles.size();
+
+    UploadRange range;
+    if (vec4* vtx = g_DynamicVertices.Map<vec4>(_ctx, numParticles, &range))
     {
-      size_t zz = sizeof(Pathy::Particle);
-      for (const Pathy::Particle& p : s->particles)
+      for (const Pathy::Segment* s : _pathy.segments)
       {
-        *(vec3*)vtx = s->spline.Interpolate(p.pos);
-        vtx->w = p.fade;
-        vtx++;
+        for (const Pathy::Particle& p : s->particles)
+        {
+          *(vec3*)vtx = s->spline.Interpolate(p.pos);
+          vtx->w = p.fade;
+          vtx++;
+        }
       }
 
-      numParticles += (int)s->particles.size();
-    }
+      memcpy(vtx, _cloudParticles.data(), _cloudParticles.size() * sizeof(vec4));
+      g_DynamicVertices.Unmap(_ctx, range);
 
-    memcpy(vtx, _cloudParticles.data(), _cloudParticles.size() * sizeof(vec4));
-    numParticles += (int)_cloudParticles.size();
-    _ctx->Unmap(handle);
+      _cbParticle.Set(_ctx, 0);
+      _ctx->SetBundleWithSamplers(_particleBundle, ShaderType::PixelShader);
+      _ctx->SetVertexBuffer(range.handle);
 
-    _cbParticle.Set(_ctx, 0);
-    _ctx->SetBundleWithSamplers(_particleBundle, ShaderType::PixelShader);
-
-    ObjectHandle srv[] = {_particleTexture};
-    _ctx->SetShaderResources(srv, 1, ShaderType::PixelShader);
-    _ctx->Draw(numParticles, 0);
-    _ctx->UnsetShaderResources(0, 1, ShaderType::PixelShader);
+      ObjectHandle srv[] = {_particleTexture};
+      _ctx->SetShaderResources(srv, 1, ShaderType::PixelShader);
+      _ctx->Draw(numParticles, range.firstElement);
+      _ctx->UnsetShaderResources(0, 1, ShaderType::PixelShader);
+    }
   }
 
   {
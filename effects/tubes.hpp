@@ -15,6 +15,11 @@
 
 namespace tano
 {
+  namespace scheduler
+  {
+    struct TaskData;
+  }
+
   struct PN
   {
     vec3 pos;
@@ -29,8 +34,12 @@ namespace tano
       POINTS_PER_CHILD = 1024,
       MAX_NUM_LINES = 32
     };
+
+    // The generators are per instance, so the benchmark's seed gives the same tubes
+    Pathy(u64 seed = Philox::DEFAULT_SEED) : randomFloat(seed, 0), random150(seed, 1) {}
     void Create();
 
+    // Adds the rings for the started segments, with the segments split across tasks
     void CreateTubesIncremental(float t);
 
     struct Particle
@@ -53,9 +62,15 @@ namespace tano
       float angleX, angleY, angleZ;
       int lastNumTicks = 0;
       bool isStarted = false;
+      int NumVerts() const;
+
       vector<vec3> verts;
-      vector<PN> completeRings;
-      vector<PN> inprogressRing;
+      // The complete rings, followed by the in progress ring. Grown on the main thread
+      // before the ring tasks run
+      vector<PN> rings;
+      int numCompleteRings = 0;
+      // the last tick that gives a non-degenerate ring
+      int maxTicks = 0;
       CardinalSpline spline;
 
       float lastSpawn = 0;
@@ -93,10 +108,29 @@ namespace tano
       float time;
       Segment* segment;
     };
+
+    struct ActiveSegment
+    {
+      Segment* segment;
+      float elapsedTime;
+    };
+
+    struct RingKernelData
+    {
+      ActiveSegment* segments;
+      int numSegments;
+    };
+
+    static void UpdateRings(Segment* segment, float elapsedTime);
+    static void RingKernel(const scheduler::TaskData& data);
+
     deque<SegmentStart> segmentStart;
     vector<Segment*> segments;
 
     vector<Line> lines;
+
+    RandomUniform randomFloat;
+    RandomGauss150 random150;
   };
 
   class Tubes : public BaseEffect
@@ -108,6 +142,8 @@ namespace tano
     virtual bool Init() override;
     virtual bool Update(const UpdateState& state) override;
     virtual bool FixedUpdate(const FixedUpdateState& state) override;
+    virtual bool ThreadSafeUpdate() const override { return true; }
+    virtual void PreUpdate() override;
     virtual bool Render() override;
     virtual bool Close() override;
     virtual const char* GetName() { return Name(); }
@@ -13,8 +13,11 @@
 #include "../fullscreen_effect.hpp"
 #include "../mesh_utils.hpp"
 #include "../mesh_loader.hpp"
+#include "../scheduler.hpp"
+#include "../upload_buffer.hpp"
 
 using namespace tano;
+using namespace tano::scheduler;
 using namespace bristol;
 
 static float START_OFS = -2;
@@ -44,8 +47,9 @@ Snake::Snake(RandomUniform& randomFloat,
     , _numParticles(dimX * dimY)
     , _forceAngle(randomFloat.Next(-2.f, 2.f))
 {
-  _particles.resize(_numParticles);
-  Particle* p = &_particles[0];
+  _cloth.Create(_numParticles);
+  VerletSystem::Particle* p = _cloth._particles.data();
+  vector<VerletSystem::Constraint> constraints;
 
   for (int i = 0; i < dimY; ++i)
   {
@@ -68,7 +72,7 @@ Snake::Snake(RandomUniform& randomFloat,
     for (int i = 0; i < dimY; ++i)
     {
       u32 idx0 = i * dimX;
-      Particle* p0 = &_particles[idx0];
+      VerletSystem::Particle* p0 = &_cloth._particles[idx0];
 
       static int ofs[] = {-1, +1};
 
@@ -81,9 +85,8 @@ Snake::Snake(RandomUniform& randomFloat,
             continue;
 
           u32 idx1 = yy * dimX;
-          Particle* p1 = &_particles[idx1];
-          //_constraints.push_back({ p0, p1, Distance(p0->pos, p1->pos) });
-          _constraints.push_back({idx0, idx1, Distance(p0->pos, p1->pos)});
+          VerletSystem::Particle* p1 = &_cloth._particles[idx1];
+          constraints.push_back({idx0, idx1, Distance(p0->pos, p1->pos)});
         }
       }
     }
@@ -97,7 +100,7 @@ Snake::Snake(RandomUniform& randomFloat,
       for (int j = 0; j < dimX; ++j)
       {
         u32 idx0 = i * dimX + j;
-        Particle* p0 = &_particles[idx0];
+        VerletSystem::Particle* p0 = &_cloth._particles[idx0];
 
         static int ofs[] = {-1, +0, -1, +1, +0, +1, +1, +1, +1, +0, +1, -1, +0, -1, -1, -1};
 
@@ -111,87 +114,60 @@ Snake::Snake(RandomUniform& randomFloat,
               continue;
 
             u32 idx1 = yy * dimX + xx;
-            Particle* p1 = &_particles[idx1];
-            //_constraints.push_back({ p0, p1, Distance(p0->pos, p1->pos) });
-            _constraints.push_back({idx0, idx1, Distance(p0->pos, p1->pos)});
+            VerletSystem::Particle* p1 = &_cloth._particles[idx1];
+            constraints.push_back({idx0, idx1, Distance(p0->pos, p1->pos)});
           }
         }
       }
     }
   }
+
+  _cloth.SetConstraints(constraints.data(), (int)constraints.size());
 }
 
 //------------------------------------------------------------------------------
-void Snake::Update(float dt)
+void Snake::Update(float dt, const Params& params)
 {
-  size_t numParticles = _particles.size();
-  float dt2 = dt * dt;
-
-  vec3 gg = g_Blackboard->GetVec3Var("tunnel.gravity");
-  float damping = g_Blackboard->GetFloatVar("tunnel.damping");
-  float windForce = g_Blackboard->GetFloatVar("tunnel.windForce");
-
-  vec3 force = windForce * vec3{sinf(_forceAngle), 0, cosf(_forceAngle)};
-  _forceAngle += dt * g_Blackboard->GetFloatVar("tunnel.forceSpeed");
-
-  // Add forces
-  for (size_t i = 0; i < numParticles; ++i)
-  {
-    _particles[i].acc = gg;
-    _particles[i].acc += force;
-  }
-
-  Particle* p = &_particles[0];
-  for (size_t i = 0; i < numParticles; ++i)
-  {
-    // verlet integration
-    vec3 tmp = p->pos;
-    p->pos = p->pos + (1.0f - damping) * (p->pos - p->lastPos) + p->acc * dt2;
-    p->lastPos = tmp;
-    ++p;
-  }
-
-  // apply the constraints
-  for (int i = 0; i < 2; ++i)
-  {
-    for (const Constraint& c : _constraints)
-    {
-      Particle* p0 = &_particles[c.i0];
-      Particle* p1 = &_particles[c.i1];
+  vec3 force = params.windForce * vec3{sinf(_forceAngle), 0, cosf(_forceAngle)};
+  _forceAngle += dt * params.forceSpeed;
 
-      float dist = Distance(p0->pos, p1->pos);
-      vec3 dir = ((dist - c.restLength) / dist) * (p1->pos - p0->pos);
-      p0->pos += 0.5f * dir;
-      p1->pos -= 0.5f * dir;
-    }
-  }
+  _cloth.Integrate(dt, params.damping, params.gravity + force);
+  _cloth.Relax(params.iterations, params.tolerance);
 
   // fix the upper row
   vec3 cur = _anchor;
   for (int i = 0; i < _clothDimX; ++i)
   {
-    _particles[i].pos = cur;
+    _cloth._particles[i].pos = cur;
   }
 }
 
+//------------------------------------------------------------------------------
+void Snake::UpdateKernel(const TaskData& data)
+{
+  UpdateKernelData* k = (UpdateKernelData*)data.kernelData.data;
+  k->snake->Update(k->dt, *k->params);
+}
+
 //------------------------------------------------------------------------------
 int Snake::CopyOutLines(vec3* out)
 {
+  const vector<VerletSystem::Particle>& particles = _cloth._particles;
   int numVerts = 0;
   for (int i = 0; i < _clothDimY; ++i)
   {
-    *out++ = _particles[i * _clothDimX].pos;
-    *out++ = _particles[i * _clothDimX + _clothDimX - 1].pos;
+    *out++ = particles[i * _clothDimX].pos;
+    *out++ = particles[i * _clothDimX + _clothDimX - 1].pos;
     numVerts += 2;
   }
 
   for (int i = 0; i < _clothDimY - 1; ++i)
   {
-    *out++ = _particles[i * _clothDimX].pos;
-    *out++ = _particles[(i + 1) * _clothDimX].pos;
+    *out++ = particles[i * _clothDimX].pos;
+    *out++ = particles[(i + 1) * _clothDimX].pos;
 
-    *out++ = _particles[i * _clothDimX + _clothDimX - 1].pos;
-    *out++ = _particles[(i + 1) * _clothDimX + _clothDimX - 1].pos;
+    *out++ = particles[i * _clothDimX + _clothDimX - 1].pos;
+    *out++ = particles[(i + 1) * _clothDimX + _clothDimX - 1].pos;
     numVerts += 4;
   }
 
@@ -213,8 +189,7 @@ Tunnel::~Tunnel()
 //------------------------------------------------------------------------------
 bool Tunnel::OnConfigChanged(const vector<char>& buf)
 {
-  _settings = ParseTunnelSettings(InputBuffer(buf));
-  return true;
+  return ParseSettings(buf, &_settings, ParseTunnelSettings);
 }
 
 //------------------------------------------------------------------------------
@@ -261,8 +236,7 @@ bool Tunnel::Init()
     .GeometryShader("shaders/out/tunnel.facecolor", "GsFace")
     .PixelShader("shaders/out/tunnel.facecolor", "PsFace")
     .InputElement(CD3D11_INPUT_ELEMENT_DESC("POSITION", DXGI_FORMAT_R32G32B32_FLOAT))
-    .RasterizerDesc(rasterizeDescCullNone)
-    .DynamicVb(128 * 1024, sizeof(vec3))));
+    .RasterizerDesc(rasterizeDescCullNone)));
 
   INIT_FATAL(_linesBundle.Create(BundleOptions()
     .VertexShader("shaders/out/tunnel.lines", "VsTunnelLines")
@@ -272,7 +246,6 @@ bool Tunnel::Init()
     .RasterizerDesc(rasterizeDescCullNone)
     .BlendDesc(blendDescBlendOneOne)
     .DepthStencilDesc(depthDescDepthWriteDisabled)
-    .DynamicVb(128 * 1024, sizeof(vec3))
     .Topology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST)));
 
   INIT_FATAL(_snakeBundle.Create(BundleOptions()
@@ -283,7 +256,6 @@ bool Tunnel::Init()
     .RasterizerDesc(rasterizeDescCullNone)
     .BlendDesc(blendDescBlendOneOne)
     .DepthStencilDesc(depthDescDepthWriteDisabled)
-    .DynamicVb(128 * 1024, sizeof(vec3))
     .Topology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST)));
 
   INIT_FATAL(_compositeBundle.Create(BundleOptions()
@@ -291,7 +263,6 @@ bool Tunnel::Init()
     .PixelShader("shaders/out/tunnel.composite", "PsComposite")));
 
   INIT(_particleBundle.Create(BundleOptions()
-    .DynamicVb(1024 * 1024, sizeof(vec3))
     .VertexShader("shaders/out/tunnel.particle", "VsParticle")
     .GeometryShader("shaders/out/tunnel.particle", "GsParticle")
     .PixelShader("shaders/out/tunnel.particle", "PsParticle")
@@ -311,23 +282,51 @@ bool Tunnel::Init()
   // Particles
   INIT_RESOURCE_FATAL(_particleTexture, RESOURCE_MANAGER.LoadTexture("gfx/particle_white.png"));
 
+  Snake::Params snakeParams = SnakeParams();
   for (int i = 0; i < 1000; ++i)
   {
     for (Snake& s : _snakes)
     {
-      s.Update(0.01f);
+      s.Update(0.01f, snakeParams);
     }
   }
 
   END_INIT_SEQUENCE();
 }
 
+//------------------------------------------------------------------------------
+Snake::Params Tunnel::SnakeParams() const
+{
+  Snake::Params params;
+  params.gravity = g_Blackboard->GetVec3Var("tunnel.gravity");
+  params.damping = g_Blackboard->GetFloatVar("tunnel.damping");
+  params.windForce = g_Blackboard->GetFloatVar("tunnel.windForce");
+  params.forceSpeed = g_Blackboard->GetFloatVar("tunnel.forceSpeed");
+  params.iterations = _settings.snake_iterations;
+  params.tolerance = _settings.snake_tolerance;
+  return params;
+}
+
 //------------------------------------------------------------------------------
 bool Tunnel::Update(const UpdateState& state)
 {
-  for (Snake& s : _snakes)
   {
-    s.Update(state.delta.TotalSecondsAsFloat());
+    // each snake is its own cloth, so they can all be updated in parallel
+    Snake::Params snakeParams = SnakeParams();
+    SimpleAppendBuffer<TaskId, 64> tasks;
+    for (Snake& s : _snakes)
+    {
+      Snake::UpdateKernelData* data = g_ScratchMemory.Alloc<Snake::UpdateKernelData>(1);
+      *data = Snake::UpdateKernelData{&s, state.delta.TotalSecondsAsFloat(), &snakeParams};
+
+      KernelData kd;
+      kd.data = data;
+      kd.size = sizeof(Snake::UpdateKernelData);
+      tasks.Append(g_Scheduler->AddTask(kd, Snake::UpdateKernel));
+    }
+
+    for (const TaskId& taskId : tasks)
+      g_Scheduler->Wait(taskId);
   }
 
   vec3 pos(vec3(_freeflyCamera._pos));
@@ -359,10 +358,17 @@ void Tunnel::PlexusUpdate(const UpdateState& state)
 
   int numVerts = TUNNEL_DEPTH * numSegments;
 
+  // the ring centers are used for both the points and the faces
+  float* ringT = g_ScratchMemory.Alloc<float>(TUNNEL_DEPTH);
+  vec3* ringPos = g_ScratchMemory.Alloc<vec3>(TUNNEL_DEPTH);
+  for (int j = 0; j < TUNNEL_DEPTH; ++j)
+    ringT[j] = distSnapped + (float)j + START_OFS;
+  _spline.Interpolate(ringT, TUNNEL_DEPTH, ringPos);
+
   int idx = 0;
   for (int j = 0; j < TUNNEL_DEPTH; ++j)
   {
-    vec3 pos = _spline.Interpolate(distSnapped + (float)j + START_OFS);
+    vec3 pos = ringPos[j];
 
     float angle = 0;
     float angleInc = 2 * XM_PI / numSegments;
@@ -371,41 +377,6 @@ void Tunnel::PlexusUpdate(const UpdateState& state)
       vec3 p = pos + radius * vec3(cosf(angle), sinf(angle), 0);
       points[idx] = p;
 
-      // add neighbours
-      int n = 0;
-
-      auto dn = [=](int n)
-      {
-        int tmp = i - n;
-        return tmp < 0 ? tmp + numSegments : tmp;
-      };
-      auto up = [=](int n)
-      {
-        int tmp = i + n;
-        return tmp % numSegments;
-      };
-      int dn1 = dn(1), dn2 = dn(2);
-      int up1 = up(1), up2 = up(2);
-
-      neighbours[idx * MAX_N + n++] = (j * numSegments) + dn1;
-      neighbours[idx * MAX_N + n++] = (j * numSegments) + up1;
-
-      if (j > 0)
-      {
-        neighbours[idx * MAX_N + n++] = ((j - 1) * numSegments) + i;
-        neighbours[idx * MAX_N + n++] = ((j - 1) * numSegments) + dn1;
-        neighbours[idx * MAX_N + n++] = ((j - 1) * numSegments) + up1;
-      }
-
-      if (j < TUNNEL_DEPTH - 1)
-      {
-        neighbours[idx * MAX_N + n++] = ((j + 1) * numSegments) + i;
-        neighbours[idx * MAX_N + n++] = ((j + 1) * numSegments) + dn1;
-        neighbours[idx * MAX_N + n++] = ((j + 1) * numSegments) + up1;
-      }
-
-      neighbours[idx * MAX_N + n] = -1;
-
       idx++;
       angle += angleInc;
     }
@@ -417,10 +388,9 @@ void Tunnel::PlexusUpdate(const UpdateState& state)
     float b = g_Blackboard->GetFloatVar("tunnel.lenScale");
     float c = g_Blackboard->GetFloatVar("tunnel.rScale");
     float prob = g_Blackboard->GetFloatVar("tunnel.rProb");
-    float distSnapped = (float)tmp;
     for (int j = 0; j < TUNNEL_DEPTH - 1; ++j)
     {
-      vec3 pos = _spline.Interpolate(distSnapped + (float)j + START_OFS);
+      vec3 pos = ringPos[j];
 
       int startSegment = (int)(pos.z * a) % TUNNEL_SEGMENTS;
       int numSegments = (int)(pos.z * b) % TUNNEL_SEGMENTS;
@@ -446,11 +416,27 @@ void Tunnel::PlexusUpdate(const UpdateState& state)
     }
   }
 
+  // The tunnel rings follow the spline, so rather than hand-building the lattice
+  // neighbours, look them up spatially
+  _plexusGrid.Update(points, idx, _settings.plexus.max_dist);
+  _plexusGrid.CalcNeighbours(_settings.plexus.num_neighbours,
+      _settings.plexus.min_dist,
+      _settings.plexus.max_dist,
+      neighbours,
+      MAX_N);
+
   int plexusVerts = CalcPlexusGrouping(
       _tunnelPlexusVerts.Data(), points, idx, neighbours, MAX_N, _settings.plexus);
   _tunnelPlexusVerts.Resize(plexusVerts);
 }
 
+//------------------------------------------------------------------------------
+void Tunnel::PreUpdate()
+{
+  if (g_KeyUpTrigger.IsTriggered('1'))
+    _useFreeFly = !_useFreeFly;
+}
+
 //------------------------------------------------------------------------------
 bool Tunnel::FixedUpdate(const FixedUpdateState& state)
 {
@@ -469,9 +455,6 @@ bool Tunnel::FixedUpdate(const FixedUpdateState& state)
     _freeflyCamera._dir = vec3(sinf(t) * dirScale, cosf(t) * dirScale, 1);
   }
 
-  if (g_KeyUpTrigger.IsTriggered('1'))
-    _useFreeFly = !_useFreeFly;
-
   //_freeflyCamera .SetFollowTarget(ToVector3(pos));
   _freeflyCamera.Update(state.delta);
   return true;
@@ -524,14 +507,17 @@ bool Tunnel::Render()
     // tunnel face
     _ctx->SetRenderTarget(rtColor._rtHandle, rtColor._dsHandle, &black);
 
-    ObjectHandle h = _tunnelFaceBundle.objects._vb;
-    vec3* verts = _ctx->MapWriteDiscard<vec3>(h);
-    memcpy(verts, _tunnelFaceVerts.Data(), _tunnelFaceVerts.DataSize());
-    _ctx->Unmap(h);
+    UploadRange range;
+    if (vec3* verts = g_DynamicVertices.Map<vec3>(_ctx, _tunnelFaceVerts.Size(), &range))
+    {
+      memcpy(verts, _tunnelFaceVerts.Data(), _tunnelFaceVerts.DataSize());
+      g_DynamicVertices.Unmap(_ctx, range);
 
-    _cbFace.Set(_ctx, 0);
-    _ctx->SetBundle(_tunnelFaceBundle);
-    _ctx->Draw(_tunnelFaceVerts.Size(), 0);
+      _cbFace.Set(_ctx, 0);
+      _ctx->SetBundle(_tunnelFaceBundle);
+      _ctx->SetVertexBuffer(range.handle);
+      _ctx->Draw(_tunnelFaceVerts.Size(), range.firstElement);
+    }
   }
 
   ScopedRenderTarget rtLines(DXGI_FORMAT_R11G11B10_FLOAT, BufferFlag::CreateSrv);
@@ -539,81 +525,89 @@ bool Tunnel::Render()
 
   {
     // tunnel
-    ObjectHandle h = _linesBundle.objects._vb;
-    vec3* verts = _ctx->MapWriteDiscard<vec3>(h);
-    memcpy(verts, _tunnelPlexusVerts.Data(), _tunnelPlexusVerts.DataSize());
-    _ctx->Unmap(h);
+    int numVerts = _tunnelPlexusVerts.Size();
+    UploadRange range;
+    if (vec3* verts = g_DynamicVertices.Map<vec3>(_ctx, numVerts, &range))
+    {
+      memcpy(verts, _tunnelPlexusVerts.Data(), _tunnelPlexusVerts.DataSize());
+      g_DynamicVertices.Unmap(_ctx, range);
 
-    _cbLines.gs0.dim = vec4((float)rtColor._desc.width, (float)rtColor._desc.height, 0, 0);
-    vec3 params = g_Blackboard->GetVec3Var("tunnel.lineParams");
-    _cbLines.ps0.lineParams = vec4(params.x, params.y, params.z, 1);
-    _cbLines.Set(_ctx, 0);
+      _cbLines.gs0.dim = vec4((float)rtColor._desc.width, (float)rtColor._desc.height, 0, 0);
+      vec3 params = g_Blackboard->GetVec3Var("tunnel.lineParams");
+      _cbLines.ps0.lineParams = vec4(params.x, params.y, params.z, 1);
+      _cbLines.Set(_ctx, 0);
 
-    int numVerts = _tunnelPlexusVerts.Size();
-    _ctx->SetBundle(_linesBundle);
-    _ctx->Draw(numVerts, 0);
+      _ctx->SetBundle(_linesBundle);
+      _ctx->SetVertexBuffer(range.handle);
+      _ctx->Draw(numVerts, range.firstElement);
+    }
   }
 
   {
     // snakes!
-    ObjectHandle h = _snakeBundle.objects._vb;
-    vec3* verts = _ctx->MapWriteDiscard<vec3>(h);
     int numVerts = 0;
-    for (Snake& c : _snakes)
+    for (const Snake& c : _snakes)
+      numVerts += c.NumLineVerts();
+
+    UploadRange range;
+    if (vec3* verts = g_DynamicVertices.Map<vec3>(_ctx, numVerts, &range))
     {
-      int tmp = c.CopyOutLines(verts);
-      verts += tmp;
-      numVerts += tmp;
+      for (Snake& c : _snakes)
+        verts += c.CopyOutLines(verts);
+      g_DynamicVertices.Unmap(_ctx, range);
+
+      _cbLines.gs0.dim = vec4((float)rtColor._desc.width, (float)rtColor._desc.height, 0, 0);
+      vec3 params = g_Blackboard->GetVec3Var("tunnel.snakeLineParams");
+      _cbLines.ps0.lineParams = vec4(params.x, params.y, params.z, 1);
+      _cbLines.Set(_ctx, 0);
+
+      _ctx->SetBundle(_snakeBundle);
+      _ctx->SetVertexBuffer(range.handle);
+      _ctx->Draw(numVerts, range.firstElement);
+
+      // snake particles
+      _cbParticle.gs0.particleSize = g_Blackboard->GetFloatVar("tunnel.snakeParticleSize");
+      _cbParticle.ps0.particleColor = g_Blackboard->GetVec4Var("tunnel.snakeParticleColor");
+
+      _cbParticle.Set(_ctx, 0);
+      _ctx->SetBundleWithSamplers(_particleBundle, ShaderType::PixelShader);
+      _ctx->SetVertexBuffer(range.handle);
+
+      // Unset the DSV, as we want to use it as a texture resource
+      _ctx->SetRenderTarget(rtColor._rtHandle, ObjectHandle(), nullptr);
+      ObjectHandle srv[] = {_particleTexture, rtColor._dsHandle};
+      _ctx->SetShaderResources(srv, 2, ShaderType::PixelShader);
+      _ctx->Draw(numVerts, range.firstElement);
+      _ctx->UnsetShaderResources(0, 2, ShaderType::PixelShader);
     }
-    _ctx->Unmap(h);
-
-    _cbLines.gs0.dim = vec4((float)rtColor._desc.width, (float)rtColor._desc.height, 0, 0);
-    vec3 params = g_Blackboard->GetVec3Var("tunnel.snakeLineParams");
-    _cbLines.ps0.lineParams = vec4(params.x, params.y, params.z, 1);
-    _cbLines.Set(_ctx, 0);
-
-    _ctx->SetBundle(_snakeBundle);
-    _ctx->Draw(numVerts, 0);
-
-    // snake particles
-    _cbParticle.gs0.particleSize = g_Blackboard->GetFloatVar("tunnel.snakeParticleSize");
-    _cbParticle.ps0.particleColor = g_Blackboard->GetVec4Var("tunnel.snakeParticleColor");
-
-    _cbParticle.Set(_ctx, 0);
-    _ctx->SetBundleWithSamplers(_particleBundle, ShaderType::PixelShader);
-    _ctx->SetVertexBuffer(h);
-
-    // Unset the DSV, as we want to use it as a texture resource
-    _ctx->SetRenderTarget(rtColor._rtHandle, ObjectHandle(), nullptr);
-    ObjectHandle srv[] = {_particleTexture, rtColor._dsHandle};
-    _ctx->SetShaderResources(srv, 2, ShaderType::PixelShader);
-    _ctx->Draw(numVerts, 0);
-    _ctx->UnsetShaderResources(0, 2, ShaderType::PixelShader);
   }
   _ctx->UnsetRenderTargets(0, 1);
 
   {
     // particles
-    vec3* vtx = _ctx->MapWriteDiscard<vec3>(_particleBundle.objects._vb);
-
     int numParticles = 1000;
-    for (int i = 0; i < numParticles; ++i)
+    UploadRange range;
+    if (vec3* vtx = g_DynamicVertices.Map<vec3>(_ctx, numParticles, &range))
     {
-      vec3 pos = _spline.Interpolate(i + START_OFS);
-      vtx[i] = pos;
+      for (int i = 0; i < numParticles; ++i)
+      {
+        vec3 pos = _spline.Interpolate(i + START_OFS);
+        vtx[i] = pos;
+      }
+      g_DynamicVertices.Unmap(_ctx, range);
+      _cbParticle.gs0.particleSize = g_Blackboard->GetFloatVar("tunnel.cloudParticleSize");
+      _cbParticle.ps0.particleColor = g_Blackboard->GetVec4Var("tunnel.cloudParticleColor");
+      _cbParticle.Set(_ctx, 0);
+      _ctx->SetBundleWithSamplers(_particleBundle, ShaderType::PixelShader);
+      _ctx->SetVertexBuffer(range.handle);
+
+      // Unset the DSV, as we want to use it as a texture resource
+      _ctx->SetRenderTarget(rtColor._rtHandle, ObjectHandle(), nullptr);
+      ObjectHandle srv[] = {_particleTexture, rtColor._dsHandle};
+      _ctx->SetShaderResources(srv, 2, ShaderType::PixelShader);
+      _ctx->Draw(numParticles, range.firstElement);
+      _ctx->UnsetShaderResources(0, 2, ShaderType::PixelShader);
     }
-    _ctx->Unmap(_particleBundle.objects._vb);
-    _cbParticle.gs0.particleSize = g_Blackboard->GetFloatVar("tunnel.cloudParticleSize");
-    _cbParticle.ps0.particleColor = g_Blackboard->GetVec4Var("tunnel.cloudParticleColor");
-    _cbParticle.Set(_ctx, 0);
-    _ctx->SetBundleWithSamplers(_particleBundle, ShaderType::PixelShader);
-
-    // Unset the DSV, as we want to use it as a texture resource
-    _ctx->SetRenderTarget(rtColor._rtHandle, ObjectHandle(), nullptr);
-    ObjectHandle srv[] = {_particleTexture, rtColor._dsHandle};
-    _ctx->SetShaderResources(srv, 2, ShaderType::PixelShader);
-    _ctx->Draw(numParticles, 0);
-    _ctx->UnsetShaderResources(0, 2, ShaderType::PixelShader);
   }
 
   ScopedRenderTarget rtColorBlurred(rtColor._desc, BufferFlag::CreateSrv | BufferFlag::CreateUav);
@@ -649,6 +643,8 @@ void Tunnel::RenderParameterSet()
   ImGui::SliderFloat("max-dist", &_settings.plexus.max_dist, 10.0, 150.0f);
   ImGui::SliderInt("num-nearest", &_settings.plexus.num_nearest, 1, 20);
   ImGui::SliderInt("num-neighbours", &_settings.plexus.num_neighbours, 1, 100);
+  ImGui::SliderInt("snake-iterations", &_settings.snake_iterations, 1, 20);
+  ImGui::SliderFloat("snake-tolerance", &_settings.snake_tolerance, 0, 0.1f);
 
   if (ImGui::Button("Reset"))
     Reset();
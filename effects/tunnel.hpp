@@ -12,9 +12,16 @@
 #include "../shaders/out/tunnel.particle_gsparticle.cbuffers.hpp"
 #include "../shaders/out/tunnel.particle_psparticle.cbuffers.hpp"
 #include "../random.hpp"
+#include "../spatial_grid.hpp"
+#include "../verlet.hpp"
 
 namespace tano
 {
+  namespace scheduler
+  {
+    struct TaskData;
+  }
+
   struct Snake
   {
     Snake(RandomUniform& randomFloat,
@@ -25,23 +32,32 @@ namespace tano
         const vec3& anchor,
         const vec3& dir);
 
-    void Update(float dt);
-    int CopyOutLines(vec3* out);
-
-    struct Particle
+    // The blackboard values are read once per frame on the main thread, as the snakes
+    // are updated from scheduler tasks
+    struct Params
     {
-      vec3 pos;
-      vec3 lastPos;
-      vec3 acc;
+      vec3 gravity;
+      float damping;
+      float windForce;
+      float forceSpeed;
+      int iterations;
+      float tolerance;
     };
 
-    struct Constraint
+    void Update(float dt, const Params& params);
+    int CopyOutLines(vec3* out);
+    // number of verts written by CopyOutLines
+    int NumLineVerts() const { return 2 * _clothDimY + 4 * (_clothDimY - 1); }
+
+    struct UpdateKernelData
     {
-      u16 i0;
-      u16 i1;
-      float restLength;
+      Snake* snake;
+      float dt;
+      const Params* params;
     };
 
+    static void UpdateKernel(const scheduler::TaskData& data);
+
     vec3 _gravity = vec3{ 0, 0, 0 };
     float _damping = 0.99f;
     int _clothDimX, _clothDimY;
@@ -51,8 +67,7 @@ namespace tano
     int _numParticles = 0;
     float _forceAngle;
 
-    vector<Particle> _particles;
-    vector<Constraint> _constraints;
+    VerletSystem _cloth;
   };
 
   //------------------------------------------------------------------------------
@@ -66,6 +81,8 @@ namespace tano
     virtual bool Init() override;
     virtual bool Update(const UpdateState& state) override;
     virtual bool FixedUpdate(const FixedUpdateState& state) override;
+    virtual bool ThreadSafeUpdate() const override { return true; }
+    virtual void PreUpdate() override;
     virtual bool Render() override;
     virtual bool Close() override;
     virtual const char* GetName() { return Name(); }
@@ -85,6 +102,7 @@ namespace tano
     void UpdateCameraMatrix(const UpdateState& state);
 
     void PlexusUpdate(const UpdateState& state);
+    Snake::Params SnakeParams() const;
 
     u32 _numTunnelFaceIndices = 0;
     u32 _numTunnelFaces = 0;
@@ -101,6 +119,7 @@ namespace tano
 
     SimpleAppendBuffer<vec3, 64 * 1024> _tunnelPlexusVerts;
     SimpleAppendBuffer<vec3, 64 * 1024> _tunnelFaceVerts;
+    SpatialGrid _plexusGrid;
 
     bool _useFreeFly = false;
     float _dist = 0;
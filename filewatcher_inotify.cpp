@@ -0,0 +1,338 @@
+#if defined(__linux__)
+#include "filewatcher_inotify.hpp"
+#include "path_utils.hpp"
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+using namespace tano;
+using namespace bristol;
+
+// IN_MOVED_TO catches editors that write a temp file and rename it over the original,
+// and IN_MODIFY keeps pushing the debounce back during long writes
+static const uint32_t INOTIFY_FLAGS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY;
+
+//------------------------------------------------------------------------------
+FileWatcherInotify::FileWatcherInotify()
+{
+  _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_fd == -1)
+    LOG_WARN("Unable to create inotify instance: ", strerror(errno));
+}
+
+//------------------------------------------------------------------------------
+FileWatcherInotify::~FileWatcherInotify()
+{
+  // several paths can lead to the same directory, so collect the unique ones
+  unordered_set<WatchedDir*> dirs;
+  for (auto kv : _watchesByDir)
+    dirs.insert(kv.second);
+
+  for (WatchedDir* dir : dirs)
+  {
+    for (auto& file : dir->files)
+      SeqDelete(&file.second);
+    delete dir;
+  }
+  _watchesByDir.clear();
+
+  // closing the descriptor removes all the watches
+  if (_fd != -1)
+    close(_fd);
+}
+
+//------------------------------------------------------------------------------
+u64 FileWatcherInotify::NowMs()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//------------------------------------------------------------------------------
+FileWatcherInotify::AddFileWatchResult FileWatcherInotify::AddFileWatch(
+  const string& filename, bool initialCallback, const cbFileChanged& cb)
+{
+  if (_fd == -1)
+    return AddFileWatchResult();
+
+  // split filename into dir/file
+  string head, tail;
+  string canonical = Path::MakeCanonical(filename);
+  Path::Split(canonical, &head, &tail);
+  if (head.empty())
+    head = ".";
+
+  // check if the directory is already watched
+  WatchedDir* dir = nullptr;
+  auto it = _watchesByDir.find(head);
+  if (it == _watchesByDir.end())
+  {
+    int wd = inotify_add_watch(_fd, head.c_str(), INOTIFY_FLAGS | IN_ONLYDIR);
+    if (wd == -1)
+    {
+      LOG_WARN("Unable to watch directory: ", head, ", ", strerror(errno));
+      return AddFileWatchResult();
+    }
+
+    // different paths to the same directory give the same descriptor
+    auto itWd = _watchesByDescriptor.find(wd);
+    if (itWd != _watchesByDescriptor.end())
+    {
+      dir = itWd->second;
+    }
+    else
+    {
+      dir = new WatchedDir{wd, head};
+      _watchesByDescriptor[wd] = dir;
+    }
+    _watchesByDir[head] = dir;
+  }
+  else
+  {
+    dir = it->second;
+    // the watch was lost when the directory was removed, so try again, in case it has
+    // been recreated since
+    if (dir->wd == -1)
+    {
+      dir = RearmDir(dir);
+      if (!dir)
+        return AddFileWatchResult();
+    }
+  }
+
+  AddFileWatchResult res;
+  res.watchId = _nextId++;
+  dir->files[tail].push_back(new CallbackContext{filename, cb, res.watchId});
+  _dirByWatchId[res.watchId] = dir;
+
+  // Do the initial calback if requested
+  if (initialCallback)
+    res.initialResult = cb(filename);
+
+  return res;
+}
+
+//------------------------------------------------------------------------------
+FileWatcherInotify::WatchedDir* FileWatcherInotify::RearmDir(WatchedDir* dir)
+{
+  int wd = inotify_add_watch(_fd, dir->path.c_str(), INOTIFY_FLAGS | IN_ONLYDIR);
+  if (wd == -1)
+  {
+    LOG_WARN("Unable to watch directory: ", dir->path, ", ", strerror(errno));
+    return nullptr;
+  }
+
+  auto itWd = _watchesByDescriptor.find(wd);
+  if (itWd == _watchesByDescriptor.end())
+  {
+    dir->wd = wd;
+    _watchesByDescriptor[wd] = dir;
+    return dir;
+  }
+
+  // another path to the same directory has already been rearmed, so move the callbacks
+  // over to it
+  WatchedDir* other = itWd->second;
+  for (auto& file : dir->files)
+  {
+    vector<CallbackContext*>& callbacks = other->files[file.first];
+    callbacks.insert(callbacks.end(), file.second.begin(), file.second.end());
+  }
+
+  for (auto& kv : _watchesByDir)
+  {
+    if (kv.second == dir)
+      kv.second = other;
+  }
+
+  for (auto& kv : _dirByWatchId)
+  {
+    if (kv.second == dir)
+      kv.second = other;
+  }
+
+  delete dir;
+  return other;
+}
+
+//------------------------------------------------------------------------------
+void FileWatcherInotify::RemoveFileWatch(WatchId id)
+{
+  auto itId = _dirByWatchId.find(id);
+  if (itId == _dirByWatchId.end())
+    return;
+
+  WatchedDir* dir = itId->second;
+  _dirByWatchId.erase(itId);
+
+  for (auto itFile = dir->files.begin(); itFile != dir->files.end(); )
+  {
+    vector<CallbackContext*>& callbacks = itFile->second;
+    for (auto itCb = callbacks.begin(); itCb != callbacks.end(); )
+    {
+      if ((*itCb)->id == id)
+      {
+        delete *itCb;
+        itCb = callbacks.erase(itCb);
+      }
+      else
+      {
+        ++itCb;
+      }
+    }
+
+    if (callbacks.empty())
+      itFile = dir->files.erase(itFile);
+    else
+      ++itFile;
+  }
+
+  if (dir->files.empty())
+    RemoveDir(dir);
+}
+
+//------------------------------------------------------------------------------
+void FileWatcherInotify::RemoveDir(WatchedDir* dir)
+{
+  if (dir->wd != -1)
+  {
+    inotify_rm_watch(_fd, dir->wd);
+    _watchesByDescriptor.erase(dir->wd);
+  }
+
+  for (auto it = _watchesByDir.begin(); it != _watchesByDir.end(); )
+  {
+    if (it->second == dir)
+      it = _watchesByDir.erase(it);
+    else
+      ++it;
+  }
+
+  delete dir;
+}
+
+//------------------------------------------------------------------------------
+void FileWatcherInotify::AddPendingChange(int wd, const string& filename, u64 now)
+{
+  // repeated events for the same file just push the deadline back
+  string key = to_string(wd) + "/" + filename;
+  auto it = _pendingChanges.find(key);
+  if (it == _pendingChanges.end())
+    _pendingChanges[key] = PendingChange{wd, filename, now};
+  else
+    it->second.lastEvent = now;
+}
+
+//------------------------------------------------------------------------------
+void FileWatcherInotify::ReadEvents(u64 now)
+{
+  while (true)
+  {
+    ssize_t len = read(_fd, _buf, BUF_SIZE);
+    if (len <= 0)
+    {
+      // EAGAIN means the queue is drained
+      if (len == -1 && errno != EAGAIN && errno != EINTR)
+        LOG_WARN("Error reading inotify events: ", strerror(errno));
+      if (len == -1 && errno == EINTR)
+        continue;
+      break;
+    }
+
+    for (char* ptr = _buf; ptr < _buf + len; )
+    {
+      const inotify_event* event = (const inotify_event*)ptr;
+      ptr += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW)
+      {
+        // events were dropped, so assume every watched file changed
+        for (auto kv : _watchesByDescriptor)
+        {
+          for (auto& file : kv.second->files)
+            AddPendingChange(kv.first, file.first, now);
+        }
+        continue;
+      }
+
+      auto itDir = _watchesByDescriptor.find(event->wd);
+      if (itDir == _watchesByDescriptor.end())
+        continue;
+
+      WatchedDir* dir = itDir->second;
+      if (event->mask & IN_IGNORED)
+      {
+        // the directory was deleted or unmounted, so the watch is gone. The next
+        // AddFileWatch for the directory rearms it
+        LOG_WARN("Lost the watch on directory: ", dir->path);
+        _watchesByDescriptor.erase(itDir);
+        dir->wd = -1;
+        continue;
+      }
+
+      if (event->len == 0)
+        continue;
+
+      // only keep events for files that are actually watched
+      string filename(event->name);
+      if (dir->files.find(filename) != dir->files.end())
+        AddPendingChange(event->wd, filename, now);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void FileWatcherInotify::Tick()
+{
+  if (_fd == -1)
+    return;
+
+  u64 now = NowMs();
+  ReadEvents(now);
+
+  if (_pendingChanges.empty())
+    return;
+
+  // move the changes that have settled to the ready queue
+  _readyChanges.clear();
+  for (auto it = _pendingChanges.begin(); it != _pendingChanges.end(); )
+  {
+    if (now - it->second.lastEvent >= DEBOUNCE_MS)
+    {
+      _readyChanges.push_back(it->second);
+      it = _pendingChanges.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  sort(_readyChanges.begin(), _readyChanges.end(),
+      [](const PendingChange& lhs, const PendingChange& rhs)
+      {
+        return lhs.lastEvent < rhs.lastEvent;
+      });
+
+  for (const PendingChange& change : _readyChanges)
+  {
+    auto itDir = _watchesByDescriptor.find(change.wd);
+    if (itDir == _watchesByDescriptor.end())
+      continue;
+
+    auto itFile = itDir->second->files.find(change.filename);
+    if (itFile == itDir->second->files.end())
+      continue;
+
+    // copy the callbacks, as they are free to add or remove watches
+    vector<pair<string, cbFileChanged>> callbacks;
+    for (const CallbackContext* ctx : itFile->second)
+      callbacks.push_back(make_pair(ctx->fullPath, ctx->cb));
+
+    for (const auto& cb : callbacks)
+      cb.second(cb.first);
+  }
+}
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#if defined(__linux__)
+namespace tano
+{
+  // Event driven file watcher using inotify, with the same interface as FileWatcherWin32.
+  // Directories are watched rather than files, so saves done via a temp file and rename
+  // are picked up, and any number of files in a directory share a single watch.
+  // Tick drains the inotify queue without blocking, and the events are coalesced per
+  // file, and delivered once the file has been quiet for DEBOUNCE_MS.
+  class FileWatcherInotify
+  {
+  public:
+    FileWatcherInotify();
+    ~FileWatcherInotify();
+
+    typedef int WatchId;
+    typedef function<bool(const string&)> cbFileChanged;
+
+    enum { DEBOUNCE_MS = 100 };
+
+    struct AddFileWatchResult
+    {
+      WatchId watchId = -1;
+      bool initialResult = true;
+    };
+
+    AddFileWatchResult AddFileWatch(
+        const string& filename, bool initialCallback, const cbFileChanged& cb);
+    void RemoveFileWatch(WatchId id);
+
+    void Tick();
+
+  private:
+
+    struct CallbackContext
+    {
+      string fullPath;
+      cbFileChanged cb;
+      WatchId id;
+    };
+
+    struct WatchedDir
+    {
+      int wd;
+      string path;
+      // callbacks by filename
+      unordered_map<string, vector<CallbackContext*>> files;
+    };
+
+    struct PendingChange
+    {
+      int wd;
+      string filename;
+      u64 lastEvent;
+    };
+
+    void ReadEvents(u64 now);
+    void AddPendingChange(int wd, const string& filename, u64 now);
+    // Returns the directory that now holds the callbacks, or null if it can't be watched
+    WatchedDir* RearmDir(WatchedDir* dir);
+    void RemoveDir(WatchedDir* dir);
+    static u64 NowMs();
+
+    int _fd = -1;
+
+    unordered_map<string, WatchedDir*> _watchesByDir;
+    unordered_map<int, WatchedDir*> _watchesByDescriptor;
+    unordered_map<WatchId, WatchedDir*> _dirByWatchId;
+
+    // changed files, keyed on their path, waiting to be quiet for DEBOUNCE_MS
+    unordered_map<string, PendingChange> _pendingChanges;
+    // changes that are ready to be delivered, in the order they settled
+    vector<PendingChange> _readyChanges;
+
+    uint32_t _nextId = 0;
+
+    enum { BUF_SIZE = 16 * 1024 };
+    alignas(8) char _buf[BUF_SIZE];
+  };
+}
+#endif
@@ -0,0 +1,309 @@
+#include "fractal_noise.hpp"
+#include "perlin2d.hpp"
+
+#if WITH_BENCHMARKS
+#include "stop_watch.hpp"
+#endif
+
+using namespace tano;
+using namespace bristol;
+
+namespace
+{
+  // Batch evaluation works on blocks this size, so the temp buffers can live on the stack
+  const int BLOCK_COLS = 256;
+  const int BLOCK_ROWS = 16;
+  const int BLOCK_POINTS = 256;
+
+  // Offset for the warp's second lookup, so the two components are uncorrelated
+  const vec2 WARP_OFFSET(5.2f, 1.3f);
+
+  //------------------------------------------------------------------------------
+  // Each octave is shifted, so the lattice points don't line up at the origin
+  inline vec2 OctaveOffset(int octave)
+  {
+    return vec2(octave * 19.19f, octave * -7.37f);
+  }
+
+  //------------------------------------------------------------------------------
+  inline float Ridge(float v)
+  {
+    float r = 1 - fabsf(v);
+    return r * r;
+  }
+
+  //------------------------------------------------------------------------------
+  inline float Identity(float v)
+  {
+    return v;
+  }
+
+  //------------------------------------------------------------------------------
+  template <typename Fn>
+  void OctaveGrid(const FractalNoise& noise,
+      float x0,
+      float y0,
+      float stepX,
+      float stepY,
+      int w,
+      int h,
+      float* out,
+      Fn fn)
+  {
+    float tmp[BLOCK_COLS * BLOCK_ROWS];
+
+    for (int by = 0; by < h; by += BLOCK_ROWS)
+    {
+      for (int bx = 0; bx < w; bx += BLOCK_COLS)
+      {
+        int bw = min(BLOCK_COLS, w - bx);
+        int bh = min(BLOCK_ROWS, h - by);
+
+        for (int j = 0; j < bh; ++j)
+          memset(out + (by + j) * w + bx, 0, bw * sizeof(float));
+
+        float amp = 1;
+        float ampSum = 0;
+        float freq = noise.frequency;
+        for (int i = 0; i < noise.octaves; ++i)
+        {
+          vec2 ofs = OctaveOffset(i);
+          Perlin2D::ValueGrid((x0 + bx * stepX) * freq + ofs.x,
+              (y0 + by * stepY) * freq + ofs.y,
+              stepX * freq,
+              stepY * freq,
+              bw,
+              bh,
+              tmp);
+
+          for (int j = 0; j < bh; ++j)
+          {
+            float* dst = out + (by + j) * w + bx;
+            const float* src = tmp + j * bw;
+            for (int k = 0; k < bw; ++k)
+              dst[k] += amp * fn(src[k]);
+          }
+
+          ampSum += amp;
+          amp *= noise.gain;
+          freq *= noise.lacunarity;
+        }
+
+        float scale = ampSum > 0 ? 1 / ampSum : 0;
+        for (int j = 0; j < bh; ++j)
+        {
+          float* dst = out + (by + j) * w + bx;
+          for (int k = 0; k < bw; ++k)
+            dst[k] *= scale;
+        }
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+float FractalNoise::Fbm(float x, float y) const
+{
+  float sum = 0;
+  float amp = 1;
+  float ampSum = 0;
+  float freq = frequency;
+  for (int i = 0; i < octaves; ++i)
+  {
+    vec2 ofs = OctaveOffset(i);
+    sum += amp * Perlin2D::Value(x * freq + ofs.x, y * freq + ofs.y);
+    ampSum += amp;
+    amp *= gain;
+    freq *= lacunarity;
+  }
+
+  return ampSum > 0 ? sum / ampSum : 0;
+}
+
+//------------------------------------------------------------------------------
+float FractalNoise::Fbm(float x, float y, vec2* deriv) const
+{
+  float sum = 0;
+  vec2 dsum(0, 0);
+  float amp = 1;
+  float ampSum = 0;
+  float freq = frequency;
+  for (int i = 0; i < octaves; ++i)
+  {
+    vec2 ofs = OctaveOffset(i);
+    vec2 d;
+    sum += amp * Perlin2D::ValueDeriv(x * freq + ofs.x, y * freq + ofs.y, &d);
+    // chain rule, as the octave is sampled at freq * p
+    dsum = dsum + (amp * freq) * d;
+    ampSum += amp;
+    amp *= gain;
+    freq *= lacunarity;
+  }
+
+  float scale = ampSum > 0 ? 1 / ampSum : 0;
+  *deriv = scale * dsum;
+  return scale * sum;
+}
+
+//------------------------------------------------------------------------------
+float FractalNoise::Ridged(float x, float y) const
+{
+  float sum = 0;
+  float amp = 1;
+  float ampSum = 0;
+  float freq = frequency;
+  for (int i = 0; i < octaves; ++i)
+  {
+    vec2 ofs = OctaveOffset(i);
+    sum += amp * Ridge(Perlin2D::Value(x * freq + ofs.x, y * freq + ofs.y));
+    ampSum += amp;
+    amp *= gain;
+    freq *= lacunarity;
+  }
+
+  return ampSum > 0 ? sum / ampSum : 0;
+}
+
+//------------------------------------------------------------------------------
+float FractalNoise::Warped(float x, float y) const
+{
+  float qx = Fbm(x, y);
+  float qy = Fbm(x + WARP_OFFSET.x, y + WARP_OFFSET.y);
+  return Fbm(x + warpStrength * qx, y + warpStrength * qy);
+}
+
+//------------------------------------------------------------------------------
+void FractalNoise::FbmGrid(
+    float x0, float y0, float stepX, float stepY, int w, int h, float* out) const
+{
+  OctaveGrid(*this, x0, y0, stepX, stepY, w, h, out, Identity);
+}
+
+//------------------------------------------------------------------------------
+void FractalNoise::RidgedGrid(
+    float x0, float y0, float stepX, float stepY, int w, int h, float* out) const
+{
+  OctaveGrid(*this, x0, y0, stepX, stepY, w, h, out, Ridge);
+}
+
+//------------------------------------------------------------------------------
+void FractalNoise::FbmValues(const vec2* pts, int num, float* out) const
+{
+  vec2 scaled[BLOCK_POINTS];
+  float tmp[BLOCK_POINTS];
+
+  for (int start = 0; start < num; start += BLOCK_POINTS)
+  {
+    int n = min(BLOCK_POINTS, num - start);
+    const vec2* src = pts + start;
+    float* dst = out + start;
+    memset(dst, 0, n * sizeof(float));
+
+    float amp = 1;
+    float ampSum = 0;
+    float freq = frequency;
+    for (int i = 0; i < octaves; ++i)
+    {
+      vec2 ofs = OctaveOffset(i);
+      for (int k = 0; k < n; ++k)
+        scaled[k] = vec2(src[k].x * freq + ofs.x, src[k].y * freq + ofs.y);
+
+      Perlin2D::Values(scaled, n, tmp);
+      for (int k = 0; k < n; ++k)
+        dst[k] += amp * tmp[k];
+
+      ampSum += amp;
+      amp *= gain;
+      freq *= lacunarity;
+    }
+
+    float scale = ampSum > 0 ? 1 / ampSum : 0;
+    for (int k = 0; k < n; ++k)
+      dst[k] *= scale;
+  }
+}
+
+//------------------------------------------------------------------------------
+void FractalNoise::WarpedValues(const vec2* pts, int num, float* out) const
+{
+  vec2 tmpPts[BLOCK_POINTS];
+  float qx[BLOCK_POINTS];
+  float qy[BLOCK_POINTS];
+
+  for (int start = 0; start < num; start += BLOCK_POINTS)
+  {
+    int n = min(BLOCK_POINTS, num - start);
+    const vec2* src = pts + start;
+
+    FbmValues(src, n, qx);
+
+    for (int k = 0; k < n; ++k)
+      tmpPts[k] = src[k] + WARP_OFFSET;
+    FbmValues(tmpPts, n, qy);
+
+    for (int k = 0; k < n; ++k)
+      tmpPts[k] = vec2(src[k].x + warpStrength * qx[k], src[k].y + warpStrength * qy[k]);
+    FbmValues(tmpPts, n, out + start);
+  }
+}
+
+#if WITH_BENCHMARKS
+//------------------------------------------------------------------------------
+void tano::FractalNoiseBenchmark()
+{
+  const int W = 256;
+  const int H = 256;
+  const int NUM_SAMPLES = W * H;
+  vector<float> out(NUM_SAMPLES);
+  vector<vec2> pts(NUM_SAMPLES);
+  for (int i = 0; i < NUM_SAMPLES; ++i)
+    pts[i] = vec2((i % W) * 0.05f, (i / W) * 0.05f);
+
+  FractalNoise noise;
+  StopWatch stopWatch;
+
+  auto fnReport = [&](const char* name, double seconds, int octaves)
+  {
+    double ns = 1e9 * seconds / NUM_SAMPLES;
+    LOG_INFO("noise benchmark: ", name, ": ", ns, " ns/sample, ", ns / octaves, " ns/octave");
+  };
+
+  stopWatch.Start();
+  for (int i = 0; i < NUM_SAMPLES; ++i)
+    out[i] = Perlin2D::Value(pts[i].x, pts[i].y);
+  fnReport("Perlin2D::Value", stopWatch.Stop(), 1);
+
+  stopWatch.Start();
+  Perlin2D::ValueGrid(0, 0, 0.05f, 0.05f, W, H, out.data());
+  fnReport("Perlin2D::ValueGrid", stopWatch.Stop(), 1);
+
+  stopWatch.Start();
+  for (int i = 0; i < NUM_SAMPLES; ++i)
+    out[i] = noise.Fbm(pts[i].x, pts[i].y);
+  fnReport("Fbm", stopWatch.Stop(), noise.octaves);
+
+  stopWatch.Start();
+  for (int i = 0; i < NUM_SAMPLES; ++i)
+  {
+    vec2 d;
+    out[i] = noise.Fbm(pts[i].x, pts[i].y, &d);
+  }
+  fnReport("Fbm (with derivatives)", stopWatch.Stop(), noise.octaves);
+
+  stopWatch.Start();
+  noise.FbmGrid(0, 0, 0.05f, 0.05f, W, H, out.data());
+  fnReport("FbmGrid", stopWatch.Stop(), noise.octaves);
+
+  stopWatch.Start();
+  noise.RidgedGrid(0, 0, 0.05f, 0.05f, W, H, out.data());
+  fnReport("RidgedGrid", stopWatch.Stop(), noise.octaves);
+
+  stopWatch.Start();
+  noise.FbmValues(pts.data(), NUM_SAMPLES, out.data());
+  fnReport("FbmValues", stopWatch.Stop(), noise.octaves);
+
+  stopWatch.Start();
+  noise.WarpedValues(pts.data(), NUM_SAMPLES, out.data());
+  fnReport("WarpedValues", stopWatch.Stop(), 3 * noise.octaves);
+}
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "tano_math.hpp"
+
+namespace tano
+{
+  //------------------------------------------------------------------------------
+  // Multi-octave noise built on Perlin2D. The fBm value is normalized by the sum of
+  // the octave amplitudes, so it stays in roughly the same range as a single octave.
+  // The batch versions evaluate an octave at a time using the SSE Perlin2D paths.
+  struct FractalNoise
+  {
+    float Fbm(float x, float y) const;
+    // fBm with analytic partial derivatives
+    float Fbm(float x, float y, vec2* deriv) const;
+
+    // Ridged multifractal: sharp creases where the base noise crosses zero, in [0, 1]
+    float Ridged(float x, float y) const;
+
+    // fBm sampled at a position offset by two other fBm lookups (Quilez-style warp)
+    float Warped(float x, float y) const;
+
+    // out[j * w + i] = Fbm(x0 + i * stepX, y0 + j * stepY), and likewise for Ridged
+    void FbmGrid(float x0, float y0, float stepX, float stepY, int w, int h, float* out) const;
+    void RidgedGrid(float x0, float y0, float stepX, float stepY, int w, int h, float* out) const;
+
+    void FbmValues(const vec2* pts, int num, float* out) const;
+    void WarpedValues(const vec2* pts, int num, float* out) const;
+
+    int octaves = 5;
+    float frequency = 1;
+    float lacunarity = 2;
+    float gain = 0.5f;
+    float warpStrength = 4;
+  };
+
+#if WITH_BENCHMARKS
+  // Logs the per-sample cost of the noise variants compared to Perlin2D::Value
+  void FractalNoiseBenchmark();
+#endif
+}
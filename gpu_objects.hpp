@@ -207,17 +207,20 @@ namespace tano
         vs0.Create() && ps0.Create() && gs0.Create() && vs1.Create() && ps1.Create() && gs1.Create();
     }
 
-    void Set(GraphicsContext* ctx, const DummyCb& cb, u32 type, u32 slot)
+    template<typename Ctx>
+    void Set(Ctx* ctx, const DummyCb& cb, u32 type, u32 slot)
     {
     }
 
-    template<typename T>
-    void Set(GraphicsContext* ctx, ConstantBuffer<T>& cb, u32 type, u32 slot)
+    template<typename Ctx, typename T>
+    void Set(Ctx* ctx, ConstantBuffer<T>& cb, u32 type, u32 slot)
     {
       ctx->SetConstantBuffer(cb, type, slot);
     }
 
-    void Set(GraphicsContext* ctx, u32 slot)
+    // Ctx is a GraphicsContext, or a CommandBuffer when recording
+    template<typename Ctx>
+    void Set(Ctx* ctx, u32 slot)
     {
       switch (slot)
       {
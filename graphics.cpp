@@ -94,6 +94,10 @@ bool Graphics::Init(HINSTANCE hInstance, bool* cancelled)
 //------------------------------------------------------------------------------
 bool Graphics::Destroy()
 {
+  // the headless benchmark never creates the device
+  if (!g_Graphics)
+    return true;
+
   const GraphicsSettings& settings = g_Graphics->GetGraphicsSettings();
   if (!settings.windowed)
   {
@@ -245,6 +249,8 @@ ID3D11ShaderResourceView* Graphics::GetShaderResourceView(ObjectHandle h)
 
     case ObjectHandle::kDepthStencil: return _depthStencils.Get(h)->srv.ptr;
 
+    case ObjectHandle::kShaderResourceView: return _shaderResourceViews.Get(h);
+
     default: LOG_ERROR("Trying to set a non supported resource view type!"); return nullptr;
   }
 }
@@ -307,45 +313,46 @@ ObjectHandle Graphics::GetTempRenderTarget(
 ObjectHandle Graphics::GetTempRenderTarget(
     int width, int height, DXGI_FORMAT format, const BufferFlags& flags)
 {
-  // Look for a temp render target with the required format etc
-  for (TempRenderTarget& t : _tempRenderTargets)
-  {
-    const D3D11_TEXTURE2D_DESC& d = t.desc;
-    if (!t.inUse && d.Width == width && d.Height == height && d.Format == format
-        && t.flags == flags)
-    {
-      // Found a free render target!
-      t.inUse = true;
-      return MakeObjectHandle(ObjectHandle::kRenderTarget, t.idx);
-    }
-  }
+  // Look for a free temp render target with the required format etc
+  u64 key = TempResourcePool::MakeKey(width, height, format, flags._value);
+  int idx = _tempRenderTargets.Acquire(key);
+  if (idx != -1)
+    return MakeObjectHandle(ObjectHandle::kRenderTarget, idx);
 
   // Render target not found, so create a new one
   RenderTargetResource* rt = CreateRenderTargetPtr(width, height, format, flags);
-  int rtIdx = _renderTargets.Append(rt);
-  _tempRenderTargets.Append({rt->texture.desc, flags, rtIdx, true});
+  if (!rt)
+    return emptyHandle;
 
-  return MakeObjectHandle(ObjectHandle::kRenderTarget, rtIdx);
+  idx = _renderTargets.Append(rt);
+
+  u32 bytes = width * height * SizeFromFormat(format);
+  if (flags.IsSet(BufferFlag::CreateMipMaps))
+    bytes += bytes / 3;
+  _tempRenderTargets.Add(key, idx, bytes);
+
+  return MakeObjectHandle(ObjectHandle::kRenderTarget, idx);
 }
 
 //------------------------------------------------------------------------------
 ObjectHandle Graphics::GetTempDepthStencil(int width, int height, const BufferFlags& flags)
 {
-  for (TempDepthStencil& t : _tempDepthStencils)
-  {
-    if (!t.inUse && t.flags == flags)
-    {
-      t.inUse = true;
-      return MakeObjectHandle(ObjectHandle::kDepthStencil, t.idx);
-    }
-  }
-
-  // Render target not found, so create a new one
+  // all depth stencils are D24S8
+  DXGI_FORMAT format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+  u64 key = TempResourcePool::MakeKey(width, height, format, flags._value);
+  int idx = _tempDepthStencils.Acquire(key);
+  if (idx != -1)
+    return MakeObjectHandle(ObjectHandle::kDepthStencil, idx);
+
+  // Depth stencil not found, so create a new one
   DepthStencilResource* ds = CreateDepthStencilPtr(width, height, flags);
-  int dsIdx = _depthStencils.Append(ds);
-  _tempDepthStencils.Append({flags, dsIdx, true});
+  if (!ds)
+    return emptyHandle;
 
-  return MakeObjectHandle(ObjectHandle::kDepthStencil, dsIdx);
+  idx = _depthStencils.Append(ds);
+  _tempDepthStencils.Add(key, idx, width * height * SizeFromFormat(format));
+
+  return MakeObjectHandle(ObjectHandle::kDepthStencil, idx);
 }
 
 //------------------------------------------------------------------------------
@@ -354,15 +361,7 @@ void Graphics::ReleaseTempRenderTarget(ObjectHandle h)
   if (!h.IsValid())
     return;
 
-  for (TempRenderTarget& t : _tempRenderTargets)
-  {
-    if (t.idx == h.id())
-    {
-      assert(t.inUse);
-      t.inUse = false;
-      break;
-    }
-  }
+  _tempRenderTargets.Release(h.slot());
 }
 
 //------------------------------------------------------------------------------
@@ -371,14 +370,59 @@ void Graphics::ReleaseTempDepthStencil(ObjectHandle h)
   if (!h.IsValid())
     return;
 
-  for (TempDepthStencil& t : _tempDepthStencils)
+  _tempDepthStencils.Release(h.slot());
+}
+
+//------------------------------------------------------------------------------
+void Graphics::EvictTempResources()
+{
+  // Destroy the temp resources that have gone unused for a while, like the targets for
+  // an old resolution, or an effect that has finished
+  _evictedIds.clear();
+  _tempRenderTargets.NewFrame(TEMP_RESOURCE_MAX_AGE, TEMP_RESOURCE_BUDGET, &_evictedIds);
+  for (u32 slot : _evictedIds)
+    _renderTargets.Remove(MakeObjectHandle(ObjectHandle::kRenderTarget, slot));
+
+  _evictedIds.clear();
+  _tempDepthStencils.NewFrame(TEMP_RESOURCE_MAX_AGE, TEMP_RESOURCE_BUDGET, &_evictedIds);
+  for (u32 slot : _evictedIds)
+    _depthStencils.Remove(MakeObjectHandle(ObjectHandle::kDepthStencil, slot));
+}
+
+//------------------------------------------------------------------------------
+void Graphics::ReleaseObject(ObjectHandle h)
+{
+  switch (h.type())
   {
-    if (t.idx == h.id())
-    {
-      assert(t.inUse);
-      t.inUse = false;
+    case ObjectHandle::kVertexBuffer: _vertexBuffers.Remove(h); break;
+    case ObjectHandle::kIndexBuffer: _indexBuffers.Remove(h); break;
+    case ObjectHandle::kConstantBuffer: _constantBuffers.Remove(h); break;
+    case ObjectHandle::kTexture: _textures.Remove(h); break;
+    case ObjectHandle::kResource: _resources.Remove(h); break;
+    case ObjectHandle::kRenderTarget: _renderTargets.Remove(h); break;
+    case ObjectHandle::kDepthStencil: _depthStencils.Remove(h); break;
+    case ObjectHandle::kInputLayout: _inputLayouts.Remove(h); break;
+    case ObjectHandle::kBlendState: _blendStates.Remove(h); break;
+    case ObjectHandle::kRasterizerState: _rasterizerStates.Remove(h); break;
+    case ObjectHandle::kSamplerState: _samplerStates.Remove(h); break;
+    case ObjectHandle::kDepthStencilState: _depthStencilStates.Remove(h); break;
+    case ObjectHandle::kVertexShader: _vertexShaders.Remove(h); break;
+    case ObjectHandle::kGeometryShader: _geometryShaders.Remove(h); break;
+    case ObjectHandle::kPixelShader: _pixelShaders.Remove(h); break;
+    case ObjectHandle::kComputeShader: _computeShaders.Remove(h); break;
+    case ObjectHandle::kStructuredBuffer: _structuredBuffers.Remove(h); break;
+    case ObjectHandle::kShaderResourceView: _shaderResourceViews.Remove(h); break;
+    case ObjectHandle::kSwapChain:
+      // the back buffer getters all go through the default swap chain
+      if (h.ToInt() == _defaultSwapChainHandle.ToInt())
+      {
+        _defaultSwapChainHandle = emptyHandle;
+        _defaultSwapChain = nullptr;
+      }
+      _swapChains.Remove(h);
       break;
-    }
+    case ObjectHandle::kInvalid: break;
+    default: assert(!"Unsupported object type");
   }
 }
 
@@ -600,7 +644,7 @@ ObjectHandle Graphics::LoadTexture(const char* filename, bool srgb, D3DX11_IMAGE
   ObjectHandle handle = ReserveObjectHandle(ObjectHandle::kResource);
   bool firstTime = true;
 
-  FileWatcherWin32::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename,
+  NativeFileWatcher::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename,
     true,
     [&firstTime, info, handle, this](const string& filename) -> bool
   {
@@ -988,9 +1032,9 @@ SwapChain* Graphics::GetSwapChain(ObjectHandle h)
 }
 
 //------------------------------------------------------------------------------
-ObjectHandle Graphics::MakeObjectHandle(ObjectHandle::Type type, int idx, int data)
+ObjectHandle Graphics::MakeObjectHandle(ObjectHandle::Type type, int slot, int data)
 {
-  return idx != -1 ? ObjectHandle(type, idx, data) : emptyHandle;
+  return slot != -1 ? ObjectHandle(type, slot, data) : emptyHandle;
 }
 
 //------------------------------------------------------------------------------
@@ -1033,6 +1077,7 @@ void Graphics::Present()
   rmt_ScopedCPUSample(Graphics_Present);
 
   _defaultSwapChain->Present();
+  EvictTempResources();
 }
 
 //------------------------------------------------------------------------------
@@ -1068,6 +1113,26 @@ ObjectHandle Graphics::DefaultSwapChain()
   return _defaultSwapChainHandle;
 }
 
+//------------------------------------------------------------------------------
+bool Graphics::LoadShaderBytecode(
+    const string& filename, const void* curShader, vector<char>* buf)
+{
+  if (!_shaderCacheLoaded)
+  {
+    _shaderCache.Load(SHADER_CACHE_FILE);
+    _shaderCacheLoaded = true;
+  }
+
+  // The shader's slot stays empty until its initial load, so if there's already a shader,
+  // this is a hot reload. The cache holds the shaders as they were at startup, so an
+  // edited one is read from its file.
+  bool hotReload = curShader != nullptr;
+  if (!hotReload && _shaderCache.Get(filename.c_str(), buf))
+    return true;
+
+  return RESOURCE_MANAGER.LoadFile(filename.c_str(), buf);
+}
+
 //------------------------------------------------------------------------------
 ObjectHandle Graphics::LoadVertexShaderFromFile(const string& filenameBase,
     const char* entry,
@@ -1086,7 +1151,7 @@ ObjectHandle Graphics::LoadVertexShaderFromFile(const string& filenameBase,
   if (elements)
     localElementDesc = *elements;
 
-  FileWatcherWin32::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename.c_str(),
+  NativeFileWatcher::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename.c_str(),
       true,
       [=](const string& filename)
       {
@@ -1094,12 +1159,15 @@ ObjectHandle Graphics::LoadVertexShaderFromFile(const string& filenameBase,
         vector<char> buf;
         ID3D11VertexShader* shader = nullptr;
 
-        INIT_FATAL(RESOURCE_MANAGER.LoadFile(filename.c_str(), &buf));
+        INIT_FATAL(LoadShaderBytecode(filename, _vertexShaders.Get(handle), &buf));
         INIT_HR_FATAL(_device->CreateVertexShader(buf.data(), buf.size(), NULL, &shader));
         _vertexShaders.Update(handle, shader);
 
         if (inputLayout)
         {
+          // a reload replaces the layout, so free the old one rather than leaking its slot
+          if (inputLayout->IsValid())
+            ReleaseObject(*inputLayout);
           INIT_RESOURCE_FATAL(*inputLayout, CreateInputLayout(localElementDesc, buf));
         }
 
@@ -1120,7 +1188,7 @@ ObjectHandle Graphics::LoadPixelShaderFromFile(const string& filenameBase, const
   string filename = filenameBase + ToString("_%s.pso", entry);
 #endif
 
-  FileWatcherWin32::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename,
+  NativeFileWatcher::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename,
       true,
       [=](const string& filename)
       {
@@ -1129,7 +1197,7 @@ ObjectHandle Graphics::LoadPixelShaderFromFile(const string& filenameBase, const
         vector<char> buf;
         ID3D11PixelShader* shader = nullptr;
 
-        INIT_FATAL(RESOURCE_MANAGER.LoadFile(filename.c_str(), &buf));
+        INIT_FATAL(LoadShaderBytecode(filename, _pixelShaders.Get(handle), &buf));
         INIT_HR_FATAL(_device->CreatePixelShader(buf.data(), buf.size(), NULL, &shader));
         _pixelShaders.Update(handle, shader);
 
@@ -1150,7 +1218,7 @@ ObjectHandle Graphics::LoadGeometryShaderFromFile(const string& filenameBase, co
   string filename = filenameBase + ToString("_%s.gso", entry);
 #endif
 
-  FileWatcherWin32::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename.c_str(),
+  NativeFileWatcher::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename.c_str(),
       true,
       [=](const string& filename)
       {
@@ -1159,7 +1227,7 @@ ObjectHandle Graphics::LoadGeometryShaderFromFile(const string& filenameBase, co
         vector<char> buf;
         ID3D11GeometryShader* shader = nullptr;
 
-        INIT_FATAL(RESOURCE_MANAGER.LoadFile(filename.c_str(), &buf));
+        INIT_FATAL(LoadShaderBytecode(filename, _geometryShaders.Get(handle), &buf));
         INIT_HR_FATAL(_device->CreateGeometryShader(buf.data(), buf.size(), NULL, &shader));
         _geometryShaders.Update(handle, shader);
 
@@ -1180,7 +1248,7 @@ ObjectHandle Graphics::LoadComputeShaderFromFile(const string& filenameBase, con
   string filename = filenameBase + ToString("_%s.cso", entry);
 #endif
 
-  FileWatcherWin32::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename.c_str(),
+  NativeFileWatcher::AddFileWatchResult res = RESOURCE_MANAGER.AddFileWatch(filename.c_str(),
       true,
       [=](const string& filename)
       {
@@ -1189,7 +1257,7 @@ ObjectHandle Graphics::LoadComputeShaderFromFile(const string& filenameBase, con
         vector<char> buf;
         ID3D11ComputeShader* shader = nullptr;
 
-        INIT_FATAL(RESOURCE_MANAGER.LoadFile(filename.c_str(), &buf));
+        INIT_FATAL(LoadShaderBytecode(filename, _computeShaders.Get(handle), &buf));
         INIT_HR_FATAL(_device->CreateComputeShader(buf.data(), buf.size(), NULL, &shader));
         _computeShaders.Update(handle, shader);
 
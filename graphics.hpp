@@ -7,8 +7,10 @@
 
 #pragma once
 #include "object_handle.hpp"
-#include "append_buffer.hpp"
+#include "slot_map.hpp"
 #include "graphics_extra.hpp"
+#include "temp_resource_pool.hpp"
+#include "shader_cache.hpp"
 
 namespace tano
 {
@@ -68,6 +70,14 @@ namespace tano
     ObjectHandle GetTempDepthStencil(int width, int height, const BufferFlags& bufferFlags);
     void ReleaseTempRenderTarget(ObjectHandle h);
     void ReleaseTempDepthStencil(ObjectHandle h);
+    const TempResourcePool::Stats& TempRenderTargetStats() const
+    {
+      return _tempRenderTargets.GetStats();
+    }
+    const TempResourcePool::Stats& TempDepthStencilStats() const
+    {
+      return _tempDepthStencils.GetStats();
+    }
 
     ObjectHandle CreateRenderTarget(
         int width, int height, DXGI_FORMAT format, const BufferFlags& bufferFlags);
@@ -129,7 +139,11 @@ namespace tano
     ObjectHandle LoadComputeShaderFromFile(const string& filenameBase, const char* entry);
     ObjectHandle LoadGeometryShaderFromFile(const string& filenameBase, const char* entry);
 
-    static ObjectHandle MakeObjectHandle(ObjectHandle::Type type, int idx, int data = 0);
+    static ObjectHandle MakeObjectHandle(ObjectHandle::Type type, int slot, int data = 0);
+
+    // Destroys the object, and frees its slot for reuse. Any remaining handles to it are
+    // detected as stale.
+    void ReleaseObject(ObjectHandle h);
 
   private:
     ~Graphics();
@@ -155,6 +169,10 @@ namespace tano
 
     ObjectHandle InsertTexture(TextureResource* data);
 
+    // Shaders come from the shader cache on their initial load when it has them, and
+    // otherwise from their file. 'curShader' is the shader currently in the slot.
+    bool LoadShaderBytecode(const string& filename, const void* curShader, vector<char>* buf);
+
     GraphicsSettings _graphicsSettings;
 
     CComPtr<ID3D11Device> _device;
@@ -167,31 +185,27 @@ namespace tano
 #endif
 
     // resources
-    enum
-    {
-      IdCount = 1 << ObjectHandle::cIdBits
-    };
-    AppendBuffer<ID3D11VertexShader*, IdCount, ReleaseMixin> _vertexShaders;
-    AppendBuffer<ID3D11PixelShader*, IdCount, ReleaseMixin> _pixelShaders;
-    AppendBuffer<ID3D11ComputeShader*, IdCount, ReleaseMixin> _computeShaders;
-    AppendBuffer<ID3D11GeometryShader*, IdCount, ReleaseMixin> _geometryShaders;
-    AppendBuffer<ID3D11InputLayout*, IdCount, ReleaseMixin> _inputLayouts;
-    AppendBuffer<ID3D11Buffer*, IdCount, ReleaseMixin> _vertexBuffers;
-    AppendBuffer<ID3D11Buffer*, IdCount, ReleaseMixin> _indexBuffers;
-    AppendBuffer<ID3D11Buffer*, IdCount, ReleaseMixin> _constantBuffers;
-
-    AppendBuffer<ID3D11BlendState*, IdCount, ReleaseMixin> _blendStates;
-    AppendBuffer<ID3D11DepthStencilState*, IdCount, ReleaseMixin> _depthStencilStates;
-    AppendBuffer<ID3D11RasterizerState*, IdCount, ReleaseMixin> _rasterizerStates;
-    AppendBuffer<ID3D11SamplerState*, IdCount, ReleaseMixin> _samplerStates;
-    AppendBuffer<ID3D11ShaderResourceView*, IdCount, ReleaseMixin> _shaderResourceViews;
-
-    AppendBuffer<TextureResource*, IdCount, DeleteMixin> _textures;
-    AppendBuffer<RenderTargetResource*, IdCount, DeleteMixin> _renderTargets;
-    AppendBuffer<DepthStencilResource*, IdCount, DeleteMixin> _depthStencils;
-    AppendBuffer<SimpleResource*, IdCount, DeleteMixin> _resources;
-    AppendBuffer<StructuredBuffer*, IdCount, DeleteMixin> _structuredBuffers;
-    AppendBuffer<SwapChain*, 16, DeleteMixin> _swapChains;
+    SlotMap<ID3D11VertexShader*, ReleaseMixin> _vertexShaders;
+    SlotMap<ID3D11PixelShader*, ReleaseMixin> _pixelShaders;
+    SlotMap<ID3D11ComputeShader*, ReleaseMixin> _computeShaders;
+    SlotMap<ID3D11GeometryShader*, ReleaseMixin> _geometryShaders;
+    SlotMap<ID3D11InputLayout*, ReleaseMixin> _inputLayouts;
+    SlotMap<ID3D11Buffer*, ReleaseMixin> _vertexBuffers;
+    SlotMap<ID3D11Buffer*, ReleaseMixin> _indexBuffers;
+    SlotMap<ID3D11Buffer*, ReleaseMixin> _constantBuffers;
+
+    SlotMap<ID3D11BlendState*, ReleaseMixin> _blendStates;
+    SlotMap<ID3D11DepthStencilState*, ReleaseMixin> _depthStencilStates;
+    SlotMap<ID3D11RasterizerState*, ReleaseMixin> _rasterizerStates;
+    SlotMap<ID3D11SamplerState*, ReleaseMixin> _samplerStates;
+    SlotMap<ID3D11ShaderResourceView*, ReleaseMixin> _shaderResourceViews;
+
+    SlotMap<TextureResource*, DeleteMixin> _textures;
+    SlotMap<RenderTargetResource*, DeleteMixin> _renderTargets;
+    SlotMap<DepthStencilResource*, DeleteMixin> _depthStencils;
+    SlotMap<SimpleResource*, DeleteMixin> _resources;
+    SlotMap<StructuredBuffer*, DeleteMixin> _structuredBuffers;
+    SlotMap<SwapChain*, DeleteMixin> _swapChains;
 
     static IDXGIDebug* _debugInterface;
     static HMODULE _debugModule;
@@ -208,23 +222,19 @@ namespace tano
 
     bool _enumerateAllOutputs = false;
 
-    struct TempRenderTarget
-    {
-      D3D11_TEXTURE2D_DESC desc;
-      BufferFlags flags;
-      u32 idx;
-      bool inUse;
-    };
+    // free temp resources are destroyed after this many frames, or when the pool is over
+    // budget
+    enum { TEMP_RESOURCE_MAX_AGE = 120 };
+    static const u64 TEMP_RESOURCE_BUDGET = 512 * 1024 * 1024;
 
-    struct TempDepthStencil
-    {
-      BufferFlags flags;
-      u32 idx;
-      bool inUse;
-    };
+    void EvictTempResources();
+
+    ShaderCache _shaderCache;
+    bool _shaderCacheLoaded = false;
 
-    SimpleAppendBuffer<TempRenderTarget, 64> _tempRenderTargets;
-    SimpleAppendBuffer<TempDepthStencil, 64> _tempDepthStencils;
+    TempResourcePool _tempRenderTargets;
+    TempResourcePool _tempDepthStencils;
+    vector<u32> _evictedIds;
   };
 
   extern Graphics* g_Graphics;
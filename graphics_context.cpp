@@ -298,7 +298,7 @@ void GraphicsContext::Unmap(ObjectHandle h, UINT sub)
 void GraphicsContext::CopyToBuffer(ObjectHandle h, const void* data, u32 len)
 {
   D3D11_MAPPED_SUBRESOURCE res;
-  if (Map(h, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
+  if (SUCCEEDED(Map(h, 0, D3D11_MAP_WRITE_DISCARD, 0, &res)))
   {
     memcpy(res.pData, data, len);
     Unmap(h, 0);
@@ -315,10 +315,10 @@ void GraphicsContext::CopyToBuffer(
     u32 len)
 {
   D3D11_MAPPED_SUBRESOURCE res;
-  if (Map(h, 0, D3D11_MAP_WRITE_DISCARD, 0, &res))
+  if (SUCCEEDED(Map(h, sub, type, flags, &res)))
   {
     memcpy(res.pData, data, len);
-    Unmap(h, 0);
+    Unmap(h, sub);
   }
 }
 
@@ -346,6 +346,23 @@ void GraphicsContext::Flush()
   _ctx->Flush();
 }
 
+//------------------------------------------------------------------------------
+void GraphicsContext::IssueFence(ID3D11Query* fence)
+{
+  _ctx->End(fence);
+}
+
+//------------------------------------------------------------------------------
+bool GraphicsContext::FenceReached(ID3D11Query* fence, bool flush)
+{
+  BOOL done = FALSE;
+  HRESULT hr = _ctx->GetData(
+      fence, &done, sizeof(done), flush ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+  // S_FALSE means the query hasn't completed yet. On errors (like a removed device), treat
+  // the fence as done, so callers waiting on it don't hang.
+  return hr != S_FALSE && (FAILED(hr) || done);
+}
+
 //------------------------------------------------------------------------------
 void GraphicsContext::SetShaderResources(
     const vector<ObjectHandle>& handles,
@@ -72,6 +72,11 @@ namespace tano
 
     void Flush();
 
+    // Event queries used as GPU fences. FenceReached doesn't block, but flushes the
+    // command buffer unless 'flush' is false.
+    void IssueFence(ID3D11Query* fence);
+    bool FenceReached(ID3D11Query* fence, bool flush = true);
+
   private:
     GraphicsContext(ID3D11DeviceContext* ctx);
     ID3D11DeviceContext *_ctx;
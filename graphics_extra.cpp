@@ -422,11 +422,11 @@ bool SwapChain::CreateBackBuffers(u32 width, u32 height, DXGI_FORMAT format)
   depthStencil->view.ptr->GetDesc(&depthStencil->view.desc);
 
   // register the render-target and depth-stencil
-  u32 rtIdx = g_Graphics->_renderTargets.Append(rt);
-  _renderTarget = ObjectHandle(ObjectHandle::kRenderTarget, rtIdx);
+  u32 rtSlot = g_Graphics->_renderTargets.Append(rt);
+  _renderTarget = ObjectHandle(ObjectHandle::kRenderTarget, rtSlot);
 
-  u32 dsIdx = g_Graphics->_depthStencils.Append(depthStencil);
-  _depthStencil = ObjectHandle(ObjectHandle::kDepthStencil, rtIdx);
+  u32 dsSlot = g_Graphics->_depthStencils.Append(depthStencil);
+  _depthStencil = ObjectHandle(ObjectHandle::kDepthStencil, dsSlot);
 
   _viewport = CD3D11_VIEWPORT(0.0f, 0.0f, (float)width, (float)height);
 
@@ -0,0 +1,396 @@
+#include "mesh_optimizer.hpp"
+
+using namespace tano;
+using namespace bristol;
+
+namespace
+{
+  // Forsyth scoring constants
+  const int FORSYTH_CACHE_SIZE = 32;
+  const float CACHE_DECAY_POWER = 1.5f;
+  const float LAST_TRI_SCORE = 0.75f;
+  const float VALENCE_BOOST_SCALE = 2.0f;
+  const float VALENCE_BOOST_POWER = 0.5f;
+
+  //------------------------------------------------------------------------------
+  float VertexScore(int cachePos, u32 numActiveTris)
+  {
+    // No triangles left using this vertex, so it's worthless
+    if (numActiveTris == 0)
+      return -1.0f;
+
+    float score = 0;
+    if (cachePos >= 0)
+    {
+      if (cachePos < 3)
+      {
+        // The vertices used by the last triangle get a fixed score, otherwise
+        // it's too easy to keep looping around the same triangles
+        score = LAST_TRI_SCORE;
+      }
+      else
+      {
+        const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+        score = 1.0f - (cachePos - 3) * scaler;
+        score = powf(score, CACHE_DECAY_POWER);
+      }
+    }
+
+    // Bonus for vertices with few triangles left, so we get rid of lone triangles
+    float valenceBoost = powf((float)numActiveTris, -VALENCE_BOOST_POWER);
+    return score + VALENCE_BOOST_SCALE * valenceBoost;
+  }
+
+  //------------------------------------------------------------------------------
+  // Simple FIFO cache simulator, used both for stats and the overdraw clustering
+  struct FifoCache
+  {
+    FifoCache(u32 numVerts, u32 cacheSize) : timestamps(numVerts, 0), cacheSize(cacheSize) {}
+
+    // Returns true if the vertex had to be transformed
+    bool Access(u32 v)
+    {
+      // A vertex is in the cache if it was added less than cacheSize misses ago
+      if (timestamps[v] && time - timestamps[v] < cacheSize)
+        return false;
+
+      timestamps[v] = ++time;
+      return true;
+    }
+
+    vector<u32> timestamps;
+    u32 cacheSize;
+    u32 time = 0;
+  };
+}
+
+namespace tano
+{
+  //------------------------------------------------------------------------------
+  float CalcAcmr(const u32* indices, u32 numIndices, u32 cacheSize)
+  {
+    if (numIndices < 3)
+      return 0;
+
+    u32 maxIndex = 0;
+    for (u32 i = 0; i < numIndices; ++i)
+      maxIndex = max(maxIndex, indices[i]);
+
+    FifoCache cache(maxIndex + 1, cacheSize);
+    u32 misses = 0;
+    for (u32 i = 0; i < numIndices; ++i)
+      misses += cache.Access(indices[i]) ? 1 : 0;
+
+    return (float)misses / (numIndices / 3);
+  }
+
+  //------------------------------------------------------------------------------
+  void OptimizeVertexCache(u32* indices, u32 numIndices, u32 numVerts)
+  {
+    u32 numTris = numIndices / 3;
+    if (numTris == 0)
+      return;
+
+    // Build the vertex -> triangle adjacency (CSR layout)
+    vector<u32> numActiveTris(numVerts, 0);
+    for (u32 i = 0; i < numIndices; ++i)
+      numActiveTris[indices[i]]++;
+
+    vector<u32> triOffset(numVerts + 1, 0);
+    for (u32 i = 0; i < numVerts; ++i)
+      triOffset[i + 1] = triOffset[i] + numActiveTris[i];
+
+    vector<u32> vertTris(numIndices);
+    vector<u32> fill(triOffset.begin(), triOffset.end() - 1);
+    for (u32 i = 0; i < numIndices; ++i)
+      vertTris[fill[indices[i]]++] = i / 3;
+
+    vector<int> cachePos(numVerts, -1);
+    vector<float> vertexScore(numVerts);
+    for (u32 i = 0; i < numVerts; ++i)
+      vertexScore[i] = VertexScore(-1, numActiveTris[i]);
+
+    vector<float> triScore(numTris);
+    vector<u8> emitted(numTris, 0);
+    for (u32 i = 0; i < numTris; ++i)
+    {
+      const u32* tri = &indices[i * 3];
+      triScore[i] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+    }
+
+    // Note, the cache is 3 larger than the scoring size, to have room for the
+    // vertices of the new triangle before the oldest ones are evicted
+    int cache[FORSYTH_CACHE_SIZE + 3];
+    int cacheCount = 0;
+
+    vector<u32> output(numIndices);
+    u32 outputIdx = 0;
+
+    int bestTri = 0;
+    u32 fallbackCursor = 0;
+
+    while (outputIdx < numIndices)
+    {
+      if (bestTri < 0)
+      {
+        // No candidate in the cache, so fall back to the next unemitted triangle
+        while (emitted[fallbackCursor])
+          fallbackCursor++;
+        bestTri = fallbackCursor;
+      }
+
+      const u32* tri = &indices[bestTri * 3];
+      emitted[bestTri] = 1;
+
+      int newCache[FORSYTH_CACHE_SIZE + 3];
+      int newCount = 0;
+
+      for (int i = 0; i < 3; ++i)
+      {
+        u32 v = tri[i];
+        output[outputIdx++] = v;
+        newCache[newCount++] = v;
+
+        // Remove the triangle from the vertex's active list
+        u32 start = triOffset[v];
+        u32 end = start + numActiveTris[v];
+        for (u32 j = start; j < end; ++j)
+        {
+          if (vertTris[j] == (u32)bestTri)
+          {
+            swap(vertTris[j], vertTris[end - 1]);
+            break;
+          }
+        }
+        numActiveTris[v]--;
+      }
+
+      // Append the old cache entries behind the new triangle's vertices
+      for (int i = 0; i < cacheCount; ++i)
+      {
+        int v = cache[i];
+        if (v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2])
+          newCache[newCount++] = v;
+      }
+
+      // Rescore every vertex in the cache (including ones that just fell out)
+      for (int i = 0; i < newCount; ++i)
+      {
+        int v = newCache[i];
+        cachePos[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+        vertexScore[v] = VertexScore(cachePos[v], numActiveTris[v]);
+      }
+
+      // Update the triangle scores, and find the best candidate among the cached vertices
+      float bestScore = -1;
+      bestTri = -1;
+      for (int i = 0; i < newCount; ++i)
+      {
+        int v = newCache[i];
+        u32 start = triOffset[v];
+        u32 end = start + numActiveTris[v];
+        for (u32 j = start; j < end; ++j)
+        {
+          u32 t = vertTris[j];
+          const u32* cand = &indices[t * 3];
+          float score = vertexScore[cand[0]] + vertexScore[cand[1]] + vertexScore[cand[2]];
+          triScore[t] = score;
+          if (score > bestScore)
+          {
+            bestScore = score;
+            bestTri = t;
+          }
+        }
+      }
+
+      cacheCount = min(newCount, (int)FORSYTH_CACHE_SIZE);
+      memcpy(cache, newCache, cacheCount * sizeof(int));
+    }
+
+    memcpy(indices, output.data(), numIndices * sizeof(u32));
+  }
+
+  //------------------------------------------------------------------------------
+  void OptimizeOverdraw(u32* indices,
+      u32 numIndices,
+      const void* verts,
+      u32 vertexSize,
+      u32 numVerts,
+      float threshold,
+      u32 cacheSize)
+  {
+    u32 numTris = numIndices / 3;
+    if (numTris < 2)
+      return;
+
+    auto fnPos = [=](u32 idx)
+    {
+      const float* p = (const float*)((const u8*)verts + idx * vertexSize);
+      return vec3(p[0], p[1], p[2]);
+    };
+
+    // Split the triangles into clusters. A new cluster is started at a "hard"
+    // boundary (all 3 vertices miss the cache), as long as the current cluster's
+    // ACMR is close enough to the mesh ACMR, so we don't lose the cache gains
+    float meshAcmr = CalcAcmr(indices, numIndices, cacheSize);
+
+    vector<u32> clusterStart;
+    clusterStart.push_back(0);
+    {
+      FifoCache cache(numVerts, cacheSize);
+      u32 clusterMisses = 0;
+      for (u32 i = 0; i < numTris; ++i)
+      {
+        const u32* tri = &indices[i * 3];
+        u32 misses = 0;
+        for (int j = 0; j < 3; ++j)
+          misses += cache.Access(tri[j]) ? 1 : 0;
+
+        u32 clusterTris = i - clusterStart.back();
+        if (misses == 3 && clusterTris > 0 && clusterMisses <= threshold * meshAcmr * clusterTris)
+        {
+          clusterStart.push_back(i);
+          clusterMisses = 0;
+        }
+        clusterMisses += misses;
+      }
+    }
+
+    u32 numClusters = (u32)clusterStart.size();
+    if (numClusters < 2)
+      return;
+
+    clusterStart.push_back(numTris);
+
+    // Calc the area weighted mesh centroid
+    vec3 meshCentroid(0, 0, 0);
+    float meshArea = 0;
+    for (u32 i = 0; i < numTris; ++i)
+    {
+      vec3 p0 = fnPos(indices[i * 3 + 0]);
+      vec3 p1 = fnPos(indices[i * 3 + 1]);
+      vec3 p2 = fnPos(indices[i * 3 + 2]);
+      float area = Length(Cross(p1 - p0, p2 - p0));
+      meshCentroid += area / 3 * (p0 + p1 + p2);
+      meshArea += area;
+    }
+    if (meshArea > 0)
+      meshCentroid /= meshArea;
+
+    // Sort key per cluster is how much the cluster faces away from the mesh center
+    struct ClusterSort
+    {
+      float key;
+      u32 idx;
+    };
+    vector<ClusterSort> sortKeys(numClusters);
+
+    for (u32 c = 0; c < numClusters; ++c)
+    {
+      vec3 centroid(0, 0, 0);
+      vec3 normal(0, 0, 0);
+      float area = 0;
+      for (u32 i = clusterStart[c]; i < clusterStart[c + 1]; ++i)
+      {
+        vec3 p0 = fnPos(indices[i * 3 + 0]);
+        vec3 p1 = fnPos(indices[i * 3 + 1]);
+        vec3 p2 = fnPos(indices[i * 3 + 2]);
+        vec3 n = Cross(p1 - p0, p2 - p0);
+        float a = Length(n);
+        centroid += a / 3 * (p0 + p1 + p2);
+        normal += n;
+        area += a;
+      }
+
+      // a cluster of degenerate triangles, or one whose normals cancel out, has no
+      // facing, so it keeps its place relative to the others
+      float len = Length(normal);
+      float key = 0;
+      if (area > 0 && len > 1e-12f)
+        key = Dot(centroid / area - meshCentroid, normal / len);
+
+      sortKeys[c] = ClusterSort{key, c};
+    }
+
+    std::stable_sort(sortKeys.begin(),
+        sortKeys.end(),
+        [](const ClusterSort& a, const ClusterSort& b)
+        {
+          return a.key > b.key;
+        });
+
+    vector<u32> output(numTris * 3);
+    u32* dst = output.data();
+    for (const ClusterSort& s : sortKeys)
+    {
+      u32 start = clusterStart[s.idx] * 3;
+      u32 end = clusterStart[s.idx + 1] * 3;
+      dst = copy(indices + start, indices + end, dst);
+    }
+
+    memcpy(indices, output.data(), numTris * 3 * sizeof(u32));
+  }
+
+  //------------------------------------------------------------------------------
+  u32 OptimizeVertexFetch(void* verts, u32 vertexSize, u32 numVerts, u32* indices, u32 numIndices)
+  {
+    const u32 UNUSED = 0xffffffff;
+    vector<u32> remap(numVerts, UNUSED);
+
+    u32 nextVertex = 0;
+    for (u32 i = 0; i < numIndices; ++i)
+    {
+      u32& r = remap[indices[i]];
+      if (r == UNUSED)
+        r = nextVertex++;
+      indices[i] = r;
+    }
+
+    u32 numUsed = nextVertex;
+
+    // Move any unused vertices to the end, so the buffer keeps its size
+    for (u32 i = 0; i < numVerts; ++i)
+    {
+      if (remap[i] == UNUSED)
+        remap[i] = nextVertex++;
+    }
+
+    vector<u8> tmp(numVerts * vertexSize);
+    for (u32 i = 0; i < numVerts; ++i)
+      memcpy(&tmp[remap[i] * vertexSize], (u8*)verts + i * vertexSize, vertexSize);
+    memcpy(verts, tmp.data(), tmp.size());
+
+    return numUsed;
+  }
+
+  //------------------------------------------------------------------------------
+  bool CompactIndices(const u32* indices, u32 numIndices, u16* out)
+  {
+    for (u32 i = 0; i < numIndices; ++i)
+    {
+      if (indices[i] > 0xffff)
+        return false;
+    }
+
+    for (u32 i = 0; i < numIndices; ++i)
+      out[i] = (u16)indices[i];
+
+    return true;
+  }
+
+  //------------------------------------------------------------------------------
+  MeshOptimizeStats OptimizeMesh(
+      void* verts, u32 vertexSize, u32 numVerts, u32* indices, u32 numIndices)
+  {
+    MeshOptimizeStats stats;
+    stats.numTris = numIndices / 3;
+    stats.acmrBefore = CalcAcmr(indices, numIndices);
+
+    OptimizeVertexCache(indices, numIndices, numVerts);
+    OptimizeOverdraw(indices, numIndices, verts, vertexSize, numVerts);
+    OptimizeVertexFetch(verts, vertexSize, numVerts, indices, numIndices);
+
+    stats.acmrAfter = CalcAcmr(indices, numIndices);
+    return stats;
+  }
+}
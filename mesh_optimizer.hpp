@@ -0,0 +1,52 @@
+#pragma once
+
+namespace tano
+{
+  // Size of the post-transform cache we simulate/optimize for. Most DX11 class hardware
+  // has somewhere between 16 and 32 entries, so 16 is a safe lower bound.
+  enum { DEFAULT_VERTEX_CACHE_SIZE = 16 };
+
+  //------------------------------------------------------------------------------
+  // Returns the average cache miss ratio (transformed vertices / triangle) for the
+  // given index list, using a FIFO cache of the given size
+  float CalcAcmr(const u32* indices, u32 numIndices, u32 cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+  //------------------------------------------------------------------------------
+  // Reorders the triangles for post-transform cache efficiency using Tom Forsyth's
+  // "Linear-Speed Vertex Cache Optimisation"
+  void OptimizeVertexCache(u32* indices, u32 numIndices, u32 numVerts);
+
+  //------------------------------------------------------------------------------
+  // Reorders clusters of triangles so that the ones facing outwards from the mesh
+  // center are drawn first (Sander et al, "Fast Triangle Reordering for Vertex Locality
+  // and Reduced Overdraw"). Expects indices that have already been cache optimized.
+  // Vertex positions are read as 3 floats at the start of each vertex.
+  void OptimizeOverdraw(u32* indices,
+      u32 numIndices,
+      const void* verts,
+      u32 vertexSize,
+      u32 numVerts,
+      float threshold = 1.05f,
+      u32 cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+  //------------------------------------------------------------------------------
+  // Reorders the vertices in the order they are first referenced, and remaps the
+  // indices. Returns the number of referenced vertices (unused ones end up at the end)
+  u32 OptimizeVertexFetch(void* verts, u32 vertexSize, u32 numVerts, u32* indices, u32 numIndices);
+
+  //------------------------------------------------------------------------------
+  // Converts 32 bit indices to 16 bit. Returns false if any of the indices doesn't fit
+  bool CompactIndices(const u32* indices, u32 numIndices, u16* out);
+
+  //------------------------------------------------------------------------------
+  struct MeshOptimizeStats
+  {
+    u32 numTris = 0;
+    float acmrBefore = 0;
+    float acmrAfter = 0;
+  };
+
+  // Runs the cache, overdraw and vertex fetch passes on a single indexed triangle list
+  MeshOptimizeStats OptimizeMesh(
+      void* verts, u32 vertexSize, u32 numVerts, u32* indices, u32 numIndices);
+}
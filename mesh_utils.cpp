@@ -3,9 +3,12 @@
 #include "gpu_objects.hpp"
 #include "init_sequence.hpp"
 #include "arena_allocator.hpp"
+#include "mesh_optimizer.hpp"
+#include "scheduler.hpp"
 #include "generated/demo.types.hpp"
 
 using namespace tano;
+using namespace tano::scheduler;
 using namespace bristol;
 
 namespace
@@ -13,9 +16,10 @@ namespace
   // vertex info per vertex format
   struct BufferInfo
   {
-    BufferInfo() : vertexCount(0), indexCount(0) {}
+    BufferInfo() : vertexCount(0), indexCount(0), maxMeshVerts(0) {}
     int vertexCount;
     int indexCount;
+    u32 maxMeshVerts;
 
     vector<float> verts;
     vector<u32> indices;
@@ -29,6 +33,63 @@ namespace
 
     vector<VtxInfo> vtxInfo;
   };
+
+  //------------------------------------------------------------------------------
+  const int PLEXUS_NODES_PER_TASK = 1024;
+
+  struct PlexusCandidate
+  {
+    float dist;
+    int idx;
+  };
+
+  struct PlexusKernelData
+  {
+    const vec3* points;
+    const int* neighbours;
+    int maxNeighbours;
+    int numNeighbours;
+    float minDist;
+    float maxDist;
+    int start;
+    int end;
+    PlexusCandidate* candidates;
+    int* numCandidates;
+  };
+
+  //------------------------------------------------------------------------------
+  void CalcPlexusCandidates(const scheduler::TaskData& data)
+  {
+    const PlexusKernelData* k = (const PlexusKernelData*)data.kernelData.data;
+    const vec3* points = k->points;
+
+    for (int i = k->start; i < k->end; ++i)
+    {
+      PlexusCandidate* cand = &k->candidates[i * k->numNeighbours];
+      int numValid = 0;
+      for (int j = 0; j < k->numNeighbours; ++j)
+      {
+        int curIdx = k->neighbours[i * k->maxNeighbours + j];
+        if (curIdx == -1)
+          break;
+
+        float d = Distance(points[i], points[curIdx]);
+        if (curIdx == i || d < k->minDist || d > k->maxDist)
+          continue;
+
+        cand[numValid++] = PlexusCandidate{d, curIdx};
+      }
+
+      sort(cand,
+          cand + numValid,
+          [](const PlexusCandidate& a, const PlexusCandidate& b)
+          {
+            return a.dist < b.dist || (a.dist == b.dist && a.idx < b.idx);
+          });
+
+      k->numCandidates[i] = numValid;
+    }
+  }
 }
 
 namespace tano
@@ -66,6 +127,13 @@ namespace tano
     return *this;
   }
 
+  //------------------------------------------------------------------------------
+  SceneOptions& SceneOptions::OptimizeMeshes()
+  {
+    flags.Set(OptionFlag::OptimizeMeshes);
+    return *this;
+  }
+
   //------------------------------------------------------------------------------
   SceneOptions& SceneOptions::SetUserDataSize(ObjectType type, u32 size)
   {
@@ -127,8 +195,12 @@ namespace tano
         BufferInfo& info = bufferInfo[fmt];
         info.indexCount += meshBlob->numIndices;
         info.vertexCount += meshBlob->numVerts;
+        info.maxMeshVerts = max(info.maxMeshVerts, meshBlob->numVerts);
       }
 
+      bool optimizeMeshes = options.flags.IsSet(SceneOptions::OptionFlag::OptimizeMeshes);
+      MeshOptimizeStats optimizeStats;
+
       vec3 minVerts(+FLT_MAX, +FLT_MAX, +FLT_MAX);
       vec3 maxVerts(-FLT_MAX, -FLT_MAX, -FLT_MAX);
 
@@ -226,11 +298,46 @@ namespace tano
             mesh->indexCount += mg->numIndices;
           }
         }
+
+        if (optimizeMeshes)
+        {
+          float* meshVerts = &info.verts[prevFloatCount];
+          optimizeStats.numTris += numIndices / 3;
+          optimizeStats.acmrBefore += CalcAcmr(indices, numIndices) * (numIndices / 3);
+
+          // Triangles can't move between material groups, so optimize each group separately
+          if (mesh->materialGroups.empty())
+          {
+            OptimizeVertexCache(indices, numIndices, numVerts);
+            OptimizeOverdraw(indices, numIndices, meshVerts, vertexSize, numVerts);
+          }
+
+          for (const scene::Mesh::MaterialGroup& mg : mesh->materialGroups)
+          {
+            u32* groupIndices = indices + mg.startIndex;
+            OptimizeVertexCache(groupIndices, mg.indexCount, numVerts);
+            OptimizeOverdraw(groupIndices, mg.indexCount, meshVerts, vertexSize, numVerts);
+          }
+
+          OptimizeVertexFetch(meshVerts, vertexSize, numVerts, indices, numIndices);
+          optimizeStats.acmrAfter += CalcAcmr(indices, numIndices) * (numIndices / 3);
+        }
       }
 
       scene->minVerts = minVerts;
       scene->maxVerts = maxVerts;
 
+      if (optimizeMeshes && optimizeStats.numTris > 0)
+      {
+        float numTris = (float)optimizeStats.numTris;
+        LOG_INFO("Optimized ",
+            optimizeStats.numTris,
+            " tris. ACMR before: ",
+            optimizeStats.acmrBefore / numTris,
+            ", after: ",
+            optimizeStats.acmrAfter / numTris);
+      }
+
       // Create the mesh buffers
       for (const auto& kv : bufferInfo)
       {
@@ -243,8 +350,23 @@ namespace tano
         scene->meshBuffers.push_back(buf);
         ObjectHandle vb = g_Graphics->CreateBuffer(
             D3D11_BIND_VERTEX_BUFFER, info.vertexCount * vertexSize, false, info.verts.data(), vertexSize);
-        ObjectHandle ib = g_Graphics->CreateBuffer(D3D11_BIND_INDEX_BUFFER, info.indexCount * sizeof(u32), false,
-            info.indices.data(), DXGI_FORMAT_R32_UINT);
+
+        // The indices are relative to each mesh's base vertex, so 16 bit indices are
+        // fine as long as no single mesh is too large
+        ObjectHandle ib;
+        vector<u16> indices16;
+        if (optimizeMeshes && info.maxMeshVerts <= 0x10000)
+        {
+          indices16.resize(info.indexCount);
+          CompactIndices(info.indices.data(), info.indexCount, indices16.data());
+          ib = g_Graphics->CreateBuffer(D3D11_BIND_INDEX_BUFFER, info.indexCount * sizeof(u16), false,
+              indices16.data(), DXGI_FORMAT_R16_UINT);
+        }
+        else
+        {
+          ib = g_Graphics->CreateBuffer(D3D11_BIND_INDEX_BUFFER, info.indexCount * sizeof(u32), false,
+              info.indices.data(), DXGI_FORMAT_R32_UINT);
+        }
 
         buf->vb = vb;
         buf->ib = ib;
@@ -350,75 +472,104 @@ namespace tano
   int CalcPlexusGrouping(
       vec3* vtx, const vec3* points, int num, int* neighbours, int maxNeighbours, const PlexusGrouping& config)
   {
-    u8* connected = g_ScratchMemory.Alloc<u8>(num * num);
-    memset(connected, 0, num * num);
+    int numNeighbours = min(config.num_neighbours, maxNeighbours);
+    int maxEdges = max(1, config.num_nearest);
+
+    // Calc the candidate lists in parallel. Each node gets its valid neighbours
+    // sorted by distance, and the connections are then made in a serial pass below
+    PlexusCandidate* candidates = g_ScratchMemory.Alloc<PlexusCandidate>(num * numNeighbours);
+    int* numCandidates = g_ScratchMemory.Alloc<int>(num);
 
-    struct DistEntry
+    SimpleAppendBuffer<TaskId, 256> tasks;
+    for (int start = 0; start < num; start += PLEXUS_NODES_PER_TASK)
     {
-      float dist;
-      int idx;
-    };
-    DistEntry* dist = g_ScratchMemory.Alloc<DistEntry>(num);
-    int* idx = g_ScratchMemory.Alloc<int>(num);
-    u8* degree = g_ScratchMemory.Alloc<u8>(num);
-    memset(degree, 0, num);
+      PlexusKernelData* data = (PlexusKernelData*)g_ScratchMemory.Alloc(sizeof(PlexusKernelData));
+      *data = PlexusKernelData{points,
+          neighbours,
+          maxNeighbours,
+          numNeighbours,
+          config.min_dist,
+          config.max_dist,
+          start,
+          min(num, start + PLEXUS_NODES_PER_TASK),
+          candidates,
+          numCandidates};
+
+      KernelData kd;
+      kd.data = data;
+      kd.size = sizeof(PlexusKernelData);
+      tasks.Append(g_Scheduler->AddTask(kd, CalcPlexusCandidates));
+    }
 
-    vec3* orgVtx = vtx;
+    for (const TaskId& taskId : tasks)
+      g_Scheduler->Wait(taskId);
 
-    float minDist = config.min_dist;
-    float maxDist = config.max_dist;
-    int numNeighbours = config.num_neighbours;
+    // Each node stores the (at most num_nearest) edges it created, so checking if two
+    // nodes are connected is a scan over a couple of entries instead of a N^2 matrix
+    int* edges = g_ScratchMemory.Alloc<int>(num * maxEdges);
+    int* numEdges = g_ScratchMemory.Alloc<int>(num);
+    int* degree = g_ScratchMemory.Alloc<int>(num);
+    memset(numEdges, 0, num * sizeof(int));
+    memset(degree, 0, num * sizeof(int));
 
-    float eps = config.eps;
+    auto fnHasEdge = [&](int from, int to)
+    {
+      const int* e = &edges[from * maxEdges];
+      for (int i = 0; i < numEdges[from]; ++i)
+      {
+        if (e[i] == to)
+          return true;
+      }
+      return false;
+    };
 
-    auto fnSort = [&](int a, int b)
+    float eps = config.eps;
+    auto fnSort = [&](const PlexusCandidate& a, const PlexusCandidate& b)
     {
-      float da = dist[a].dist;
-      float db = dist[b].dist;
-      float d = da - db;
+      float d = a.dist - b.dist;
       if (d < 0)
         d *= -1;
       if (d < eps)
-        return degree[a] < degree[b];
-      return da < db;
+        return degree[a.idx] < degree[b.idx];
+      return a.dist < b.dist;
     };
 
-    Range(idx, 0, num);
+    PlexusCandidate* valid = g_ScratchMemory.Alloc<PlexusCandidate>(max(1, numNeighbours));
+    vec3* orgVtx = vtx;
 
-    // iterate over all the neighbours, and calc distance etc
+    // The merge is done in node order, so the result is the same regardless of how
+    // the candidate tasks were scheduled
     for (int i = 0; i < num; ++i)
     {
+      const PlexusCandidate* cand = &candidates[i * numNeighbours];
       int numValid = 0;
-      for (int j = 0; j < numNeighbours; ++j)
+      for (int j = 0; j < numCandidates[i]; ++j)
       {
-        int curIdx = neighbours[i * maxNeighbours + j];
-        if (curIdx == -1)
-          break;
-
-        float d = Distance(points[i], points[curIdx]);
-
-        if (curIdx == i || d < minDist || d > maxDist || connected[i * num + curIdx] ||
-            connected[curIdx * num + i])
+        int curIdx = cand[j].idx;
+        if (fnHasEdge(i, curIdx) || fnHasEdge(curIdx, i))
           continue;
 
-        idx[numValid] = numValid;
-        dist[numValid].dist = d;
-        dist[numValid].idx = curIdx;
-        numValid++;
+        // The candidates are already sorted by distance, so the insertion sort only moves
+        // entries within the eps window where the degree is used as tie breaker
+        int k = numValid++;
+        while (k > 0 && fnSort(cand[j], valid[k - 1]))
+        {
+          valid[k] = valid[k - 1];
+          --k;
+        }
+        valid[k] = cand[j];
       }
 
-      sort(idx, idx + numValid, fnSort);
-
       int cnt = min(config.num_nearest, numValid);
       for (int j = 0; j < cnt; ++j)
       {
-        int curIdx = dist[idx[j]].idx;
+        int curIdx = valid[j].idx;
 
         vtx[0] = points[i];
         vtx[1] = points[curIdx];
         vtx += 2;
 
-        connected[i * num + curIdx] = 1;
+        edges[i * maxEdges + numEdges[i]++] = curIdx;
         degree[i]++;
         degree[curIdx]++;
       }
@@ -668,4 +819,19 @@ namespace tano
       }
     }
   }
+
+  //------------------------------------------------------------------------------
+  void ReplicateIndices(const vector<u32>& src, int count, u32 stride, vector<u32>* out)
+  {
+    size_t oldSize = out->size();
+    out->resize(oldSize + count * src.size());
+    u32* res = out->data() + oldSize;
+
+    for (int i = 0; i < count; ++i)
+    {
+      u32 ofs = i * stride;
+      for (u32 idx : src)
+        *res++ = idx + ofs;
+    }
+  }
 }
@@ -41,6 +41,7 @@ namespace tano
         WorldSpace = 1 << 0,
         UseMaterials = 1 << 1,
         UniqueBuffers = 1 << 2,
+        OptimizeMeshes = 1 << 3,
       };
 
       struct Bits
@@ -48,12 +49,15 @@ namespace tano
         u32 worldSpace : 1;
         u32 useMaterials : 1;
         u32 uniqueBuffers : 1;
+        u32 optimizeMeshes : 1;
       };
     };
 
     SceneOptions& TransformToWorldSpace();
     SceneOptions& UseMaterials();
     SceneOptions& UniqueBuffers();
+    // Reorder indices/vertices for the post-transform cache, and use 16 bit indices if possible
+    SceneOptions& OptimizeMeshes();
     SceneOptions& SetUserDataSize(ObjectType type, u32 size);
     SceneOptions& SetLoadFilter(ObjectType filter);
 
@@ -79,4 +83,7 @@ namespace tano
   vec3* AddCubeWithNormal(vec3* buf, const vec3& pos, float scale, bool singleFace = false);
 
   void GeneratePlaneIndices(int width, int height, int ofs, vector<u32>* out);
+
+  // Appends 'count' copies of 'src', offsetting each copy by 'stride' vertices
+  void ReplicateIndices(const vector<u32>& src, int count, u32 stride, vector<u32>* out);
 }
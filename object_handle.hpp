@@ -33,26 +33,56 @@ namespace tano
       kMaterial,
       kStructuredBuffer,
       kSwapChain,
+      kShaderResourceView,
 
       // Animation
       kAnimation,
       cNumTypes
     };
 
-  private:
-    friend class Graphics;
-    friend struct SwapChain;
+    // The id is split into the slot index, and a generation that's bumped every time the
+    // slot is freed, so handles to released resources can be detected.
+#if WITH_64BIT_HANDLES
+    typedef u64 Bits;
     enum
-    { 
+    {
       cTypeBits = 8,
+      cIdBits = 20,
+      cGenerationBits = 12,
+      cDataBits = 24,
+    };
+#else
+    typedef u32 Bits;
+    enum
+    {
+      cTypeBits = 6,
       cIdBits = 12,
-      cDataBits = 32 - (cTypeBits + cIdBits),
+      cGenerationBits = 4,
+      cDataBits = 10,
     };
+#endif
 
-    static_assert(1 << ObjectHandle::cTypeBits > ObjectHandle::cNumTypes, "Not enough type bits");
+    static_assert(1 << cTypeBits > cNumTypes, "Not enough type bits");
+    static_assert(cTypeBits + cIdBits + cGenerationBits + cDataBits == sizeof(Bits) * 8,
+        "Handle bits don't add up");
+    static_assert(cIdBits + cGenerationBits <= 32, "Slot doesn't fit in 32 bits");
 
-    ObjectHandle(u32 type, u32 id) : _type(type), _id(id), _data(0) {}
-    ObjectHandle(u32 type, u32 id, u32 data) : _type(type), _id(id), _data(data) 
+    // Slots pack the index and generation, and are what the resource tables hand out
+    static u32 MakeSlot(u32 id, u32 generation)
+    {
+      return id | (generation << cIdBits);
+    }
+
+  private:
+    friend class Graphics;
+    friend struct SwapChain;
+
+    ObjectHandle(u32 type, u32 slot) : ObjectHandle(type, slot, 0) {}
+    ObjectHandle(u32 type, u32 slot, u32 data)
+        : _type(type)
+        , _id(slot & ((1 << cIdBits) - 1))
+        , _generation(slot >> cIdBits)
+        , _data(data)
     {
     }
 
@@ -60,20 +90,26 @@ namespace tano
     {
       struct
       {
-        u32 _type : cTypeBits;
-        u32 _id : cIdBits;
-        u32 _data : cDataBits;
+        Bits _type : cTypeBits;
+        Bits _id : cIdBits;
+        Bits _generation : cGenerationBits;
+        Bits _data : cDataBits;
       };
-      u32 _raw;
+      Bits _raw;
     };
   public:
     ObjectHandle() : _raw(kInvalid) {}
     bool IsValid() const { return _raw != kInvalid; }
-    u32 ToInt() const { return _raw; }
-    u32 id() const { return _id; }
-    u32 data() const { return _data; }
+    Bits ToInt() const { return _raw; }
+    u32 id() const { return (u32)_id; }
+    u32 generation() const { return (u32)_generation; }
+    u32 slot() const { return MakeSlot((u32)_id, (u32)_generation); }
+    u32 data() const { return (u32)_data; }
     Type type() const { return (Type)_type; }
+
+    // The same object, with different user data (like another stride for a vertex buffer)
+    ObjectHandle WithData(u32 data) const { return ObjectHandle(_type, slot(), data); }
   };
 
-  static_assert(sizeof(ObjectHandle) <= sizeof(uint32_t), "GraphicsObjectHandle too large");
+  static_assert(sizeof(ObjectHandle) == sizeof(ObjectHandle::Bits), "ObjectHandle too large");
 }
@@ -7,8 +7,6 @@ using namespace tano::scheduler;
 using namespace bristol;
 using namespace DirectX;
 
-static RandomUniform RANDOM_FLOAT;
-
 //------------------------------------------------------------------------------
 template <typename T>
 void UpdateEmitter(const scheduler::TaskData& data)
@@ -30,8 +28,9 @@ void CopyOutEmitter(const scheduler::TaskData& data)
 }
 
 //------------------------------------------------------------------------------
-void ParticleEmitter::Create(const vec3& center, int numParticles)
+void ParticleEmitter::Create(const vec3& center, int numParticles, u64 stream)
 {
+  _random = RandomUniform(Philox::DEFAULT_SEED, stream);
   _center = center;
   _numParticles = numParticles;
   _pos = new XMVECTOR[_numParticles];
@@ -54,13 +53,13 @@ void ParticleEmitter::Create(const vec3& center, int numParticles)
 void ParticleEmitter::CreateParticle(int idx, float s)
 {
   // lifetime and lifetime decay is stored in the w-component
-  XMFLOAT4 p(_center.x + RANDOM_FLOAT.Next(-s, s),
-      _center.y + RANDOM_FLOAT.Next(-s, s),
-      _center.z + RANDOM_FLOAT.Next(1500.f, 2000.f),
+  XMFLOAT4 p(_center.x + _random.Next(-s, s),
+      _center.y + _random.Next(-s, s),
+      _center.z + _random.Next(1500.f, 2000.f),
       0.f);
 
   XMFLOAT4 v(
-      RANDOM_FLOAT.Next(-s, s), RANDOM_FLOAT.Next(-s, s), -RANDOM_FLOAT.Next(10.f, 200.f), 0);
+      _random.Next(-s, s), _random.Next(-s, s), -_random.Next(10.f, 200.f), 0);
 
   _pos[idx] = XMLoadFloat4(&p);
   _vel[idx] = XMLoadFloat4(&v);
@@ -124,8 +123,10 @@ void ParticleEmitter::CopyOutEmitter(const TaskData& data)
 }
 
 //------------------------------------------------------------------------------
-void RadialParticleEmitter::Create(const vec3& center, float radius, int numParticles)
+void RadialParticleEmitter::Create(
+    const vec3& center, float radius, int numParticles, u64 stream)
 {
+  _random = RandomUniform(Philox::DEFAULT_SEED, stream);
   _center = center;
   _radius = radius;
   _numParticles = numParticles;
@@ -152,15 +153,15 @@ void RadialParticleEmitter::Create(const vec3& center, float radius, int numPart
 void RadialParticleEmitter::CreateParticle(int idx, float s)
 {
   // lifetime and lifetime decay is stored in the w-component
-  XMFLOAT4 p(_center.x + RANDOM_FLOAT.Next(-s, s),
-      _center.y + RANDOM_FLOAT.Next(-s, s),
-      _center.z + RANDOM_FLOAT.Next(1500.f, 2000.f),
+  XMFLOAT4 p(_center.x + _random.Next(-s, s),
+      _center.y + _random.Next(-s, s),
+      _center.z + _random.Next(1500.f, 2000.f),
       0.f);
 
   XMFLOAT4 v(
-      RANDOM_FLOAT.Next(-s, s), RANDOM_FLOAT.Next(-s, s), -RANDOM_FLOAT.Next(10.f, 200.f), 0);
+      _random.Next(-s, s), _random.Next(-s, s), -_random.Next(10.f, 200.f), 0);
 
-  float newAngle = RANDOM_FLOAT.Next(0.1f, 1.0f);
+  float newAngle = _random.Next(0.1f, 1.0f);
   XMFLOAT4 newPos(_radius * sinf(newAngle), 0, _radius * cosf(newAngle), 1);
 
   _pos[idx] = XMLoadFloat4(&newPos);
@@ -12,7 +12,8 @@ namespace tano
   //------------------------------------------------------------------------------
   struct ParticleEmitter
   {
-    void Create(const vec3& center, int numParticles);
+    // Each emitter spawns from its own random stream, as emitters are updated in parallel
+    void Create(const vec3& center, int numParticles, u64 stream = 0);
     void Destroy();
     void Update(float dt);
     void CreateParticle(int idx, float s);
@@ -25,6 +26,7 @@ namespace tano
 
     int _numParticles = 0;
     vec3 _center = { 0, 0, 0 };
+    RandomUniform _random;
 
     struct EmitterKernelData
     {
@@ -40,7 +42,7 @@ namespace tano
   //------------------------------------------------------------------------------
   struct RadialParticleEmitter
   {
-    void Create(const vec3& center, float radius, int numParticles);
+    void Create(const vec3& center, float radius, int numParticles, u64 stream = 0);
     void Destroy();
     void Update(float dt);
     void CreateParticle(int idx, float s);
@@ -56,6 +58,7 @@ namespace tano
     int _numParticles = 0;
     float _radius = 10;
     vec3 _center = { 0, 0, 0 };
+    RandomUniform _random;
 
     struct EmitterKernelData
     {
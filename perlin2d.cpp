@@ -1,5 +1,6 @@
 #include "perlin2d.hpp"
 #include "random.hpp"
+#include <emmintrin.h>
 
 using namespace tano;
 using namespace bristol;
@@ -22,6 +23,10 @@ static inline float Interp(float t)
 //------------------------------------------------------------------------------
 void Perlin2D::Init()
 {
+  // restart the random sequence so the tables are the same however many times
+  // we're initialized
+  randomFloat = RandomUniform();
+
   // create random gradients
   for (int i = 0; i < GRID_SIZE; ++i)
     gradients[i] = Normalize(vec2(randomFloat.Next(-1.f, 1.f), randomFloat.Next(-1.f, 1.f)));
@@ -86,3 +91,231 @@ float Perlin2D::Value(float x, float y)
   return value;
 }
 
+//------------------------------------------------------------------------------
+float Perlin2D::ValueDeriv(float x, float y, vec2* deriv)
+{
+  int x0 = (int)floorf(x);
+  int y0 = (int)floorf(y);
+  int x1 = x0 + 1;
+  int y1 = y0 + 1;
+
+  vec2 g00 = gradients[permutation[(permutation[x0 & 0xff] + y0) & 0xff]];
+  vec2 g01 = gradients[permutation[(permutation[x1 & 0xff] + y0) & 0xff]];
+  vec2 g10 = gradients[permutation[(permutation[x0 & 0xff] + y1) & 0xff]];
+  vec2 g11 = gradients[permutation[(permutation[x1 & 0xff] + y1) & 0xff]];
+
+  float fx = x - (float)x0;
+  float fy = y - (float)y0;
+
+  float d00 = Dot(vec2(fx, fy), g00);
+  float d01 = Dot(vec2(fx - 1, fy), g01);
+  float d10 = Dot(vec2(fx, fy - 1), g10);
+  float d11 = Dot(vec2(fx - 1, fy - 1), g11);
+
+  float u = Interp(fx);
+  float v = Interp(fy);
+  // derivative of the quintic fade curve, 30t^4 - 60t^3 + 30t^2
+  float du = 30 * fx * fx * (fx * (fx - 2) + 1);
+  float dv = 30 * fy * fy * (fy * (fy - 2) + 1);
+
+  // value = d00 + u * (d01 - d00) + v * (d10 - d00) + u * v * (d00 - d01 - d10 + d11)
+  float k1 = d01 - d00;
+  float k2 = d10 - d00;
+  float k3 = d00 - d01 - d10 + d11;
+
+  vec2 gk1 = g01 - g00;
+  vec2 gk2 = g10 - g00;
+  vec2 gk3 = g00 - g01 - g10 + g11;
+
+  deriv->x = g00.x + u * gk1.x + v * gk2.x + u * v * gk3.x + du * (k1 + v * k3);
+  deriv->y = g00.y + u * gk1.y + v * gk2.y + u * v * gk3.y + dv * (k2 + u * k3);
+
+  return d00 + u * k1 + v * k2 + u * v * k3;
+}
+
+//------------------------------------------------------------------------------
+static inline __m128 InterpSse(__m128 t)
+{
+  // same operation order as Interp, so the results match the scalar path
+  __m128 t2 = _mm_mul_ps(t, t);
+  __m128 t3 = _mm_mul_ps(t2, t);
+  __m128 a = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(6), t3), t2);
+  __m128 b = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(15), t3), t);
+  __m128 c = _mm_mul_ps(_mm_set1_ps(10), t3);
+  return _mm_add_ps(_mm_sub_ps(a, b), c);
+}
+
+//------------------------------------------------------------------------------
+static inline __m128 LerpSse(__m128 a, __m128 b, __m128 t)
+{
+  __m128 one = _mm_set1_ps(1);
+  return _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, t), a), _mm_mul_ps(t, b));
+}
+
+//------------------------------------------------------------------------------
+static inline __m128 DotGradientSse(__m128 vx, __m128 vy, const int* idx)
+{
+  // SSE2 has no gather, so the gradient lookups are done per lane
+  const vec2& g0 = gradients[idx[0]];
+  const vec2& g1 = gradients[idx[1]];
+  const vec2& g2 = gradients[idx[2]];
+  const vec2& g3 = gradients[idx[3]];
+  __m128 gx = _mm_setr_ps(g0.x, g1.x, g2.x, g3.x);
+  __m128 gy = _mm_setr_ps(g0.y, g1.y, g2.y, g3.y);
+  return _mm_add_ps(_mm_mul_ps(vx, gx), _mm_mul_ps(vy, gy));
+}
+
+//------------------------------------------------------------------------------
+static inline __m128 FloorSse(__m128 x)
+{
+  // truncate, and step down for the negative values that were rounded up
+  __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1)));
+}
+
+//------------------------------------------------------------------------------
+// Evaluates 4 samples given the corner offsets, fade values and gradient indices
+static inline __m128 Value4(__m128 dx0,
+    __m128 dx1,
+    __m128 dy0,
+    __m128 dy1,
+    __m128 ux,
+    __m128 uy,
+    const int* idx00,
+    const int* idx01,
+    const int* idx10,
+    const int* idx11)
+{
+  __m128 d00 = DotGradientSse(dx0, dy0, idx00);
+  __m128 d01 = DotGradientSse(dx1, dy0, idx01);
+  __m128 d10 = DotGradientSse(dx0, dy1, idx10);
+  __m128 d11 = DotGradientSse(dx1, dy1, idx11);
+
+  __m128 xUpper = LerpSse(d00, d01, ux);
+  __m128 xLower = LerpSse(d10, d11, ux);
+  return LerpSse(xUpper, xLower, uy);
+}
+
+//------------------------------------------------------------------------------
+void Perlin2D::ValueGrid(float x0, float y0, float stepX, float stepY, int w, int h, float* out)
+{
+  // Everything that only depends on the column (the x offsets, fade values and the
+  // first permutation lookup) is computed once, and shared between all the rows.
+  // Wide grids are processed in tiles of columns.
+  const int TILE_SIZE = 256;
+  float colDx0[TILE_SIZE];
+  float colDx1[TILE_SIZE];
+  float colUx[TILE_SIZE];
+  int colPerm0[TILE_SIZE];
+  int colPerm1[TILE_SIZE];
+
+  for (int tileStart = 0; tileStart < w; tileStart += TILE_SIZE)
+  {
+    int tileWidth = min(TILE_SIZE, w - tileStart);
+    // pad to a multiple of 4 by repeating the last column
+    int paddedWidth = (tileWidth + 3) & ~3;
+
+    for (int i = 0; i < paddedWidth; ++i)
+    {
+      float x = x0 + (tileStart + min(i, tileWidth - 1)) * stepX;
+      int ix = (int)floorf(x);
+      colDx0[i] = x - (float)ix;
+      colDx1[i] = x - (float)(ix + 1);
+      colUx[i] = Interp(colDx0[i]);
+      colPerm0[i] = permutation[ix & 0xff];
+      colPerm1[i] = permutation[(ix + 1) & 0xff];
+    }
+
+    for (int j = 0; j < h; ++j)
+    {
+      float y = y0 + j * stepY;
+      int iy = (int)floorf(y);
+      __m128 dy0 = _mm_set1_ps(y - (float)iy);
+      __m128 dy1 = _mm_set1_ps(y - (float)(iy + 1));
+      __m128 uy = _mm_set1_ps(Interp(y - (float)iy));
+
+      float* row = out + j * w + tileStart;
+      for (int i = 0; i < paddedWidth; i += 4)
+      {
+        int idx00[4], idx01[4], idx10[4], idx11[4];
+        for (int k = 0; k < 4; ++k)
+        {
+          idx00[k] = permutation[(colPerm0[i + k] + iy) & 0xff];
+          idx01[k] = permutation[(colPerm1[i + k] + iy) & 0xff];
+          idx10[k] = permutation[(colPerm0[i + k] + iy + 1) & 0xff];
+          idx11[k] = permutation[(colPerm1[i + k] + iy + 1) & 0xff];
+        }
+
+        __m128 value = Value4(_mm_loadu_ps(colDx0 + i),
+            _mm_loadu_ps(colDx1 + i),
+            dy0,
+            dy1,
+            _mm_loadu_ps(colUx + i),
+            uy,
+            idx00,
+            idx01,
+            idx10,
+            idx11);
+
+        if (i + 4 <= tileWidth)
+        {
+          _mm_storeu_ps(row + i, value);
+        }
+        else
+        {
+          float tmp[4];
+          _mm_storeu_ps(tmp, value);
+          for (int k = 0; i + k < tileWidth; ++k)
+            row[i + k] = tmp[k];
+        }
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void Perlin2D::Values(const vec2* pts, int num, float* out)
+{
+  int i = 0;
+  for (; i + 4 <= num; i += 4)
+  {
+    __m128 x = _mm_setr_ps(pts[i + 0].x, pts[i + 1].x, pts[i + 2].x, pts[i + 3].x);
+    __m128 y = _mm_setr_ps(pts[i + 0].y, pts[i + 1].y, pts[i + 2].y, pts[i + 3].y);
+
+    __m128 fx = FloorSse(x);
+    __m128 fy = FloorSse(y);
+    __m128 one = _mm_set1_ps(1);
+
+    int ix[4], iy[4];
+    _mm_storeu_si128((__m128i*)ix, _mm_cvttps_epi32(fx));
+    _mm_storeu_si128((__m128i*)iy, _mm_cvttps_epi32(fy));
+
+    int idx00[4], idx01[4], idx10[4], idx11[4];
+    for (int k = 0; k < 4; ++k)
+    {
+      int p0 = permutation[ix[k] & 0xff];
+      int p1 = permutation[(ix[k] + 1) & 0xff];
+      idx00[k] = permutation[(p0 + iy[k]) & 0xff];
+      idx01[k] = permutation[(p1 + iy[k]) & 0xff];
+      idx10[k] = permutation[(p0 + iy[k] + 1) & 0xff];
+      idx11[k] = permutation[(p1 + iy[k] + 1) & 0xff];
+    }
+
+    __m128 dx0 = _mm_sub_ps(x, fx);
+    __m128 dy0 = _mm_sub_ps(y, fy);
+    __m128 value = Value4(dx0,
+        _mm_sub_ps(x, _mm_add_ps(fx, one)),
+        dy0,
+        _mm_sub_ps(y, _mm_add_ps(fy, one)),
+        InterpSse(dx0),
+        InterpSse(dy0),
+        idx00,
+        idx01,
+        idx10,
+        idx11);
+    _mm_storeu_ps(out + i, value);
+  }
+
+  for (; i < num; ++i)
+    out[i] = Value(pts[i].x, pts[i].y);
+}
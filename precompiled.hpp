@@ -21,6 +21,7 @@
 #define WITH_BLACKBOARD_SAVE 1
 
 #define WITH_TESTS 1
+#define WITH_BENCHMARKS 0
 #define WITH_EXPRESSION_EDITOR 1
 
 #define WITH_IMGUI 1
@@ -32,6 +33,8 @@
 
 #define WITH_SCHEDULER_STATS 0
 
+#define WITH_64BIT_HANDLES 1
+
 #ifdef _PUBLIC
   #define WITH_UNPACKED_RESOUCES 0
   #define WITH_DEBUG_SHADERS 0
@@ -40,6 +43,7 @@
   #define WITH_REMOTERY 0
   #define WITH_IMGUI 0
   #define WITH_TESTS 0
+  #define WITH_BENCHMARKS 0
   #define WITH_EXPRESSION_EDITOR 0
   #define WITH_CONFIG_DLG 1
   #define WITH_BLACKBOARD_TCP 0
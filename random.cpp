@@ -1,4 +1,5 @@
 #include "random.hpp"
+#include <emmintrin.h>
 
 #if WITH_IMGUI
 #include "imgui/imgui_internal.h"
@@ -7,80 +8,368 @@
 using namespace tano;
 using namespace bristol;
 
-static const int NUM_VALUES = 21347;
+namespace
+{
+  const u32 PHILOX_M0 = 0xD2511F53;
+  const u32 PHILOX_M1 = 0xCD9E8D57;
+  const u32 PHILOX_W0 = 0x9E3779B9;
+  const u32 PHILOX_W1 = 0xBB67AE85;
+  const int PHILOX_ROUNDS = 10;
+
+  // Batch fills generate this many values at a time on the stack
+  const int BATCH_SIZE = 256;
+
+  // The old tables summed 50 uniform values in [-v, v], giving a std dev of v / sqrt(150)
+  const float GAUSS_CLT_SCALE = 0.0816497f;
+
+  const float U32_TO_UNIT = 1.0f / 16777216.0f;
+
+  // start of the Ziggurat's tail
+  const double ZIGGURAT_R = 3.442619855899;
+
+  //------------------------------------------------------------------------------
+  inline float ToUnitFloat(u32 v)
+  {
+    // top 24 bits, so the result is exact and strictly below 1
+    return (v >> 8) * U32_TO_UNIT;
+  }
+
+  //------------------------------------------------------------------------------
+  inline u32 MulHiLo(u32 a, u32 b, u32* hi)
+  {
+    u64 p = (u64)a * b;
+    *hi = (u32)(p >> 32);
+    return (u32)p;
+  }
+
+  //------------------------------------------------------------------------------
+  // 32x32 -> 64 multiply of each lane by a constant, returning the low and high halves
+  inline void MulHiLo4(__m128i x, __m128i m, __m128i* lo, __m128i* hi)
+  {
+    __m128i even = _mm_mul_epu32(x, m);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), m);
+    *lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    *hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 3, 1)),
+        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 3, 1)));
+  }
+
+  //------------------------------------------------------------------------------
+  // Generates the blocks for counter .. counter + 3, in counter order
+  void Block4(u64 seed, u64 stream, u64 counter, u32* out)
+  {
+    __m128i x0 = _mm_setr_epi32((u32)counter,
+        (u32)(counter + 1),
+        (u32)(counter + 2),
+        (u32)(counter + 3));
+    // the carry into the high word is done per lane, in case the low word wraps
+    __m128i x1 = _mm_setr_epi32((u32)(counter >> 32),
+        (u32)((counter + 1) >> 32),
+        (u32)((counter + 2) >> 32),
+        (u32)((counter + 3) >> 32));
+    __m128i x2 = _mm_set1_epi32((u32)stream);
+    __m128i x3 = _mm_set1_epi32((u32)(stream >> 32));
+
+    __m128i k0 = _mm_set1_epi32((u32)seed);
+    __m128i k1 = _mm_set1_epi32((u32)(seed >> 32));
+    const __m128i w0 = _mm_set1_epi32(PHILOX_W0);
+    const __m128i w1 = _mm_set1_epi32(PHILOX_W1);
+    const __m128i m0 = _mm_set1_epi32(PHILOX_M0);
+    const __m128i m1 = _mm_set1_epi32(PHILOX_M1);
+
+    for (int i = 0; i < PHILOX_ROUNDS; ++i)
+    {
+      if (i > 0)
+      {
+        k0 = _mm_add_epi32(k0, w0);
+        k1 = _mm_add_epi32(k1, w1);
+      }
+
+      __m128i lo0, hi0, lo1, hi1;
+      MulHiLo4(x0, m0, &lo0, &hi0);
+      MulHiLo4(x2, m1, &lo1, &hi1);
+      x0 = _mm_xor_si128(_mm_xor_si128(hi1, x1), k0);
+      x1 = lo1;
+      x2 = _mm_xor_si128(_mm_xor_si128(hi0, x3), k1);
+      x3 = lo0;
+    }
+
+    // transpose, so each block's 4 words are contiguous
+    __m128i t0 = _mm_unpacklo_epi32(x0, x1);
+    __m128i t1 = _mm_unpacklo_epi32(x2, x3);
+    __m128i t2 = _mm_unpackhi_epi32(x0, x1);
+    __m128i t3 = _mm_unpackhi_epi32(x2, x3);
+    _mm_storeu_si128((__m128i*)(out + 0), _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(out + 8), _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i*)(out + 12), _mm_unpackhi_epi64(t2, t3));
+  }
+
+  //------------------------------------------------------------------------------
+  // 128 layer Ziggurat tables, from Marsaglia & Tsang, "The Ziggurat Method for
+  // Generating Random Variables"
+  struct ZigguratTables
+  {
+    ZigguratTables()
+    {
+      const double m1 = 2147483648.0;
+      const double vn = 9.91256303526217e-3;
+      double dn = ZIGGURAT_R;
+      double tn = dn;
+
+      double q = vn / exp(-0.5 * dn * dn);
+      kn[0] = (u32)((dn / q) * m1);
+      kn[1] = 0;
+      wn[0] = (float)(q / m1);
+      wn[127] = (float)(dn / m1);
+      fn[0] = 1.0f;
+      fn[127] = (float)exp(-0.5 * dn * dn);
+
+      for (int i = 126; i >= 1; --i)
+      {
+        dn = sqrt(-2 * log(vn / dn + exp(-0.5 * dn * dn)));
+        kn[i + 1] = (u32)((dn / tn) * m1);
+        tn = dn;
+        fn[i] = (float)exp(-0.5 * dn * dn);
+        wn[i] = (float)(dn / m1);
+      }
+    }
+
+    u32 kn[128];
+    float wn[128];
+    float fn[128];
+  };
+
+  //------------------------------------------------------------------------------
+  const ZigguratTables& Ziggurat()
+  {
+    static ZigguratTables tables;
+    return tables;
+  }
+
+  //------------------------------------------------------------------------------
+  // The rare case where the sample falls outside a layer's inner rectangle
+  float GaussianTail(Philox* rng, s32 hz)
+  {
+    const ZigguratTables& z = Ziggurat();
+    const float r = (float)ZIGGURAT_R;
+
+    for (;;)
+    {
+      int iz = hz & 127;
+      float x = hz * z.wn[iz];
+      if (iz == 0)
+      {
+        // sample from the tail beyond r
+        float y;
+        do
+        {
+          x = -logf(1 - rng->NextFloat()) / r;
+          y = -logf(1 - rng->NextFloat());
+        } while (y + y < x * x);
+        return hz > 0 ? r + x : -r - x;
+      }
+
+      if (z.fn[iz] + rng->NextFloat() * (z.fn[iz - 1] - z.fn[iz]) < expf(-0.5f * x * x))
+        return x;
+
+      hz = (s32)rng->NextU32();
+      iz = hz & 127;
+      if ((u32)abs((s64)hz) < z.kn[iz])
+        return hz * z.wn[iz];
+    }
+  }
+
+  //------------------------------------------------------------------------------
+  inline float Gaussian(Philox* rng, u32 v)
+  {
+    const ZigguratTables& z = Ziggurat();
+    s32 hz = (s32)v;
+    int iz = hz & 127;
+    if ((u32)abs((s64)hz) < z.kn[iz])
+      return hz * z.wn[iz];
+    return GaussianTail(rng, hz);
+  }
+}
+
+//------------------------------------------------------------------------------
+Philox::Philox(u64 seed, u64 stream) : _seed(seed), _stream(stream)
+{
+}
+
+//------------------------------------------------------------------------------
+void Philox::Block(u64 seed, u64 stream, u64 counter, u32* out)
+{
+  u32 x0 = (u32)counter;
+  u32 x1 = (u32)(counter >> 32);
+  u32 x2 = (u32)stream;
+  u32 x3 = (u32)(stream >> 32);
+  u32 k0 = (u32)seed;
+  u32 k1 = (u32)(seed >> 32);
 
-static float FLOAT_TABLE[NUM_VALUES];
-static float GAUSS_1_01_TABLE[NUM_VALUES];
-static float GAUSS_1_10_TABLE[NUM_VALUES];
-static float GAUSS_1_50_TABLE[NUM_VALUES];
-static float GAUSS_1_150_TABLE[NUM_VALUES];
+  for (int i = 0; i < PHILOX_ROUNDS; ++i)
+  {
+    if (i > 0)
+    {
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+
+    u32 hi0, hi1;
+    u32 lo0 = MulHiLo(PHILOX_M0, x0, &hi0);
+    u32 lo1 = MulHiLo(PHILOX_M1, x2, &hi1);
+    x0 = hi1 ^ x1 ^ k0;
+    x1 = lo1;
+    x2 = hi0 ^ x3 ^ k1;
+    x3 = lo0;
+  }
 
-static int INT_TABLE[NUM_VALUES];
+  out[0] = x0;
+  out[1] = x1;
+  out[2] = x2;
+  out[3] = x3;
+}
 
-static bool GenTables()
+//------------------------------------------------------------------------------
+u32 Philox::NextU32()
 {
-  for (int i = 0; i < NUM_VALUES; ++i)
+  if (_blockIdx == 4)
   {
-    FLOAT_TABLE[i] = randf(0.f, 1.f);
-    GAUSS_1_01_TABLE[i] = GaussianRand(0.f, 0.10f);
-    GAUSS_1_10_TABLE[i] = GaussianRand(0.f, 0.50f);
-    GAUSS_1_50_TABLE[i] = GaussianRand(0.f, 1.50f);
-    GAUSS_1_150_TABLE[i] = GaussianRand(0.f, 2.50f);
-    INT_TABLE[i] = rand();
+    Block(_seed, _stream, _counter++, _block);
+    _blockIdx = 0;
   }
-  return true;
+  return _block[_blockIdx++];
+}
+
+//------------------------------------------------------------------------------
+float Philox::NextFloat()
+{
+  return ToUnitFloat(NextU32());
+}
+
+//------------------------------------------------------------------------------
+float Philox::NextGaussian()
+{
+  return Gaussian(this, NextU32());
 }
 
-static bool tablesGenerated = GenTables();
+//------------------------------------------------------------------------------
+void Philox::FillU32(u32* out, int num)
+{
+  // drain what's left of the current block first, to keep the sequence intact
+  int i = 0;
+  while (i < num && _blockIdx < 4)
+    out[i++] = _block[_blockIdx++];
+
+  for (; i + 16 <= num; i += 16)
+  {
+    Block4(_seed, _stream, _counter, out + i);
+    _counter += 4;
+  }
+
+  while (i < num)
+    out[i++] = NextU32();
+}
+
+//------------------------------------------------------------------------------
+void Philox::FillUniform(float* out, int num, float minValue, float maxValue)
+{
+  assert(maxValue >= minValue);
+  u32 tmp[BATCH_SIZE];
+  __m128 scale = _mm_set1_ps((maxValue - minValue) * U32_TO_UNIT);
+  __m128 ofs = _mm_set1_ps(minValue);
+
+  for (int start = 0; start < num; start += BATCH_SIZE)
+  {
+    int n = min(BATCH_SIZE, num - start);
+    FillU32(tmp, n);
+
+    float* dst = out + start;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      __m128i v = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)(tmp + i)), 8);
+      _mm_storeu_ps(dst + i, _mm_add_ps(ofs, _mm_mul_ps(_mm_cvtepi32_ps(v), scale)));
+    }
+
+    for (; i < n; ++i)
+      dst[i] = minValue + (maxValue - minValue) * ToUnitFloat(tmp[i]);
+  }
+}
+
+//------------------------------------------------------------------------------
+void Philox::FillGaussian(float* out, int num, float mean, float stdDev)
+{
+  u32 tmp[BATCH_SIZE];
+  for (int start = 0; start < num; start += BATCH_SIZE)
+  {
+    int n = min(BATCH_SIZE, num - start);
+    FillU32(tmp, n);
+
+    // ~99% of samples take the table lookup path, and the rest pull extra values
+    // from the stream after this batch
+    float* dst = out + start;
+    for (int i = 0; i < n; ++i)
+      dst[i] = mean + stdDev * Gaussian(this, tmp[i]);
+  }
+}
+
+//------------------------------------------------------------------------------
+RandomUniform::RandomUniform(u64 seed, u64 stream) : _rng(seed, stream)
+{
+}
 
 //------------------------------------------------------------------------------
 float RandomUniform::Next(float minValue, float maxValue)
 {
   assert(maxValue >= minValue);
-  float s = maxValue - minValue;
-  float res = minValue + s * FLOAT_TABLE[_idx];
-  _idx = (_idx + 1) % NUM_VALUES;
-  return res;
+  return minValue + (maxValue - minValue) * _rng.NextFloat();
+}
+
+//------------------------------------------------------------------------------
+RandomInt::RandomInt(u64 seed, u64 stream) : _rng(seed, stream)
+{
 }
 
 //------------------------------------------------------------------------------
 int RandomInt::Next()
 {
-  int res = INT_TABLE[_idx];
-  _idx = (_idx + 1) % NUM_VALUES;
-  return res;
+  return (int)(_rng.NextU32() >> 1);
 }
 
 //------------------------------------------------------------------------------
-RandomGaussBase::RandomGaussBase(float* table) : _table(table)
+RandomGaussBase::RandomGaussBase(float stdDev, u64 seed, u64 stream)
+    : _stdDev(stdDev), _rng(seed, stream)
 {
 }
 
 //------------------------------------------------------------------------------
 float RandomGaussBase::Next(float mean, float variance)
 {
-  float res = mean + variance * _table[_idx];
-  _idx = (_idx + 1) % NUM_VALUES;
-  return res;
+  return mean + variance * _stdDev * _rng.NextGaussian();
 }
 
 //------------------------------------------------------------------------------
-RandomGauss01::RandomGauss01() : RandomGaussBase(GAUSS_1_01_TABLE)
+RandomGauss01::RandomGauss01(u64 seed, u64 stream)
+    : RandomGaussBase(0.10f * GAUSS_CLT_SCALE, seed, stream)
 {
 }
 
 //------------------------------------------------------------------------------
-RandomGauss10::RandomGauss10() : RandomGaussBase(GAUSS_1_10_TABLE)
+RandomGauss10::RandomGauss10(u64 seed, u64 stream)
+    : RandomGaussBase(0.50f * GAUSS_CLT_SCALE, seed, stream)
 {
 }
 
 //------------------------------------------------------------------------------
-RandomGauss50::RandomGauss50() : RandomGaussBase(GAUSS_1_50_TABLE)
+RandomGauss50::RandomGauss50(u64 seed, u64 stream)
+    : RandomGaussBase(1.50f * GAUSS_CLT_SCALE, seed, stream)
 {
 }
 
 //------------------------------------------------------------------------------
-RandomGauss150::RandomGauss150() : RandomGaussBase(GAUSS_1_150_TABLE)
+RandomGauss150::RandomGauss150(u64 seed, u64 stream)
+    : RandomGaussBase(2.50f * GAUSS_CLT_SCALE, seed, stream)
 {
 }
 
@@ -93,8 +382,11 @@ void tano::ShowRandomDistribution()
   static bool opened = true;
   ImGui::Begin("Distribution");
 
-  float* distTables[] = {
-      GAUSS_1_01_TABLE, GAUSS_1_10_TABLE, GAUSS_1_50_TABLE, GAUSS_1_150_TABLE, FLOAT_TABLE};
+  float stdDevs[] = { 0.10f * GAUSS_CLT_SCALE,
+      0.50f * GAUSS_CLT_SCALE,
+      1.50f * GAUSS_CLT_SCALE,
+      2.50f * GAUSS_CLT_SCALE,
+      0 };
   float scaleFactors[] = { 0.5f, 0.5f, 0.5f, 0.5f, 1.0f };
   float ofs[] = { 0.5f, 0.5f, 0.5f, 0.5f, 0 };
   static char* distributions[] = {
@@ -108,11 +400,19 @@ void tano::ShowRandomDistribution()
   static int curDist = 0;
   ImGui::Combo("Distribution", &curDist, fnGetParam, NULL, IM_ARRAYSIZE(distributions));
 
+  // always draw from the same stream, so the histogram is stable between frames
+  const int NUM_SAMPLES = 32 * 1024;
+  vector<float> samples(NUM_SAMPLES);
+  Philox rng;
+  if (curDist == IM_ARRAYSIZE(distributions) - 1)
+    rng.FillUniform(samples.data(), NUM_SAMPLES);
+  else
+    rng.FillGaussian(samples.data(), NUM_SAMPLES, 0, stdDevs[curDist]);
+
   int numBuckets = 2048;
   vector<float> values(numBuckets);
-  for (int i = 0; i < NUM_VALUES; ++i)
+  for (float v : samples)
   {
-    float v = distTables[curDist][i];
     int idx = (int)(numBuckets * (scaleFactors[curDist] * v + ofs[curDist]));
     if (idx >= 0 && idx < numBuckets)
       values[idx] += 1;
@@ -125,4 +425,4 @@ void tano::ShowRandomDistribution()
 
   ImGui::End();
 }
-#endif
\ No newline at end of file
+#endif
@@ -2,55 +2,91 @@
 
 namespace tano
 {
+  //------------------------------------------------------------------------------
+  // Philox4x32-10 counter based generator (Salmon et al, "Parallel Random Numbers: As
+  // Easy as 1, 2, 3"). Each block of 4 values is a pure function of (seed, stream,
+  // counter), so every task can draw from its own stream without any shared state, and
+  // the results don't depend on which thread ran the task.
+  struct Philox
+  {
+    enum : u64 { DEFAULT_SEED = 0x7a4e5eedull };
+
+    Philox(u64 seed = DEFAULT_SEED, u64 stream = 0);
+
+    // Fills out[0..3] with the block for the given counter
+    static void Block(u64 seed, u64 stream, u64 counter, u32* out);
+
+    u32 NextU32();
+    // in [0, 1)
+    float NextFloat();
+    // mean 0, std dev 1 (Ziggurat)
+    float NextGaussian();
+
+    // Batch versions, generating 4 blocks at a time with SSE. FillU32 and FillUniform
+    // return the same values as the equivalent sequence of single draws.
+    void FillU32(u32* out, int num);
+    void FillUniform(float* out, int num, float minValue = 0.f, float maxValue = 1.f);
+    void FillGaussian(float* out, int num, float mean = 0.f, float stdDev = 1.f);
+
+    u64 _seed;
+    u64 _stream;
+    u64 _counter = 0;
+    u32 _block[4];
+    int _blockIdx = 4;
+  };
+
   //------------------------------------------------------------------------------
   struct RandomUniform
   {
+    RandomUniform(u64 seed = Philox::DEFAULT_SEED, u64 stream = 0);
     float Next(float minValue = 0.f, float maxValue = 1.f);
-    int _idx = 0;
+    Philox _rng;
   };
 
   //------------------------------------------------------------------------------
+  // Returns non-negative values
   struct RandomInt
   {
+    RandomInt(u64 seed = Philox::DEFAULT_SEED, u64 stream = 0);
     int Next();
-    int _idx = 0;
+    Philox _rng;
   };
 
   //------------------------------------------------------------------------------
-  // NB: Don't read too much into the gaussian distribution names. I'm pretty sure
-  // their std devs don't match to what's given :)
+  // NB: Don't read too much into the gaussian distribution names. The std devs are
+  // the ones the old sum-of-uniforms tables had, and not what the names suggest :)
   struct RandomGaussBase
   {
-    RandomGaussBase(float* table);
+    RandomGaussBase(float stdDev, u64 seed, u64 stream);
     float Next(float mean, float variance);
 
-    float* _table;
-    int _idx = 0;
+    float _stdDev;
+    Philox _rng;
   };
 
   //------------------------------------------------------------------------------
   struct RandomGauss01 : public RandomGaussBase
   {
-    RandomGauss01();
+    RandomGauss01(u64 seed = Philox::DEFAULT_SEED, u64 stream = 0);
   };
 
   //------------------------------------------------------------------------------
   struct RandomGauss10 : public RandomGaussBase
   {
-    RandomGauss10();
+    RandomGauss10(u64 seed = Philox::DEFAULT_SEED, u64 stream = 0);
   };
 
   //------------------------------------------------------------------------------
   struct RandomGauss50 : public RandomGaussBase
   {
-    RandomGauss50();
+    RandomGauss50(u64 seed = Philox::DEFAULT_SEED, u64 stream = 0);
   };
 
   //------------------------------------------------------------------------------
   struct RandomGauss150 : public RandomGaussBase
   {
-    RandomGauss150();
+    RandomGauss150(u64 seed = Philox::DEFAULT_SEED, u64 stream = 0);
   };
 
   void ShowRandomDistribution();
-}
\ No newline at end of file
+}
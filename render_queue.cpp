@@ -0,0 +1,335 @@
+#include "render_queue.hpp"
+#include "graphics_context.hpp"
+
+using namespace tano;
+using namespace bristol;
+
+namespace
+{
+  const u32 COMMAND_ALIGNMENT = 16;
+
+  //------------------------------------------------------------------------------
+  inline u32 AlignUp(u32 ofs)
+  {
+    return (ofs + COMMAND_ALIGNMENT - 1) & ~(COMMAND_ALIGNMENT - 1);
+  }
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::Init(void* start, void* end)
+{
+  _mem = (u8*)start;
+  _capacity = (u32)((u8*)end - (u8*)start);
+  Reset();
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::Reset()
+{
+  _ofs = 0;
+  _overflow = false;
+  _firstPacket = _lastPacket = _curPacket = nullptr;
+  _numPackets = 0;
+}
+
+//------------------------------------------------------------------------------
+u8* CommandBuffer::Alloc(u32 size)
+{
+  // align the actual address, as the block itself might not be aligned
+  u32 ofs = AlignUp((u32)((uintptr_t)_mem + _ofs)) - (u32)(uintptr_t)_mem;
+  if (ofs + size > _capacity)
+  {
+    _overflow = true;
+    return nullptr;
+  }
+
+  _ofs = ofs + size;
+  return _mem + ofs;
+}
+
+//------------------------------------------------------------------------------
+template <typename T>
+T* CommandBuffer::AddCommand(u32 payloadSize)
+{
+  assert(_curPacket || _overflow);
+  if (!_curPacket)
+    return nullptr;
+
+  // the command and its payload are allocated together, so a command that doesn't fit
+  // is dropped without leaving anything half written
+  u32 cmdSize = AlignUp(sizeof(T));
+  u8* mem = Alloc(cmdSize + payloadSize);
+  if (!mem)
+    return nullptr;
+
+  T* cmd = (T*)mem;
+  cmd->type = T::TYPE;
+  cmd->payloadSize = payloadSize;
+  cmd->payload = payloadSize ? mem + cmdSize : nullptr;
+  cmd->next = nullptr;
+
+  if (_curPacket->last)
+    _curPacket->last->next = cmd;
+  else
+    _curPacket->first = cmd;
+  _curPacket->last = cmd;
+
+  return cmd;
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::BeginPacket(u64 key)
+{
+  CommandPacket* packet = (CommandPacket*)Alloc(sizeof(CommandPacket));
+  if (!packet)
+  {
+    // make sure the following commands don't end up in the previous packet
+    _curPacket = nullptr;
+    return;
+  }
+
+  packet->key = key;
+  packet->first = packet->last = nullptr;
+  packet->next = nullptr;
+
+  if (_lastPacket)
+    _lastPacket->next = packet;
+  else
+    _firstPacket = packet;
+  _lastPacket = _curPacket = packet;
+  ++_numPackets;
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::SetRenderTarget(
+    ObjectHandle renderTarget, ObjectHandle depthStencil, const Color* clearColor)
+{
+  SetRenderTargets(&renderTarget, 1, depthStencil, &clearColor);
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::SetRenderTargets(const ObjectHandle* renderTargets,
+    int numRenderTargets,
+    ObjectHandle depthStencil,
+    const Color** clearColors)
+{
+  assert(numRenderTargets <= cmd::MAX_RENDER_TARGETS);
+  cmd::SetRenderTargets* c = AddCommand<cmd::SetRenderTargets>();
+  if (!c)
+    return;
+
+  c->numRenderTargets = min((int)cmd::MAX_RENDER_TARGETS, numRenderTargets);
+  c->depthStencil = depthStencil;
+  c->clearMask = 0;
+  for (int i = 0; i < c->numRenderTargets; ++i)
+  {
+    c->renderTargets[i] = renderTargets[i];
+    if (clearColors && clearColors[i])
+    {
+      c->clearMask |= 1 << i;
+      c->clearColors[i] = *clearColors[i];
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::SetBundle(const GpuBundle& bundle)
+{
+  if (cmd::SetBundle* c = AddCommand<cmd::SetBundle>())
+    c->bundle = &bundle;
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::SetRasterizerState(ObjectHandle rs)
+{
+  if (cmd::SetRasterizerState* c = AddCommand<cmd::SetRasterizerState>())
+    c->handle = rs;
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::SetShaderResources(
+    const ObjectHandle* handles, int numHandles, ShaderType shaderType)
+{
+  assert(numHandles <= cmd::MAX_SHADER_RESOURCES);
+  cmd::SetShaderResources* c = AddCommand<cmd::SetShaderResources>();
+  if (!c)
+    return;
+
+  c->numHandles = min((int)cmd::MAX_SHADER_RESOURCES, numHandles);
+  c->shaderType = shaderType;
+  for (int i = 0; i < c->numHandles; ++i)
+    c->handles[i] = handles[i];
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::SetConstantBuffer(
+    ObjectHandle h, const void* buf, u32 len, u32 shaderFlags, u32 slot)
+{
+  cmd::SetConstantBuffer* c = AddCommand<cmd::SetConstantBuffer>(len);
+  if (!c)
+    return;
+
+  c->handle = h;
+  c->shaderFlags = shaderFlags;
+  c->slot = slot;
+  memcpy(c->payload, buf, len);
+}
+
+//------------------------------------------------------------------------------
+void* CommandBuffer::CopyToBuffer(ObjectHandle h, u32 len)
+{
+  cmd::CopyToBuffer* c = AddCommand<cmd::CopyToBuffer>(len);
+  if (!c)
+    return nullptr;
+
+  c->handle = h;
+  return c->payload;
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::Draw(int vertexCount, int startVertex)
+{
+  if (cmd::Draw* c = AddCommand<cmd::Draw>())
+  {
+    c->vertexCount = vertexCount;
+    c->startVertex = startVertex;
+  }
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::DrawIndexed(int indexCount, int startIndex, int baseVertex)
+{
+  if (cmd::DrawIndexed* c = AddCommand<cmd::DrawIndexed>())
+  {
+    c->indexCount = indexCount;
+    c->startIndex = startIndex;
+    c->baseVertex = baseVertex;
+  }
+}
+
+//------------------------------------------------------------------------------
+void CommandBuffer::Dispatch(int threadGroupsX, int threadGroupsY, int threadGroupsZ)
+{
+  if (cmd::Dispatch* c = AddCommand<cmd::Dispatch>())
+  {
+    c->threadGroupsX = threadGroupsX;
+    c->threadGroupsY = threadGroupsY;
+    c->threadGroupsZ = threadGroupsZ;
+  }
+}
+
+//------------------------------------------------------------------------------
+void ContextRenderBackend::Execute(const Command& c)
+{
+  switch (c.type)
+  {
+  case CommandType::SetRenderTargets:
+  {
+    const cmd::SetRenderTargets& rt = (const cmd::SetRenderTargets&)c;
+    const Color* clearColors[cmd::MAX_RENDER_TARGETS];
+    for (int i = 0; i < rt.numRenderTargets; ++i)
+      clearColors[i] = (rt.clearMask & (1 << i)) ? &rt.clearColors[i] : nullptr;
+    _ctx->SetRenderTargets(rt.renderTargets, rt.numRenderTargets, rt.depthStencil, clearColors);
+    break;
+  }
+
+  case CommandType::SetBundle:
+    _ctx->SetBundle(*((const cmd::SetBundle&)c).bundle);
+    break;
+
+  case CommandType::SetRasterizerState:
+    _ctx->SetRasterizerState(((const cmd::SetRasterizerState&)c).handle);
+    break;
+
+  case CommandType::SetShaderResources:
+  {
+    const cmd::SetShaderResources& sr = (const cmd::SetShaderResources&)c;
+    _ctx->SetShaderResources(sr.handles, sr.numHandles, sr.shaderType);
+    break;
+  }
+
+  case CommandType::SetConstantBuffer:
+  {
+    const cmd::SetConstantBuffer& cb = (const cmd::SetConstantBuffer&)c;
+    _ctx->SetConstantBuffer(cb.handle, cb.payload, cb.payloadSize, cb.shaderFlags, cb.slot);
+    break;
+  }
+
+  case CommandType::CopyToBuffer:
+    _ctx->CopyToBuffer(((const cmd::CopyToBuffer&)c).handle, c.payload, c.payloadSize);
+    break;
+
+  case CommandType::Draw:
+  {
+    const cmd::Draw& d = (const cmd::Draw&)c;
+    _ctx->Draw(d.vertexCount, d.startVertex);
+    break;
+  }
+
+  case CommandType::DrawIndexed:
+  {
+    const cmd::DrawIndexed& d = (const cmd::DrawIndexed&)c;
+    _ctx->DrawIndexed(d.indexCount, d.startIndex, d.baseVertex);
+    break;
+  }
+
+  case CommandType::Dispatch:
+  {
+    const cmd::Dispatch& d = (const cmd::Dispatch&)c;
+    _ctx->Dispatch(d.threadGroupsX, d.threadGroupsY, d.threadGroupsZ);
+    break;
+  }
+
+  default:
+    LOG_WARN("Unknown render command: ", (int)c.type);
+    break;
+  }
+}
+
+//------------------------------------------------------------------------------
+void NullRenderBackend::Execute(const Command& c)
+{
+  trace.push_back(c.type);
+  numCommands[(int)c.type]++;
+  payloadBytes += c.payloadSize;
+
+  if (c.type == CommandType::Draw)
+    numVertices += ((const cmd::Draw&)c).vertexCount;
+  else if (c.type == CommandType::DrawIndexed)
+    numVertices += ((const cmd::DrawIndexed&)c).indexCount;
+}
+
+//------------------------------------------------------------------------------
+void NullRenderBackend::Reset()
+{
+  trace.clear();
+  for (int& n : numCommands)
+    n = 0;
+  payloadBytes = 0;
+  numVertices = 0;
+}
+
+//------------------------------------------------------------------------------
+void RenderQueue::Submit(const CommandBuffer& buffer)
+{
+  for (const CommandPacket* packet = buffer._firstPacket; packet; packet = packet->next)
+    _packets.push_back(SortEntry{packet->key, (u32)_packets.size(), packet});
+}
+
+//------------------------------------------------------------------------------
+void RenderQueue::Execute(RenderBackend* backend)
+{
+  // the submission order breaks ties, so equal keys are executed in a stable order
+  sort(_packets.begin(), _packets.end(), [](const SortEntry& lhs, const SortEntry& rhs)
+  {
+    return lhs.key < rhs.key || (lhs.key == rhs.key && lhs.order < rhs.order);
+  });
+
+  for (const SortEntry& entry : _packets)
+  {
+    for (const Command* c = entry.packet->first; c; c = c->next)
+      backend->Execute(*c);
+  }
+
+  _packets.clear();
+}
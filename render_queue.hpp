@@ -1,76 +1,259 @@
-// A start to something based on
+#pragma once
+#include "gpu_objects.hpp"
+
+// Sort based command buffers, loosely based on
 // https://molecularmusings.wordpress.com/2014/12/16/stateless-layered-multi-threaded-rendering-part-3-api-design-details/
+//
+// Effects record packets of commands into a CommandBuffer, one buffer per recording
+// thread, so recording needs no locks. The buffers are submitted to a RenderQueue,
+// which sorts the packets on their 64 bit key and feeds them to a RenderBackend.
 
-struct CommandBase
+namespace tano
 {
-  u8* data = nullptr;
-  CommandBase* next = nullptr;
-};
+  //------------------------------------------------------------------------------
+  // Default key layout: pass in the top 8 bits, then 24 bits of depth, then 32 bits
+  // of state (shader/material etc)
+  inline u64 MakeRenderKey(u32 pass, u32 depth, u32 state)
+  {
+    return ((u64)(pass & 0xff) << 56) | ((u64)(depth & 0xffffff) << 32) | state;
+  }
 
-struct SetSwapChain : CommandBase
-{
-  SetSwapChain(ObjectHandle h, const Color& color) : handle(h), clearColor(color) {}
-  ObjectHandle handle;
-  Color clearColor;
-};
+  //------------------------------------------------------------------------------
+  enum class CommandType : u8
+  {
+    SetRenderTargets,
+    SetBundle,
+    SetRasterizerState,
+    SetShaderResources,
+    SetConstantBuffer,
+    CopyToBuffer,
+    Draw,
+    DrawIndexed,
+    Dispatch,
+    NumCommands,
+  };
 
-struct SetConstantBuffer : CommandBase
-{
-  ObjectHandle handle;
-  ShaderType shader;
-};
+  //------------------------------------------------------------------------------
+  struct Command
+  {
+    CommandType type;
+    u32 payloadSize;
+    // constant buffer data, or buffer contents. Lives in the command buffer's memory
+    u8* payload;
+    Command* next;
+  };
 
-struct RenderQueue
-{
-  static const u32 INITIAL_MEMORY_SIZE = 128 * 1024 * 1024;
+  namespace cmd
+  {
+    enum
+    {
+      MAX_RENDER_TARGETS = 8,
+      MAX_SHADER_RESOURCES = 8,
+    };
 
-  RenderQueue() : _memory(INITIAL_MEMORY_SIZE) {}
+    struct SetRenderTargets : Command
+    {
+      static const CommandType TYPE = CommandType::SetRenderTargets;
+      ObjectHandle renderTargets[MAX_RENDER_TARGETS];
+      int numRenderTargets;
+      ObjectHandle depthStencil;
+      // bit i set if target i should be cleared
+      u32 clearMask;
+      Color clearColors[MAX_RENDER_TARGETS];
+    };
 
-  void FrameStart();
+    struct SetBundle : Command
+    {
+      static const CommandType TYPE = CommandType::SetBundle;
+      const GpuBundle* bundle;
+    };
 
-  template <typename T, typename... Args>
-  T* AllocateCommand(u32 dataSize, Args&&... args)
-  {
-    T* cmd = new (AllocChunk(sizeof(T)))T(forward<Args>(args)...);
-    _memoryOfs += sizeof(T);
+    struct SetRasterizerState : Command
+    {
+      static const CommandType TYPE = CommandType::SetRasterizerState;
+      ObjectHandle handle;
+    };
 
-    if (dataSize)
-      cmd->data = AllocChunk(dataSize);
+    struct SetShaderResources : Command
+    {
+      static const CommandType TYPE = CommandType::SetShaderResources;
+      ObjectHandle handles[MAX_SHADER_RESOURCES];
+      int numHandles;
+      ShaderType shaderType;
+    };
 
-    return cmd;
+    struct SetConstantBuffer : Command
+    {
+      static const CommandType TYPE = CommandType::SetConstantBuffer;
+      ObjectHandle handle;
+      u32 shaderFlags;
+      u32 slot;
+    };
+
+    struct CopyToBuffer : Command
+    {
+      static const CommandType TYPE = CommandType::CopyToBuffer;
+      ObjectHandle handle;
+    };
+
+    struct Draw : Command
+    {
+      static const CommandType TYPE = CommandType::Draw;
+      int vertexCount;
+      int startVertex;
+    };
+
+    struct DrawIndexed : Command
+    {
+      static const CommandType TYPE = CommandType::DrawIndexed;
+      int indexCount;
+      int startIndex;
+      int baseVertex;
+    };
+
+    struct Dispatch : Command
+    {
+      static const CommandType TYPE = CommandType::Dispatch;
+      int threadGroupsX, threadGroupsY, threadGroupsZ;
+    };
   }
 
-  template <typename T, typename... Args>
-  T* AppendCommand(CommandBase* parent, u32 dataSize, Args&&... args)
+  //------------------------------------------------------------------------------
+  struct CommandPacket
   {
-    T* cmd = new (AllocChunk(sizeof(T)))T(forward<Args>(args)...);
-    _memoryOfs += sizeof(T);
+    u64 key;
+    Command* first;
+    Command* last;
+    CommandPacket* next;
+  };
 
-    if (parent)
-      parent->next = cmd;
+  //------------------------------------------------------------------------------
+  // Records packets into a fixed block of memory, typically allocated from the scratch
+  // memory once per frame. Not thread safe, so each recording task uses its own.
+  class CommandBuffer
+  {
+  public:
+    void Init(void* start, void* end);
+    // Drops all recorded packets, but keeps the memory
+    void Reset();
 
-    if (dataSize)
-      cmd->data = AllocChunk(dataSize);
+    // Commands are added to the current packet, which is executed as a unit
+    void BeginPacket(u64 key);
 
-    return cmd;
-  }
+    void SetRenderTarget(
+        ObjectHandle renderTarget, ObjectHandle depthStencil, const Color* clearColor);
+    void SetRenderTargets(const ObjectHandle* renderTargets,
+        int numRenderTargets,
+        ObjectHandle depthStencil,
+        const Color** clearColors);
+    void SetBundle(const GpuBundle& bundle);
+    void SetRasterizerState(ObjectHandle rs);
+    void SetShaderResources(const ObjectHandle* handles, int numHandles, ShaderType shaderType);
+
+    // The constant buffer contents are copied when recorded
+    void SetConstantBuffer(ObjectHandle h, const void* buf, u32 len, u32 shaderFlags, u32 slot);
+    template <typename T>
+    void SetConstantBuffer(const ConstantBuffer<T>& buffer, u32 shaderFlags, u32 slot)
+    {
+      SetConstantBuffer(buffer.handle, &buffer, sizeof(T), shaderFlags, slot);
+    }
+
+    // Returns memory to write the buffer contents to, which is copied to the buffer
+    // when the packet is executed. Returns nullptr if the command buffer is full.
+    void* CopyToBuffer(ObjectHandle h, u32 len);
+    template <typename T>
+    T* CopyToBuffer(ObjectHandle h, int count)
+    {
+      return (T*)CopyToBuffer(h, count * sizeof(T));
+    }
+
+    void Draw(int vertexCount, int startVertex);
+    void DrawIndexed(int indexCount, int startIndex, int baseVertex);
+    void Dispatch(int threadGroupsX, int threadGroupsY, int threadGroupsZ);
 
-  u8* AllocChunk(u32 size)
+    int NumPackets() const { return _numPackets; }
+    u32 BytesUsed() const { return _ofs; }
+    // set if a command didn't fit, in which case it was dropped
+    bool Overflowed() const { return _overflow; }
+
+  private:
+    friend class RenderQueue;
+
+    u8* Alloc(u32 size);
+    template <typename T>
+    T* AddCommand(u32 payloadSize = 0);
+
+    u8* _mem = nullptr;
+    u32 _capacity = 0;
+    u32 _ofs = 0;
+    bool _overflow = false;
+
+    CommandPacket* _firstPacket = nullptr;
+    CommandPacket* _lastPacket = nullptr;
+    // packet commands are added to, or null if it didn't fit
+    CommandPacket* _curPacket = nullptr;
+    int _numPackets = 0;
+  };
+
+  //------------------------------------------------------------------------------
+  class RenderBackend
   {
-    u8* tmp = &_memory[_memoryOfs];
-    _memoryOfs += size;
-    return tmp;
-  }
+  public:
+    virtual ~RenderBackend() {}
+    virtual void Execute(const Command& cmd) = 0;
+  };
 
-  vector<u8> _memory;
-  u32 _memoryOfs = 0;
-};
+  //------------------------------------------------------------------------------
+  // Executes the commands on a GraphicsContext
+  class ContextRenderBackend : public RenderBackend
+  {
+  public:
+    ContextRenderBackend(GraphicsContext* ctx) : _ctx(ctx) {}
+    virtual void Execute(const Command& cmd) override;
 
-void RenderQueue::FrameStart()
-{
-  // reset the render queue
-  _memoryOfs = 0;
-}
+  private:
+    GraphicsContext* _ctx;
+  };
 
-SetSwapChain* setSwapChain = renderQueue.AllocateCommand<SetSwapChain>(0, g_Graphics->DefaultSwapChain(), Color(0, 0, 0, 0));
-SetConstantBuffer* setConstantBuffer = renderQueue.AppendCommand<SetConstantBuffer>(setSwapChain, 0);
+  //------------------------------------------------------------------------------
+  // Doesn't touch the GPU, but keeps stats and a trace of the executed commands, for
+  // tests and for inspecting frames
+  class NullRenderBackend : public RenderBackend
+  {
+  public:
+    virtual void Execute(const Command& cmd) override;
+    void Reset();
+
+    vector<CommandType> trace;
+    int numCommands[(int)CommandType::NumCommands] = {};
+    u64 payloadBytes = 0;
+    // vertices (or indices) drawn
+    u64 numVertices = 0;
+  };
+
+  //------------------------------------------------------------------------------
+  class RenderQueue
+  {
+  public:
+    // Not thread safe. Buffers can be recorded in parallel, but should be submitted
+    // from one thread in a fixed order, so packets with equal keys run in the same
+    // order every frame.
+    void Submit(const CommandBuffer& buffer);
+
+    // Runs the submitted packets in key order, and clears the queue. The buffers must
+    // stay valid until this is done.
+    void Execute(RenderBackend* backend);
+
+    int NumPackets() const { return (int)_packets.size(); }
+
+  private:
+    struct SortEntry
+    {
+      u64 key;
+      u32 order;
+      const CommandPacket* packet;
+    };
+
+    vector<SortEntry> _packets;
+  };
+}
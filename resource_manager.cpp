@@ -76,7 +76,11 @@ ResourceManager::~ResourceManager()
     FILE* f = fopen(_outputFilename.c_str(), "wt");
     for (auto it = begin(_readFiles); it != end(_readFiles); ++it)
     {
-      fprintf(f, "%s\t%s\n", it->orgName.c_str(), it->resolvedName.c_str());
+      // pack the compiled version of the file, if there is one
+      auto itCompiled = _compiledFiles.find(it->orgName);
+      const string& resolvedName =
+          itCompiled != _compiledFiles.end() ? itCompiled->second : it->resolvedName;
+      fprintf(f, "%s\t%s\n", it->orgName.c_str(), resolvedName.c_str());
     }
     fclose(f);
   }
@@ -179,16 +183,16 @@ string ResourceManager::ResolveFilename(const char* filename, bool returnFullPat
 }
 
 //------------------------------------------------------------------------------
-FileWatcherWin32::AddFileWatchResult ResourceManager::AddFileWatch(
+NativeFileWatcher::AddFileWatchResult ResourceManager::AddFileWatch(
     const string& filename,
     bool initialCallback,
-    const FileWatcherWin32::cbFileChanged &cb)
+    const NativeFileWatcher::cbFileChanged &cb)
 {
   return _fileWatcher.AddFileWatch(filename, initialCallback, cb);
 }
 
 //------------------------------------------------------------------------------
-void ResourceManager::RemoveFileWatch(FileWatcher::WatchId id)
+void ResourceManager::RemoveFileWatch(NativeFileWatcher::WatchId id)
 {
   _fileWatcher.RemoveFileWatch(id);
 }
@@ -251,6 +255,29 @@ void ResourceManager::CloseFile(FILE* f)
   fclose(f);
 }
 
+//------------------------------------------------------------------------------
+bool ResourceManager::WriteCompiledFile(
+    const char* filename, const char* ext, const vector<char>& buf)
+{
+  string fullPath = ResolveFilename(filename, true);
+  if (fullPath.empty())
+    return false;
+
+  string compiledPath = fullPath + ext;
+  FILE* f = fopen(compiledPath.c_str(), "wb");
+  if (!f)
+  {
+    LOG_WARN("Unable to write compiled file: ", compiledPath);
+    return false;
+  }
+
+  fwrite(buf.data(), 1, buf.size(), f);
+  fclose(f);
+
+  _compiledFiles[filename] = compiledPath;
+  return true;
+}
+
 
 #else
 
@@ -382,13 +409,13 @@ ObjectHandle PackedResourceManager::LoadTextureFromMemory(
 }
 
 //------------------------------------------------------------------------------
-FileWatcherWin32::AddFileWatchResult PackedResourceManager::AddFileWatch(
+NativeFileWatcher::AddFileWatchResult PackedResourceManager::AddFileWatch(
     const string& filename,
     bool initialCallback,
-    const FileWatcherWin32::cbFileChanged& cb)
+    const NativeFileWatcher::cbFileChanged& cb)
 {
   // Invoke the callback directly
-  FileWatcherWin32::AddFileWatchResult res;
+  NativeFileWatcher::AddFileWatchResult res;
   res.watchId = 0;
   res.initialResult = cb(filename);
   return res;
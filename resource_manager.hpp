@@ -1,10 +1,20 @@
 #pragma once
 
 #include "object_handle.hpp"
+#if defined(_WIN32)
 #include "filewatcher_win32.hpp"
+#else
+#include "filewatcher_inotify.hpp"
+#endif
 
 namespace tano
 {
+#if defined(_WIN32)
+  typedef FileWatcherWin32 NativeFileWatcher;
+#else
+  typedef FileWatcherInotify NativeFileWatcher;
+#endif
+
 #if WITH_UNPACKED_RESOUCES
 
   class ResourceManager
@@ -31,15 +41,19 @@ namespace tano
     void WriteFile(FILE* f, const char* buf, int len);
     void CloseFile(FILE* f);
 
+    // Writes a compiled version of 'filename' next to it, with 'ext' appended. The
+    // resource list then maps 'filename' to the compiled file, so that's what gets packed.
+    bool WriteCompiledFile(const char* filename, const char* ext, const vector<char>& buf);
+
     ObjectHandle LoadTexture(const char* filename, bool srgb = false, D3DX11_IMAGE_INFO* info = nullptr);
     ObjectHandle LoadTextureFromMemory(const char* buf, u32 len, bool srgb, D3DX11_IMAGE_INFO* info);
 
     void AddPath(const string& path);
 
-    FileWatcherWin32::AddFileWatchResult AddFileWatch(
-        const string& filename, bool initial_callback, const FileWatcherWin32::cbFileChanged& cb);
+    NativeFileWatcher::AddFileWatchResult AddFileWatch(
+        const string& filename, bool initial_callback, const NativeFileWatcher::cbFileChanged& cb);
 
-    void RemoveFileWatch(FileWatcher::WatchId id);
+    void RemoveFileWatch(NativeFileWatcher::WatchId id);
 
     void Tick();
 
@@ -50,7 +64,7 @@ namespace tano
     // files (and call resman's LoadFile)
     string ResolveFilename(const char* filename, bool returnFullPath);
 
-    FileWatcherWin32 _fileWatcher;
+    NativeFileWatcher _fileWatcher;
 
     vector<string> _paths;
     unordered_map<string, string> _resolvedPaths;
@@ -73,6 +87,8 @@ namespace tano
     };
 
     set<FileInfo> _readFiles;
+    // resolved compiled file, by original name
+    unordered_map<string, string> _compiledFiles;
     string _appRoot;
   };
 #define RESOURCE_MANAGER ResourceManager::Instance()
@@ -96,8 +112,8 @@ namespace tano
 
     ObjectHandle LoadTextureFromMemory(const char* buf, size_t len, bool srgb, D3DX11_IMAGE_INFO* info);
 
-    FileWatcherWin32::AddFileWatchResult AddFileWatch(
-      const string& filename, bool initial_callback, const FileWatcherWin32::cbFileChanged& cb);
+    NativeFileWatcher::AddFileWatchResult AddFileWatch(
+      const string& filename, bool initial_callback, const NativeFileWatcher::cbFileChanged& cb);
 
   private:
     bool Init();
@@ -29,6 +29,8 @@ void Scheduler::Destroy()
 Scheduler::Scheduler()
   : _taskAlloc(_taskMemory, _taskMemory + MAX_TASKS * sizeof(Task), sizeof(Task))
   , _taskQueue(_queueMemory, _queueMemory + MAX_TASKS * sizeof(Task*))
+  , _lowPriorityQueue(
+        _lowPriorityQueueMemory, _lowPriorityQueueMemory + MAX_TASKS * sizeof(Task*))
 {
 }
 
@@ -73,23 +75,36 @@ bool Scheduler::Init()
 }
 
 //------------------------------------------------------------------------------
-void Scheduler::QueueTask(Task* task)
+void Scheduler::QueueTask(Task* task, TaskPriority priority)
 {
+  CircularBuffer<Task*>& queue = priority == TaskPriority::Low ? _lowPriorityQueue : _taskQueue;
   while (true)
   {
     {
       ScopedCriticalSection cs(&_csTask);
-      if (!_taskQueue.IsFull())
+      if (!queue.IsFull())
       {
-        _taskQueue.Push(task);
+        queue.Push(task);
         WakeConditionVariable(&_cvTask);
         return;
       }
     }
-    HelpWithWork();
+    // without any worker threads, nothing else is going to make room in the low
+    // priority queue
+    HelpWithWork(priority == TaskPriority::Low && _threads.empty());
   }
 }
 
+//------------------------------------------------------------------------------
+Task* Scheduler::PopTask(bool allowLowPriority)
+{
+  // Note, the task lock must be held when calling this
+  if (!_taskQueue.IsEmpty())
+    return _taskQueue.Pop();
+
+  return allowLowPriority && !_lowPriorityQueue.IsEmpty() ? _lowPriorityQueue.Pop() : nullptr;
+}
+
 //------------------------------------------------------------------------------
 void Scheduler::WorkerThread()
 {
@@ -102,8 +117,9 @@ void Scheduler::WorkerThread()
       EnterCriticalSection(&_csTask);
     }
 
-    // Queue is locked, so look for tasks
-    if (Task* task = _taskQueue.IsEmpty() ? nullptr : _taskQueue.Pop())
+    // Queue is locked, so look for tasks. The worker is idle, so low priority tasks are
+    // fair game when there's no normal work
+    if (Task* task = PopTask(true))
     {
       LeaveCriticalSection(&_csTask);
       WorkOnTask(task);
@@ -193,12 +209,12 @@ bool Scheduler::CanExecuteTask(Task* task)
 }
 
 //------------------------------------------------------------------------------
-void Scheduler::HelpWithWork()
+void Scheduler::HelpWithWork(bool allowLowPriority)
 {
   Task* task;
   {
     ScopedCriticalSection cs(&_csTask);
-    task = _taskQueue.IsEmpty() ? nullptr : _taskQueue.Pop();
+    task = PopTask(allowLowPriority);
   }
   if (task)
   {
@@ -230,15 +246,17 @@ void Scheduler::FinishTask(Task* task)
 }
 
 //------------------------------------------------------------------------------
-TaskId Scheduler::AddTask(const KernelData& kernelData, const Kernel& kernel)
+TaskId Scheduler::AddTask(
+    const KernelData& kernelData, const Kernel& kernel, TaskPriority priority)
 {
   Task* task = AllocTask();
 
   task->kernel = kernel;
   task->taskData.kernelData = kernelData;
   task->openTasks = 1;
+  task->priority = priority;
 
-  QueueTask(task);
+  QueueTask(task, priority);
 
   return TaskId{ TaskToOffset(task), task->generation };
 }
@@ -260,7 +278,7 @@ TaskId Scheduler::AddStreamingTask(
   task->taskData.streamingData.inputStreams[0] = inputStream0;
   task->taskData.streamingData.outputStreams[0] = outputStream0;
 
-  QueueTask(task);
+  QueueTask(task, TaskPriority::Normal);
 
   return TaskId{ TaskToOffset(task), task->generation };
 }
@@ -268,9 +286,16 @@ TaskId Scheduler::AddStreamingTask(
 //------------------------------------------------------------------------------
 void Scheduler::Wait(const TaskId& taskId)
 {
+  // Only help with low priority work when waiting on a low priority task, and only if
+  // there are no worker threads to run it. Otherwise a wait on a critical task could
+  // end up running a long speculative one.
+  Task* task = GetTask(taskId);
+  bool allowLowPriority = _threads.empty() && task->generation == taskId.generation
+                          && task->priority == TaskPriority::Low;
+
   while (!IsTaskFinished(taskId))
   {
-    HelpWithWork();
+    HelpWithWork(allowLowPriority);
   }
 }
 
@@ -34,6 +34,15 @@ namespace tano
 
     typedef void(*Kernel)(const TaskData&);
 
+    // Low priority tasks are meant for speculative work that can span several frames.
+    // They are only picked up by idle worker threads, so a thread that is waiting on
+    // normal work never ends up running one.
+    enum class TaskPriority
+    {
+      Normal,
+      Low,
+    };
+
     typedef u32 TaskOffset;
 
     struct Task
@@ -43,6 +52,7 @@ namespace tano
       int generation = 0;
       u32 openTasks = 0;
       TaskOffset parent = NO_PARENT;
+      TaskPriority priority = TaskPriority::Normal;
       TaskData taskData;
       Kernel kernel;
     };
@@ -59,7 +69,9 @@ namespace tano
       static bool Create();
       static void Destroy();
 
-      TaskId AddTask(const KernelData& kernelData, const Kernel& kernel);
+      TaskId AddTask(const KernelData& kernelData,
+          const Kernel& kernel,
+          TaskPriority priority = TaskPriority::Normal);
       TaskId AddStreamingTask(
         const KernelData& kernelData,
         const Kernel& kernel,
@@ -68,6 +80,7 @@ namespace tano
         const StreamData& outputStream0);
 
       void Wait(const TaskId& taskId);
+      bool IsTaskFinished(const TaskId& taskId);
 
     private:
       Scheduler();
@@ -80,15 +93,15 @@ namespace tano
 
       void WorkerThread();
 
-      void QueueTask(Task* task);
+      void QueueTask(Task* task, TaskPriority priority);
+      Task* PopTask(bool allowLowPriority);
 
       Task* AllocTask();
       void FreeTask(Task* task);
 
-      bool IsTaskFinished(const TaskId& taskId);
       void WorkOnTask(Task* task);
       bool CanExecuteTask(Task* task);
-      void HelpWithWork();
+      void HelpWithWork(bool allowLowPriority = false);
       void FinishTask(Task* task);
 
       vector<thread> _threads;
@@ -98,7 +111,9 @@ namespace tano
       enum { MAX_TASKS = 16 * 1024 };
       char _taskMemory[MAX_TASKS * sizeof(Task)];
       char _queueMemory[MAX_TASKS * sizeof(Task*)];
+      char _lowPriorityQueueMemory[MAX_TASKS * sizeof(Task*)];
       CircularBuffer<Task*> _taskQueue;
+      CircularBuffer<Task*> _lowPriorityQueue;
 
       u32 _done = FALSE;
       u32 _allocGeneration = 0;
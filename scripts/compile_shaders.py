@@ -2,27 +2,64 @@
 # each shader's entry points are listed, and the script will try to compile
 # debug and optimized version for each entry point.
 # the script is on a loop, and constantly checks if shaders need to be
-# recompiled.
+# recompiled (pass --once to just do a single pass).
+#
+# the compiled bytecode is cached on a hash of the source, everything it
+# includes and the compiler arguments, so only changed permutations are
+# rebuilt. the changed permutations are compiled in parallel. after each pass,
+# all the bytecode is packed into a single file that the engine loads at
+# startup, and cache entries that are no longer in the manifest are evicted.
 
 import os
+import sys
 import time
 import glob
+import json
+import shutil
+import struct
+import hashlib
+import threading
 import subprocess
+from multiprocessing import cpu_count
+from multiprocessing.pool import ThreadPool
 from collections import OrderedDict, defaultdict
 from string import Template
 import re
 
 SHADER_DIR = os.path.join('..', 'shaders')
 OUT_DIR = os.path.join(SHADER_DIR, 'out')
+CACHE_DIR = os.path.join(OUT_DIR, 'cache')
+MANIFEST_FILE = os.path.join(CACHE_DIR, 'manifest.json')
+PACK_FILE = os.path.join(OUT_DIR, 'shaders.cache')
+# the packed shaders are named like the engine loads them
+PACK_PREFIX = 'shaders/out/'
+PACK_VERSION = 1
 ENTRY_POINT_TAG = 'entry-point'
 SHADERS = {}
-SHADER_FILES = set()
+# hash of each hlsl file when its entry points were parsed
+SHADER_FILES = {}
+
+# defines passed to every shader. these are part of the cache key
+DEFINES = {}
+# bump to invalidate the cache, e.g. after a compiler update
+CACHE_SALT = '1'
 
 SHADER_DECL_RE = re.compile('(.+)? (.+)\(.*')
 ENTRY_POINT_RE = re.compile('// entry-point: (.+)')
 DEPS_RE = re.compile('#include "(.+?)"')
 
-DEPS = defaultdict(set)
+# hash of each file, keyed on path, along with the mtime and size it was
+# computed for
+FILE_HASHES = {}
+# direct includes of each file, along with the file hash they were parsed from
+INCLUDES = {}
+# output files that are up to date, and the cache key they were built from
+MANIFEST = {}
+# cache keys that failed to compile, so they're not retried until the source
+# changes
+FAILED_KEYS = set()
+
+print_lock = threading.Lock()
 
 
 def strip_dirs(f):
@@ -69,7 +106,6 @@ shader_data = {
     'cs': {'profile': 'cs', 'obj_ext': 'cso', 'asm_ext': 'csa'},
 }
 
-last_fail_time = {}
 
 
 def safe_mkdir(path):
@@ -79,23 +115,67 @@ def safe_mkdir(path):
         pass
 
 
-def filetime_is_newer(time, filename):
+def replace_file(src, dst):
+    # os.rename doesn't overwrite on windows
     try:
-        obj_time = os.path.getmtime(filename)
-        return time > obj_time
-    except:
-        return True
+        os.remove(dst)
+    except OSError:
+        pass
+    os.rename(src, dst)
+
+
+def file_hash(path):
+    st = os.stat(path)
+    cached = FILE_HASHES.get(path)
+    if cached and cached[0] == st.st_mtime and cached[1] == st.st_size:
+        return cached[2]
+    with open(path, 'rb') as f:
+        h = hashlib.sha1(f.read()).hexdigest()
+    FILE_HASHES[path] = (st.st_mtime, st.st_size, h)
+    return h
+
+
+def direct_includes(path):
+    h = file_hash(path)
+    cached = INCLUDES.get(path)
+    if cached and cached[0] == h:
+        return cached[1]
+    deps = []
+    d = os.path.dirname(path)
+    for row in open(path, 'rt').readlines():
+        m = DEPS_RE.match(row)
+        if m:
+            deps.append(os.path.normpath(os.path.join(d, m.groups()[0])))
+    INCLUDES[path] = (h, deps)
+    return deps
+
+
+def source_hash(path):
+    # hash of the file, and everything it includes, recursively
+    h = hashlib.sha1()
+    seen = set()
+    todo = [os.path.normpath(path)]
+    while todo:
+        cur = todo.pop()
+        if cur in seen:
+            continue
+        seen.add(cur)
+        try:
+            h.update(cur + file_hash(cur))
+        except OSError:
+            # missing include, so let the compiler report it
+            h.update(cur + ' missing')
+            continue
+        todo.extend(direct_includes(cur))
+    return h.hexdigest()
 
 
-def generate_files(base, entry_points, obj_ext, asm_ext):
-    # returns the output files from the given base and entry points
-    res = []
-    for e in entry_points:
-        res.append((base + '_' + e + '.' + obj_ext, e, False))
-        res.append((base + '_' + e + '.' + asm_ext, e, False))
-        res.append((base + '_' + e + 'D.' + obj_ext, e, True))
-        res.append((base + '_' + e + 'D.' + asm_ext, e, True))
-    return res
+def fnv1a(s):
+    # matches ShaderCache::HashName
+    h = 0x811c9dc5
+    for c in s:
+        h = ((h ^ ord(c)) * 0x01000193) & 0xffffffff
+    return h
 
 # conversion between HLSL and my types
 known_types = {
@@ -257,109 +337,241 @@ def parse_cbuffer(basename, entry_point, out_name, ext):
     dump_cbuffer(cbuffer_filename, cbuffers)
 
 
-def compile():
-    first_tick = True
+def fxc_args(profile, entry_point, is_debug):
+    args = ['/T%s_5_0' % profile, '/E%s' % entry_point]
+    if is_debug:
+        args += ['/Od', '/Zi']
+    else:
+        args += ['/O3']
+    for k, v in sorted(DEFINES.iteritems()):
+        args.append('/D%s=%s' % (k, v))
+    return args
+
+
+def collect_jobs():
+    # one job per entry point, in a debug and optimized version
+    jobs = []
     for basename, data in SHADERS.iteritems():
+        # shader_file =  ..\shaders\landscape.landscape
+        shader_file = os.path.join(SHADER_DIR, basename)
+        hlsl_file_name = shader_file + '.hlsl'
+        src_hash = source_hash(hlsl_file_name)
+
         for shader_type, entry_points in data.iteritems():
-            profile = shader_data[shader_type]['profile']
             obj_ext = shader_data[shader_type]['obj_ext']
             asm_ext = shader_data[shader_type]['asm_ext']
+            for entry_point in entry_points:
+                for is_debug in (False, True):
+                    args = fxc_args(
+                        shader_data[shader_type]['profile'],
+                        entry_point,
+                        is_debug)
+                    key = hashlib.sha1(
+                        CACHE_SALT + src_hash + ' '.join(args)).hexdigest()
+                    out_name = os.path.join(
+                        OUT_DIR, basename + '_' + entry_point)
+                    suffix = 'D' if is_debug else ''
+                    jobs.append({
+                        'key': key,
+                        'args': args,
+                        'hlsl': hlsl_file_name,
+                        'basename': basename,
+                        'entry_point': entry_point,
+                        'out_name': out_name,
+                        'asm_ext': asm_ext,
+                        'obj': '%s%s.%s' % (out_name, suffix, obj_ext),
+                        'asm': '%s%s.%s' % (out_name, suffix, asm_ext),
+                        'cache_obj': os.path.join(
+                            CACHE_DIR, key + '.' + obj_ext),
+                        'cache_asm': os.path.join(
+                            CACHE_DIR, key + '.' + asm_ext),
+                    })
+    return jobs
+
+
+def run_job(job):
+    # compiles the job into the cache, unless it's already there, and copies
+    # the cached files to the output. returns True on success
+    if not (
+        os.path.exists(job['cache_obj']) and
+        os.path.exists(job['cache_asm'])
+    ):
+        # compile to temp files, so an interrupted compile doesn't leave a
+        # broken cache entry
+        tmp_obj = job['cache_obj'] + '.tmp'
+        tmp_asm = job['cache_asm'] + '.tmp'
+        p = subprocess.Popen(
+            ['fxc', '/nologo'] + job['args'] +
+            ['/Fo%s' % tmp_obj, '/Fc%s' % tmp_asm, job['hlsl']],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.STDOUT)
+        output = p.communicate()[0]
+        with print_lock:
+            if output.strip():
+                print output.rstrip()
+            if p.returncode:
+                print '** FAILURE: %s, %s' % (job['hlsl'], job['entry_point'])
+        if p.returncode:
+            return False
+        replace_file(tmp_obj, job['cache_obj'])
+        replace_file(tmp_asm, job['cache_asm'])
+
+    shutil.copyfile(job['cache_obj'], job['obj'])
+    shutil.copyfile(job['cache_asm'], job['asm'])
+    return True
+
+
+def load_manifest():
+    global MANIFEST
+    try:
+        with open(MANIFEST_FILE, 'rt') as f:
+            MANIFEST = json.load(f)
+    except (IOError, ValueError):
+        MANIFEST = {}
 
-            # shader_file =  ..\shaders\landscape.landscape
-            shader_file = os.path.join(SHADER_DIR, basename)
 
-            # get the time for the file, and all files it depends on
-            hlsl_file_name = shader_file + '.hlsl'
-            dd = hlsl_file_name.rpartition('\\')[0]
-            hlsl_file_time = os.path.getmtime(hlsl_file_name)
-            for deps in DEPS[strip_dirs(hlsl_file_name)]:
-                full_deps = os.path.join(dd, deps)
-                hlsl_file_time = max(
-                    hlsl_file_time, os.path.getmtime(full_deps))
+def save_manifest():
+    with open(MANIFEST_FILE + '.tmp', 'wt') as f:
+        json.dump(MANIFEST, f, indent=1, sort_keys=True)
+    replace_file(MANIFEST_FILE + '.tmp', MANIFEST_FILE)
 
-            # if the compilation has failed, don't try again if the hlsl file
-            # hasn't updated
-            if (
-                shader_file in last_fail_time
-                and last_fail_time[shader_file] == hlsl_file_time
-            ):
-                continue
 
-            # check for old or missing files (each entry point gets its own
-            # file)
-            g = generate_files(basename, entry_points, obj_ext, asm_ext)
-            for output, entry_point, is_debug in g:
-                if (
-                    filetime_is_newer(
-                        hlsl_file_time, os.path.join(OUT_DIR, output))
-                ):
-                    if first_tick:
-                        ll = time.localtime()
-                        print '==> COMPILE STARTED AT [%.2d:%.2d:%.2d]' % (
-                            ll.tm_hour, ll.tm_min, ll.tm_sec)
-                        first_tick = False
-                    out_name = os.path.join(
-                        OUT_DIR, basename + '_' + entry_point)
+def write_pack(jobs):
+    # layout matches ShaderCacheHeader and ShaderCacheEntry in
+    # shader_cache.hpp: header, entries sorted on name hash, names, and then
+    # the bytecode
+    entries = []
+    for job in jobs:
+        if MANIFEST.get(job['obj']) != job['key']:
+            continue
+        name = PACK_PREFIX + os.path.basename(job['obj'])
+        with open(job['obj'], 'rb') as f:
+            entries.append((fnv1a(name), name, f.read()))
+    entries.sort()
+
+    names = ''
+    name_offsets = []
+    for _, name, _ in entries:
+        name_offsets.append(len(names))
+        names += name + '\0'
+
+    data_start = 16 + 16 * len(entries) + len(names)
+    data_start = (data_start + 3) & ~3
+    header = struct.pack(
+        '<4sIII', 'tshc', PACK_VERSION, len(entries), len(names))
+    table = ''
+    data = ''
+    for (h, _, bytecode), name_ofs in zip(entries, name_offsets):
+        table += struct.pack(
+            '<IIII', h, name_ofs, data_start + len(data), len(bytecode))
+        data += bytecode
+        data += '\0' * (-len(data) & 3)
+
+    with open(PACK_FILE + '.tmp', 'wb') as f:
+        f.write(header)
+        f.write(table)
+        f.write(names)
+        f.write('\0' * (data_start - 16 - len(table) - len(names)))
+        f.write(data)
+    replace_file(PACK_FILE + '.tmp', PACK_FILE)
+
+
+def prune_cache(stale):
+    # drop the outputs of entry points that no longer exist, and evict the
+    # cached bytecode that the manifest doesn't reference any more
+    for obj in stale:
+        del MANIFEST[obj]
+
+    live_keys = set(MANIFEST.values())
+    manifest_name = os.path.basename(MANIFEST_FILE)
+    for f in os.listdir(CACHE_DIR):
+        if f.startswith(manifest_name):
+            continue
+        # cache files are named after their key, and the .tmp files are left
+        # over from interrupted compiles
+        if f.partition('.')[0] in live_keys and not f.endswith('.tmp'):
+            continue
+        try:
+            os.remove(os.path.join(CACHE_DIR, f))
+        except OSError:
+            pass
 
-                    if is_debug:
-                        # create debug shader
-                        # returns 0 on success, > 0 otherwise
-                        res = subprocess.call([
-                            'fxc',
-                            '/nologo',
-                            '/T%s_5_0' % profile,
-                            '/Od',
-                            '/Zi',
-                            '/E%s' % entry_point,
-                            '/Fo%sD.%s' % (out_name, obj_ext),
-                            '/Fc%sD.%s' % (out_name, asm_ext),
-                            '%s.hlsl' % shader_file])
-                    else:
-                        # create optimized shader
-                        res = subprocess.call([
-                            'fxc',
-                            '/nologo',
-                            '/T%s_5_0' % profile,
-                            '/O3',
-                            '/E%s' % entry_point,
-                            '/Fo%s.%s' % (out_name, obj_ext),
-                            '/Fc%s.%s' % (out_name, asm_ext),
-                            '%s.hlsl' % shader_file])
-
-                    if res:
-                        # if compilation failed, don't try again until the
-                        # .hlsl file has been updated
-                        print '** FAILURE: %s, %s' % (shader_file, entry_point)
-                        last_fail_time[shader_file] = hlsl_file_time
-                    else:
-                        parse_cbuffer(basename, entry_point, out_name, asm_ext)
-                        if shader_file in last_fail_time:
-                            del(last_fail_time[shader_file])
-
-# find any deps
-for f in glob.glob(os.path.join(SHADER_DIR, '*.hlsl')):
-    for row in open(f).readlines():
-        m = DEPS_RE.match(row)
-        if m:
-            dependant = m.groups()[0]
-            DEPS[strip_dirs(f)].add(dependant)
+
+def compile(pool):
+    jobs = collect_jobs()
+
+    # skip the outputs that are up to date, and the ones that failed, until
+    # their source changes
+    pending = [
+        job for job in jobs
+        if job['key'] not in FAILED_KEYS and not (
+            MANIFEST.get(job['obj']) == job['key'] and
+            os.path.exists(job['obj']))
+    ]
+
+    if pending:
+        ll = time.localtime()
+        print '==> COMPILE STARTED AT [%.2d:%.2d:%.2d], %d shaders' % (
+            ll.tm_hour, ll.tm_min, ll.tm_sec, len(pending))
+
+        results = pool.map(run_job, pending)
+
+        cbuffers_done = set()
+        for job, ok in zip(pending, results):
+            if not ok:
+                FAILED_KEYS.add(job['key'])
+                MANIFEST.pop(job['obj'], None)
+                continue
+            MANIFEST[job['obj']] = job['key']
+            # the debug and optimized versions share their cbuffers
+            if job['out_name'] not in cbuffers_done:
+                parse_cbuffer(
+                    job['basename'],
+                    job['entry_point'],
+                    job['out_name'],
+                    job['asm_ext'])
+                cbuffers_done.add(job['out_name'])
+
+    # only scan the cache when something has changed
+    cur_objs = set(job['obj'] for job in jobs)
+    stale = [obj for obj in MANIFEST if obj not in cur_objs]
+    if pending or stale:
+        prune_cache(stale)
+        save_manifest()
+
+    if pending or stale or not os.path.exists(PACK_FILE):
+        write_pack(jobs)
+
+
+def update_entry_points():
+    cur_files = set()
+    for f in glob.glob(os.path.join(SHADER_DIR, '*.hlsl')):
+        # reparse files that are new or have changed, to pick up added entry
+        # points
+        h = file_hash(f)
+        if SHADER_FILES.get(f) != h:
+            entry_points_for_file(f)
+            SHADER_FILES[f] = h
+        cur_files.add(f)
+
+    # remove any files that no longer exist
+    for f in set(SHADER_FILES.keys()).difference(cur_files):
+        del SHADERS[get_shader_root(f)]
+        del SHADER_FILES[f]
+
+
+safe_mkdir(OUT_DIR)
+safe_mkdir(CACHE_DIR)
+load_manifest()
+pool = ThreadPool(cpu_count())
+run_once = '--once' in sys.argv[1:]
 
 try:
     while True:
-        safe_mkdir(OUT_DIR)
-        cur_files = set()
-        for f in glob.glob(os.path.join(SHADER_DIR, '*.hlsl')):
-            if f not in SHADER_FILES:
-                entry_points_for_file(f)
-                SHADER_FILES.add(f)
-            cur_files.add(f)
-
-        # remove any files that no longer exist
-        for f in SHADER_FILES.difference(cur_files):
-            del SHADERS[get_shader_root(f)]
-            SHADER_FILES.remove(f)
-
-        compile()
+        update_entry_points()
+        compile(pool)
+        if run_once:
+            break
         time.sleep(1)
 except KeyboardInterrupt:
     print 'Exiting'
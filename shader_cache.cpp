@@ -0,0 +1,123 @@
+#include "shader_cache.hpp"
+#include "resource_manager.hpp"
+
+using namespace tano;
+using namespace bristol;
+
+//------------------------------------------------------------------------------
+u32 ShaderCache::HashName(const char* name)
+{
+  // FNV-1a, matching compile_shaders.py
+  u32 h = 0x811c9dc5;
+  while (*name)
+    h = (h ^ (u8)*name++) * 0x01000193;
+  return h;
+}
+
+//------------------------------------------------------------------------------
+bool ShaderCache::Load(const char* filename)
+{
+  vector<char> buf;
+#if WITH_UNPACKED_RESOUCES
+  // the cache is optional, so don't try loading it if it hasn't been built
+  if (!RESOURCE_MANAGER.FileExists(filename))
+  {
+    LOG_INFO("No shader cache found, loading individual shaders");
+    return false;
+  }
+#endif
+  // In a packed build, a cache that wasn't packed gives another file, which is rejected
+  // by the checks in Load
+  if (!RESOURCE_MANAGER.LoadFile(filename, &buf))
+    return false;
+
+  return Load(&buf);
+}
+
+//------------------------------------------------------------------------------
+bool ShaderCache::Load(vector<char>* buf)
+{
+  _data.swap(*buf);
+  _entries = nullptr;
+  _names = nullptr;
+  _numEntries = 0;
+
+  const ShaderCacheHeader* header = (const ShaderCacheHeader*)_data.data();
+  if (_data.size() < sizeof(ShaderCacheHeader) || memcmp(header->id, "tshc", 4) != 0
+      || header->version != VERSION)
+  {
+    _data.clear();
+    return false;
+  }
+
+  // compare against what's left of the file, so the sizes can't overflow
+  size_t tableSpace = _data.size() - sizeof(ShaderCacheHeader);
+  size_t tableSize = (size_t)header->numEntries * sizeof(ShaderCacheEntry);
+  if (header->numEntries > tableSpace / sizeof(ShaderCacheEntry)
+      || header->namesSize > tableSpace - tableSize)
+  {
+    LOG_WARN("Shader cache is truncated");
+    _data.clear();
+    return false;
+  }
+
+  // Find and Get trust the entries, so check them all up front
+  const ShaderCacheEntry* entries =
+      (const ShaderCacheEntry*)(_data.data() + sizeof(ShaderCacheHeader));
+  const char* names = _data.data() + sizeof(ShaderCacheHeader) + tableSize;
+  bool valid = header->numEntries == 0
+               || (header->namesSize > 0 && names[header->namesSize - 1] == '\0');
+  for (u32 i = 0; valid && i < header->numEntries; ++i)
+  {
+    const ShaderCacheEntry& entry = entries[i];
+    valid = entry.nameOffset < header->namesSize && entry.dataOffset <= _data.size()
+            && entry.dataSize <= _data.size() - entry.dataOffset;
+  }
+
+  if (!valid)
+  {
+    LOG_WARN("Shader cache is corrupt");
+    _data.clear();
+    return false;
+  }
+
+  _entries = entries;
+  _names = names;
+  _numEntries = header->numEntries;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+const ShaderCacheEntry* ShaderCache::Find(const char* filename) const
+{
+  u32 hash = HashName(filename);
+  const ShaderCacheEntry* end = _entries + _numEntries;
+  const ShaderCacheEntry* it = lower_bound(_entries,
+      end,
+      hash,
+      [](const ShaderCacheEntry& entry, u32 hash)
+      {
+        return entry.nameHash < hash;
+      });
+
+  // check the names, in case of hash collisions
+  for (; it != end && it->nameHash == hash; ++it)
+  {
+    if (strcmp(_names + it->nameOffset, filename) == 0)
+      return it;
+  }
+
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+bool ShaderCache::Get(const char* filename, vector<char>* buf) const
+{
+  const ShaderCacheEntry* entry = Find(filename);
+  if (!entry)
+    return false;
+
+  buf->assign(
+      _data.data() + entry->dataOffset, _data.data() + entry->dataOffset + entry->dataSize);
+  return true;
+}
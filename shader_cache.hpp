@@ -0,0 +1,54 @@
+#pragma once
+
+namespace tano
+{
+  // The bytecode of all the compiled shaders, packed into a single file by
+  // scripts/compile_shaders.py, so startup reads one file instead of one per entry point.
+  //
+  // The file is a ShaderCacheHeader, then the entries sorted on the hash of their name,
+  // then the names, and then the bytecode.
+  struct ShaderCacheHeader
+  {
+    char id[4];
+    u32 version;
+    u32 numEntries;
+    u32 namesSize;
+  };
+
+  struct ShaderCacheEntry
+  {
+    // FNV-1a of the name the shader is loaded with, like "shaders/out/common_VsQuad.vso"
+    u32 nameHash;
+    // offset into the names
+    u32 nameOffset;
+    // offset from the start of the file
+    u32 dataOffset;
+    u32 dataSize;
+  };
+
+  static const char* SHADER_CACHE_FILE = "shaders/out/shaders.cache";
+
+  class ShaderCache
+  {
+  public:
+    enum { VERSION = 1 };
+
+    // Returns false if there's no valid cache, and shaders are loaded from their files
+    bool Load(const char* filename);
+    bool Load(vector<char>* buf);
+
+    // Copies the bytecode for 'filename'. The cache is a snapshot from startup, so it's
+    // only used for the initial load, and hot reloads after an edit go to the file.
+    bool Get(const char* filename, vector<char>* buf) const;
+
+    static u32 HashName(const char* name);
+
+  private:
+    const ShaderCacheEntry* Find(const char* filename) const;
+
+    vector<char> _data;
+    const ShaderCacheEntry* _entries = nullptr;
+    const char* _names = nullptr;
+    u32 _numEntries = 0;
+  };
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "append_buffer.hpp"
+
+namespace tano
+{
+  //------------------------------------------------------------------------------
+  // Resource table behind the object handles. Removed slots go on a free list, and their
+  // generation is bumped, so a stale handle to a slot that has been reused is caught by
+  // the generation check instead of returning the new resource.
+  template <typename T, template <typename> class DestroyMixin>
+  class SlotMap : DestroyMixin<T>
+  {
+  public:
+    // the last index is never used, so a slot can't be confused with -1
+    enum { MAX_SLOTS = (1 << ObjectHandle::cIdBits) - 1 };
+    enum { GENERATION_MASK = (1 << ObjectHandle::cGenerationBits) - 1 };
+
+    //------------------------------------------------------------------------------
+    ~SlotMap()
+    {
+      for (Slot& slot : _slots)
+      {
+        if (slot.inUse)
+          this->destroy(slot.value);
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    // Returns the packed slot, for Graphics::MakeObjectHandle
+    u32 Append(T res)
+    {
+      u32 idx;
+      if (_freeList.empty())
+      {
+        assert(_slots.size() < MAX_SLOTS);
+        idx = (u32)_slots.size();
+        _slots.push_back(Slot());
+      }
+      else
+      {
+        idx = _freeList.back();
+        _freeList.pop_back();
+      }
+
+      Slot& slot = _slots[idx];
+      slot.value = res;
+      slot.inUse = true;
+      return ObjectHandle::MakeSlot(idx, slot.generation);
+    }
+
+    //------------------------------------------------------------------------------
+    T Get(ObjectHandle h) const
+    {
+      if (!h.IsValid())
+        return T();
+
+      const Slot* slot = Lookup(h);
+      return slot ? slot->value : T();
+    }
+
+    //------------------------------------------------------------------------------
+    // Replaces the resource, and destroys the old one
+    void Update(ObjectHandle h, T res)
+    {
+      if (Slot* slot = Lookup(h))
+      {
+        if (slot->value != res)
+          this->destroy(slot->value);
+        slot->value = res;
+      }
+    }
+
+    //------------------------------------------------------------------------------
+    // Destroys the resource, and frees the slot. Any remaining handles to it are stale.
+    void Remove(ObjectHandle h)
+    {
+      Slot* slot = Lookup(h);
+      if (!slot)
+        return;
+
+      this->destroy(slot->value);
+      slot->value = T();
+      slot->inUse = false;
+      slot->generation = (slot->generation + 1) & GENERATION_MASK;
+      _freeList.push_back(h.id());
+    }
+
+    //------------------------------------------------------------------------------
+    bool IsLive(ObjectHandle h) const
+    {
+      return h.id() < _slots.size() && _slots[h.id()].inUse
+             && _slots[h.id()].generation == h.generation();
+    }
+
+    u32 Size() const { return (u32)(_slots.size() - _freeList.size()); }
+
+  private:
+    struct Slot
+    {
+      T value = T();
+      u32 generation = 0;
+      bool inUse = false;
+    };
+
+    //------------------------------------------------------------------------------
+    const Slot* Lookup(ObjectHandle h) const
+    {
+      if (!IsLive(h))
+      {
+        assert(!"Stale or invalid ObjectHandle");
+        return nullptr;
+      }
+      return &_slots[h.id()];
+    }
+
+    //------------------------------------------------------------------------------
+    Slot* Lookup(ObjectHandle h)
+    {
+      return const_cast<Slot*>(static_cast<const SlotMap*>(this)->Lookup(h));
+    }
+
+    vector<Slot> _slots;
+    vector<u32> _freeList;
+  };
+}
@@ -0,0 +1,277 @@
+#include "spatial_grid.hpp"
+#include "arena_allocator.hpp"
+#include "scheduler.hpp"
+
+using namespace tano;
+using namespace tano::scheduler;
+using namespace bristol;
+
+namespace
+{
+  const int NODES_PER_TASK = 1024;
+  const int MAX_KNN = 128;
+  const int MAX_RINGS = 64;
+
+  // 21 bits per axis, biased so negative coordinates pack correctly
+  const int CELL_BITS = 21;
+  const int CELL_BIAS = 1 << (CELL_BITS - 1);
+  const u64 CELL_MASK = (1ull << CELL_BITS) - 1;
+
+  struct Candidate
+  {
+    float distSq;
+    int idx;
+  };
+
+  //------------------------------------------------------------------------------
+  // Inserts into a list sorted by distance, keeping at most k entries
+  void InsertCandidate(Candidate* candidates, int* numCandidates, int k, float distSq, int idx)
+  {
+    int n = *numCandidates;
+    if (n == k && distSq >= candidates[n - 1].distSq)
+      return;
+
+    int i = n == k ? n - 1 : n;
+    while (i > 0 && (candidates[i - 1].distSq > distSq
+                      || (candidates[i - 1].distSq == distSq && candidates[i - 1].idx > idx)))
+    {
+      candidates[i] = candidates[i - 1];
+      --i;
+    }
+    candidates[i] = Candidate{distSq, idx};
+    *numCandidates = min(n + 1, k);
+  }
+}
+
+//------------------------------------------------------------------------------
+u64 SpatialGrid::CellKey(int x, int y, int z)
+{
+  return ((u64)((x + CELL_BIAS) & CELL_MASK) << (2 * CELL_BITS))
+         | ((u64)((y + CELL_BIAS) & CELL_MASK) << CELL_BITS)
+         | (u64)((z + CELL_BIAS) & CELL_MASK);
+}
+
+//------------------------------------------------------------------------------
+void SpatialGrid::CellCoords(const vec3& p, int* x, int* y, int* z) const
+{
+  *x = (int)floorf(p.x * _invCellSize);
+  *y = (int)floorf(p.y * _invCellSize);
+  *z = (int)floorf(p.z * _invCellSize);
+}
+
+//------------------------------------------------------------------------------
+u64 SpatialGrid::CellKey(const vec3& p) const
+{
+  int x, y, z;
+  CellCoords(p, &x, &y, &z);
+  return CellKey(x, y, z);
+}
+
+//------------------------------------------------------------------------------
+void SpatialGrid::AddToCell(int idx, u64 key)
+{
+  vector<int>& cell = _cells[key].points;
+  _pointCell[idx] = key;
+  _pointSlot[idx] = (int)cell.size();
+  cell.push_back(idx);
+}
+
+//------------------------------------------------------------------------------
+void SpatialGrid::RemoveFromCell(int idx)
+{
+  auto it = _cells.find(_pointCell[idx]);
+  assert(it != _cells.end());
+  vector<int>& cell = it->second.points;
+
+  // swap the last point in the cell into the removed point's slot
+  int slot = _pointSlot[idx];
+  int last = cell.back();
+  cell[slot] = last;
+  _pointSlot[last] = slot;
+  cell.pop_back();
+
+  if (cell.empty())
+    _cells.erase(it);
+}
+
+//------------------------------------------------------------------------------
+void SpatialGrid::Build(const vec3* points, int numPoints, float cellSize)
+{
+  _points = points;
+  _numPoints = numPoints;
+  _numMoved = numPoints;
+  _cellSize = max(cellSize, 1e-6f);
+  _invCellSize = 1.0f / _cellSize;
+
+  _cells.clear();
+  _pointCell.resize(numPoints);
+  _pointSlot.resize(numPoints);
+
+  for (int i = 0; i < numPoints; ++i)
+    AddToCell(i, CellKey(points[i]));
+}
+
+//------------------------------------------------------------------------------
+void SpatialGrid::Update(const vec3* points, int numPoints, float cellSize)
+{
+  if (numPoints != _numPoints || cellSize != _cellSize)
+  {
+    Build(points, numPoints, cellSize);
+    return;
+  }
+
+  _points = points;
+  _numMoved = 0;
+  for (int i = 0; i < numPoints; ++i)
+  {
+    u64 key = CellKey(points[i]);
+    if (key == _pointCell[i])
+      continue;
+
+    RemoveFromCell(i);
+    AddToCell(i, key);
+    _numMoved++;
+  }
+}
+
+//------------------------------------------------------------------------------
+int SpatialGrid::QueryRadius(const vec3& pos, float radius, int* out, int maxResults) const
+{
+  int x0, y0, z0, x1, y1, z1;
+  CellCoords(pos - vec3(radius, radius, radius), &x0, &y0, &z0);
+  CellCoords(pos + vec3(radius, radius, radius), &x1, &y1, &z1);
+
+  float radiusSq = radius * radius;
+  int numResults = 0;
+
+  for (int z = z0; z <= z1; ++z)
+  {
+    for (int y = y0; y <= y1; ++y)
+    {
+      for (int x = x0; x <= x1; ++x)
+      {
+        auto it = _cells.find(CellKey(x, y, z));
+        if (it == _cells.end())
+          continue;
+
+        for (int idx : it->second.points)
+        {
+          if (LengthSquared(_points[idx] - pos) > radiusSq)
+            continue;
+
+          if (numResults == maxResults)
+            return numResults;
+          out[numResults++] = idx;
+        }
+      }
+    }
+  }
+
+  return numResults;
+}
+
+//------------------------------------------------------------------------------
+int SpatialGrid::QueryKnn(
+    const vec3& pos, int k, float minDist, float maxDist, int exclude, int* out) const
+{
+  k = min(k, MAX_KNN);
+  if (k <= 0 || _numPoints == 0)
+    return 0;
+
+  Candidate candidates[MAX_KNN];
+  int numCandidates = 0;
+  float minDistSq = minDist * minDist;
+  float maxDistSq = maxDist * maxDist;
+
+  int cx, cy, cz;
+  CellCoords(pos, &cx, &cy, &cz);
+
+  // Visit the cells in rings of increasing Chebyshev distance. After ring r has been
+  // visited, any remaining point is at least r * cellSize away, so we can stop when
+  // the k-th candidate is closer than that.
+  int maxRing = (int)min(ceilf(maxDist * _invCellSize), (float)MAX_RINGS);
+  for (int r = 0; r <= maxRing; ++r)
+  {
+    for (int z = cz - r; z <= cz + r; ++z)
+    {
+      for (int y = cy - r; y <= cy + r; ++y)
+      {
+        bool shell = abs(z - cz) == r || abs(y - cy) == r;
+        // for interior rows, only the two cells on the ring boundary are new
+        int step = shell || r == 0 ? 1 : 2 * r;
+        for (int x = cx - r; x <= cx + r; x += step)
+        {
+          auto it = _cells.find(CellKey(x, y, z));
+          if (it == _cells.end())
+            continue;
+
+          for (int idx : it->second.points)
+          {
+            if (idx == exclude)
+              continue;
+
+            // points that are too close are skipped here, rather than by the caller, so
+            // they don't use up any of the k slots
+            float distSq = LengthSquared(_points[idx] - pos);
+            if (distSq >= minDistSq && distSq <= maxDistSq)
+              InsertCandidate(candidates, &numCandidates, k, distSq, idx);
+          }
+        }
+      }
+    }
+
+    float ringDist = r * _cellSize;
+    if (numCandidates == k && candidates[k - 1].distSq <= ringDist * ringDist)
+      break;
+  }
+
+  for (int i = 0; i < numCandidates; ++i)
+    out[i] = candidates[i].idx;
+
+  return numCandidates;
+}
+
+//------------------------------------------------------------------------------
+void SpatialGrid::CalcNeighboursKernel(const TaskData& data)
+{
+  const NeighbourKernelData* k = (const NeighbourKernelData*)data.kernelData.data;
+  const SpatialGrid* grid = k->grid;
+
+  for (int i = k->start; i < k->end; ++i)
+  {
+    int* n = k->neighbours + i * k->maxNeighbours;
+    int num = grid->QueryKnn(grid->_points[i], k->k, k->minDist, k->maxDist, i, n);
+    if (num < k->maxNeighbours)
+      n[num] = -1;
+  }
+}
+
+//------------------------------------------------------------------------------
+void SpatialGrid::CalcNeighbours(
+    int k, float minDist, float maxDist, int* neighbours, int maxNeighbours) const
+{
+  k = min(k, maxNeighbours);
+
+  SimpleAppendBuffer<TaskId, 256> tasks;
+  for (int start = 0; start < _numPoints; start += NODES_PER_TASK)
+  {
+    NeighbourKernelData* data =
+        (NeighbourKernelData*)g_ScratchMemory.Alloc(sizeof(NeighbourKernelData));
+    *data = NeighbourKernelData{this,
+        k,
+        minDist,
+        maxDist,
+        neighbours,
+        maxNeighbours,
+        start,
+        min(start + NODES_PER_TASK, _numPoints)};
+
+    KernelData kd;
+    kd.data = data;
+    kd.size = sizeof(NeighbourKernelData);
+    tasks.Append(g_Scheduler->AddTask(kd, CalcNeighboursKernel));
+  }
+
+  for (const TaskId& taskId : tasks)
+    g_Scheduler->Wait(taskId);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+namespace tano
+{
+  namespace scheduler
+  {
+    struct TaskData;
+  }
+
+  //------------------------------------------------------------------------------
+  // Uniform grid over a vec3 point cloud, supporting radius and k-nearest queries.
+  // Points are bucketed by cell, and Update only moves the points that changed cell,
+  // so slowly deforming point clouds are cheap to keep up to date.
+  class SpatialGrid
+  {
+  public:
+    void Build(const vec3* points, int numPoints, float cellSize);
+
+    // Re-buckets points that have moved to a new cell. Falls back to a full build if
+    // the point count or cell size has changed.
+    void Update(const vec3* points, int numPoints, float cellSize);
+
+    // Returns the number of points within 'radius' of pos (up to maxResults)
+    int QueryRadius(const vec3& pos, float radius, int* out, int maxResults) const;
+
+    // Returns the (at most k) nearest points to pos with a distance in [minDist, maxDist],
+    // closest first. 'exclude' is skipped, which is useful when querying for a point in
+    // the cloud itself
+    int QueryKnn(
+        const vec3& pos, int k, float minDist, float maxDist, int exclude, int* out) const;
+
+    // Fills in the neighbours array in the format expected by CalcPlexusGrouping, ie
+    // maxNeighbours entries per point, closest first, terminated by -1 if not full.
+    // The queries are split into scheduler tasks.
+    void CalcNeighbours(
+        int k, float minDist, float maxDist, int* neighbours, int maxNeighbours) const;
+
+    int NumPoints() const { return _numPoints; }
+    int NumMoved() const { return _numMoved; }
+
+  private:
+    struct Cell
+    {
+      vector<int> points;
+    };
+
+    struct NeighbourKernelData
+    {
+      const SpatialGrid* grid;
+      int k;
+      float minDist;
+      float maxDist;
+      int* neighbours;
+      int maxNeighbours;
+      int start, end;
+    };
+
+    static void CalcNeighboursKernel(const scheduler::TaskData& data);
+
+    u64 CellKey(const vec3& p) const;
+    static u64 CellKey(int x, int y, int z);
+    void CellCoords(const vec3& p, int* x, int* y, int* z) const;
+    void AddToCell(int idx, u64 key);
+    void RemoveFromCell(int idx);
+
+    unordered_map<u64, Cell> _cells;
+    vector<u64> _pointCell;
+    vector<int> _pointSlot;
+    const vec3* _points = nullptr;
+    int _numPoints = 0;
+    int _numMoved = 0;
+    float _cellSize = 1;
+    float _invCellSize = 1;
+  };
+}
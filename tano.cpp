@@ -10,7 +10,10 @@
 #include "arena_allocator.hpp"
 #include "stop_watch.hpp"
 #include "perlin2d.hpp"
+#include "fractal_noise.hpp"
+#include "effect_benchmark.hpp"
 #include "blackboard.hpp"
+#include "upload_buffer.hpp"
 #include "generated/app.parse.hpp"
 #include "effects/intro.hpp"
 #include "effects/landscape.hpp"
@@ -39,6 +42,11 @@ const TCHAR* g_AppWindowTitle = _T("radio silence- neurotica e.f.s");
 const int ARENA_MEMORY_SIZE = 512 * 1024 * 1024;
 static u8 scratchMemory[ARENA_MEMORY_SIZE];
 
+// size of the shared upload buffers, which hold a few frames worth of dynamic geometry
+// Landscape alone writes around 15MB per frame with all its chunks visible
+const u32 DYNAMIC_VERTEX_BYTES = 64 * 1024 * 1024;
+const u32 DYNAMIC_INDEX_BYTES = 4 * 1024 * 1024;
+
 namespace tano
 {
   ArenaAllocator g_ScratchMemory;
@@ -101,6 +109,8 @@ bool App::Destroy()
   INIT(RESOURCE_MANAGER_STATIC::Destroy());
   DemoEngine::Destroy();
   DebugApi::Destroy();
+  g_DynamicIndices.Destroy();
+  g_DynamicVertices.Destroy();
   INIT(Graphics::Destroy());
   Scheduler::Destroy();
 
@@ -116,7 +126,7 @@ App& App::Instance()
 }
 
 //------------------------------------------------------------------------------
-bool App::Init(HINSTANCE hinstance)
+bool App::InitResources()
 {
   BEGIN_INIT_SEQUENCE();
 
@@ -146,6 +156,16 @@ bool App::Init(HINSTANCE hinstance)
 
   INIT_FATAL(Scheduler::Create());
 
+  END_INIT_SEQUENCE();
+}
+
+//------------------------------------------------------------------------------
+bool App::Init(HINSTANCE hinstance)
+{
+  BEGIN_INIT_SEQUENCE();
+
+  INIT_FATAL(InitResources());
+
 #if WITH_CONFIG_DLG
   INIT_FATAL(Graphics::CreateWithConfigDialog(hinstance, WndProc));
 #else
@@ -163,6 +183,8 @@ bool App::Init(HINSTANCE hinstance)
       width, height, bbWidth, bbHeight, true, DXGI_FORMAT_R8G8B8A8_UNORM, WndProc, hinstance);
 #endif
   INIT_FATAL(DebugApi::Create(g_Graphics->GetGraphicsContext()));
+  INIT_FATAL(g_DynamicVertices.Create(D3D11_BIND_VERTEX_BUFFER, DYNAMIC_VERTEX_BYTES));
+  INIT_FATAL(g_DynamicIndices.Create(D3D11_BIND_INDEX_BUFFER, DYNAMIC_INDEX_BYTES));
 
   INIT_FATAL(g_ScratchMemory.Init(scratchMemory, scratchMemory + ARENA_MEMORY_SIZE));
   Perlin2D::Init();
@@ -189,6 +211,24 @@ bool App::Init(HINSTANCE hinstance)
   END_INIT_SEQUENCE();
 }
 
+#if WITH_BENCHMARKS
+//------------------------------------------------------------------------------
+bool App::RunBenchmark(const char* cmdLine)
+{
+  BEGIN_INIT_SEQUENCE();
+
+  // Headless, so only the systems used by the effects' CPU paths are created
+  INIT_FATAL(InitResources());
+  INIT_FATAL(g_ScratchMemory.Init(scratchMemory, scratchMemory + ARENA_MEMORY_SIZE));
+  Perlin2D::Init();
+
+  FractalNoiseBenchmark();
+  INIT(RunEffectBenchmark(ParseEffectBenchmarkOptions(cmdLine)));
+
+  END_INIT_SEQUENCE();
+}
+#endif
+
 //------------------------------------------------------------------------------
 bool App::Run()
 {
@@ -274,6 +314,21 @@ bool App::Run()
       ImGui::PlotLines(
           "Frame time", times, (int)numSamples, 0, 0, FLT_MAX, FLT_MAX, ImVec2(200, 50));
 
+      const TempResourcePool::Stats& rtStats = g_Graphics->TempRenderTargetStats();
+      const TempResourcePool::Stats& dsStats = g_Graphics->TempDepthStencilStats();
+      ImGui::Text("Temp RTs: %u/%u, %.1f MB (peak %.1f MB, evicted %u)",
+          rtStats.numInUse,
+          rtStats.numResources,
+          rtStats.bytes / (1024.f * 1024.f),
+          rtStats.peakBytes / (1024.f * 1024.f),
+          rtStats.numEvicted);
+      ImGui::Text("Temp DSs: %u/%u, %.1f MB (peak %.1f MB, evicted %u)",
+          dsStats.numInUse,
+          dsStats.numResources,
+          dsStats.bytes / (1024.f * 1024.f),
+          dsStats.peakBytes / (1024.f * 1024.f),
+          dsStats.numEvicted);
+
       // Invoke any custom perf callbacks
       for (const fnPerfCallback& cb : _perfCallbacks)
         cb();
@@ -291,6 +346,8 @@ bool App::Run()
       avgFrameTime.AddSample((float)frameTime);
 
     g_Graphics->Present();
+    g_DynamicVertices.EndFrame(g_Graphics->GetGraphicsContext());
+    g_DynamicIndices.EndFrame(g_Graphics->GetGraphicsContext());
   }
 
   return true;
@@ -304,7 +361,14 @@ bool App::LoadSettings()
   vector<char> buf;
   // INIT(RESOURCE_MANAGER.LoadFile(PathJoin(_appRoot.c_str(), "app.gb").c_str(), &buf));
   INIT_FATAL(RESOURCE_MANAGER.LoadFile("app.gb", &buf));
-  _settings = ParseAppSettings(InputBuffer(buf.data(), buf.size()));
+  InputBuffer inputBuffer(buf.data(), buf.size());
+  AppSettings settings = ParseAppSettings(inputBuffer);
+  INIT_FATAL_LOG(inputBuffer.Ok(),
+      "Error parsing app.gb in ",
+      inputBuffer.ErrorFunction(),
+      ", at offset ",
+      inputBuffer.ErrorOffset());
+  _settings = settings;
 
   END_INIT_SEQUENCE();
 }
@@ -513,6 +577,17 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line
   if (!App::Create())
     return 1;
 
+#if WITH_BENCHMARKS
+  // "--benchmark" runs the effect benchmark without creating a window or device
+  if (strstr(cmd_line, "--benchmark"))
+  {
+    bool res = TANO.RunBenchmark(cmd_line);
+    App::Destroy();
+    GlobalClose();
+    return res ? 0 : 1;
+  }
+#endif
+
   if (!TANO.Init(instance))
     return 1;
 
@@ -58,6 +58,9 @@ namespace tano
 
     bool Init(HINSTANCE hinstance);
     bool Run();
+#if WITH_BENCHMARKS
+    bool RunBenchmark(const char* cmdLine);
+#endif
 
     static bool Create();
     static bool Destroy();
@@ -73,6 +76,8 @@ namespace tano
     App();
 
     bool FindAppRoot(const char* filename);
+    // Resources, settings, blackboard and scheduler
+    bool InitResources();
     bool LoadSettings();
     void SaveSettings();
     void UpdateIoState();
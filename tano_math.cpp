@@ -51,22 +51,20 @@ namespace tano
   }
 
   //------------------------------------------------------------------------------
-  vec3 CardinalSplineBlend(const vec3& p0, const vec3& p1, const vec3& p2, const vec3& p3, float s)
+  namespace
   {
-    float a = 0.5f;
+    // Arc length samples per control point segment
+    const int ARC_LENGTH_SAMPLES = 32;
 
-    vec3 t1 = a * (p2 - p0);
-    vec3 t2 = a * (p3 - p1);
-
-    // P = h1 * P1 + h2 * P2 + h3 * T1 + h4 * T2;
-    float s2 = s * s;
-    float s3 = s2 * s;
-    float h1 = +2 * s3 - 3 * s2 + 1;
-    float h2 = -2 * s3 + 3 * s2;
-    float h3 = s3 - 2 * s2 + s;
-    float h4 = s3 - s2;
+    inline vec3 EvalSegment(const CardinalSpline::Segment& seg, float s)
+    {
+      return seg.c0 + s * (seg.c1 + s * (seg.c2 + s * seg.c3));
+    }
 
-    return h1 * p1 + h2 * p2 + h3 * t1 + h4 * t2;
+    inline vec3 EvalSegmentDeriv(const CardinalSpline::Segment& seg, float s)
+    {
+      return seg.c1 + s * (2 * seg.c2 + 3 * s * seg.c3);
+    }
   }
 
   //------------------------------------------------------------------------------
@@ -76,23 +74,140 @@ namespace tano
     _scale = scale;
     _controlPoints.resize(numPoints);
     copy(pts, pts + numPoints, _controlPoints.begin());
+
+    // Hermite form, with the tangents at p1 and p2 taken from their neighbours. The
+    // end points are clamped, so the segments before -1 and after numPoints - 1 are
+    // constant, and only one of each is kept.
+    int m = numPoints - 1;
+    _segments.resize(numPoints + 3);
+    for (int i = -2; i <= m + 1; ++i)
+    {
+      vec3 p0 = _controlPoints[min(m, max(0, i - 1))];
+      vec3 p1 = _controlPoints[min(m, max(0, i + 0))];
+      vec3 p2 = _controlPoints[min(m, max(0, i + 1))];
+      vec3 p3 = _controlPoints[min(m, max(0, i + 2))];
+
+      vec3 t1 = 0.5f * (p2 - p0);
+      vec3 t2 = 0.5f * (p3 - p1);
+
+      Segment& seg = _segments[i + 2];
+      seg.c0 = p1;
+      seg.c1 = t1;
+      seg.c2 = 3 * (p2 - p1) - 2 * t1 - t2;
+      seg.c3 = 2 * (p1 - p2) + t1 + t2;
+    }
+
+    // Sample the cumulative length, and invert it to get the parameter at evenly
+    // spaced distances
+    _arcParam.clear();
+    _length = 0;
+    int numSamples = max(0, m) * ARC_LENGTH_SAMPLES;
+    if (numSamples == 0)
+      return;
+
+    float step = _scale / ARC_LENGTH_SAMPLES;
+    vector<float> dist(numSamples + 1);
+    dist[0] = 0;
+    vec3 prev = Interpolate(0);
+    for (int i = 1; i <= numSamples; ++i)
+    {
+      vec3 cur = Interpolate(i * step);
+      dist[i] = dist[i - 1] + Distance(prev, cur);
+      prev = cur;
+    }
+
+    _length = dist[numSamples];
+    if (_length <= 0)
+      return;
+
+    _arcParam.resize(numSamples + 1);
+    int k = 0;
+    for (int i = 0; i <= numSamples; ++i)
+    {
+      float target = i * _length / numSamples;
+      while (k < numSamples - 1 && dist[k + 1] < target)
+        ++k;
+
+      float len = dist[k + 1] - dist[k];
+      float frac = len > 0 ? min(1.f, max(0.f, (target - dist[k]) / len)) : 0;
+      _arcParam[i] = (k + frac) * step;
+    }
   }
 
   //------------------------------------------------------------------------------
-  vec3 CardinalSpline::Interpolate(float t) const
+  const CardinalSpline::Segment& CardinalSpline::SegmentAt(float t, float* s) const
   {
-    int numPoints = (int)_controlPoints.size();
     t /= _scale;
     int i = (int)t;
+    *s = t - (float)i;
+    int m = (int)_controlPoints.size() - 1;
+    return _segments[min(m + 1, max(-2, i)) + 2];
+  }
 
-    int m = numPoints - 1;
-    vec3 p0 = _controlPoints[min(m, max(0, i - 1))];
-    vec3 p1 = _controlPoints[min(m, max(0, i + 0))];
-    vec3 p2 = _controlPoints[min(m, max(0, i + 1))];
-    vec3 p3 = _controlPoints[min(m, max(0, i + 2))];
+  //------------------------------------------------------------------------------
+  vec3 CardinalSpline::Interpolate(float t) const
+  {
+    float s;
+    const Segment& seg = SegmentAt(t, &s);
+    return EvalSegment(seg, s);
+  }
 
-    float s = t - (float)i;
-    return CardinalSplineBlend(p0, p1, p2, p3, s);
+  //------------------------------------------------------------------------------
+  void CardinalSpline::Interpolate(const float* t, int num, vec3* out) const
+  {
+    float invScale = 1 / _scale;
+    int m = (int)_controlPoints.size() - 1;
+    const Segment* segments = _segments.data() + 2;
+    for (int j = 0; j < num; ++j)
+    {
+      float tt = t[j] * invScale;
+      int i = (int)tt;
+      out[j] = EvalSegment(segments[min(m + 1, max(-2, i))], tt - (float)i);
+    }
+  }
+
+  //------------------------------------------------------------------------------
+  vec3 CardinalSpline::Derivative(float t) const
+  {
+    float s;
+    const Segment& seg = SegmentAt(t, &s);
+    return (1 / _scale) * EvalSegmentDeriv(seg, s);
+  }
+
+  //------------------------------------------------------------------------------
+  void CardinalSpline::Frame(float t, vec3* pos, vec3* dir) const
+  {
+    float s;
+    const Segment& seg = SegmentAt(t, &s);
+    *pos = EvalSegment(seg, s);
+    *dir = Normalize(EvalSegmentDeriv(seg, s));
+  }
+
+  //------------------------------------------------------------------------------
+  float CardinalSpline::ArcLengthParam(float t) const
+  {
+    int n = (int)_arcParam.size();
+    float end = (_controlPoints.size() - 1) * _scale;
+    if (n < 2 || t <= 0 || t >= end)
+      return t;
+
+    float x = t / end * (n - 1);
+    int i = min(n - 2, (int)x);
+    float frac = x - (float)i;
+    return _arcParam[i] + frac * (_arcParam[i + 1] - _arcParam[i]);
+  }
+
+  //------------------------------------------------------------------------------
+  vec3 CardinalSpline::InterpolateArcLength(float t) const
+  {
+    return Interpolate(ArcLengthParam(t));
+  }
+
+  //------------------------------------------------------------------------------
+  void CardinalSpline::InterpolateArcLength(const float* t, int num, vec3* out) const
+  {
+    for (int j = 0; j < num; ++j)
+      out[j] = Interpolate(ArcLengthParam(t[j]));
   }
 
   //------------------------------------------------------------------------------
@@ -264,12 +264,41 @@ namespace tano
   int ClipPolygonAgainstPlane(int vertexCount, const vec3* vertex, const Plane& plane, vec3* result);
 
   //------------------------------------------------------------------------------
+  // Catmull-Rom spline through the control points, where 't' = i * scale is at
+  // control point i. The segment polynomials and an arc length table are built in
+  // Create, so evaluating is just a lookup and a cubic.
   struct CardinalSpline
   {
     void Create(const vec3* pts, int numPoints, float scale = 1.f);
     vec3 Interpolate(float t) const;
+    void Interpolate(const float* t, int num, vec3* out) const;
+
+    // dP/dt
+    vec3 Derivative(float t) const;
+    // Position and unit tangent
+    void Frame(float t, vec3* pos, vec3* dir) const;
+
+    // Arc length parameterization. 't' has the same range as for Interpolate, but
+    // equal steps in 't' give equal distances along the curve
+    float ArcLengthParam(float t) const;
+    vec3 InterpolateArcLength(float t) const;
+    void InterpolateArcLength(const float* t, int num, vec3* out) const;
+    float Length() const { return _length; }
+
+    struct Segment
+    {
+      // P(s) = c0 + c1 * s + c2 * s^2 + c3 * s^3
+      vec3 c0, c1, c2, c3;
+    };
+
+    const Segment& SegmentAt(float t, float* s) const;
 
     std::vector<vec3> _controlPoints;
+    // Segments for i = -2 .. numPoints, where the first and last are constant
+    std::vector<Segment> _segments;
+    // Parameter at evenly spaced distances along the curve
+    std::vector<float> _arcParam;
+    float _length = 0;
     float _scale;
   };
 
@@ -0,0 +1,104 @@
+#include "temp_resource_pool.hpp"
+
+using namespace tano;
+using namespace bristol;
+
+//------------------------------------------------------------------------------
+u64 TempResourcePool::MakeKey(int width, int height, DXGI_FORMAT format, u32 flags)
+{
+  assert(width >= 0 && width < (1 << 16) && height >= 0 && height < (1 << 16));
+  return (u64)width | ((u64)height << 16) | ((u64)(format & 0xff) << 32) | ((u64)flags << 40);
+}
+
+//------------------------------------------------------------------------------
+int TempResourcePool::Acquire(u64 key)
+{
+  auto it = _freeByKey.find(key);
+  if (it == _freeByKey.end() || it->second.empty())
+    return -1;
+
+  u32 id = it->second.back();
+  it->second.pop_back();
+
+  Entry& entry = _entries[id];
+  entry.inUse = true;
+  entry.lastUsed = _frame;
+
+  _stats.numInUse++;
+  _stats.bytesInUse += entry.bytes;
+  return (int)id;
+}
+
+//------------------------------------------------------------------------------
+void TempResourcePool::Add(u64 key, u32 id, u32 bytes)
+{
+  assert(_entries.find(id) == _entries.end());
+  _entries[id] = Entry{key, bytes, _frame, true};
+
+  _stats.numResources++;
+  _stats.numInUse++;
+  _stats.bytes += bytes;
+  _stats.bytesInUse += bytes;
+  _stats.peakBytes = max(_stats.peakBytes, _stats.bytes);
+}
+
+//------------------------------------------------------------------------------
+void TempResourcePool::Release(u32 id)
+{
+  auto it = _entries.find(id);
+  if (it == _entries.end())
+    return;
+
+  Entry& entry = it->second;
+  assert(entry.inUse);
+  entry.inUse = false;
+  entry.lastUsed = _frame;
+  _freeByKey[entry.key].push_back(id);
+
+  _stats.numInUse--;
+  _stats.bytesInUse -= entry.bytes;
+}
+
+//------------------------------------------------------------------------------
+void TempResourcePool::Evict(u32 id, vector<u32>* evicted)
+{
+  auto it = _entries.find(id);
+  const Entry& entry = it->second;
+
+  vector<u32>& ids = _freeByKey[entry.key];
+  ids.erase(find(ids.begin(), ids.end(), id));
+  if (ids.empty())
+    _freeByKey.erase(entry.key);
+
+  _stats.numResources--;
+  _stats.bytes -= entry.bytes;
+  _stats.numEvicted++;
+
+  _entries.erase(it);
+  evicted->push_back(id);
+}
+
+//------------------------------------------------------------------------------
+void TempResourcePool::NewFrame(u32 maxAge, u64 budget, vector<u32>* evicted)
+{
+  ++_frame;
+
+  // the pool only holds a handful of resources, so a scan per frame is fine
+  vector<pair<u32, u32>> candidates;
+  for (const auto& kv : _entries)
+  {
+    if (!kv.second.inUse)
+      candidates.push_back(make_pair(kv.second.lastUsed, kv.first));
+  }
+
+  if (candidates.empty())
+    return;
+
+  sort(candidates.begin(), candidates.end());
+  for (const pair<u32, u32>& c : candidates)
+  {
+    if (_frame - c.first < maxAge && _stats.bytes <= budget)
+      break;
+    Evict(c.second, evicted);
+  }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+namespace tano
+{
+  // Book-keeping for the temporary render targets and depth stencils. Free resources are
+  // found by a key packed from their description, and resources in use by their id, so
+  // acquire and release don't scan. Resources that go unused for a number of frames, or
+  // that don't fit in the memory budget, are handed back to the owner to destroy.
+  class TempResourcePool
+  {
+  public:
+    struct Stats
+    {
+      u32 numResources = 0;
+      u32 numInUse = 0;
+      u64 bytes = 0;
+      u64 bytesInUse = 0;
+      u64 peakBytes = 0;
+      u32 numEvicted = 0;
+    };
+
+    static u64 MakeKey(int width, int height, DXGI_FORMAT format, u32 flags);
+
+    // Returns the id of a free resource matching 'key', or -1
+    int Acquire(u64 key);
+    // Adds a newly created resource, which starts out in use
+    void Add(u64 key, u32 id, u32 bytes);
+    void Release(u32 id);
+
+    // Appends the ids of the free resources that haven't been used for 'maxAge' frames,
+    // and then the least recently used ones until the pool fits in 'budget' bytes. The
+    // evicted ids are removed from the pool.
+    void NewFrame(u32 maxAge, u64 budget, vector<u32>* evicted);
+
+    const Stats& GetStats() const { return _stats; }
+
+  private:
+    struct Entry
+    {
+      u64 key;
+      u32 bytes;
+      u32 lastUsed;
+      bool inUse;
+    };
+
+    void Evict(u32 id, vector<u32>* evicted);
+
+    // ids of the free resources, by key
+    unordered_map<u64, vector<u32>> _freeByKey;
+    unordered_map<u32, Entry> _entries;
+
+    u32 _frame = 0;
+    Stats _stats;
+  };
+}
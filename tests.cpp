@@ -1,7 +1,21 @@
 #if WITH_TESTS
 
 #include "circular_buffer.hpp"
+#include "compiled_settings.hpp"
 #include "fixed_deque.hpp"
+#include "fractal_noise.hpp"
+#include "graphics.hpp"
+#include "mesh_utils.hpp"
+#include "mesh_optimizer.hpp"
+#include "perlin2d.hpp"
+#include "random.hpp"
+#include "render_queue.hpp"
+#include "shader_cache.hpp"
+#include "slot_map.hpp"
+#include "tano_math.hpp"
+#include "temp_resource_pool.hpp"
+#include "text_writer.hpp"
+#include "verlet.hpp"
 
 using namespace tano;
 using namespace bristol;
@@ -134,10 +148,665 @@ bool StringTest()
   return true;
 }
 
+//------------------------------------------------------------------------------
+bool MeshOptimizerTest()
+{
+  const int N = 17;
+  vector<u32> indices;
+  GeneratePlaneIndices(N, N, 0, &indices);
+  vector<u32> org = indices;
+
+  float acmrBefore = CalcAcmr(indices.data(), (u32)indices.size());
+  OptimizeVertexCache(indices.data(), (u32)indices.size(), N * N);
+  float acmrAfter = CalcAcmr(indices.data(), (u32)indices.size());
+  assert(acmrAfter < acmrBefore);
+
+  // the same triangles should be present, just in a different order
+  auto fnSortedTris = [](const vector<u32>& src)
+  {
+    vector<vector<u32>> tris;
+    for (size_t i = 0; i < src.size(); i += 3)
+      tris.push_back({src[i + 0], src[i + 1], src[i + 2]});
+    sort(tris.begin(), tris.end());
+    return tris;
+  };
+  assert(fnSortedTris(org) == fnSortedTris(indices));
+
+  // after a fetch optimization, the vertices should be referenced in order
+  vector<vec3> verts(N * N);
+  for (int i = 0; i < N * N; ++i)
+    verts[i] = vec3((float)(i % N), 0, (float)(i / N));
+
+  u32 numUsed = OptimizeVertexFetch(
+      verts.data(), sizeof(vec3), N * N, indices.data(), (u32)indices.size());
+  assert(numUsed == N * N);
+  u32 maxSeen = 0;
+  for (u32 idx : indices)
+  {
+    assert(idx <= maxSeen + 1);
+    maxSeen = max(maxSeen, idx);
+  }
+
+  vector<u16> indices16(indices.size());
+  bool compacted = CompactIndices(indices.data(), (u32)indices.size(), indices16.data());
+  assert(compacted);
+  for (size_t i = 0; i < indices.size(); ++i)
+    assert(indices16[i] == indices[i]);
+
+  // degenerate triangles have no facing, and shouldn't produce NaN sort keys
+  vector<vec3> flat(N * N, vec3(1, 2, 3));
+  vector<u32> flatIndices = org;
+  OptimizeOverdraw(flatIndices.data(), (u32)flatIndices.size(), flat.data(), sizeof(vec3), N * N);
+  assert(fnSortedTris(org) == fnSortedTris(flatIndices));
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool Perlin2DTest()
+{
+  Perlin2D::Init();
+
+  // the batch versions should match the scalar path
+  const int W = 37;
+  const int H = 29;
+  float x0 = -123.45f, y0 = 67.89f;
+  float stepX = 0.05f, stepY = 0.31f;
+  float grid[W * H];
+  Perlin2D::ValueGrid(x0, y0, stepX, stepY, W, H, grid);
+  for (int j = 0; j < H; ++j)
+  {
+    for (int i = 0; i < W; ++i)
+    {
+      float v = Perlin2D::Value(x0 + i * stepX, y0 + j * stepY);
+      assert(fabsf(v - grid[j * W + i]) < 1e-5f);
+    }
+  }
+
+  const int N = 103;
+  vec2 pts[N];
+  float values[N];
+  for (int i = 0; i < N; ++i)
+    pts[i] = vec2(i * 1.37f - 70, i * -2.71f + 33);
+
+  Perlin2D::Values(pts, N, values);
+  for (int i = 0; i < N; ++i)
+    assert(fabsf(Perlin2D::Value(pts[i].x, pts[i].y) - values[i]) < 1e-5f);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool FractalNoiseTest()
+{
+  Perlin2D::Init();
+
+  FractalNoise noise;
+  const int N = 200;
+  vec2 pts[N];
+  float fbm[N], ridged[N], warped[N];
+  for (int i = 0; i < N; ++i)
+  {
+    pts[i] = vec2(i * 0.731f - 40, i * -0.377f + 25);
+    fbm[i] = noise.Fbm(pts[i].x, pts[i].y);
+    ridged[i] = noise.Ridged(pts[i].x, pts[i].y);
+    warped[i] = noise.Warped(pts[i].x, pts[i].y);
+
+    // fBm is normalized by the amplitude sum, and ridged is in [0, 1]
+    assert(fbm[i] >= -1 && fbm[i] <= 1);
+    assert(ridged[i] >= 0 && ridged[i] <= 1);
+    assert(warped[i] >= -1 && warped[i] <= 1);
+  }
+
+  // the tables are rebuilt from the same sequence, so a re-init gives the same values,
+  // and the batch versions match the scalar ones
+  Perlin2D::Init();
+  float batch[N];
+  noise.FbmValues(pts, N, batch);
+  for (int i = 0; i < N; ++i)
+  {
+    assert(noise.Fbm(pts[i].x, pts[i].y) == fbm[i]);
+    assert(noise.Ridged(pts[i].x, pts[i].y) == ridged[i]);
+    assert(fabsf(batch[i] - fbm[i]) < 1e-5f);
+  }
+
+  noise.WarpedValues(pts, N, batch);
+  for (int i = 0; i < N; ++i)
+    assert(fabsf(batch[i] - warped[i]) < 1e-4f);
+
+  noise.RidgedGrid(pts[0].x, pts[0].y, 0.731f, 0, N, 1, batch);
+  for (int i = 0; i < N; ++i)
+    assert(fabsf(batch[i] - noise.Ridged(pts[0].x + i * 0.731f, pts[0].y)) < 1e-5f);
+
+  // the analytic derivatives should agree with central differences
+  float h = 1e-3f;
+  for (int i = 0; i < N; ++i)
+  {
+    float x = pts[i].x;
+    float y = pts[i].y;
+
+    vec2 d;
+    float v = Perlin2D::ValueDeriv(x, y, &d);
+    assert(fabsf(v - Perlin2D::Value(x, y)) < 1e-6f);
+    float dx = (Perlin2D::Value(x + h, y) - Perlin2D::Value(x - h, y)) / (2 * h);
+    float dy = (Perlin2D::Value(x, y + h) - Perlin2D::Value(x, y - h)) / (2 * h);
+    assert(fabsf(dx - d.x) < 1e-2f && fabsf(dy - d.y) < 1e-2f);
+
+    v = noise.Fbm(x, y, &d);
+    assert(fabsf(v - fbm[i]) < 1e-6f);
+    dx = (noise.Fbm(x + h, y) - noise.Fbm(x - h, y)) / (2 * h);
+    dy = (noise.Fbm(x, y + h) - noise.Fbm(x, y - h)) / (2 * h);
+    assert(fabsf(dx - d.x) < 2e-2f && fabsf(dy - d.y) < 2e-2f);
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool RandomTest()
+{
+  // known answers from the Random123 test vectors
+  u32 block[4];
+  Philox::Block(0, 0, 0, block);
+  assert(block[0] == 0x6627e8d5 && block[1] == 0xe169c58d);
+  assert(block[2] == 0xbc57ac4c && block[3] == 0x9b00dbd8);
+  Philox::Block(~0ull, ~0ull, ~0ull, block);
+  assert(block[0] == 0x408f276d && block[1] == 0x41c83b0e);
+  assert(block[2] == 0xa20bc7c6 && block[3] == 0x6d5451fd);
+
+  // the batch fills should continue the same sequence as the single draws
+  const int N = 1001;
+  u32 values[N];
+  float floats[N];
+  Philox a(123, 7), b(123, 7);
+  a.NextU32();
+  b.NextU32();
+  a.FillU32(values, N);
+  for (int i = 0; i < N; ++i)
+    assert(values[i] == b.NextU32());
+
+  a.FillUniform(floats, N, -3.f, 5.f);
+  for (int i = 0; i < N; ++i)
+  {
+    assert(floats[i] >= -3.f && floats[i] < 5.f);
+    assert(floats[i] == -3.f + 8.f * b.NextFloat());
+  }
+
+  // different streams shouldn't overlap
+  Philox c(123, 8);
+  assert(c.NextU32() != Philox(123, 7).NextU32());
+
+  Philox g(5, 0);
+  g.FillGaussian(floats, N, 1.f, 2.f);
+  float sum = 0;
+  for (int i = 0; i < N; ++i)
+    sum += floats[i];
+  assert(fabsf(sum / N - 1.f) < 0.25f);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool VerletTest()
+{
+  // A small cloth with structural and shear constraints. The colours are too small to
+  // be split into tasks, so this doesn't need the scheduler.
+  const int W = 12;
+  const int H = 10;
+  VerletSystem cloth;
+  cloth.Create(W * H);
+  for (int i = 0; i < W * H; ++i)
+  {
+    VerletSystem::Particle& p = cloth._particles[i];
+    p.pos = p.lastPos = vec3((i % W) * 0.1f, (i / W) * -0.1f, 0);
+    p.acc = vec3(0, 0, 0);
+  }
+
+  vector<VerletSystem::Constraint> constraints;
+  auto fnAdd = [&](int x0, int y0, int x1, int y1)
+  {
+    if (x1 < 0 || x1 >= W || y1 >= H)
+      return;
+    u32 a = y0 * W + x0;
+    u32 b = y1 * W + x1;
+    constraints.push_back({a, b, Distance(cloth._particles[a].pos, cloth._particles[b].pos)});
+  };
+
+  for (int y = 0; y < H; ++y)
+  {
+    for (int x = 0; x < W; ++x)
+    {
+      fnAdd(x, y, x + 1, y);
+      fnAdd(x, y, x, y + 1);
+      fnAdd(x, y, x + 1, y + 1);
+      fnAdd(x, y, x - 1, y + 1);
+    }
+  }
+  // constraints from a particle to itself are dropped
+  constraints.push_back({5, 5, 0});
+  int numConstraints = (int)constraints.size();
+
+  ConstraintBatching batching;
+  BatchConstraints(
+      constraints.data(), numConstraints, W * H, VerletSystem::BATCH_WIDTH, &batching);
+
+  // every other constraint is used exactly once
+  assert((int)batching.order.size() == numConstraints - 1);
+  vector<int> seen(numConstraints, 0);
+  for (int idx : batching.order)
+    seen[idx]++;
+  for (int i = 0; i < numConstraints - 1; ++i)
+    assert(seen[i] == 1);
+  assert(seen.back() == 0);
+
+  // colours are made of full batches, and no two constraints in a colour share a particle
+  vector<int> lastColour(W * H, -1);
+  for (int c = 0; c < batching.NumColours(); ++c)
+  {
+    int start = batching.colourStart[c];
+    int end = batching.colourStart[c + 1];
+    assert(end > start && (end - start) % VerletSystem::BATCH_WIDTH == 0);
+    for (int i = start; i < end; ++i)
+    {
+      const VerletSystem::Constraint& con = constraints[batching.order[i]];
+      assert(lastColour[con.idx0] != c && lastColour[con.idx1] != c);
+      lastColour[con.idx0] = c;
+      lastColour[con.idx1] = c;
+    }
+  }
+
+  cloth.SetConstraints(constraints.data(), numConstraints);
+  assert(cloth.NumConstraints() == numConstraints - 1);
+  assert(cloth.NumColours() == batching.NumColours());
+
+  // Perturb the cloth, and relaxing should bring back the rest lengths. The offsets are
+  // in the plane, as the lengths only change to second order when a flat cloth is
+  // pushed out of it, so that converges too slowly for a test.
+  for (int i = 0; i < W * H; ++i)
+  {
+    VerletSystem::Particle& p = cloth._particles[i];
+    p.pos += 0.02f * vec3(sinf(i * 1.7f), cosf(i * 2.3f), 0);
+    p.lastPos = p.pos;
+  }
+
+  int numIterations = cloth.Relax(500, 1e-4f);
+  assert(numIterations < 500);
+  for (int i = 0; i < numConstraints - 1; ++i)
+  {
+    const VerletSystem::Constraint& con = constraints[i];
+    float dist = Distance(cloth._particles[con.idx0].pos, cloth._particles[con.idx1].pos);
+    assert(fabsf(dist - con.restLength) < 1e-3f * con.restLength);
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool SplineTest()
+{
+  const int N = 12;
+  vec3 pts[N];
+  for (int i = 0; i < N; ++i)
+    pts[i] = vec3(i * i * 0.5f, sinf((float)i) * 4, (float)(i % 3));
+
+  CardinalSpline spline;
+  spline.Create(pts, N, 0.5f);
+
+  // passes through the control points, and the batch version matches
+  float t[3 * N];
+  vec3 out[3 * N];
+  for (int i = 0; i < 3 * N; ++i)
+    t[i] = i * 0.25f - 1.f;
+  spline.Interpolate(t, 3 * N, out);
+  for (int i = 0; i < 3 * N; ++i)
+    assert(Distance(out[i], spline.Interpolate(t[i])) == 0);
+  for (int i = 0; i < N; ++i)
+    assert(Distance(spline.Interpolate(i * 0.5f), pts[i]) < 1e-4f);
+
+  // the derivative should agree with finite differences
+  float h = 1e-3f;
+  for (float tt = 0.1f; tt < 5.f; tt += 0.37f)
+  {
+    vec3 fd = (1 / (2 * h)) * (spline.Interpolate(tt + h) - spline.Interpolate(tt - h));
+    assert(Distance(fd, spline.Derivative(tt)) < 1e-2f * max(1.f, Length(fd)));
+  }
+
+  // equal steps in t should cover (roughly) equal distances
+  const int STEPS = 100;
+  float end = (N - 1) * 0.5f;
+  vec3 prev = spline.InterpolateArcLength(0);
+  float sum = 0;
+  for (int i = 1; i <= STEPS; ++i)
+  {
+    vec3 cur = spline.InterpolateArcLength(i * end / STEPS);
+    float d = Distance(prev, cur);
+    assert(d < 1.05f * spline.Length() / STEPS);
+    sum += d;
+    prev = cur;
+  }
+  assert(sum <= spline.Length() * 1.001f && sum > spline.Length() * 0.98f);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool RenderQueueTest()
+{
+  // g_ScratchMemory isn't set up when the tests run, so use a local block
+  static u8 mem0[4096];
+  static u8 mem1[4096];
+
+  CommandBuffer buf0, buf1;
+  buf0.Init(mem0, mem0 + sizeof(mem0));
+  buf1.Init(mem1, mem1 + sizeof(mem1));
+
+  float cb[16] = {1, 2, 3};
+  buf0.BeginPacket(MakeRenderKey(1, 0, 0));
+  buf0.SetConstantBuffer(ObjectHandle(), cb, sizeof(cb), VertexShader, 0);
+  buf0.Draw(3, 0);
+
+  buf1.BeginPacket(MakeRenderKey(0, 10, 0));
+  int* data = buf1.CopyToBuffer<int>(ObjectHandle(), 4);
+  assert(data);
+  for (int i = 0; i < 4; ++i)
+    data[i] = i;
+  buf1.DrawIndexed(6, 0, 0);
+
+  // same key as the first packet, so should run after it
+  buf0.BeginPacket(MakeRenderKey(1, 0, 0));
+  buf0.Dispatch(1, 1, 1);
+
+  RenderQueue queue;
+  queue.Submit(buf0);
+  queue.Submit(buf1);
+  assert(queue.NumPackets() == 3);
+
+  NullRenderBackend backend;
+  queue.Execute(&backend);
+  assert(queue.NumPackets() == 0);
+
+  vector<CommandType> expected = {CommandType::CopyToBuffer,
+      CommandType::DrawIndexed,
+      CommandType::SetConstantBuffer,
+      CommandType::Draw,
+      CommandType::Dispatch};
+  assert(backend.trace == expected);
+  assert(backend.payloadBytes == sizeof(cb) + 4 * sizeof(int));
+  assert(backend.numVertices == 9);
+
+  // commands that don't fit are dropped, and the buffer is flagged
+  CommandBuffer small;
+  small.Init(mem0, mem0 + 64);
+  small.BeginPacket(0);
+  small.SetConstantBuffer(ObjectHandle(), cb, sizeof(cb), PixelShader, 0);
+  assert(small.Overflowed());
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+namespace
+{
+  struct CompiledTestSettings
+  {
+    float scale = 1;
+    int count = 10;
+    vec3 dir = {0, 0, 1};
+  };
+
+  void Serialize(OutputBuffer& buf, const CompiledTestSettings& s)
+  {
+    Serialize(buf, 0, "scale", s.scale);
+    Serialize(buf, 0, "count", s.count);
+    Serialize(buf, 0, "dir", s.dir);
+  }
+}
+
+//------------------------------------------------------------------------------
+bool CompiledSettingsTest()
+{
+  CompiledTestSettings settings;
+  settings.scale = 2.5f;
+  settings.count = 7;
+
+  vector<char> buf;
+  bool compiled = CompileSettings(settings, &buf);
+  assert(compiled);
+  assert(IsCompiledSettings(buf));
+
+  CompiledTestSettings loaded;
+  bool loadedOk = LoadCompiledSettings(buf, &loaded);
+  assert(loadedOk);
+  assert(loaded.scale == 2.5f && loaded.count == 7 && loaded.dir.z == 1);
+
+  // a compiled file from a different layout is rejected
+  ((CompiledSettingsHeader*)buf.data())->schemaHash ^= 1;
+  loadedOk = LoadCompiledSettings(buf, &loaded);
+  assert(!loadedOk);
+
+  // text configs aren't mistaken for compiled ones
+  const char* text = "scale: 1;";
+  assert(!IsCompiledSettings(vector<char>(text, text + strlen(text))));
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool TempResourcePoolTest()
+{
+  TempResourcePool pool;
+  vector<u32> evicted;
+
+  u64 keyA = TempResourcePool::MakeKey(640, 360, DXGI_FORMAT_R11G11B10_FLOAT, 0);
+  u64 keyB = TempResourcePool::MakeKey(640, 360, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
+  assert(keyA != keyB);
+
+  assert(pool.Acquire(keyA) == -1);
+  pool.Add(keyA, 3, 100);
+  pool.Add(keyB, 5, 200);
+  assert(pool.Acquire(keyA) == -1);
+
+  // released resources are handed out again, but only for the same key
+  pool.Release(3);
+  assert(pool.Acquire(keyB) == -1);
+  assert(pool.Acquire(keyA) == 3);
+  assert(pool.GetStats().numInUse == 2 && pool.GetStats().bytes == 300);
+
+  // unused resources are evicted once they're too old
+  pool.Release(3);
+  pool.Release(5);
+  pool.NewFrame(10, 1000, &evicted);
+  assert(evicted.empty());
+  assert(pool.Acquire(keyB) == 5);
+  for (int i = 0; i < 10; ++i)
+    pool.NewFrame(10, 1000, &evicted);
+  assert(evicted.size() == 1 && evicted[0] == 3);
+  assert(pool.Acquire(keyA) == -1);
+
+  // and free ones are evicted when over budget, but not ones in use
+  pool.Release(5);
+  pool.Add(keyA, 3, 100);
+  evicted.clear();
+  pool.NewFrame(10, 50, &evicted);
+  assert(evicted.size() == 1 && evicted[0] == 5);
+  assert(pool.GetStats().numResources == 1 && pool.GetStats().bytes == 100);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool SlotMapTest()
+{
+  SlotMap<int*, DeleteMixin> map;
+
+  ObjectHandle a = Graphics::MakeObjectHandle(ObjectHandle::kTexture, map.Append(new int(1)));
+  ObjectHandle b = Graphics::MakeObjectHandle(ObjectHandle::kTexture, map.Append(new int(2)));
+  assert(*map.Get(a) == 1 && *map.Get(b) == 2);
+  assert(map.Size() == 2);
+
+  // removing frees the slot, and the next append reuses it with a new generation
+  map.Remove(a);
+  assert(!map.IsLive(a));
+  ObjectHandle c = Graphics::MakeObjectHandle(ObjectHandle::kTexture, map.Append(new int(3)));
+  assert(c.id() == a.id() && c.generation() != a.generation());
+  assert(!map.IsLive(a) && map.IsLive(c));
+  assert(*map.Get(c) == 3 && *map.Get(b) == 2);
+
+  // update replaces the value in place
+  map.Update(b, new int(4));
+  assert(*map.Get(b) == 4);
+  assert(map.Size() == 2);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool TextWriterTest()
+{
+  // each glyph is a 10x20 quad, with the caps using the same mesh as the outline
+  static float verts[] = {0, 0, 0, 10, 0, 0, 10, 20, 0, 0, 20, 0};
+  static u32 indices[] = {0, 1, 2, 0, 2, 3};
+  const char* names[] = {"A", "Cap 1", "Cap 2", "B", "Cap 1", "Cap 2"};
+
+  protocol::MeshBlob blobs[6];
+  vector<protocol::MeshBlob*> meshes;
+  for (int i = 0; i < 6; ++i)
+  {
+    memset(&blobs[i], 0, sizeof(protocol::MeshBlob));
+    blobs[i].name = names[i];
+    blobs[i].numVerts = 4;
+    blobs[i].numIndices = 6;
+    blobs[i].verts = verts;
+    blobs[i].indices = indices;
+    meshes.push_back(&blobs[i]);
+  }
+
+  // building the glyphs again, as a reload does, replaces them
+  TextWriter writer;
+  writer.InitGlyphs(meshes);
+  writer.InitGlyphs(meshes);
+  assert(writer._glyphs.size() == 3);
+  assert(writer.Segment(TextWriter::TextCap1).glyphs.size() == 3);
+  assert(writer.Segment(TextWriter::TextCap1).verts.size() == 8);
+
+  // unknown characters are skipped, and space only advances
+  vector<TextWriter::GlyphInstance> layout;
+  writer.Layout("AB#A", TextWriter::TextCap1, &layout);
+  assert(layout.size() == 3);
+  writer.Layout("AB A", TextWriter::TextCap1, &layout);
+  assert(layout.size() == 3);
+  assert(writer._glyphs[layout[0].glyph].codepoint == 'A');
+  assert(writer._glyphs[layout[1].glyph].codepoint == 'B');
+
+  float advance = 10 * writer._tracking;
+  assert(fabsf(layout[1].pos.x - layout[0].pos.x - advance) < 1e-4f);
+  assert(fabsf(layout[2].pos.x - layout[1].pos.x - advance - writer._spaceAdvance) < 1e-4f);
+
+  // the row is centered around the origin
+  assert(fabsf(layout[0].pos.x + layout[2].pos.x + 10) < 1e-4f);
+  for (const TextWriter::GlyphInstance& g : layout)
+    assert(g.pos.y == -10);
+
+  // lower case folds onto the upper case glyphs, also when resolving the fallback, and
+  // an advance from the metrics is used for space
+  writer._fallback = 'b';
+  writer._advanceByCodepoint[' '] = 7;
+  writer.InitGlyphs(meshes);
+  writer.Layout("a #", TextWriter::TextCap1, &layout);
+  assert(layout.size() == 2);
+  assert(writer._glyphs[layout[0].glyph].codepoint == 'A');
+  assert(writer._glyphs[layout[1].glyph].codepoint == 'B');
+  assert(fabsf(layout[1].pos.x - layout[0].pos.x - advance - 7) < 1e-4f);
+
+  // metrics from a file, where a kern pair shifts the second glyph by its value
+  const char* metrics = "space: 30;\ntracking: 1;\nfallback: '?';\nkern: 'AB' -3;\n";
+  vector<char> metricsBuf(metrics, metrics + strlen(metrics));
+  writer.ResetMetrics();
+  bool parsed = writer.ParseMetrics(metricsBuf, "test");
+  assert(parsed);
+  assert(writer._spaceAdvance == 30 && writer._tracking == 1 && writer._fallback == '?');
+  writer.InitGlyphs(meshes);
+  writer.Layout("AB", TextWriter::TextCap1, &layout);
+  assert(layout.size() == 2);
+  assert(fabsf(layout[1].pos.x - layout[0].pos.x - (10 - 3)) < 1e-4f);
+
+  // and only for that pair
+  writer.Layout("BA", TextWriter::TextCap1, &layout);
+  assert(fabsf(layout[1].pos.x - layout[0].pos.x - 10) < 1e-4f);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool ShaderCacheTest()
+{
+  const char* name = "shaders/out/common_VsQuad.vso";
+  const char bytecode[] = {1, 2, 3, 4};
+  u32 namesSize = (u32)strlen(name) + 1;
+
+  ShaderCacheHeader header = {{'t', 's', 'h', 'c'}, ShaderCache::VERSION, 1, namesSize};
+  u32 dataOffset = sizeof(ShaderCacheHeader) + sizeof(ShaderCacheEntry) + namesSize;
+  ShaderCacheEntry entry = {ShaderCache::HashName(name), 0, dataOffset, sizeof(bytecode)};
+
+  vector<char> file;
+  file.insert(file.end(), (const char*)&header, (const char*)(&header + 1));
+  file.insert(file.end(), (const char*)&entry, (const char*)(&entry + 1));
+  file.insert(file.end(), name, name + namesSize);
+  file.insert(file.end(), bytecode, bytecode + sizeof(bytecode));
+
+  ShaderCache cache;
+  bool loaded = cache.Load(&file);
+  assert(loaded);
+
+  // entries aren't consumed, so a shader shared between effects hits the cache every time
+  vector<char> a, b;
+  bool foundA = cache.Get(name, &a);
+  bool foundB = cache.Get(name, &b);
+  assert(foundA && foundB);
+  assert(a.size() == sizeof(bytecode) && memcmp(a.data(), bytecode, sizeof(bytecode)) == 0);
+  assert(a == b);
+
+  vector<char> c;
+  bool foundC = cache.Get("shaders/out/common_PsQuad.pso", &c);
+  assert(!foundC);
+
+  // entries pointing outside the names or the data reject the whole file
+  ShaderCacheEntry badName = entry;
+  badName.nameOffset = namesSize;
+  ShaderCacheEntry badData = entry;
+  badData.dataSize += 1;
+  for (const ShaderCacheEntry& bad : {badName, badData})
+  {
+    vector<char> corrupt(a.size() + dataOffset);
+    memcpy(corrupt.data(), &header, sizeof(header));
+    memcpy(corrupt.data() + sizeof(header), &bad, sizeof(bad));
+    memcpy(corrupt.data() + sizeof(header) + sizeof(bad), name, namesSize);
+    memcpy(corrupt.data() + dataOffset, bytecode, sizeof(bytecode));
+
+    ShaderCache corruptCache;
+    bool corruptLoaded = corruptCache.Load(&corrupt);
+    assert(!corruptLoaded);
+  }
+
+  return true;
+}
+
 //------------------------------------------------------------------------------
 static bool bufferTestPassed = BufferTest();
 static bool dequeTest1Passed = DequeTest();
 static bool evalTestPassed = EvalTest();
 static bool stringTestPassed = StringTest();
+static bool meshOptimizerTestPassed = MeshOptimizerTest();
+static bool perlin2DTestPassed = Perlin2DTest();
+static bool fractalNoiseTestPassed = FractalNoiseTest();
+static bool randomTestPassed = RandomTest();
+static bool verletTestPassed = VerletTest();
+static bool splineTestPassed = SplineTest();
+static bool renderQueueTestPassed = RenderQueueTest();
+static bool compiledSettingsTestPassed = CompiledSettingsTest();
+static bool tempResourcePoolTestPassed = TempResourcePoolTest();
+static bool slotMapTestPassed = SlotMapTest();
+static bool textWriterTestPassed = TextWriterTest();
+static bool shaderCacheTestPassed = ShaderCacheTest();
 
 #endif
\ No newline at end of file
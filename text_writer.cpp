@@ -1,47 +1,19 @@
 #include "text_writer.hpp"
 #include "resource_manager.hpp"
+#include "mesh_optimizer.hpp"
 
 //------------------------------------------------------------------------------
 using namespace tano;
 
 //------------------------------------------------------------------------------
-namespace
+void TextWriter::Glyph::CalcBounds()
 {
-  struct RowDim
-  {
-    u32 triStart, triEnd;
-    float xMin, xMax;
-    float yMin, yMax;
-  };
-
-  void MakeRows(const char* str, vector<string>* rows)
-  {
-    // split text into rows
-    u32 len = (u32)strlen(str);
-    const char* start = str;
-    const char* end = str + len;
-    const char* cur = start;
-    while (start != end)
-    {
-      cur = strchr(start, '\n');
-      if (!cur)
-        break;
-      rows->push_back(string(start, cur - start));
-      start = cur + 1;
-    }
-
-    if (start != end)
-      rows->push_back(string(start, end - start));
-  }
-};
-
-//------------------------------------------------------------------------------
-void TextWriter::Letter::CalcBounds()
-{
-  if (!cap1)
+  // the bounds come from the front cap, or the outline if there isn't one
+  const protocol::MeshBlob* mesh = cap1 ? cap1 : outline;
+  if (!mesh)
     return;
 
-  u32 numIndices = cap1->numIndices;
+  u32 numIndices = mesh->numIndices;
 
   float minX = FLT_MAX;
   float maxX = -FLT_MAX;
@@ -49,259 +21,444 @@ void TextWriter::Letter::CalcBounds()
   float maxY = -FLT_MAX;
   for (u32 j = 0; j < numIndices; ++j)
   {
-    float x = cap1->verts[cap1->indices[j] * 3 + 0];
-    float y = cap1->verts[cap1->indices[j] * 3 + 1];
-    float z = cap1->verts[cap1->indices[j] * 3 + 2];
+    float x = mesh->verts[mesh->indices[j] * 3 + 0];
+    float y = mesh->verts[mesh->indices[j] * 3 + 1];
     minX = min(minX, x);
     maxX = max(maxX, x);
     minY = min(minY, y);
     maxY = max(maxY, y);
   }
 
-  width = maxX - minX;
-  height = maxY - minY;
+  if (numIndices)
+  {
+    width = maxX - minX;
+    height = maxY - minY;
+  }
 }
 
 //------------------------------------------------------------------------------
-bool TextWriter::Init(const char* filename)
+int TextWriter::AddGlyph(u32 codepoint)
 {
+  _glyphIndex[codepoint] = (int)_glyphs.size();
+  _glyphs.push_back(Glyph());
+  _glyphs.back().codepoint = codepoint;
+  return _glyphIndex[codepoint];
+}
+
+//------------------------------------------------------------------------------
+bool TextWriter::Init(const char* filename, const char* metricsFile)
+{
+  // the loader appends, so start from a fresh one
+  _loader = MeshLoader();
+  ResetMetrics();
+
   if (!_loader.Load(filename))
     return false;
 
-  u32 numLetters = 'Z' - 'A' + 1;
-  _letters.resize(numLetters);
+  if (metricsFile && !LoadMetrics(metricsFile))
+    return false;
 
-  Letter* curLetter = nullptr;
+  InitGlyphs(_loader.meshes);
+  return true;
+}
 
-  for (u32 i = 0; i < _loader.meshes.size(); ++i)
+//------------------------------------------------------------------------------
+void TextWriter::InitGlyphs(const vector<protocol::MeshBlob*>& meshes)
+{
+  _glyphs.clear();
+  _kerning.clear();
+  _lineHeight = 0;
+  for (SegmentCache& cache : _segments)
+    cache = SegmentCache();
+
+  for (int& idx : _glyphIndex)
+    idx = -1;
+
+  Glyph* curGlyph = nullptr;
+
+  for (u32 i = 0; i < meshes.size(); ++i)
   {
-    // Letter mesh names are ['A'..'Z']
-    protocol::MeshBlob* e = _loader.meshes[i];
-    int t = (int)e->name[0] - 'A';
-    if (strlen(e->name) == 1 && t >= 0 && t < (int)numLetters)
+    // Glyph meshes are named after their character
+    protocol::MeshBlob* e = meshes[i];
+    if (strlen(e->name) == 1)
     {
-      curLetter = &_letters[t];
-      curLetter->outline = e;
+      u32 codepoint = (u8)e->name[0];
+      if (_glyphIndex[codepoint] != -1)
+      {
+        LOG_WARN("Duplicate glyph found: ", e->name);
+        curGlyph = nullptr;
+        continue;
+      }
+
+      curGlyph = &_glyphs[AddGlyph(codepoint)];
+      curGlyph->outline = e;
     }
     else if (strcmp(e->name, "Cap 1") == 0)
     {
-      if (curLetter)
-        curLetter->cap1 = e;
+      if (curGlyph)
+        curGlyph->cap1 = e;
       else
-        LOG_WARN("Cap found without matching letter!");
+        LOG_WARN("Cap found without matching glyph!");
     }
     else if (strcmp(e->name, "Cap 2") == 0)
     {
-      if (curLetter)
-        curLetter->cap2 = e;
+      if (curGlyph)
+        curGlyph->cap2 = e;
       else
-        LOG_WARN("Cap found without matching letter!");
+        LOG_WARN("Cap found without matching glyph!");
     }
   }
 
-  for (size_t i = 0; i < _letters.size(); ++i)
+  // space only advances, unless the scene has a mesh for it
+  if (_glyphIndex[' '] == -1)
+    AddGlyph(' ');
+
+  for (Glyph& glyph : _glyphs)
   {
-    _letters[i].CalcBounds();
+    if (glyph.outline)
+    {
+      glyph.CalcBounds();
+      _lineHeight = max(_lineHeight, glyph.height);
+    }
+
+    // an explicit advance wins, also for space
+    auto it = _advanceByCodepoint.find(glyph.codepoint);
+    if (it != _advanceByCodepoint.end())
+      glyph.advance = it->second;
+    else
+      glyph.advance = glyph.outline ? glyph.width * _tracking : _spaceAdvance;
   }
 
-  return true;
+  // resolve case folding and the fallback up front, so Layout is a single lookup per
+  // character. Case folding goes first, so the fallback can be a letter that only has a
+  // glyph in the other case.
+  for (u32 i = 0; i < NUM_CODEPOINTS; ++i)
+  {
+    if (_glyphIndex[i] == -1 && isalpha(i))
+      _glyphIndex[i] = _glyphIndex[isupper(i) ? tolower(i) : toupper(i)];
+  }
+
+  int fallback = _fallback ? _glyphIndex[_fallback] : -1;
+  for (u32 i = ' '; i < NUM_CODEPOINTS; ++i)
+  {
+    if (_glyphIndex[i] == -1)
+      _glyphIndex[i] = fallback;
+  }
+
+  for (auto kv : _kerningByCodepoint)
+  {
+    int left = _glyphIndex[kv.first >> 8];
+    int right = _glyphIndex[kv.first & 0xff];
+    if (left != -1 && right != -1)
+      _kerning[(left << 16) | right] = kv.second;
+  }
+
+  for (int i = 0; i < NumSegments; ++i)
+    BuildSegmentCache((TextSegment)i);
 }
 
 //------------------------------------------------------------------------------
-void TextWriter::GenerateTris(const char* str, TextSegment segment, vector<vec3>* verts)
+void TextWriter::ResetMetrics()
 {
-  // split text into rows
-  vector<string> rows;
-  MakeRows(str, &rows);
-
-  vector<RowDim> lineInfo;
+  _spaceAdvance = 50;
+  _tracking = 1.15f;
+  _fallback = 0;
+  _advanceByCodepoint.clear();
+  _kerningByCodepoint.clear();
+}
 
-  vec3 vMin(+FLT_MAX, +FLT_MAX, +FLT_MAX);
-  vec3 vMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-  u32 vtxIdx = 0;
-  for (const string& str : rows)
+//------------------------------------------------------------------------------
+bool TextWriter::LoadMetrics(const char* filename)
+{
+  vector<char> buf;
+  if (!RESOURCE_MANAGER.LoadFile(filename, &buf))
   {
-    float xOfs = 0;
-    u32 curLen = (u32)str.size();
-    u32 triStart = (u32)verts->size();
-    for (u32 i = 0; i < curLen; ++i)
-    {
-      char ch = toupper(str[i]);
-
-      if (ch == ' ')
-      {
-        xOfs += 50;
-        continue;
-      }
-      else if (ch < 'A' || ch > 'Z')
-      {
-        continue;
-      }
-
-      const TextWriter::Letter& letter = _letters[ch - 'A'];
+    LOG_WARN("Unable to load glyph metrics: ", filename);
+    return false;
+  }
 
-      // Copy vertices to @tris
-      // The actual mesh data uses indices, so we expand those here
-      const protocol::MeshBlob* blobs[] = {letter.outline, letter.cap1, letter.cap2};
-      const protocol::MeshBlob* elem = blobs[(int)segment];
-      u32 numIndices = elem->numIndices;
-      verts->resize(verts->size() + numIndices);
-      for (u32 j = 0; j < numIndices; ++j)
-      {
-        int vertIdx = elem->indices[j] * 3;
-        vec3 v(elem->verts[vertIdx + 0] + xOfs, elem->verts[vertIdx + 1], elem->verts[vertIdx + 2]);
-        vMin = Min(v, vMin);
-        vMax = Max(v, vMax);
-        (*verts)[vtxIdx + j] = v;
-      }
+  return ParseMetrics(buf, filename);
+}
 
-      vtxIdx += numIndices;
+//------------------------------------------------------------------------------
+bool TextWriter::ParseMetrics(const vector<char>& buf, const char* filename)
+{
+  InputBuffer inputBuffer(buf);
+  while (true)
+  {
+    inputBuffer.SkipWhitespace();
+    if (inputBuffer.Eof())
+      break;
 
-      xOfs += letter.width * 1.15f;
+    string id = ParseIdentifier(inputBuffer);
+    inputBuffer.SkipWhitespace();
+    if (id == "space")
+    {
+      _spaceAdvance = ParseFloat(inputBuffer);
+    }
+    else if (id == "tracking")
+    {
+      _tracking = ParseFloat(inputBuffer);
+    }
+    else if (id == "fallback")
+    {
+      string str = ParseString(inputBuffer);
+      _fallback = str.size() == 1 ? (u8)str[0] : 0;
+    }
+    else if (id == "advance")
+    {
+      string str = ParseString(inputBuffer);
+      inputBuffer.SkipWhitespace();
+      float value = ParseFloat(inputBuffer);
+      if (str.size() == 1)
+        _advanceByCodepoint[(u8)str[0]] = value;
+    }
+    else if (id == "kern")
+    {
+      string str = ParseString(inputBuffer);
+      inputBuffer.SkipWhitespace();
+      float value = ParseFloat(inputBuffer);
+      if (str.size() == 2)
+        _kerningByCodepoint[((u8)str[0] << 8) | (u8)str[1]] = value;
+    }
+    else
+    {
+      LOG_WARN("Unknown glyph metric: ", id);
+      return false;
     }
 
-    lineInfo.push_back({triStart, (u32)verts->size(), vMin.x, vMax.x, vMin.y, vMax.y});
+    inputBuffer.SkipWhitespace();
+    inputBuffer.Expect(';');
+    if (!inputBuffer.Ok())
+    {
+      LOG_WARN("Error parsing ",
+          filename,
+          " in ",
+          inputBuffer.ErrorFunction(),
+          ", at offset ",
+          inputBuffer.ErrorOffset());
+      return false;
+    }
   }
 
-  float xStart = lineInfo[0].xMin;
-  float xEnd = lineInfo[0].xMax;
-  float ySize = 0;
-  for (size_t i = 1; i < lineInfo.size(); ++i)
-  {
-    xStart = min(xStart, lineInfo[i].xMin);
-    xEnd = max(xEnd, lineInfo[i].xMax);
-    ySize += lineInfo[i].yMax - lineInfo[i].yMin;
-  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+float TextWriter::Kerning(int left, int right) const
+{
+  if (_kerning.empty() || left == -1)
+    return 0;
 
-  float sx = xEnd - xStart;
-  float xCenter = sx / 2;
-  float yOfs = ySize / 2;
+  auto it = _kerning.find((left << 16) | right);
+  return it != _kerning.end() ? it->second : 0;
+}
+
+//------------------------------------------------------------------------------
+void TextWriter::BuildSegmentCache(TextSegment segment)
+{
+  SegmentCache& cache = _segments[segment];
+  cache.glyphs.resize(_glyphs.size());
+  vector<u32> glyphIndices;
 
-  for (const RowDim& row : lineInfo)
+  for (u32 i = 0; i < (u32)_glyphs.size(); ++i)
   {
-    float rx = row.xMax - row.xMin;
-    float ry = row.yMax - row.yMin;
-    float xRowOfs = (sx - rx) / 2;
+    const Glyph& g = _glyphs[i];
+    const protocol::MeshBlob* blobs[] = {g.outline, g.cap1, g.cap2};
+    const protocol::MeshBlob* elem = blobs[(int)segment];
+    GlyphMesh& glyph = cache.glyphs[i];
+    glyph.triStart = (u32)cache.tris.size();
+    glyph.vtxStart = (u32)cache.verts.size();
+    glyph.idxStart = (u32)cache.indices.size();
+    glyph.edgeStart = (u32)cache.edges.size();
+    if (!elem)
+      continue;
+
+    glyph.numTriVerts = elem->numIndices;
+    glyph.numVerts = elem->numVerts;
+    glyph.numIndices = elem->numIndices;
+    glyph.numEdges = elem->numSelectedEdges;
+
+    vec3 vMin(+FLT_MAX, +FLT_MAX, +FLT_MAX);
+    vec3 vMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (u32 j = 0; j < elem->numVerts; ++j)
+    {
+      vec3 v(elem->verts[j * 3 + 0], elem->verts[j * 3 + 1], elem->verts[j * 3 + 2]);
+      cache.verts.push_back(v);
+      vMin = Min(v, vMin);
+      vMax = Max(v, vMax);
+    }
 
-    // loop over all the verts and center the text
-    if (verts)
+    // Only the triangle order is optimized, as the selected edges index into the
+    // vertices, so they keep their order
+    glyphIndices.assign(elem->indices, elem->indices + elem->numIndices);
+    OptimizeVertexCache(glyphIndices.data(), elem->numIndices, elem->numVerts);
+    OptimizeOverdraw(
+        glyphIndices.data(), elem->numIndices, elem->verts, 3 * sizeof(float), elem->numVerts);
+
+    // the actual mesh data uses indices, so the expanded version is stored as well
+    for (u32 idx : glyphIndices)
     {
-      for (u32 i = row.triStart, e = row.triEnd; i < e; ++i)
-      {
-        (*verts)[i].x -= (xCenter - xRowOfs);
-        // we first center the text around its local origin, and then move it
-        // to the correct global position
-        (*verts)[i].y += -ry / 2 + yOfs;
-      }
+      cache.indices.push_back(idx);
+      cache.tris.push_back(cache.verts[glyph.vtxStart + idx]);
     }
 
-    yOfs -= ry;
+    cache.edges.insert(
+        cache.edges.end(), elem->selectedEdges, elem->selectedEdges + elem->numSelectedEdges);
+
+    if (elem->numVerts)
+    {
+      glyph.xMin = vMin.x;
+      glyph.xMax = vMax.x;
+      glyph.yMin = vMin.y;
+      glyph.yMax = vMax.y;
+    }
   }
 }
 
 //------------------------------------------------------------------------------
-void TextWriter::GenerateIndexedTris(
-    const char* str, TextSegment segment, vector<vec3>* verts, vector<int>* indices, vector<u32>* edges)
+void TextWriter::Layout(const char* str, TextSegment segment, vector<GlyphInstance>* glyphs)
 {
+  const SegmentCache& cache = _segments[segment];
 
-  vector<string> rows;
-  MakeRows(str, &rows);
-
-  vector<RowDim> lineInfo;
+  glyphs->clear();
+  _rows.clear();
 
-  vec3 vMin(+FLT_MAX, +FLT_MAX, +FLT_MAX);
-  vec3 vMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-  for (const string& str : rows)
+  RowDim row = {0, 0, +FLT_MAX, -FLT_MAX, +FLT_MAX, -FLT_MAX};
+  float xOfs = 0;
+  int prev = -1;
+  for (const char* cur = str;; ++cur)
   {
-    float xOfs = 0;
-    u32 curLen = (u32)str.size();
-    u32 triStart = (u32)verts->size();
-    for (u32 i = 0; i < curLen; ++i)
+    if (*cur == '\n' || *cur == 0)
     {
-      char ch = toupper(str[i]);
+      row.glyphEnd = (u32)glyphs->size();
+      _rows.push_back(row);
+      if (*cur == 0)
+        break;
 
-      if (ch == ' ')
-      {
-        xOfs += 50;
-        continue;
-      }
-      else if (ch < 'A' || ch > 'Z')
-      {
-        continue;
-      }
+      row = {row.glyphEnd, 0, +FLT_MAX, -FLT_MAX, +FLT_MAX, -FLT_MAX};
+      xOfs = 0;
+      prev = -1;
+      continue;
+    }
 
-      const TextWriter::Letter& letter = _letters[ch - 'A'];
-      const protocol::MeshBlob* blobs[] = {letter.outline, letter.cap1, letter.cap2};
-      const protocol::MeshBlob* elem = blobs[(int)segment];
+    int idx = _glyphIndex[(u8)*cur];
+    if (idx == -1)
+      continue;
 
-      // copy verts/indices
-      u32 numIndices = elem->numIndices;
-      u32 prevIndices = (u32)indices->size();
-      u32 numVerts = elem->numVerts;
-      u32 prevVerts = (u32)verts->size();
-      indices->resize(indices->size() + numIndices);
-      verts->resize(verts->size() + numVerts);
+    xOfs += Kerning(prev, idx);
+    prev = idx;
 
-      if (edges)
-      {
-        size_t prev = edges->size();
-        u32 num = elem->numSelectedEdges;
-        edges->resize(prev + num);
-        for (u32 j = 0; j < num; ++j)
-        {
-          (*edges)[j + prev] = elem->selectedEdges[j] + prevVerts;
-        }
-      }
+    // glyphs without a mesh, like space, only advance
+    const GlyphMesh& glyph = cache.glyphs[idx];
+    if (glyph.numVerts)
+    {
+      glyphs->push_back(GlyphInstance{vec3(xOfs, 0, 0), (u32)idx});
 
-      for (u32 j = 0; j < numIndices; ++j)
-      {
-        (*indices)[j + prevIndices] = elem->indices[j] + prevVerts;
-      }
+      row.xMin = min(row.xMin, xOfs + glyph.xMin);
+      row.xMax = max(row.xMax, xOfs + glyph.xMax);
+      row.yMin = min(row.yMin, glyph.yMin);
+      row.yMax = max(row.yMax, glyph.yMax);
+    }
 
-      // get max vertex dimensions
-      for (u32 j = 0; j < numVerts; ++j)
-      {
-        vec3 v(elem->verts[j * 3 + 0] + xOfs, elem->verts[j * 3 + 1], elem->verts[j * 3 + 2]);
-        (*verts)[j + prevVerts] = v;
-        vMin = Min(v, vMin);
-        vMax = Max(v, vMax);
-      }
+    xOfs += _glyphs[idx].advance;
+  }
+
+  float height = 0;
+  for (const RowDim& row : _rows)
+    height += row.glyphStart != row.glyphEnd ? row.yMax - row.yMin : _lineHeight;
 
-      xOfs += letter.width * 1.15f;
+  // center each row on x, and stack them top to bottom, centered on y
+  float yTop = height / 2;
+  for (const RowDim& row : _rows)
+  {
+    if (row.glyphStart == row.glyphEnd)
+    {
+      yTop -= _lineHeight;
+      continue;
     }
 
-    lineInfo.push_back({triStart, (u32)verts->size(), vMin.x, vMax.x, vMin.y, vMax.y});
+    float ry = row.yMax - row.yMin;
+    vec3 ofs(-(row.xMin + row.xMax) / 2, yTop - ry / 2 - (row.yMin + row.yMax) / 2, 0);
+    for (u32 i = row.glyphStart; i < row.glyphEnd; ++i)
+      (*glyphs)[i].pos += ofs;
+
+    yTop -= ry;
   }
+}
 
-  float xStart = lineInfo[0].xMin;
-  float xEnd = lineInfo[0].xMax;
-  float ySize = 0;
-  for (size_t i = 1; i < lineInfo.size(); ++i)
+//------------------------------------------------------------------------------
+void TextWriter::GenerateTris(const char* str, TextSegment segment, vector<vec3>* verts)
+{
+  const SegmentCache& cache = _segments[segment];
+  Layout(str, segment, &_layout);
+
+  u32 numVerts = 0;
+  for (const GlyphInstance& g : _layout)
+    numVerts += cache.glyphs[g.glyph].numTriVerts;
+
+  u32 vtxIdx = (u32)verts->size();
+  verts->resize(vtxIdx + numVerts);
+  vec3* dst = verts->data() + vtxIdx;
+
+  for (const GlyphInstance& g : _layout)
   {
-    xStart = min(xStart, lineInfo[i].xMin);
-    xEnd = max(xEnd, lineInfo[i].xMax);
-    ySize += lineInfo[i].yMax - lineInfo[i].yMin;
+    const GlyphMesh& glyph = cache.glyphs[g.glyph];
+    const vec3* src = cache.tris.data() + glyph.triStart;
+    for (u32 j = 0; j < glyph.numTriVerts; ++j)
+      dst[j] = src[j] + g.pos;
+    dst += glyph.numTriVerts;
   }
+}
 
-  float sx = xEnd - xStart;
-  float xCenter = sx / 2;
-  float yOfs = ySize / 2;
+//------------------------------------------------------------------------------
+void TextWriter::GenerateIndexedTris(
+    const char* str, TextSegment segment, vector<vec3>* verts, vector<int>* indices, vector<u32>* edges)
+{
+  const SegmentCache& cache = _segments[segment];
+  Layout(str, segment, &_layout);
 
-  for (const RowDim& row : lineInfo)
+  u32 numVerts = 0, numIndices = 0, numEdges = 0;
+  for (const GlyphInstance& g : _layout)
   {
-    float rx = row.xMax - row.xMin;
-    float ry = row.yMax - row.yMin;
-    float xRowOfs = (sx - rx) / 2;
+    const GlyphMesh& glyph = cache.glyphs[g.glyph];
+    numVerts += glyph.numVerts;
+    numIndices += glyph.numIndices;
+    numEdges += glyph.numEdges;
+  }
+
+  u32 vtxIdx = (u32)verts->size();
+  u32 idxIdx = (u32)indices->size();
+  u32 edgeIdx = edges ? (u32)edges->size() : 0;
+  verts->resize(vtxIdx + numVerts);
+  indices->resize(idxIdx + numIndices);
+  if (edges)
+    edges->resize(edgeIdx + numEdges);
+
+  for (const GlyphInstance& g : _layout)
+  {
+    const GlyphMesh& glyph = cache.glyphs[g.glyph];
+
+    vec3* dstVerts = verts->data() + vtxIdx;
+    const vec3* srcVerts = cache.verts.data() + glyph.vtxStart;
+    for (u32 j = 0; j < glyph.numVerts; ++j)
+      dstVerts[j] = srcVerts[j] + g.pos;
+
+    int* dstIndices = indices->data() + idxIdx;
+    const int* srcIndices = cache.indices.data() + glyph.idxStart;
+    for (u32 j = 0; j < glyph.numIndices; ++j)
+      dstIndices[j] = srcIndices[j] + vtxIdx;
 
-    // loop over all the verts and center the text
-    for (u32 i = row.triStart, e = row.triEnd; i < e; ++i)
+    if (edges)
     {
-      (*verts)[i].x -= (xCenter - xRowOfs);
-      // we first center the text around its local origin, and then move it
-      // to the correct global position
-      (*verts)[i].y += -ry / 2 + yOfs;
+      u32* dstEdges = edges->data() + edgeIdx;
+      const u32* srcEdges = cache.edges.data() + glyph.edgeStart;
+      for (u32 j = 0; j < glyph.numEdges; ++j)
+        dstEdges[j] = srcEdges[j] + vtxIdx;
+      edgeIdx += glyph.numEdges;
     }
 
-    yOfs -= ry;
+    vtxIdx += glyph.numVerts;
+    idxIdx += glyph.numIndices;
   }
 }
@@ -4,6 +4,15 @@
 
 namespace tano
 {
+  // Builds text from a scene where each glyph is a mesh named after its character,
+  // followed by its "Cap 1" and "Cap 2" meshes.
+  //
+  // An optional metrics file tweaks the spacing, with statements like:
+  //   space: 50;
+  //   tracking: 1.15;       (default advance, as a multiple of the glyph's width)
+  //   fallback: '?';        (used for characters without a glyph)
+  //   advance: 'W' 140;     (also for ' ', over the space advance)
+  //   kern: 'AV' -12;
   struct TextWriter
   {
     enum TextSegment
@@ -11,10 +20,54 @@ namespace tano
       TextOutline,
       TextCap1,
       TextCap2,
+      NumSegments,
     };
 
-    bool Init(const char* filename);
+    // The glyphs are looked up by byte, so only 8-bit text is supported. A UTF-8 string
+    // gets one glyph (or fallback) for each byte of a multibyte character.
+    enum { NUM_CODEPOINTS = 256 };
 
+    // Placement of a single glyph. Layout only produces these, so the text can be drawn
+    // as instances of the cached glyph meshes, or expanded into a single mesh.
+    struct GlyphInstance
+    {
+      vec3 pos;
+      u32 glyph;
+    };
+
+    // A glyph's range in the segment's cached buffers
+    struct GlyphMesh
+    {
+      u32 triStart = 0, numTriVerts = 0;
+      u32 vtxStart = 0, numVerts = 0;
+      u32 idxStart = 0, numIndices = 0;
+      u32 edgeStart = 0, numEdges = 0;
+      float xMin = 0, xMax = 0;
+      float yMin = 0, yMax = 0;
+    };
+
+    // The glyph meshes for one segment, built once in Init. 'tris' holds the expanded
+    // triangles, and 'verts', 'indices' and 'edges' the indexed version, with the indices
+    // and edges relative to the glyph's first vertex.
+    struct SegmentCache
+    {
+      vector<vec3> tris;
+      vector<vec3> verts;
+      vector<int> indices;
+      vector<u32> edges;
+      vector<GlyphMesh> glyphs;
+    };
+
+    // Can be called again to reload the font, which replaces all the glyphs and metrics
+    bool Init(const char* filename, const char* metricsFile = nullptr);
+    // Builds the glyphs and segment caches from loaded meshes, using the current metrics
+    void InitGlyphs(const vector<protocol::MeshBlob*>& meshes);
+
+    // Centers each row horizontally, and the rows as a block around the origin. Reuses
+    // the memory in 'glyphs'.
+    void Layout(const char* str, TextSegment segment, vector<GlyphInstance>* glyphs);
+
+    // Expand the layout into a mesh. The output vectors are appended to.
     void GenerateTris(const char* str, TextSegment segment, vector<vec3>* verts);
     void GenerateIndexedTris(const char* str,
         TextSegment segment,
@@ -22,18 +75,59 @@ namespace tano
         vector<int>* indices,
         vector<u32>* edges = nullptr);
 
-    struct Letter
+    const SegmentCache& Segment(TextSegment segment) const { return _segments[segment]; }
+
+    struct Glyph
     {
       void CalcBounds();
+      u32 codepoint = 0;
       float width = 0;
       float height = 0;
+      float advance = 0;
       protocol::MeshBlob* outline = nullptr;
       protocol::MeshBlob* cap1 = nullptr;
       protocol::MeshBlob* cap2 = nullptr;
     };
 
-    vector<Letter> _letters;
+    struct RowDim
+    {
+      u32 glyphStart, glyphEnd;
+      float xMin, xMax;
+      float yMin, yMax;
+    };
+
+    void ResetMetrics();
+    bool LoadMetrics(const char* filename);
+    // 'filename' is only used for the error messages
+    bool ParseMetrics(const vector<char>& buf, const char* filename);
+    void BuildSegmentCache(TextSegment segment);
+    int AddGlyph(u32 codepoint);
+    float Kerning(int left, int right) const;
+
+    vector<Glyph> _glyphs;
     MeshLoader _loader;
+
+    // glyph by codepoint, with case folding and the fallback resolved at load. -1 for
+    // characters that are skipped
+    int _glyphIndex[NUM_CODEPOINTS];
+
+    // kerning by (left glyph << 16 | right glyph)
+    unordered_map<u32, float> _kerning;
+
+    // from the metrics file
+    float _spaceAdvance = 50;
+    float _tracking = 1.15f;
+    u32 _fallback = 0;
+    unordered_map<u32, float> _advanceByCodepoint;
+    unordered_map<u32, float> _kerningByCodepoint;
+
+    SegmentCache _segments[NumSegments];
+    // height of empty rows
+    float _lineHeight = 0;
+
+    // scratch space for Layout and the Generate functions
+    vector<RowDim> _rows;
+    vector<GlyphInstance> _layout;
   };
 
 }
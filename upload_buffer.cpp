@@ -0,0 +1,169 @@
+#include "upload_buffer.hpp"
+#include "graphics.hpp"
+#include "graphics_context.hpp"
+
+using namespace tano;
+using namespace bristol;
+
+namespace tano
+{
+  UploadBuffer g_DynamicVertices;
+  UploadBuffer g_DynamicIndices;
+}
+
+//------------------------------------------------------------------------------
+bool UploadBuffer::Create(D3D11_BIND_FLAG bind, u32 size)
+{
+  assert(bind == D3D11_BIND_VERTEX_BUFFER || bind == D3D11_BIND_INDEX_BUFFER);
+
+  _bind = bind;
+  _capacity = size;
+  _buffer = g_Graphics->CreateBuffer(
+      bind, size, true, nullptr, bind == D3D11_BIND_INDEX_BUFFER ? DXGI_FORMAT_R32_UINT : 4);
+  if (!_buffer.IsValid())
+  {
+    LOG_ERROR("Unable to create upload buffer of ", size, " bytes");
+    return false;
+  }
+
+  CD3D11_QUERY_DESC desc(D3D11_QUERY_EVENT);
+  for (Fence& fence : _fences)
+  {
+    if (FAILED(g_Graphics->Device()->CreateQuery(&desc, &fence.query)))
+    {
+      LOG_ERROR("Unable to create upload buffer fence");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void UploadBuffer::Destroy()
+{
+  for (Fence& fence : _fences)
+    fence.query.Release();
+  _numFences = 0;
+}
+
+//------------------------------------------------------------------------------
+u64 UploadBuffer::Tail() const
+{
+  // the oldest data the GPU might still be reading
+  return _numFences ? _fences[_firstFence].start : _frameStart;
+}
+
+//------------------------------------------------------------------------------
+void UploadBuffer::RetireFences(GraphicsContext* ctx, bool wait)
+{
+  if (wait && _numFences)
+  {
+    ++_numStalls;
+    while (!ctx->FenceReached(_fences[_firstFence].query))
+      YieldProcessor();
+    _firstFence = (_firstFence + 1) % MAX_FRAMES_IN_FLIGHT;
+    --_numFences;
+  }
+
+  while (_numFences && ctx->FenceReached(_fences[_firstFence].query, false))
+  {
+    _firstFence = (_firstFence + 1) % MAX_FRAMES_IN_FLIGHT;
+    --_numFences;
+  }
+}
+
+//------------------------------------------------------------------------------
+UploadRange UploadBuffer::Map(GraphicsContext* ctx, u32 count, u32 stride)
+{
+  assert(!_mapped);
+  assert(stride > 0);
+
+  // nothing to draw isn't an error, so callers don't all have to check for it
+  u32 size = count * stride;
+  if (size == 0)
+    return UploadRange();
+
+  if (size > _capacity)
+  {
+    LOG_WARN("Invalid upload buffer allocation of ", size, " bytes");
+    return UploadRange();
+  }
+
+  // The range is addressed in elements, so align it to the stride. Allocations don't
+  // wrap, so skip to the start of the buffer if this one would cross the end.
+  u64 ofs = _head % _capacity;
+  u64 lapStart = _head - ofs;
+  u64 alignedOfs = (ofs + stride - 1) / stride * stride;
+  u64 start = alignedOfs + size <= _capacity ? lapStart + alignedOfs : lapStart + _capacity;
+  u64 end = start + size;
+
+  // wait until the GPU is done with the space we're about to overwrite
+  if (end - Tail() > _capacity)
+  {
+    RetireFences(ctx, false);
+    while (end - Tail() > _capacity)
+    {
+      if (_numFences == 0)
+      {
+        LOG_WARN("Upload buffer full. A single frame can't allocate more than ",
+            _capacity, " bytes");
+        return UploadRange();
+      }
+      RetireFences(ctx, true);
+    }
+  }
+
+  D3D11_MAPPED_SUBRESOURCE res;
+  D3D11_MAP mapType = _discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+  if (FAILED(ctx->Map(_buffer, 0, mapType, 0, &res)))
+    return UploadRange();
+
+  _discard = false;
+  _mapped = true;
+  _head = end;
+
+  u32 data = stride;
+  if (_bind == D3D11_BIND_INDEX_BUFFER)
+  {
+    assert(stride == 2 || stride == 4);
+    data = stride == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+  }
+
+  UploadRange range;
+  range.handle = _buffer.WithData(data);
+  range.offset = (u32)(start % _capacity);
+  range.firstElement = range.offset / stride;
+  range.size = size;
+  range.ptr = (u8*)res.pData + range.offset;
+  return range;
+}
+
+//------------------------------------------------------------------------------
+void UploadBuffer::Unmap(GraphicsContext* ctx, const UploadRange& range)
+{
+  assert(_mapped);
+  ctx->Unmap(_buffer);
+  _mapped = false;
+}
+
+//------------------------------------------------------------------------------
+void UploadBuffer::EndFrame(GraphicsContext* ctx)
+{
+  assert(!_mapped);
+
+  if (_head != _frameStart)
+  {
+    // all the fences are in use, so wait for the oldest one
+    if (_numFences == MAX_FRAMES_IN_FLIGHT)
+      RetireFences(ctx, true);
+
+    Fence& fence = _fences[(_firstFence + _numFences) % MAX_FRAMES_IN_FLIGHT];
+    fence.start = _frameStart;
+    ctx->IssueFence(fence.query);
+    ++_numFences;
+    _frameStart = _head;
+  }
+
+  RetireFences(ctx, false);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "object_handle.hpp"
+
+namespace tano
+{
+  class GraphicsContext;
+
+  // A sub-allocation from an UploadBuffer. 'handle' refers to the shared buffer, but
+  // carries this allocation's stride (or index format), so it can be bound directly, and
+  // drawn with 'firstElement' as the start vertex or index.
+  struct UploadRange
+  {
+    bool IsValid() const { return ptr != nullptr; }
+
+    ObjectHandle handle;
+    u32 offset = 0;
+    u32 firstElement = 0;
+    u32 size = 0;
+    void* ptr = nullptr;
+  };
+
+  // One large dynamic buffer that's shared by all the effects. Allocations are made
+  // linearly through the buffer, and mapped with NO_OVERWRITE, so the GPU can keep
+  // reading older parts while new ones are written. EndFrame puts a fence after each
+  // frame's allocations, and when the buffer wraps around, the space is only reused once
+  // the fence for the frame that wrote it has been reached.
+  //
+  // Only one range can be mapped at a time, but the pointer can be handed to tasks, so
+  // map enough for all of them up front, and unmap once they're done, before drawing.
+  class UploadBuffer
+  {
+  public:
+    enum { MAX_FRAMES_IN_FLIGHT = 4 };
+
+    bool Create(D3D11_BIND_FLAG bind, u32 size);
+    void Destroy();
+
+    // For index buffers, 'stride' must be 2 or 4. Returns an invalid range if 'count' is
+    // 0, or if the allocation doesn't fit.
+    UploadRange Map(GraphicsContext* ctx, u32 count, u32 stride);
+    void Unmap(GraphicsContext* ctx, const UploadRange& range);
+
+    template <typename T>
+    T* Map(GraphicsContext* ctx, u32 count, UploadRange* range)
+    {
+      *range = Map(ctx, count, sizeof(T));
+      return (T*)range->ptr;
+    }
+
+    // Call once per frame, after Present
+    void EndFrame(GraphicsContext* ctx);
+
+    u32 Capacity() const { return _capacity; }
+    // number of times a Map had to wait for the GPU
+    u32 NumStalls() const { return _numStalls; }
+
+  private:
+    struct Fence
+    {
+      CComPtr<ID3D11Query> query;
+      // where the frame's allocations start
+      u64 start = 0;
+    };
+
+    u64 Tail() const;
+    void RetireFences(GraphicsContext* ctx, bool wait);
+
+    ObjectHandle _buffer;
+    D3D11_BIND_FLAG _bind = D3D11_BIND_VERTEX_BUFFER;
+    u32 _capacity = 0;
+
+    // Positions grow forever, and the offset in the buffer is the position modulo the
+    // capacity, so the space in use is just _head - Tail()
+    u64 _head = 0;
+    u64 _frameStart = 0;
+
+    Fence _fences[MAX_FRAMES_IN_FLIGHT];
+    int _firstFence = 0;
+    int _numFences = 0;
+
+    bool _mapped = false;
+    // the first map of a buffer has to discard
+    bool _discard = true;
+    u32 _numStalls = 0;
+  };
+
+  // Shared upload buffers for dynamic vertices and indices
+  extern UploadBuffer g_DynamicVertices;
+  extern UploadBuffer g_DynamicIndices;
+}
@@ -0,0 +1,305 @@
+#include "verlet.hpp"
+#include "scheduler.hpp"
+#include <emmintrin.h>
+
+using namespace tano;
+using namespace tano::scheduler;
+using namespace bristol;
+
+namespace
+{
+  // Colours smaller than 2 tasks worth of batches are relaxed inline
+  const int MIN_BATCHES_PER_TASK = 32;
+  const int MAX_TASKS_PER_COLOUR = 64;
+
+  const float MIN_DIST = 0.001f;
+  const float MIN_REST_LENGTH = 1e-6f;
+
+  //------------------------------------------------------------------------------
+  // Loads the positions of 4 particles, transposed to x, y and z vectors. The 4th
+  // float loaded is lastPos.x, which is ignored.
+  inline void GatherPos(const VerletSystem::Particle* particles,
+      const u32* idx,
+      __m128* x,
+      __m128* y,
+      __m128* z)
+  {
+    __m128 p0 = _mm_loadu_ps(&particles[idx[0]].pos.x);
+    __m128 p1 = _mm_loadu_ps(&particles[idx[1]].pos.x);
+    __m128 p2 = _mm_loadu_ps(&particles[idx[2]].pos.x);
+    __m128 p3 = _mm_loadu_ps(&particles[idx[3]].pos.x);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    *x = p0;
+    *y = p1;
+    *z = p2;
+  }
+
+  //------------------------------------------------------------------------------
+  inline float RelaxConstraint(VerletSystem::Particle* particles, const VerletSystem::Constraint& c)
+  {
+    vec3& p0 = particles[c.idx0].pos;
+    vec3& p1 = particles[c.idx1].pos;
+
+    vec3 v = p1 - p0;
+    float dist = max(MIN_DIST, Length(v));
+    vec3 dir = 0.5f * (1 - c.restLength / dist) * v;
+    p0 += dir;
+    p1 -= dir;
+    return fabsf(dist - c.restLength) / max(MIN_REST_LENGTH, c.restLength);
+  }
+}
+
+//------------------------------------------------------------------------------
+void VerletSystem::Create(int numParticles)
+{
+  _particles.resize(numParticles);
+  _batches.clear();
+  _colours.clear();
+  _taskData.clear();
+  _remainder.clear();
+  _numConstraints = 0;
+}
+
+//------------------------------------------------------------------------------
+void tano::BatchConstraints(const VerletSystem::Constraint* constraints,
+    int numConstraints,
+    int numParticles,
+    int batchWidth,
+    ConstraintBatching* out)
+{
+  out->order.clear();
+  out->colourStart.clear();
+  out->order.reserve(numConstraints);
+
+  vector<int> pending;
+  pending.reserve(numConstraints);
+  for (int i = 0; i < numConstraints; ++i)
+  {
+    if (constraints[i].idx0 != constraints[i].idx1)
+      pending.push_back(i);
+  }
+
+  // Each round makes one colour, taking every pending constraint whose particles haven't
+  // been used in the round yet, so a round is a single pass over the pending list. The
+  // colour is trimmed to a multiple of batchWidth, with the trimmed constraints retried
+  // in the next round.
+  vector<int> lastColour(numParticles, -1);
+  vector<int> deferred;
+  deferred.reserve(numConstraints);
+
+  for (int colour = 0; (int)pending.size() >= batchWidth; ++colour)
+  {
+    int start = (int)out->order.size();
+    deferred.clear();
+    for (int idx : pending)
+    {
+      const VerletSystem::Constraint& c = constraints[idx];
+      if (lastColour[c.idx0] == colour || lastColour[c.idx1] == colour)
+      {
+        deferred.push_back(idx);
+        continue;
+      }
+
+      lastColour[c.idx0] = colour;
+      lastColour[c.idx1] = colour;
+      out->order.push_back(idx);
+    }
+
+    int numFull = ((int)out->order.size() - start) / batchWidth * batchWidth;
+    for (int i = start + numFull; i < (int)out->order.size(); ++i)
+      deferred.push_back(out->order[i]);
+    out->order.resize(start + numFull);
+
+    // no full batch could be made, so whatever is left is the remainder
+    if (numFull == 0)
+      break;
+
+    out->colourStart.push_back(start);
+    pending.swap(deferred);
+  }
+
+  out->colourStart.push_back((int)out->order.size());
+  out->order.insert(out->order.end(), pending.begin(), pending.end());
+}
+
+//------------------------------------------------------------------------------
+void VerletSystem::SetConstraints(const Constraint* constraints, int numConstraints)
+{
+  _batches.clear();
+  _colours.clear();
+  _taskData.clear();
+  _remainder.clear();
+
+  ConstraintBatching batching;
+  BatchConstraints(constraints, numConstraints, (int)_particles.size(), BATCH_WIDTH, &batching);
+  _numConstraints = (int)batching.order.size();
+
+  int numColours = batching.NumColours();
+  _batches.resize(batching.colourStart[numColours] / BATCH_WIDTH);
+  for (int i = 0; i < numColours; ++i)
+  {
+    int first = batching.colourStart[i];
+    int end = batching.colourStart[i + 1];
+    _colours.push_back(Colour{first / BATCH_WIDTH, (end - first) / BATCH_WIDTH, 0, 0});
+  }
+
+  for (int i = 0; i < batching.colourStart[numColours]; ++i)
+  {
+    const Constraint& c = constraints[batching.order[i]];
+    Batch& batch = _batches[i / BATCH_WIDTH];
+    batch.idx0[i % BATCH_WIDTH] = c.idx0;
+    batch.idx1[i % BATCH_WIDTH] = c.idx1;
+    batch.restLength[i % BATCH_WIDTH] = c.restLength;
+  }
+
+  for (int i = batching.colourStart[numColours]; i < (int)batching.order.size(); ++i)
+    _remainder.push_back(constraints[batching.order[i]]);
+
+  // split the larger colours into tasks
+  for (Colour& colour : _colours)
+  {
+    if (colour.numBatches < 2 * MIN_BATCHES_PER_TASK)
+      continue;
+
+    int numTasks = min(MAX_TASKS_PER_COLOUR, colour.numBatches / MIN_BATCHES_PER_TASK);
+    int batchesPerTask = (colour.numBatches + numTasks - 1) / numTasks;
+    colour.firstTask = (int)_taskData.size();
+    for (int i = 0; i < colour.numBatches; i += batchesPerTask)
+    {
+      int end = min(i + batchesPerTask, colour.numBatches);
+      _taskData.push_back(
+          RelaxKernelData{nullptr, colour.firstBatch + i, colour.firstBatch + end, 0});
+    }
+    colour.numTasks = (int)_taskData.size() - colour.firstTask;
+  }
+}
+
+//------------------------------------------------------------------------------
+void VerletSystem::Integrate(float dt, float damping, const vec3& force)
+{
+  float dt2 = dt * dt;
+  float k = 1.0f - damping;
+  for (Particle& p : _particles)
+  {
+    vec3 tmp = p.pos;
+    p.pos += k * (p.pos - p.lastPos) + dt2 * (p.acc + force);
+    p.lastPos = tmp;
+    p.acc = vec3(0, 0, 0);
+  }
+}
+
+//------------------------------------------------------------------------------
+float VerletSystem::RelaxBatches(int firstBatch, int endBatch)
+{
+  Particle* particles = _particles.data();
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 minDist = _mm_set1_ps(MIN_DIST);
+  const __m128 minRest = _mm_set1_ps(MIN_REST_LENGTH);
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 maxError = _mm_setzero_ps();
+
+  for (int b = firstBatch; b < endBatch; ++b)
+  {
+    const Batch& batch = _batches[b];
+    for (int ofs = 0; ofs < BATCH_WIDTH; ofs += 4)
+    {
+      __m128 x0, y0, z0, x1, y1, z1;
+      GatherPos(particles, batch.idx0 + ofs, &x0, &y0, &z0);
+      GatherPos(particles, batch.idx1 + ofs, &x1, &y1, &z1);
+
+      __m128 vx = _mm_sub_ps(x1, x0);
+      __m128 vy = _mm_sub_ps(y1, y0);
+      __m128 vz = _mm_sub_ps(z1, z0);
+      __m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+          _mm_mul_ps(vz, vz));
+      __m128 dist = _mm_max_ps(minDist, _mm_sqrt_ps(lenSq));
+      __m128 rest = _mm_loadu_ps(batch.restLength + ofs);
+
+      __m128 err = _mm_div_ps(
+          _mm_and_ps(absMask, _mm_sub_ps(dist, rest)), _mm_max_ps(minRest, rest));
+      maxError = _mm_max_ps(maxError, err);
+
+      __m128 s = _mm_mul_ps(half, _mm_sub_ps(one, _mm_div_ps(rest, dist)));
+      __m128 dx = _mm_mul_ps(s, vx);
+      __m128 dy = _mm_mul_ps(s, vy);
+      __m128 dz = _mm_mul_ps(s, vz);
+      __m128 dw = _mm_setzero_ps();
+      _MM_TRANSPOSE4_PS(dx, dy, dz, dw);
+      __m128 dirs[4] = { dx, dy, dz, dw };
+
+      // the w component of each dir is 0, so lastPos.x is written back unchanged
+      for (int i = 0; i < 4; ++i)
+      {
+        float* p0 = &particles[batch.idx0[ofs + i]].pos.x;
+        float* p1 = &particles[batch.idx1[ofs + i]].pos.x;
+        _mm_storeu_ps(p0, _mm_add_ps(_mm_loadu_ps(p0), dirs[i]));
+        _mm_storeu_ps(p1, _mm_sub_ps(_mm_loadu_ps(p1), dirs[i]));
+      }
+    }
+  }
+
+  float tmp[4];
+  _mm_storeu_ps(tmp, maxError);
+  return max(max(tmp[0], tmp[1]), max(tmp[2], tmp[3]));
+}
+
+//------------------------------------------------------------------------------
+float VerletSystem::RelaxRemainder()
+{
+  float maxError = 0;
+  for (const Constraint& c : _remainder)
+    maxError = max(maxError, RelaxConstraint(_particles.data(), c));
+  return maxError;
+}
+
+//------------------------------------------------------------------------------
+void VerletSystem::RelaxKernel(const TaskData& data)
+{
+  RelaxKernelData* k = (RelaxKernelData*)data.kernelData.data;
+  k->maxError = k->system->RelaxBatches(k->firstBatch, k->endBatch);
+}
+
+//------------------------------------------------------------------------------
+int VerletSystem::Relax(int maxIterations, float tolerance)
+{
+  for (int iter = 0; iter < maxIterations; ++iter)
+  {
+    float maxError = 0;
+    for (const Colour& colour : _colours)
+    {
+      if (colour.numTasks == 0)
+      {
+        maxError =
+            max(maxError, RelaxBatches(colour.firstBatch, colour.firstBatch + colour.numBatches));
+        continue;
+      }
+
+      // the colours have to be done in order, so wait for each one to finish
+      SimpleAppendBuffer<TaskId, MAX_TASKS_PER_COLOUR> tasks;
+      for (int i = 0; i < colour.numTasks; ++i)
+      {
+        // set here rather than in SetConstraints, as the system might have been copied
+        RelaxKernelData* data = &_taskData[colour.firstTask + i];
+        data->system = this;
+
+        KernelData kd;
+        kd.data = data;
+        kd.size = sizeof(RelaxKernelData);
+        tasks.Append(g_Scheduler->AddTask(kd, RelaxKernel));
+      }
+
+      for (const TaskId& taskId : tasks)
+        g_Scheduler->Wait(taskId);
+
+      for (int i = 0; i < colour.numTasks; ++i)
+        maxError = max(maxError, _taskData[colour.firstTask + i].maxError);
+    }
+
+    maxError = max(maxError, RelaxRemainder());
+    if (maxError <= tolerance)
+      return iter + 1;
+  }
+
+  return maxIterations;
+}
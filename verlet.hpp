@@ -0,0 +1,110 @@
+#pragma once
+
+namespace tano
+{
+  namespace scheduler
+  {
+    struct TaskData;
+  }
+
+  //------------------------------------------------------------------------------
+  // Verlet integrated particles held together by distance constraints.
+  // The constraints are coloured with BatchConstraints, which lets a colour be relaxed
+  // BATCH_WIDTH constraints at a time, and large colours be split across scheduler tasks.
+  class VerletSystem
+  {
+  public:
+    struct Particle
+    {
+      vec3 pos;
+      vec3 lastPos;
+      vec3 acc;
+    };
+
+    struct Constraint
+    {
+      u32 idx0;
+      u32 idx1;
+      float restLength;
+    };
+
+    enum { BATCH_WIDTH = 8 };
+
+    void Create(int numParticles);
+
+    // Batches the constraints with BatchConstraints
+    void SetConstraints(const Constraint* constraints, int numConstraints);
+
+    // Integrates using the per particle acceleration plus 'force', and clears the
+    // accumulated acceleration
+    void Integrate(float dt, float damping, const vec3& force);
+
+    // Relaxes the constraints until the largest relative length error seen during a
+    // pass is below 'tolerance', or for at most maxIterations passes. Returns the
+    // number of passes done.
+    int Relax(int maxIterations, float tolerance);
+
+    int NumColours() const { return (int)_colours.size(); }
+    int NumConstraints() const { return _numConstraints; }
+
+    vector<Particle> _particles;
+
+  private:
+    struct Batch
+    {
+      u32 idx0[BATCH_WIDTH];
+      u32 idx1[BATCH_WIDTH];
+      float restLength[BATCH_WIDTH];
+    };
+
+    struct Colour
+    {
+      int firstBatch;
+      int numBatches;
+      // colours that are too small to be worth splitting have no tasks
+      int firstTask;
+      int numTasks;
+    };
+
+    struct RelaxKernelData
+    {
+      VerletSystem* system;
+      int firstBatch;
+      int endBatch;
+      float maxError;
+    };
+
+    float RelaxBatches(int firstBatch, int endBatch);
+    float RelaxRemainder();
+    static void RelaxKernel(const scheduler::TaskData& data);
+
+    vector<Batch> _batches;
+    vector<Colour> _colours;
+    vector<RelaxKernelData> _taskData;
+    // constraints that didn't fit in a full batch, and are relaxed one at a time
+    vector<Constraint> _remainder;
+    int _numConstraints = 0;
+  };
+
+  //------------------------------------------------------------------------------
+  struct ConstraintBatching
+  {
+    int NumColours() const { return (int)colourStart.size() - 1; }
+
+    // Constraint indices, colour by colour, followed by the remainder
+    vector<int> order;
+    // Start of each colour in 'order', followed by the start of the remainder
+    vector<int> colourStart;
+  };
+
+  // Greedy constraint colouring for any Verlet style solver. No two constraints of the
+  // same colour share a particle, and every colour is a multiple of batchWidth, so the
+  // colours split evenly into SIMD batches. The constraints that couldn't be placed in
+  // a full batch form a (small) remainder that must be relaxed serially. Constraints
+  // from a particle to itself are dropped.
+  void BatchConstraints(const VerletSystem::Constraint* constraints,
+      int numConstraints,
+      int numParticles,
+      int batchWidth,
+      ConstraintBatching* out);
+}